@@ -0,0 +1,263 @@
+#include "http_cache.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <openssl/evp.h>
+#include <time.h>
+
+namespace http
+{
+namespace client
+{
+
+namespace
+{
+
+// Longest a response without explicit freshness is reused unasked, however
+// long ago it was last modified.
+const std::time_t heuristic_limit = 24 * 60 * 60;
+
+std::string sha256_hex(const std::string& data)
+{
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int  size = 0;
+  EVP_Digest(data.data(), data.size(), digest, &size, EVP_sha256(), nullptr);
+  static const char digits[] = "0123456789abcdef";
+  std::string       hex;
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    hex += digits[digest[i] >> 4];
+    hex += digits[digest[i] & 15];
+  }
+  return hex;
+}
+
+std::string trim(const std::string& s)
+{
+  std::size_t begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos) return std::string();
+  std::size_t end = s.find_last_not_of(" \t");
+  return s.substr(begin, end - begin + 1);
+}
+
+// Write data to a temporary file next to path and rename it over path.
+bool replace_file(const std::string& path, const std::string& data)
+{
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::out | std::ios::binary);
+    out << data;
+    if (!out.flush()) return false;
+  }
+  return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+} // namespace
+
+http_cache::http_cache(const std::string& dir) : m_dir(dir)
+{
+  std::filesystem::create_directories(dir);
+}
+
+std::string http_cache::path(const std::string& url, const char* suffix) const
+{
+  return m_dir + "/" + sha256_hex(url) + suffix;
+}
+
+bool http_cache::lookup(const std::string& url, cache_entry& entry) const
+{
+  std::ifstream in(path(url, ".meta"));
+  if (!in) return false;
+  entry = cache_entry();
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name  = line.substr(0, colon);
+    std::string value = trim(line.substr(colon + 1));
+    if (name == "URL")
+      entry.url = value;
+    else if (name == "ETag")
+      entry.headers.etag = value;
+    else if (name == "Last-Modified")
+      entry.headers.last_modified = value;
+    else if (name == "Cache-Control")
+      entry.headers.cache_control = value;
+    else if (name == "Expires")
+      entry.headers.expires = value;
+    else if (name == "Stored")
+      entry.stored = std::strtoll(value.c_str(), nullptr, 10);
+    else if (name == "Fresh-Until")
+      entry.fresh_until = std::strtoll(value.c_str(), nullptr, 10);
+  }
+  // A different URL with the same hash is as good as no entry.
+  return entry.url == url;
+}
+
+long long http_cache::copy_body(const std::string& url,
+                                const std::string& output) const
+{
+  std::error_code ec;
+  std::filesystem::copy_file(
+      path(url, ".body"), output,
+      std::filesystem::copy_options::overwrite_existing, ec);
+  if (ec) return -1;
+  std::uintmax_t size = std::filesystem::file_size(output, ec);
+  return ec ? -1 : static_cast<long long>(size);
+}
+
+bool http_cache::store(const std::string& url, const cache_headers& headers,
+                       const std::string& body, std::time_t now)
+{
+  cache_entry entry;
+  entry.url     = url;
+  entry.headers = headers;
+  entry.stored  = now;
+  if (!describe(entry, now))
+  {
+    remove(url);
+    return false;
+  }
+
+  // The old description goes first, so that it never labels the new body.
+  std::string body_path = path(url, ".body");
+  std::string temporary = body_path + ".tmp";
+  std::error_code ec;
+  std::filesystem::remove(path(url, ".meta"), ec);
+  std::filesystem::copy_file(
+      body, temporary, std::filesystem::copy_options::overwrite_existing, ec);
+  if (ec || std::rename(temporary.c_str(), body_path.c_str()) != 0)
+  {
+    std::filesystem::remove(temporary, ec);
+    return false;
+  }
+  return write_meta(entry);
+}
+
+bool http_cache::refresh(const std::string& url, const cache_headers& headers,
+                         std::time_t now)
+{
+  cache_entry entry;
+  if (!lookup(url, entry)) return false;
+  // Headers the 304 left out keep their stored values; Date and Age
+  // describe this response only.
+  if (!headers.etag.empty()) entry.headers.etag = headers.etag;
+  if (!headers.last_modified.empty())
+    entry.headers.last_modified = headers.last_modified;
+  if (!headers.cache_control.empty())
+    entry.headers.cache_control = headers.cache_control;
+  if (!headers.expires.empty()) entry.headers.expires = headers.expires;
+  entry.headers.date = headers.date;
+  entry.headers.age  = headers.age;
+  entry.stored       = now;
+  if (!describe(entry, now))
+  {
+    remove(url);
+    return false;
+  }
+  return write_meta(entry);
+}
+
+void http_cache::remove(const std::string& url)
+{
+  std::error_code ec;
+  std::filesystem::remove(path(url, ".meta"), ec);
+  std::filesystem::remove(path(url, ".body"), ec);
+}
+
+bool http_cache::write_meta(const cache_entry& entry) const
+{
+  std::string meta = "URL: " + entry.url + "\n";
+  if (!entry.headers.etag.empty())
+    meta += "ETag: " + entry.headers.etag + "\n";
+  if (!entry.headers.last_modified.empty())
+    meta += "Last-Modified: " + entry.headers.last_modified + "\n";
+  if (!entry.headers.cache_control.empty())
+    meta += "Cache-Control: " + entry.headers.cache_control + "\n";
+  if (!entry.headers.expires.empty())
+    meta += "Expires: " + entry.headers.expires + "\n";
+  meta += "Stored: " + std::to_string(entry.stored) + "\n";
+  meta += "Fresh-Until: " + std::to_string(entry.fresh_until) + "\n";
+  return replace_file(path(entry.url, ".meta"), meta);
+}
+
+std::string http_cache::conditional_headers(const cache_entry& entry)
+{
+  std::string headers;
+  if (!entry.headers.etag.empty())
+    headers += "If-None-Match: " + entry.headers.etag + "\r\n";
+  if (!entry.headers.last_modified.empty())
+    headers += "If-Modified-Since: " + entry.headers.last_modified + "\r\n";
+  return headers;
+}
+
+bool http_cache::describe(cache_entry& entry, std::time_t now)
+{
+  const cache_headers& h = entry.headers;
+  std::string directives = h.cache_control;
+  std::transform(directives.begin(), directives.end(), directives.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  bool        no_cache = false;
+  long long   max_age  = -1;
+  std::size_t start    = 0;
+  while (start <= directives.size())
+  {
+    std::size_t comma = directives.find(',', start);
+    if (comma == std::string::npos) comma = directives.size();
+    std::string directive = trim(directives.substr(start, comma - start));
+    start                 = comma + 1;
+    if (directive == "no-store") return false;
+    if (directive == "no-cache")
+      no_cache = true;
+    else if (directive.compare(0, 8, "max-age=") == 0)
+      max_age = std::strtoll(directive.c_str() + 8, nullptr, 10);
+  }
+
+  // The server's clock, where it says what it is, so that Expires and
+  // Last-Modified are compared with the clock that produced them.
+  std::time_t date = parse_date(h.date);
+  if (date < 0) date = now;
+
+  long long lifetime = 0;
+  if (no_cache)
+    lifetime = 0;
+  else if (max_age >= 0)
+    lifetime = max_age;
+  else if (!h.expires.empty())
+  {
+    // An Expires that cannot be read means already expired.
+    std::time_t expires = parse_date(h.expires);
+    lifetime            = expires < 0 ? 0 : expires - date;
+  }
+  else if (!h.last_modified.empty())
+  {
+    // Without a word from the server, a tenth of the time since the
+    // resource last changed (RFC 9111, 4.2.2).
+    std::time_t modified = parse_date(h.last_modified);
+    if (modified >= 0 && modified < date)
+      lifetime = std::min<long long>((date - modified) / 10, heuristic_limit);
+  }
+  // Time the response already spent in caches on the way.
+  lifetime -= std::strtoll(h.age.c_str(), nullptr, 10);
+
+  entry.fresh_until = lifetime > 0 ? now + lifetime : 0;
+  return entry.fresh_until != 0 || entry.has_validator();
+}
+
+std::time_t http_cache::parse_date(const std::string& value)
+{
+  struct tm   tm = {};
+  const char* end =
+      strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (!end || *end != '\0') return -1;
+  return timegm(&tm);
+}
+
+} // namespace client
+} // namespace http
@@ -0,0 +1,97 @@
+#ifndef HTTP_CACHE_HPP
+#define HTTP_CACHE_HPP
+
+#include <ctime>
+#include <string>
+
+namespace http
+{
+namespace client
+{
+
+/// The headers of a response that say whether and for how long it may be
+/// reused, as received.
+struct cache_headers
+{
+  std::string etag;
+  std::string last_modified;
+  std::string cache_control;
+  std::string expires;
+  std::string date;
+  std::string age;
+};
+
+/// What the cache keeps about one URL besides its body.
+struct cache_entry
+{
+  std::string   url;
+  cache_headers headers;
+  // When the response arrived, and until when it may be used without
+  // asking the server (0: it must always be revalidated).
+  std::time_t stored      = 0;
+  std::time_t fresh_until = 0;
+
+  bool fresh(std::time_t now) const { return now < fresh_until; }
+
+  /// Whether the server can be asked if the entry is still current.
+  bool has_validator() const
+  {
+    return !headers.etag.empty() || !headers.last_modified.empty();
+  }
+};
+
+/// A private HTTP cache (RFC 9111) of response bodies on disk, keyed by URL.
+/// Each entry is two files in the cache directory, named by the SHA-256 of
+/// the URL: the body, and a small text file with the URL, the validators,
+/// the Cache-Control and Expires headers and the freshness worked out from
+/// them. Both are written to temporary files and renamed into place, so an
+/// interrupted client never leaves half an entry behind.
+class http_cache
+{
+  public:
+  /// Keep entries in dir, which is created if needed.
+  explicit http_cache(const std::string& dir);
+
+  /// The entry for url, if there is one.
+  bool lookup(const std::string& url, cache_entry& entry) const;
+
+  /// Copy the cached body of url to output. Returns the size, or -1 if the
+  /// body is missing or cannot be copied.
+  long long copy_body(const std::string& url, const std::string& output) const;
+
+  /// Keep a copy of the body in file body under url, described by the
+  /// response's headers. If the response may not be stored, or would be of
+  /// no use stored, any older entry is dropped and false returned.
+  bool store(const std::string& url, const cache_headers& headers,
+             const std::string& body, std::time_t now);
+
+  /// Update the entry for url after a 304: the headers sent with the 304
+  /// replace the stored ones and freshness starts again from now.
+  bool refresh(const std::string& url, const cache_headers& headers,
+               std::time_t now);
+
+  void remove(const std::string& url);
+
+  /// Request header lines, each ending in CRLF, that make a GET
+  /// conditional on entry still being current.
+  static std::string conditional_headers(const cache_entry& entry);
+
+  /// Work out entry's freshness from its headers. Returns false if they
+  /// forbid storing it (no-store), or if it could neither be used fresh nor
+  /// revalidated.
+  static bool describe(cache_entry& entry, std::time_t now);
+
+  /// An HTTP date (IMF-fixdate), or -1.
+  static std::time_t parse_date(const std::string& value);
+
+  private:
+  std::string path(const std::string& url, const char* suffix) const;
+  bool        write_meta(const cache_entry& entry) const;
+
+  std::string m_dir;
+};
+
+} // namespace client
+} // namespace http
+
+#endif // HTTP_CACHE_HPP
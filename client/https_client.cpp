@@ -0,0 +1,450 @@
+#include "https_client.hpp"
+#include <cstdlib>
+#include <ctime>
+#include <istream>
+#include <strings.h>
+
+namespace http
+{
+namespace client
+{
+
+namespace
+{
+
+enum
+{
+  chunk_size = 16384
+};
+
+const std::size_t unknown_length = static_cast<std::size_t>(-1);
+
+// Slot in each SSL object pointing back at its pool. The app data slot is
+// taken by asio for the verify callback.
+int pool_index()
+{
+  static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                          nullptr);
+  return index;
+}
+
+} // namespace
+
+connection::connection(boost::asio::io_context&   io_context,
+                       boost::asio::ssl::context& context,
+                       const std::string&         host)
+    : m_socket(io_context, context), m_host(host), m_buffer(chunk_size)
+{
+  m_socket.set_verify_mode(boost::asio::ssl::verify_peer);
+  // Send SNI so that a server hosting several sites picks the right one.
+  SSL_set_tlsext_host_name(m_socket.native_handle(), m_host.c_str());
+}
+
+void connection::start(
+    const boost::asio::ip::tcp::resolver::results_type& endpoints,
+    SSL_SESSION* session, ready_handler handler)
+{
+  if (session) SSL_set_session(m_socket.native_handle(), session);
+  auto self = shared_from_this();
+  boost::asio::async_connect(
+      m_socket.lowest_layer(), endpoints,
+      [this, self, handler](const boost::system::error_code& ec,
+                            const boost::asio::ip::tcp::endpoint&)
+      {
+        if (ec)
+        {
+          handler(ec);
+          return;
+        }
+        boost::asio::ip::tcp::no_delay option(true);
+        m_socket.lowest_layer().set_option(option);
+        m_socket.async_handshake(
+            boost::asio::ssl::stream_base::client,
+            [self, handler](const boost::system::error_code& ec)
+            { handler(ec); });
+      });
+}
+
+bool connection::resumed()
+{
+  return SSL_session_reused(m_socket.native_handle()) == 1;
+}
+
+void connection::fetch(const std::string& uri, const std::string& output,
+                       const std::string& headers, done_handler handler)
+{
+  m_result        = fetch_result();
+  m_result.uri    = uri;
+  m_result.output = output;
+  m_done          = std::move(handler);
+  m_keep_alive    = true;
+
+  std::ostream request_stream(&m_request);
+  request_stream << "GET " << uri << " HTTP/1.1\r\n";
+  request_stream << "Host: " << m_host << "\r\n";
+  request_stream << "Accept: */*\r\n";
+  request_stream << headers;
+  request_stream << "Connection: keep-alive\r\n\r\n";
+
+  auto self = shared_from_this();
+  boost::asio::async_write(
+      m_socket, m_request,
+      [this, self](const boost::system::error_code& ec, std::size_t)
+      {
+        if (ec)
+          finish(ec, false);
+        else
+          read_header();
+      });
+}
+
+void connection::read_header()
+{
+  auto self = shared_from_this();
+  boost::asio::async_read_until(
+      m_socket, m_response, "\r\n\r\n",
+      [this, self](const boost::system::error_code& ec,
+                   std::size_t header_length)
+      {
+        if (ec)
+        {
+          finish(ec, false);
+          return;
+        }
+
+        // Parse the status line and the headers we care about.
+        std::istream response_stream(&m_response);
+        std::string  http_version;
+        response_stream >> http_version >> m_result.status;
+        std::string line;
+        std::getline(response_stream, line);
+        m_remaining = unknown_length;
+        while (std::getline(response_stream, line) && line != "\r")
+        {
+          std::size_t colon = line.find(':');
+          if (colon == std::string::npos) continue;
+          std::string name  = line.substr(0, colon);
+          std::string value = line.substr(colon + 1);
+          value.erase(0, value.find_first_not_of(' '));
+          if (!value.empty() && value.back() == '\r') value.pop_back();
+          if (strcasecmp(name.c_str(), "Content-Length") == 0)
+            m_remaining = std::strtoull(value.c_str(), nullptr, 10);
+          else if (strcasecmp(name.c_str(), "Connection") == 0 &&
+                   strcasecmp(value.c_str(), "close") == 0)
+            m_keep_alive = false;
+          else if (strcasecmp(name.c_str(), "ETag") == 0)
+            m_result.headers.etag = value;
+          else if (strcasecmp(name.c_str(), "Last-Modified") == 0)
+            m_result.headers.last_modified = value;
+          else if (strcasecmp(name.c_str(), "Cache-Control") == 0)
+            m_result.headers.cache_control +=
+                (m_result.headers.cache_control.empty() ? "" : ", ") + value;
+          else if (strcasecmp(name.c_str(), "Expires") == 0)
+            m_result.headers.expires = value;
+          else if (strcasecmp(name.c_str(), "Date") == 0)
+            m_result.headers.date = value;
+          else if (strcasecmp(name.c_str(), "Age") == 0)
+            m_result.headers.age = value;
+        }
+        (void)header_length;
+        // These never have a body, whatever the headers say.
+        if (m_result.status == 204 || m_result.status == 304) m_remaining = 0;
+
+        if (m_result.status == 200)
+        {
+          m_out.open(m_result.output, std::ios::out | std::ios::binary);
+          if (!m_out)
+          {
+            finish(boost::system::errc::make_error_code(
+                       boost::system::errc::io_error),
+                   false);
+            return;
+          }
+        }
+
+        // Whatever followed the headers in the last read is body.
+        std::size_t buffered = m_response.size();
+        if (m_remaining != unknown_length && buffered > m_remaining)
+          buffered = m_remaining;
+        write_body(boost::asio::buffer_cast<const char*>(m_response.data()),
+                   buffered);
+        m_response.consume(buffered);
+        read_body();
+      });
+}
+
+void connection::read_body()
+{
+  if (m_remaining == 0)
+  {
+    finish(boost::system::error_code(), m_keep_alive);
+    return;
+  }
+
+  std::size_t want = m_buffer.size();
+  if (m_remaining != unknown_length && m_remaining < want) want = m_remaining;
+  auto self = shared_from_this();
+  m_socket.async_read_some(
+      boost::asio::buffer(m_buffer.data(), want),
+      [this, self](const boost::system::error_code& ec, std::size_t n)
+      {
+        write_body(m_buffer.data(), n);
+        if (ec == boost::asio::error::eof ||
+            ec == boost::asio::ssl::error::stream_truncated)
+        {
+          // Without a length the body ends with the connection.
+          finish(m_remaining == unknown_length ? boost::system::error_code()
+                                               : ec,
+                 false);
+          return;
+        }
+        if (ec)
+        {
+          finish(ec, false);
+          return;
+        }
+        read_body();
+      });
+}
+
+void connection::write_body(const char* data, std::size_t size)
+{
+  if (m_out.is_open()) m_out.write(data, size);
+  m_result.bytes += size;
+  if (m_remaining != unknown_length) m_remaining -= size;
+}
+
+void connection::finish(const boost::system::error_code& ec, bool reusable)
+{
+  if (m_out.is_open()) m_out.close();
+  m_result.error = ec;
+  m_used         = true;
+  m_response.consume(m_response.size());
+  done_handler done = std::move(m_done);
+  done(m_result, reusable && !ec);
+}
+
+connection_pool::connection_pool(boost::asio::io_context&   io_context,
+                                 boost::asio::ssl::context& context,
+                                 const std::string&         host,
+                                 const std::string&         port,
+                                 std::size_t max_connections)
+    : m_io_context(io_context), m_context(context), m_host(host),
+      m_port(port), m_max_connections(max_connections ? max_connections : 1),
+      m_resolver(io_context)
+{
+}
+
+connection_pool::~connection_pool()
+{
+  if (m_session) SSL_SESSION_free(m_session);
+}
+
+void connection_pool::enable_session_cache(boost::asio::ssl::context& context)
+{
+  // TLS 1.3 tickets arrive after the handshake, so sessions are captured
+  // through the callback rather than taken right after connecting.
+  SSL_CTX_set_session_cache_mode(context.native_handle(),
+                                 SSL_SESS_CACHE_CLIENT |
+                                     SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context.native_handle(),
+                          &connection_pool::new_session_callback);
+}
+
+int connection_pool::new_session_callback(SSL* ssl, SSL_SESSION* session)
+{
+  connection_pool* pool =
+      static_cast<connection_pool*>(SSL_get_ex_data(ssl, pool_index()));
+  if (!pool) return 0;
+  pool->store_session(session);
+  // We keep the reference OpenSSL handed us.
+  return 1;
+}
+
+void connection_pool::store_session(SSL_SESSION* session)
+{
+  if (m_session) SSL_SESSION_free(m_session);
+  m_session = session;
+}
+
+void connection_pool::fetch(const std::string& uri, const std::string& output,
+                            fetch_handler handler)
+{
+  job j;
+  j.uri     = uri;
+  j.output  = output;
+  j.handler = std::move(handler);
+
+  cache_entry entry;
+  if (m_cache && m_cache->lookup(url(uri), entry))
+  {
+    long long size;
+    if (entry.fresh(std::time(nullptr)) &&
+        (size = m_cache->copy_body(entry.url, output)) >= 0)
+    {
+      // No need to ask the server at all.
+      fetch_result result;
+      result.uri    = uri;
+      result.output = output;
+      result.status = 200;
+      result.bytes  = static_cast<std::size_t>(size);
+      result.cache  = cache_fresh;
+      boost::asio::post(m_io_context,
+                        [result, handler = std::move(j.handler)]()
+                        { handler(result); });
+      return;
+    }
+    j.validators = http_cache::conditional_headers(entry);
+  }
+  m_queue.push_back(std::move(j));
+  if (m_resolved)
+    dispatch();
+  else
+    resolve();
+}
+
+void connection_pool::resolve()
+{
+  if (m_resolving) return;
+  m_resolving = true;
+  m_resolver.async_resolve(
+      m_host, m_port,
+      [this](const boost::system::error_code&                     ec,
+             boost::asio::ip::tcp::resolver::results_type results)
+      {
+        m_resolving = false;
+        if (ec)
+        {
+          fail_all(ec);
+          return;
+        }
+        m_endpoints = results;
+        m_resolved  = true;
+        dispatch();
+      });
+}
+
+void connection_pool::dispatch()
+{
+  while (!m_queue.empty() && !m_idle.empty())
+  {
+    std::shared_ptr<connection> conn = m_idle.back();
+    m_idle.pop_back();
+    job j = std::move(m_queue.front());
+    m_queue.pop_front();
+    run(conn, std::move(j));
+  }
+  // Open more connections while there is queued work that the connections
+  // still handshaking will not pick up. Until the first connection has
+  // produced a session (or a response) open no others, so that they can all
+  // resume it instead of paying for full handshakes.
+  while (m_queue.size() > m_connecting && m_open < m_max_connections &&
+         (m_open == 0 || m_session || m_fetches_completed > 0))
+    open_connection();
+}
+
+void connection_pool::open_connection()
+{
+  auto conn = std::make_shared<connection>(m_io_context, m_context, m_host);
+  SSL_set_ex_data(conn->native_handle(), pool_index(), this);
+  ++m_open;
+  ++m_connecting;
+  conn->start(m_endpoints, m_session,
+              [this, conn](const boost::system::error_code& ec)
+              {
+                --m_connecting;
+                if (ec)
+                {
+                  --m_open;
+                  // Give up only if no other connection can serve the queue.
+                  if (m_open == 0) fail_all(ec);
+                  return;
+                }
+                ++m_connections_opened;
+                if (conn->resumed()) ++m_handshakes_resumed;
+                m_idle.push_back(conn);
+                dispatch();
+              });
+}
+
+void connection_pool::run(std::shared_ptr<connection> conn, job j)
+{
+  bool        was_used   = conn->used();
+  std::string uri        = j.uri;
+  std::string output     = j.output;
+  std::string validators = j.validators;
+  auto        pending    = std::make_shared<job>(std::move(j));
+  conn->fetch(
+      uri, output, validators,
+      [this, conn, pending, was_used](const fetch_result& response,
+                                      bool                reusable)
+      {
+        fetch_result result = response;
+        ++m_fetches_completed;
+        if (reusable)
+          m_idle.push_back(conn);
+        else
+          --m_open;
+
+        // The server may have closed an idle keep-alive connection just as
+        // we reused it; try such a request once more on a fresh connection.
+        if (result.error && was_used && pending->attempts == 0)
+        {
+          ++pending->attempts;
+          m_queue.push_front(std::move(*pending));
+        }
+        else if (!result.error && m_cache && !update_cache(*pending, result))
+        {
+          // The entry went away while it was being revalidated; fetch the
+          // whole body instead.
+          pending->validators.clear();
+          m_queue.push_front(std::move(*pending));
+        }
+        else
+          pending->handler(result);
+        dispatch();
+      });
+}
+
+std::string connection_pool::url(const std::string& uri) const
+{
+  return "https://" + m_host + ":" + m_port + uri;
+}
+
+bool connection_pool::update_cache(const job& j, fetch_result& result)
+{
+  std::time_t now = std::time(nullptr);
+  if (result.status == 200)
+    m_cache->store(url(j.uri), result.headers, j.output, now);
+  else if (result.status == 304 && !j.validators.empty())
+  {
+    long long size = m_cache->copy_body(url(j.uri), j.output);
+    if (size < 0)
+    {
+      m_cache->remove(url(j.uri));
+      return false;
+    }
+    m_cache->refresh(url(j.uri), result.headers, now);
+    result.status = 200;
+    result.bytes  = static_cast<std::size_t>(size);
+    result.cache  = cache_validated;
+  }
+  return true;
+}
+
+void connection_pool::fail_all(const boost::system::error_code& ec)
+{
+  std::deque<job> failed;
+  failed.swap(m_queue);
+  for (job& j : failed)
+  {
+    fetch_result result;
+    result.uri    = j.uri;
+    result.output = j.output;
+    result.error  = ec;
+    j.handler(result);
+  }
+}
+
+} // namespace client
+} // namespace http
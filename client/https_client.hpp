@@ -0,0 +1,177 @@
+#ifndef HTTPS_CLIENT_HPP
+#define HTTPS_CLIENT_HPP
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http_cache.hpp"
+
+namespace http
+{
+namespace client
+{
+
+/// How a fetch was served.
+enum cache_use
+{
+  cache_none,     // from the server in full
+  cache_fresh,    // from the cache, without asking the server
+  cache_validated // from the cache, after the server answered 304
+};
+
+/// Outcome of fetching one URI.
+struct fetch_result
+{
+  std::string               uri;
+  std::string               output;
+  int                       status = 0;
+  std::size_t               bytes  = 0;
+  boost::system::error_code error;
+  cache_headers             headers;
+  cache_use                 cache = cache_none;
+};
+
+typedef std::function<void(const fetch_result&)> fetch_handler;
+
+class connection_pool;
+
+/// One persistent TLS connection. Requests are sent one at a time with
+/// "Connection: keep-alive" and the body of each response is streamed to its
+/// output file as it arrives.
+class connection : public std::enable_shared_from_this<connection>
+{
+  public:
+  typedef std::function<void(const boost::system::error_code&)> ready_handler;
+  typedef std::function<void(const fetch_result&, bool reusable)> done_handler;
+
+  connection(boost::asio::io_context& io_context,
+             boost::asio::ssl::context& context, const std::string& host);
+
+  /// Connect and handshake, resuming the given TLS session if there is one.
+  void start(const boost::asio::ip::tcp::resolver::results_type& endpoints,
+             SSL_SESSION* session, ready_handler handler);
+
+  /// Fetch a URI on the established connection, adding the given header
+  /// lines (each ending in CRLF) to the request.
+  void fetch(const std::string& uri, const std::string& output,
+             const std::string& headers, done_handler handler);
+
+  /// Whether the last handshake resumed a previous session.
+  bool resumed();
+
+  /// Whether at least one request has completed on this connection.
+  bool used() const { return m_used; }
+
+  SSL* native_handle() { return m_socket.native_handle(); }
+
+  private:
+  void read_header();
+  void read_body();
+  void write_body(const char* data, std::size_t size);
+  void finish(const boost::system::error_code& ec, bool reusable);
+
+  boost::asio::ssl::stream<boost::asio::ip::tcp::socket> m_socket;
+  std::string                                            m_host;
+  boost::asio::streambuf                                 m_request;
+  boost::asio::streambuf                                 m_response;
+  std::vector<char>                                      m_buffer;
+  std::ofstream                                          m_out;
+  fetch_result                                           m_result;
+  done_handler                                           m_done;
+  // Body bytes still expected, or npos if the length is unknown.
+  std::size_t m_remaining = 0;
+  bool        m_keep_alive = true;
+  bool        m_used       = false;
+};
+
+/// A pool of persistent TLS connections to one host. Fetches are queued and
+/// spread over up to max_connections connections; later connections resume
+/// the TLS session of the first one. With a cache, fresh entries are served
+/// without a request and stale ones are revalidated with conditional GETs.
+class connection_pool
+{
+  public:
+  connection_pool(const connection_pool&) = delete;
+  connection_pool& operator=(const connection_pool&) = delete;
+
+  connection_pool(boost::asio::io_context& io_context,
+                  boost::asio::ssl::context& context, const std::string& host,
+                  const std::string& port, std::size_t max_connections);
+
+  ~connection_pool();
+
+  /// Queue a fetch. The handler is called on the io_context when the body
+  /// has been written to output or the fetch failed.
+  void fetch(const std::string& uri, const std::string& output,
+             fetch_handler handler);
+
+  /// Serve fetches through cache, which must outlive the pool.
+  void set_cache(http_cache* cache) { m_cache = cache; }
+
+  /// Number of TLS connections established so far.
+  std::size_t connections_opened() const { return m_connections_opened; }
+
+  /// Number of those whose handshake resumed an earlier session.
+  std::size_t handshakes_resumed() const { return m_handshakes_resumed; }
+
+  /// Prepare a context so that pools can capture session tickets. Must be
+  /// called once before any pool uses the context.
+  static void enable_session_cache(boost::asio::ssl::context& context);
+
+  private:
+  struct job
+  {
+    std::string   uri;
+    std::string   output;
+    fetch_handler handler;
+    int           attempts = 0;
+    // Conditional request headers, if a cached copy is being revalidated.
+    std::string validators;
+  };
+
+  void resolve();
+  void dispatch();
+  void open_connection();
+  void run(std::shared_ptr<connection> conn, job j);
+  void fail_all(const boost::system::error_code& ec);
+  // The cache key of a URI on this pool's host.
+  std::string url(const std::string& uri) const;
+  // Bring the cache up to date with a response, and serve a 304 from it.
+  // Returns false if a revalidated entry turned out to be gone.
+  bool update_cache(const job& j, fetch_result& result);
+  void store_session(SSL_SESSION* session);
+
+  static int new_session_callback(SSL* ssl, SSL_SESSION* session);
+
+  boost::asio::io_context&                 m_io_context;
+  boost::asio::ssl::context&               m_context;
+  std::string                              m_host;
+  std::string                              m_port;
+  std::size_t                              m_max_connections;
+  boost::asio::ip::tcp::resolver           m_resolver;
+  boost::asio::ip::tcp::resolver::results_type m_endpoints;
+  bool                                     m_resolving = false;
+  bool                                     m_resolved  = false;
+  std::deque<job>                          m_queue;
+  std::vector<std::shared_ptr<connection>> m_idle;
+  // Connections connecting, busy or idle, and those still connecting.
+  std::size_t  m_open               = 0;
+  std::size_t  m_connecting         = 0;
+  std::size_t  m_connections_opened = 0;
+  std::size_t  m_handshakes_resumed = 0;
+  std::size_t  m_fetches_completed  = 0;
+  SSL_SESSION* m_session            = nullptr;
+  http_cache*  m_cache              = nullptr;
+};
+
+} // namespace client
+} // namespace http
+
+#endif // HTTPS_CLIENT_HPP
@@ -0,0 +1,44 @@
+// Cost of recording a request on the I/O thread: sampling and copying a
+// record into the thread's ring. The flusher drains to /dev/null
+// concurrently, so drops show up if it cannot keep up.
+
+#include <benchmark/benchmark.h>
+
+#include "access_log.hpp"
+
+using namespace http::server;
+
+namespace {
+
+access_record make_record()
+{
+  access_record record{};
+  record.time_us = 1700000000000000;
+  record.handshake_us = 1200;
+  record.ttfb_us = 60;
+  record.total_us = 90;
+  record.status = 200;
+  record.bytes = 1498;
+  record.set_request("GET", "/data/images/2.png?size=large&format=webp");
+  return record;
+}
+
+void BM_Log(benchmark::State& state)
+{
+  access_log log("/dev/null", static_cast<unsigned>(state.range(0)));
+  access_record record = make_record();
+  for (auto _ : state)
+  {
+    if (log.sample(record.status))
+      log.log(record);
+  }
+  access_log::counters c = log.stats();
+  state.counters["dropped"] = static_cast<double>(c.dropped);
+  state.counters["sampled_out"] = static_cast<double>(c.sampled_out);
+}
+
+} // namespace
+
+BENCHMARK(BM_Log)->Arg(1)->Arg(10);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,70 @@
+// Autoindex listings of a directory of 2000 files: served from the cached
+// snapshot, and read from the disk on every request as a server without
+// the cache would.
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <boost/asio.hpp>
+#include <unistd.h>
+
+#include "directory_index.hpp"
+#include "fs_watcher.hpp"
+
+using namespace http::server;
+
+namespace {
+
+/// A temporary directory holding count empty files.
+struct test_directory
+{
+  explicit test_directory(int count)
+  {
+    char templ[] = "/tmp/directory_index_bench.XXXXXX";
+    path = mkdtemp(templ);
+    for (int i = 0; i < count; ++i)
+    {
+      std::string file = path + "/image" + std::to_string(i) + ".png";
+      std::fclose(std::fopen(file.c_str(), "w"));
+    }
+  }
+
+  ~test_directory()
+  {
+    std::string command = "rm -rf " + path;
+    if (std::system(command.c_str()) != 0)
+      std::perror("rm");
+  }
+
+  std::string path;
+};
+
+void BM_Listing(benchmark::State& state, std::size_t max_directories,
+    directory_index::format_type format)
+{
+  test_directory dir(static_cast<int>(state.range(0)));
+  boost::asio::io_context io_context;
+  fs_watcher watcher(io_context);
+  watcher.watch(dir.path);
+  directory_index index(watcher, max_directories);
+  std::string out;
+  for (auto _ : state)
+  {
+    index.render(dir.path, "/images/", format, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["reads"] = static_cast<double>(index.reads());
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_Listing, cached_html, 4096, directory_index::html)
+    ->Arg(2000);
+BENCHMARK_CAPTURE(BM_Listing, cached_json, 4096, directory_index::json)
+    ->Arg(2000);
+BENCHMARK_CAPTURE(BM_Listing, uncached_html, 0, directory_index::html)
+    ->Arg(2000);
+
+BENCHMARK_MAIN();
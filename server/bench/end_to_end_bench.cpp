@@ -0,0 +1,278 @@
+// Requests served by a real server over loopback TLS, in-process. The server
+// runs on its own thread; the benchmark thread is a blocking client that
+// either reuses one connection or handshakes for every request. The
+// records_per_request counter is the number of TLS records the client
+// received per reply. The Bundle benchmarks fetch range(0) 1 KB files either
+// one request at a time or as one /_bundle request. The Plain benchmarks
+// repeat the first two over the server's plain HTTP listener, so that the
+// difference is what TLS costs.
+//
+//   ./end_to_end_bench --benchmark_out=e2e.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <unistd.h>
+
+#include "server.hpp"
+
+namespace asio = boost::asio;
+typedef asio::ssl::stream<asio::ip::tcp::socket> ssl_stream;
+
+namespace {
+
+/// A server on a free port serving a temporary directory of generated
+/// files. The certificate and keys are taken from the source tree.
+class fixture
+{
+public:
+  static fixture& get()
+  {
+    static fixture instance;
+    return instance;
+  }
+
+  unsigned short port() const { return port_; }
+  unsigned short plain_port() const { return plain_port_; }
+
+  ~fixture()
+  {
+    io_context_.stop();
+    thread_.join();
+    std::system(("rm -rf " + doc_root_).c_str());
+  }
+
+private:
+  fixture()
+  {
+    char dir[] = "/tmp/end_to_end_benchXXXXXX";
+    doc_root_ = mkdtemp(dir);
+    for (int size : { 1 << 10, 64 << 10, 1 << 20 })
+    {
+      std::ofstream out(doc_root_ + "/" + std::to_string(size) + ".bin",
+          std::ios::binary);
+      out << std::string(static_cast<std::size_t>(size), 'x');
+    }
+
+    if (chdir(HTTP_SERVER_SOURCE_DIR) != 0)
+      std::perror(HTTP_SERVER_SOURCE_DIR);
+    http::server::server_config config;
+    config.doc_root = doc_root_;
+    config.listen_plain.push_back(asio::ip::tcp::endpoint(
+          asio::ip::address_v4::loopback(), 0));
+    config.bundle_max_files = 64;
+    server_.reset(new http::server::server(io_context_, config));
+    port_ = server_->port();
+    plain_port_ = server_->plain_port();
+    thread_ = std::thread([this]() { io_context_.run(); });
+  }
+
+  std::string doc_root_;
+  asio::io_context io_context_;
+  std::unique_ptr<http::server::server> server_;
+  unsigned short port_ = 0;
+  unsigned short plain_port_ = 0;
+  std::thread thread_;
+};
+
+/// A blocking TLS client for the fixture's server.
+class client
+{
+public:
+  client()
+    : context_(asio::ssl::context::sslv23),
+      stream_(io_context_, context_)
+  {
+    context_.set_verify_mode(asio::ssl::verify_none);
+    SSL_set_msg_callback(stream_.native_handle(), &client::count_records);
+    SSL_set_msg_callback_arg(stream_.native_handle(), this);
+    stream_.lowest_layer().connect(asio::ip::tcp::endpoint(
+          asio::ip::address_v4::loopback(), fixture::get().port()));
+    stream_.lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+    stream_.handshake(asio::ssl::stream_base::client);
+  }
+
+  /// Fetch a URI and return the size of the body.
+  std::size_t get(const std::string& uri)
+  {
+    std::string request = "GET " + uri + " HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Connection: keep-alive\r\n\r\n";
+    asio::write(stream_, asio::buffer(request));
+
+    std::size_t header_size = asio::read_until(stream_, buffer_, "\r\n\r\n");
+    std::string header(asio::buffers_begin(buffer_.data()),
+        asio::buffers_begin(buffer_.data()) + header_size);
+    buffer_.consume(header_size);
+    std::size_t length = 0;
+    std::size_t pos = header.find("Content-Length: ");
+    if (pos != std::string::npos)
+      length = std::strtoul(header.c_str() + pos + 16, nullptr, 10);
+
+    if (buffer_.size() < length)
+      asio::read(stream_, buffer_,
+          asio::transfer_exactly(length - buffer_.size()));
+    buffer_.consume(length);
+    return length;
+  }
+
+  /// Application data records received since the last call.
+  std::size_t take_records()
+  {
+    std::size_t n = records_;
+    records_ = 0;
+    return n;
+  }
+
+private:
+  static void count_records(int write_p, int, int content_type,
+      const void* buf, std::size_t len, SSL*, void* arg)
+  {
+    // With TLS 1.3 the callback reports the inner content type of every
+    // record as a one byte message; count the application data ones.
+    if (!write_p && content_type == SSL3_RT_INNER_CONTENT_TYPE && len == 1
+        && *static_cast<const unsigned char*>(buf)
+          == SSL3_RT_APPLICATION_DATA)
+      ++static_cast<client*>(arg)->records_;
+  }
+
+  std::size_t records_ = 0;
+  asio::io_context io_context_;
+  asio::ssl::context context_;
+  ssl_stream stream_;
+  asio::streambuf buffer_;
+};
+
+/// The same over plain TCP.
+class plain_client
+{
+public:
+  plain_client()
+    : socket_(io_context_)
+  {
+    socket_.connect(asio::ip::tcp::endpoint(
+          asio::ip::address_v4::loopback(), fixture::get().plain_port()));
+    socket_.set_option(asio::ip::tcp::no_delay(true));
+  }
+
+  std::size_t get(const std::string& uri)
+  {
+    std::string request = "GET " + uri + " HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Connection: keep-alive\r\n\r\n";
+    asio::write(socket_, asio::buffer(request));
+
+    std::size_t header_size = asio::read_until(socket_, buffer_, "\r\n\r\n");
+    std::string header(asio::buffers_begin(buffer_.data()),
+        asio::buffers_begin(buffer_.data()) + header_size);
+    buffer_.consume(header_size);
+    std::size_t length = 0;
+    std::size_t pos = header.find("Content-Length: ");
+    if (pos != std::string::npos)
+      length = std::strtoul(header.c_str() + pos + 16, nullptr, 10);
+
+    if (buffer_.size() < length)
+      asio::read(socket_, buffer_,
+          asio::transfer_exactly(length - buffer_.size()));
+    buffer_.consume(length);
+    return length;
+  }
+
+private:
+  asio::io_context io_context_;
+  asio::ip::tcp::socket socket_;
+  asio::streambuf buffer_;
+};
+
+std::string uri_for(int64_t size)
+{
+  return "/" + std::to_string(size) + ".bin";
+}
+
+void BM_EndToEnd_KeepAlive(benchmark::State& state)
+{
+  client c;
+  std::string uri = uri_for(state.range(0));
+  c.take_records();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(c.get(uri));
+  state.counters["records_per_request"] = benchmark::Counter(
+      static_cast<double>(c.take_records()),
+      benchmark::Counter::kAvgIterations);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_EndToEnd_NewConnection(benchmark::State& state)
+{
+  std::string uri = uri_for(state.range(0));
+  for (auto _ : state)
+  {
+    client c;
+    benchmark::DoNotOptimize(c.get(uri));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_EndToEnd_KeepAlive_Plain(benchmark::State& state)
+{
+  plain_client c;
+  std::string uri = uri_for(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(c.get(uri));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_EndToEnd_NewConnection_Plain(benchmark::State& state)
+{
+  std::string uri = uri_for(state.range(0));
+  for (auto _ : state)
+  {
+    plain_client c;
+    benchmark::DoNotOptimize(c.get(uri));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_EndToEnd_Separate(benchmark::State& state)
+{
+  client c;
+  std::string uri = uri_for(1 << 10);
+  for (auto _ : state)
+    for (int64_t i = 0; i < state.range(0); ++i)
+      benchmark::DoNotOptimize(c.get(uri));
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_EndToEnd_Bundle(benchmark::State& state)
+{
+  client c;
+  std::string uri = "/_bundle?fmt=tar";
+  for (int64_t i = 0; i < state.range(0); ++i)
+    uri += "&f=" + uri_for(1 << 10);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(c.get(uri));
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_EndToEnd_KeepAlive)
+    ->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->UseRealTime();
+BENCHMARK(BM_EndToEnd_NewConnection)->Arg(1 << 10)->UseRealTime();
+BENCHMARK(BM_EndToEnd_KeepAlive_Plain)
+    ->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20)->UseRealTime();
+BENCHMARK(BM_EndToEnd_NewConnection_Plain)->Arg(1 << 10)->UseRealTime();
+BENCHMARK(BM_EndToEnd_Separate)->Arg(8)->Arg(32)->UseRealTime();
+BENCHMARK(BM_EndToEnd_Bundle)->Arg(8)->Arg(32)->UseRealTime();
+
+BENCHMARK_MAIN();
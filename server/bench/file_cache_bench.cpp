@@ -0,0 +1,165 @@
+// The file cache against reading through the file_reader on every request,
+// for a 64 KB file, and how a burst of rewrites to one file is coalesced:
+// Burst rewrites the file 100 times in a row and reports how many events
+// arrived and how many invalidations (batches) they became. The Handler
+// benchmarks serve the file through request_handler, with and without the
+// cache, so that they include building the reply.
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include <unistd.h>
+
+#include "file_cache.hpp"
+#include "file_reader.hpp"
+#include "fs_watcher.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+
+using namespace http::server;
+
+namespace {
+
+/// A temporary directory holding one 64 KB file.
+struct test_directory
+{
+  test_directory()
+  {
+    char templ[] = "/tmp/file_cache_bench.XXXXXX";
+    path = mkdtemp(templ);
+    file = path + "/page.html";
+    std::ofstream(file, std::ios::binary) << std::string(65536, 'x');
+  }
+
+  ~test_directory()
+  {
+    std::string command = "rm -rf " + path;
+    if (std::system(command.c_str()) != 0)
+      std::perror("rm");
+  }
+
+  std::string path;
+  std::string file;
+};
+
+void get(boost::asio::io_context& io_context, file_cache& cache,
+    const std::string& path)
+{
+  bool done = false;
+  cache.async_get(path,
+      [&done](const boost::system::error_code&,
+        std::shared_ptr<const file_cache::file> file)
+      {
+        benchmark::DoNotOptimize(file.get());
+        done = true;
+      });
+  while (!done)
+    io_context.run_one();
+}
+
+void BM_Cached(benchmark::State& state)
+{
+  test_directory dir;
+  boost::asio::io_context io_context;
+  file_reader reader(io_context, file_reader::io_uring);
+  fs_watcher watcher(io_context);
+  watcher.watch(dir.path);
+  file_cache cache(reader, watcher);
+  for (auto _ : state)
+    get(io_context, cache, dir.file);
+  state.counters["misses"] = static_cast<double>(cache.misses());
+}
+
+void BM_Uncached(benchmark::State& state)
+{
+  test_directory dir;
+  boost::asio::io_context io_context;
+  file_reader reader(io_context, file_reader::io_uring);
+  for (auto _ : state)
+  {
+    bool done = false;
+    reader.async_read(dir.file,
+        [&done](const boost::system::error_code&, std::string content)
+        {
+          benchmark::DoNotOptimize(content.data());
+          done = true;
+        });
+    while (!done)
+      io_context.run_one();
+  }
+}
+
+/// Serve the test file through a handler, with the cache unless null.
+void serve(benchmark::State& state, const test_directory& dir,
+    boost::asio::io_context& io_context, file_reader& reader,
+    file_cache* cache)
+{
+  request_handler handler(dir.path, reader);
+  handler.set_file_cache(cache);
+  request req;
+  req.method = "GET";
+  req.uri = "/page.html";
+  req.http_version_major = 1;
+  req.http_version_minor = 1;
+  for (auto _ : state)
+  {
+    reply rep;
+    bool done = false;
+    handler.async_handle_request(req, rep, [&done]() { done = true; });
+    while (!done)
+      io_context.run_one();
+    benchmark::DoNotOptimize(rep.content_buffer().data());
+  }
+  state.SetBytesProcessed(state.iterations() * 65536);
+}
+
+void BM_Handler_Cached(benchmark::State& state)
+{
+  test_directory dir;
+  boost::asio::io_context io_context;
+  file_reader reader(io_context, file_reader::io_uring);
+  fs_watcher watcher(io_context);
+  watcher.watch(dir.path);
+  file_cache cache(reader, watcher);
+  serve(state, dir, io_context, reader, &cache);
+}
+
+void BM_Handler_Uncached(benchmark::State& state)
+{
+  test_directory dir;
+  boost::asio::io_context io_context;
+  file_reader reader(io_context, file_reader::io_uring);
+  serve(state, dir, io_context, reader, nullptr);
+}
+
+void BM_Burst(benchmark::State& state)
+{
+  test_directory dir;
+  boost::asio::io_context io_context;
+  fs_watcher watcher(io_context, std::chrono::milliseconds(20));
+  watcher.watch(dir.path);
+  for (auto _ : state)
+  {
+    std::size_t batches = watcher.batches();
+    for (int i = 0; i < 100; ++i)
+      std::ofstream(dir.file, std::ios::binary) << std::string(4096, 'y');
+    while (watcher.batches() == batches)
+      io_context.run_one();
+  }
+  state.counters["events"] = static_cast<double>(watcher.events());
+  state.counters["batches"] = static_cast<double>(watcher.batches());
+}
+
+} // namespace
+
+BENCHMARK(BM_Cached);
+BENCHMARK(BM_Uncached);
+BENCHMARK(BM_Handler_Cached);
+BENCHMARK(BM_Handler_Uncached);
+BENCHMARK(BM_Burst)->Iterations(5)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,169 @@
+// Reads a set of files through each file_reader backend and through the old
+// blocking std::ifstream path. The "cold" variants evict the files from the
+// page cache before every iteration, so the reads really go to the disk.
+//
+//   ./file_reader_bench --benchmark_filter=Cold
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_reader.hpp"
+
+using http::server::file_reader;
+
+namespace {
+
+const int file_count = 64;
+
+/// A directory of files of a given size, created once per size.
+const std::vector<std::string>& fixture(std::size_t file_size)
+{
+  static std::string dir;
+  static std::size_t size = 0;
+  static std::vector<std::string> paths;
+  if (size == file_size)
+    return paths;
+
+  if (dir.empty())
+  {
+    char tmpl[] = "/tmp/file_reader_bench.XXXXXX";
+    dir = ::mkdtemp(tmpl);
+  }
+  size = file_size;
+  paths.clear();
+  std::string block(file_size, 'x');
+  for (int i = 0; i < file_count; ++i)
+  {
+    std::string path = dir + "/" + std::to_string(i) + ".dat";
+    std::ofstream(path, std::ios::binary) << block;
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+/// Ask the kernel to drop the cached pages of the files.
+void evict(const std::vector<std::string>& paths)
+{
+  for (const std::string& path : paths)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      continue;
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+void read_async(benchmark::State& state, file_reader::backend_type backend,
+    bool cold)
+{
+  const std::vector<std::string>& paths =
+      fixture(static_cast<std::size_t>(state.range(0)));
+  boost::asio::io_context io_context;
+  file_reader reader(io_context, backend, 4);
+  if (reader.backend() != backend)
+  {
+    state.SkipWithError("backend not available");
+    return;
+  }
+
+  std::size_t bytes = 0;
+  for (auto _ : state)
+  {
+    if (cold)
+    {
+      state.PauseTiming();
+      evict(paths);
+      state.ResumeTiming();
+    }
+    std::size_t pending = paths.size();
+    for (const std::string& path : paths)
+      reader.async_read(path,
+          [&bytes, &pending](const boost::system::error_code&,
+            std::string content)
+          {
+            bytes += content.size();
+            --pending;
+          });
+    io_context.restart();
+    // The thread pool posts completions from its own threads, so keep the
+    // io_context alive until all of them have arrived.
+    auto work = boost::asio::make_work_guard(io_context);
+    while (pending > 0)
+      io_context.run_one();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+void read_blocking(benchmark::State& state, bool cold)
+{
+  const std::vector<std::string>& paths =
+      fixture(static_cast<std::size_t>(state.range(0)));
+  std::size_t bytes = 0;
+  for (auto _ : state)
+  {
+    if (cold)
+    {
+      state.PauseTiming();
+      evict(paths);
+      state.ResumeTiming();
+    }
+    for (const std::string& path : paths)
+    {
+      std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+      std::string content;
+      char buf[512];
+      while (is.read(buf, sizeof(buf)).gcount() > 0)
+        content.append(buf, is.gcount());
+      bytes += content.size();
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+void BM_Cold_IoUring(benchmark::State& state)
+{
+  read_async(state, file_reader::io_uring, true);
+}
+
+void BM_Cold_ThreadPool(benchmark::State& state)
+{
+  read_async(state, file_reader::thread_pool, true);
+}
+
+void BM_Cold_Blocking(benchmark::State& state)
+{
+  read_blocking(state, true);
+}
+
+void BM_Warm_IoUring(benchmark::State& state)
+{
+  read_async(state, file_reader::io_uring, false);
+}
+
+void BM_Warm_ThreadPool(benchmark::State& state)
+{
+  read_async(state, file_reader::thread_pool, false);
+}
+
+void BM_Warm_Blocking(benchmark::State& state)
+{
+  read_blocking(state, false);
+}
+
+} // namespace
+
+BENCHMARK(BM_Cold_IoUring)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+BENCHMARK(BM_Cold_ThreadPool)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+BENCHMARK(BM_Cold_Blocking)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+BENCHMARK(BM_Warm_IoUring)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+BENCHMARK(BM_Warm_ThreadPool)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+BENCHMARK(BM_Warm_Blocking)->Arg(4 << 10)->Arg(256 << 10)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,123 @@
+// Memory held by the server per idle keep-alive connection. The server runs
+// in a forked child so that its resident set can be measured on its own:
+// the benchmark opens connections, makes one request on each so that they
+// are past the handshake, leaves them idle and reports the growth of the
+// child's RSS divided by the number of connections.
+//
+//   ./idle_memory_bench --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+namespace asio = boost::asio;
+typedef asio::ssl::stream<asio::ip::tcp::socket> ssl_stream;
+
+namespace {
+
+/// Resident set size of a process in kilobytes.
+long rss_kb(pid_t pid)
+{
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+  return 0;
+}
+
+/// Fork a server on a free port. Returns its pid and port.
+pid_t start_server(unsigned short& port)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+    return -1;
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    if (chdir(HTTP_SERVER_SOURCE_DIR) != 0)
+      _exit(1);
+    asio::io_context io_context;
+    http::server::server s(io_context, 0, ".");
+    unsigned short p = s.port();
+    if (write(fds[1], &p, sizeof(p)) != sizeof(p))
+      _exit(1);
+    close(fds[1]);
+    io_context.run();
+    _exit(0);
+  }
+  close(fds[1]);
+  if (read(fds[0], &port, sizeof(port)) != sizeof(port))
+    port = 0;
+  close(fds[0]);
+  return pid;
+}
+
+void BM_IdleConnectionMemory(benchmark::State& state)
+{
+  const std::size_t connections = static_cast<std::size_t>(state.range(0));
+  unsigned short port = 0;
+  pid_t pid = start_server(port);
+  if (pid <= 0 || port == 0)
+  {
+    state.SkipWithError("cannot start server");
+    return;
+  }
+
+  asio::io_context io_context;
+  asio::ssl::context context(asio::ssl::context::sslv23);
+  context.set_verify_mode(asio::ssl::verify_none);
+  asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), port);
+  const std::string request = "GET /data/text/data.txt HTTP/1.1\r\n"
+      "Host: localhost\r\nConnection: keep-alive\r\n\r\n";
+
+  // Warm the server up with one connection so that the first-use costs
+  // (TLS tables, file reader, ...) are not counted per connection.
+  std::vector<std::unique_ptr<ssl_stream>> streams;
+  auto open = [&]()
+  {
+    std::unique_ptr<ssl_stream> s(new ssl_stream(io_context, context));
+    s->lowest_layer().connect(endpoint);
+    s->handshake(asio::ssl::stream_base::client);
+    asio::write(*s, asio::buffer(request));
+    asio::streambuf response;
+    asio::read_until(*s, response, "\r\n\r\n");
+    streams.push_back(std::move(s));
+  };
+
+  for (auto _ : state)
+  {
+    open();
+    usleep(100000);
+    long before = rss_kb(pid);
+    for (std::size_t i = 1; i < connections; ++i)
+      open();
+    usleep(100000);
+    long after = rss_kb(pid);
+    state.counters["server_rss_kb"] = static_cast<double>(after);
+    state.counters["kb_per_connection"] =
+        static_cast<double>(after - before) / (connections - 1);
+    streams.clear();
+  }
+
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+}
+
+} // namespace
+
+BENCHMARK(BM_IdleConnectionMemory)->Arg(500)->Iterations(1)->UseRealTime();
+
+BENCHMARK_MAIN();
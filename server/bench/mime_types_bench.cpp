@@ -0,0 +1,30 @@
+// Extension to MIME type lookup for the types the server knows, the last
+// entry in the table, and an unknown extension that falls through to the
+// default.
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "mime_types.hpp"
+
+using namespace http::server;
+
+namespace {
+
+void BM_ExtensionToType(benchmark::State& state, std::string extension)
+{
+  for (auto _ : state)
+  {
+    std::string type = mime_types::extension_to_type(extension);
+    benchmark::DoNotOptimize(type.data());
+  }
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_ExtensionToType, gif, std::string("gif"));
+BENCHMARK_CAPTURE(BM_ExtensionToType, html, std::string("html"));
+BENCHMARK_CAPTURE(BM_ExtensionToType, png, std::string("png"));
+BENCHMARK_CAPTURE(BM_ExtensionToType, unknown, std::string("woff2"));
+
+BENCHMARK_MAIN();
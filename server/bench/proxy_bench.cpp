@@ -0,0 +1,372 @@
+// Requests forwarded by a real server to a stand-in upstream, both
+// in-process and over loopback. The benchmark thread is a blocking client
+// on the server's plain listener, so the time is what the proxy adds to a
+// plain request, plus the upstream's share.
+//
+// Besides timing the proxy, each benchmark checks what it relies on and
+// fails with an error if it does not hold:
+//
+//   KeepAlive  replies arrive whole and upstream connections are pooled:
+//              a run opens at most one new one
+//   Upload     request bodies are streamed through whole
+//   Retry      a pooled connection the upstream has closed unannounced is
+//              retried on a new one, unseen by the client
+//   Timeout    an upstream that never answers gets the client a 504, also
+//              while the client is still sending the request body
+//
+//   ./proxy_bench --benchmark_out=proxy.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <unistd.h>
+
+#include "server.hpp"
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace {
+
+/// How long the server waits for the upstream's reply head.
+const std::chrono::milliseconds upstream_timeout(100);
+
+/// A stand-in upstream on a free loopback port, speaking just enough
+/// HTTP/1.0 for the proxy:
+///
+///   /up/bin/N   N bytes, keeping the connection
+///   /up/size    the size of the request body, keeping the connection
+///   /up/once/N  N bytes, then the connection is closed unannounced
+///   /up/stall   no answer at all
+///
+/// Anything else, such as the proxy's health checks, gets an empty 200
+/// and the connection closed.
+class backend
+{
+public:
+  backend()
+    : acceptor_(io_context_,
+        tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+  {
+    accept();
+    thread_ = std::thread([this]() { io_context_.run(); });
+  }
+
+  ~backend()
+  {
+    io_context_.stop();
+    thread_.join();
+  }
+
+  unsigned short port() const { return acceptor_.local_endpoint().port(); }
+
+  /// Connections whose first request was a forwarded one.
+  std::size_t connections() const { return connections_.load(); }
+
+private:
+  class connection : public std::enable_shared_from_this<connection>
+  {
+  public:
+    connection(backend& owner, tcp::socket socket)
+      : owner_(owner), socket_(std::move(socket)) {}
+
+    void read_head()
+    {
+      auto self = shared_from_this();
+      asio::async_read_until(socket_, in_, "\r\n\r\n",
+          [self](const boost::system::error_code& ec, std::size_t size)
+          {
+            if (!ec)
+              self->read_body(size);
+          });
+    }
+
+  private:
+    void read_body(std::size_t head_size)
+    {
+      std::string head(asio::buffers_begin(in_.data()),
+          asio::buffers_begin(in_.data()) + head_size);
+      in_.consume(head_size);
+      std::size_t space = head.find(' ');
+      uri_ = head.substr(space + 1, head.find(' ', space + 1) - space - 1);
+      if (requests_++ == 0 && uri_.compare(0, 4, "/up/") == 0)
+        ++owner_.connections_;
+      body_size_ = 0;
+      std::size_t pos = head.find("Content-Length: ");
+      if (pos != std::string::npos)
+        body_size_ = std::strtoul(head.c_str() + pos + 16, nullptr, 10);
+      skip_body();
+    }
+
+    /// Read the request body, keeping none of it.
+    void skip_body()
+    {
+      std::size_t n = std::min(in_.size(), body_size_ - received_);
+      in_.consume(n);
+      received_ += n;
+      if (received_ == body_size_)
+      {
+        answer();
+        return;
+      }
+      auto self = shared_from_this();
+      socket_.async_read_some(in_.prepare(65536),
+          [self](const boost::system::error_code& ec, std::size_t n)
+          {
+            if (ec)
+              return;
+            self->in_.commit(n);
+            self->skip_body();
+          });
+    }
+
+    void answer()
+    {
+      std::string body;
+      bool keep = true;
+      if (uri_ == "/up/stall")
+      {
+        // Wait for the proxy to give up and close.
+        auto self = shared_from_this();
+        socket_.async_read_some(in_.prepare(1),
+            [self](const boost::system::error_code&, std::size_t) {});
+        return;
+      }
+      if (uri_ == "/up/size")
+        body = std::to_string(received_);
+      else if (uri_.compare(0, 8, "/up/bin/") == 0)
+        body.assign(std::strtoul(uri_.c_str() + 8, nullptr, 10), 'x');
+      else if (uri_.compare(0, 9, "/up/once/") == 0)
+      {
+        body.assign(std::strtoul(uri_.c_str() + 9, nullptr, 10), 'x');
+        keep = false;
+      }
+      else
+        keep = false;
+      received_ = 0;
+
+      out_ = "HTTP/1.0 200 OK\r\nContent-Length: "
+          + std::to_string(body.size()) + "\r\n\r\n" + body;
+      auto self = shared_from_this();
+      asio::async_write(socket_, asio::buffer(out_),
+          [self, keep](const boost::system::error_code& ec, std::size_t)
+          {
+            if (!ec && keep)
+              self->read_head();
+          });
+    }
+
+    backend& owner_;
+    tcp::socket socket_;
+    asio::streambuf in_;
+    std::string uri_;
+    std::string out_;
+    std::size_t body_size_ = 0;
+    std::size_t received_ = 0;
+    std::size_t requests_ = 0;
+  };
+
+  void accept()
+  {
+    acceptor_.async_accept(
+        [this](const boost::system::error_code& ec, tcp::socket socket)
+        {
+          if (!ec)
+            std::make_shared<connection>(*this, std::move(socket))
+              ->read_head();
+          accept();
+        });
+  }
+
+  asio::io_context io_context_;
+  tcp::acceptor acceptor_;
+  std::atomic<std::size_t> connections_{ 0 };
+  std::thread thread_;
+};
+
+/// A server with /up forwarded to the backend. The certificate and keys
+/// are taken from the source tree.
+class fixture
+{
+public:
+  static fixture& get()
+  {
+    static fixture instance;
+    return instance;
+  }
+
+  unsigned short plain_port() const { return plain_port_; }
+  const backend& upstream() const { return backend_; }
+
+  ~fixture()
+  {
+    io_context_.stop();
+    thread_.join();
+  }
+
+private:
+  fixture()
+  {
+    if (chdir(HTTP_SERVER_SOURCE_DIR) != 0)
+      std::perror(HTTP_SERVER_SOURCE_DIR);
+    http::server::server_config config;
+    config.doc_root = "data";
+    config.listen_plain.push_back(tcp::endpoint(
+          asio::ip::address_v4::loopback(), 0));
+    config.routes.push_back({ "/up",
+        { "http://127.0.0.1:" + std::to_string(backend_.port()) } });
+    config.upstream_timeout = upstream_timeout;
+    server_.reset(new http::server::server(io_context_, config));
+    plain_port_ = server_->plain_port();
+    thread_ = std::thread([this]() { io_context_.run(); });
+  }
+
+  backend backend_;
+  asio::io_context io_context_;
+  std::unique_ptr<http::server::server> server_;
+  unsigned short plain_port_ = 0;
+  std::thread thread_;
+};
+
+/// A blocking client for the fixture's plain listener.
+class client
+{
+public:
+  client()
+    : socket_(io_context_)
+  {
+    socket_.connect(tcp::endpoint(
+          asio::ip::address_v4::loopback(), fixture::get().plain_port()));
+    socket_.set_option(tcp::no_delay(true));
+  }
+
+  /// Send a request, and body_size bytes of body of which only sent are
+  /// actually sent. Returns the reply's status; its body is left in body.
+  int request(const std::string& method, const std::string& uri,
+      std::size_t body_size = 0, std::size_t sent = 0)
+  {
+    std::string request = method + " " + uri + " HTTP/1.1\r\n"
+        "Host: localhost\r\n";
+    if (body_size)
+      request += "Content-Length: " + std::to_string(body_size) + "\r\n";
+    request += "\r\n";
+    asio::write(socket_, asio::buffer(request));
+    if (sent)
+    {
+      upload_.resize(sent, 'u');
+      asio::write(socket_, asio::buffer(upload_));
+    }
+
+    std::size_t header_size = asio::read_until(socket_, buffer_, "\r\n\r\n");
+    std::string header(asio::buffers_begin(buffer_.data()),
+        asio::buffers_begin(buffer_.data()) + header_size);
+    buffer_.consume(header_size);
+    std::size_t length = 0;
+    std::size_t pos = header.find("Content-Length: ");
+    if (pos != std::string::npos)
+      length = std::strtoul(header.c_str() + pos + 16, nullptr, 10);
+
+    if (buffer_.size() < length)
+      asio::read(socket_, buffer_,
+          asio::transfer_exactly(length - buffer_.size()));
+    body.assign(asio::buffers_begin(buffer_.data()),
+        asio::buffers_begin(buffer_.data()) + length);
+    buffer_.consume(length);
+    return header.size() > 12 ? std::atoi(header.c_str() + 9) : 0;
+  }
+
+  std::string body;
+
+private:
+  asio::io_context io_context_;
+  tcp::socket socket_;
+  asio::streambuf buffer_;
+  std::string upload_;
+};
+
+void BM_Proxy_KeepAlive(benchmark::State& state)
+{
+  std::size_t size = static_cast<std::size_t>(state.range(0));
+  std::string uri = "/up/bin/" + std::to_string(size);
+  client c;
+  std::size_t before = fixture::get().upstream().connections();
+  for (auto _ : state)
+  {
+    if (c.request("GET", uri) != 200 || c.body.size() != size)
+    {
+      state.SkipWithError("reply not forwarded whole");
+      break;
+    }
+  }
+  if (fixture::get().upstream().connections() - before > 1)
+    state.SkipWithError("upstream connections were not reused");
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Proxy_Upload(benchmark::State& state)
+{
+  std::size_t size = static_cast<std::size_t>(state.range(0));
+  client c;
+  for (auto _ : state)
+  {
+    if (c.request("POST", "/up/size", size, size) != 200
+        || c.body != std::to_string(size))
+    {
+      state.SkipWithError("request body not forwarded whole");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Proxy_Retry(benchmark::State& state)
+{
+  client c;
+  for (auto _ : state)
+  {
+    if (c.request("GET", "/up/once/1024") != 200 || c.body.size() != 1024)
+    {
+      state.SkipWithError("closed upstream connection not retried");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Proxy_Timeout(benchmark::State& state)
+{
+  // With a body, the client has sent half of it when the 504 comes, and
+  // the server closes the connection rather than read the rest.
+  bool with_body = state.range(0) != 0;
+  for (auto _ : state)
+  {
+    client c;
+    int status = with_body
+        ? c.request("POST", "/up/stall", 65536, 32768)
+        : c.request("GET", "/up/stall");
+    if (status != 504)
+    {
+      state.SkipWithError("stalled upstream not answered with 504");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_Proxy_KeepAlive)->Arg(1 << 10)->Arg(1 << 20)->UseRealTime();
+BENCHMARK(BM_Proxy_Upload)->Arg(1 << 10)->Arg(1 << 20)->UseRealTime();
+BENCHMARK(BM_Proxy_Retry)->UseRealTime();
+BENCHMARK(BM_Proxy_Timeout)->Arg(0)->Arg(1)->Iterations(10)->UseRealTime();
+
+BENCHMARK_MAIN();
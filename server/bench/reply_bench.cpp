@@ -0,0 +1,71 @@
+// Building the buffer sequence for stock error replies and for file replies
+// of various sizes, as separate buffers and coalesced for TLS records.
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "reply.hpp"
+
+using namespace http::server;
+
+namespace {
+
+void BM_ToBuffers_Stock(benchmark::State& state)
+{
+  reply rep = reply::stock_reply(reply::not_found);
+  for (auto _ : state)
+  {
+    auto buffers = rep.to_buffers();
+    benchmark::DoNotOptimize(buffers.data());
+  }
+}
+
+void BM_StockReply(benchmark::State& state)
+{
+  for (auto _ : state)
+  {
+    reply rep = reply::stock_reply(reply::not_found);
+    benchmark::DoNotOptimize(rep.content.data());
+  }
+}
+
+void BM_ToBuffers_File(benchmark::State& state)
+{
+  reply rep;
+  rep.status = reply::ok;
+  rep.content.assign(static_cast<std::size_t>(state.range(0)), 'x');
+  rep.headers.push_back(
+      header{ "Content-Length", std::to_string(rep.content.size()) });
+  rep.headers.push_back(header{ "Content-Type", "image/png" });
+  for (auto _ : state)
+  {
+    auto buffers = rep.to_buffers();
+    benchmark::DoNotOptimize(buffers.data());
+  }
+}
+
+void BM_ToCoalescedBuffers_File(benchmark::State& state)
+{
+  reply rep;
+  rep.status = reply::ok;
+  rep.content.assign(static_cast<std::size_t>(state.range(0)), 'x');
+  rep.headers.push_back(
+      header{ "Content-Length", std::to_string(rep.content.size()) });
+  rep.headers.push_back(header{ "Content-Type", "image/png" });
+  std::string head;
+  for (auto _ : state)
+  {
+    auto buffers = rep.to_coalesced_buffers(head, 16384);
+    benchmark::DoNotOptimize(buffers.data());
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_ToBuffers_Stock);
+BENCHMARK(BM_StockReply);
+BENCHMARK(BM_ToBuffers_File)->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20);
+BENCHMARK(BM_ToCoalescedBuffers_File)
+    ->Arg(1 << 10)->Arg(64 << 10)->Arg(1 << 20);
+
+BENCHMARK_MAIN();
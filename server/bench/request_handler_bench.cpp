@@ -0,0 +1,111 @@
+// URL-decoding of typical request paths, and the whole synchronous
+// handle_request path for a small file from the source tree, read from disk
+// or from an archive of the source tree's data directory.
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "archive.hpp"
+#include "file_cache.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+
+using namespace http::server;
+
+namespace {
+
+const std::string plain_uri = "/data/images/2.png?size=large&format=webp";
+const std::string escaped_uri =
+    "/data/%D0%B4%D0%BE%D0%BA%D1%83%D0%BC%D0%B5%D0%BD%D1%82%D1%8B/"
+    "my%20report%20(final)%202024.pdf?q=a%2Bb%3Dc";
+
+void BM_UrlDecode_Plain(benchmark::State& state)
+{
+  std::string out;
+  for (auto _ : state)
+  {
+    bool ok = request_handler::url_decode(plain_uri, out);
+    benchmark::DoNotOptimize(ok);
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * plain_uri.size()));
+}
+
+void BM_UrlDecode_Escaped(benchmark::State& state)
+{
+  std::string out;
+  for (auto _ : state)
+  {
+    bool ok = request_handler::url_decode(escaped_uri, out);
+    benchmark::DoNotOptimize(ok);
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * escaped_uri.size()));
+}
+
+void BM_HandleRequest(benchmark::State& state)
+{
+  request_handler handler(HTTP_SERVER_SOURCE_DIR);
+  request req;
+  req.method = "GET";
+  req.uri = "/data/text/data.txt";
+  req.http_version_major = 1;
+  req.http_version_minor = 1;
+  for (auto _ : state)
+  {
+    reply rep;
+    handler.handle_request(req, rep);
+    benchmark::DoNotOptimize(rep.content.data());
+  }
+}
+
+void BM_HandleRequest_Archive(benchmark::State& state)
+{
+  std::vector<archive::source> files;
+  for (const char* path : { "/data/text/data.txt", "/data/images/2.png" })
+  {
+    archive::source file;
+    file.path = path;
+    std::ifstream in(std::string(HTTP_SERVER_SOURCE_DIR) + path,
+        std::ios::binary);
+    file.body.assign(std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+    file.content_type = "text/plain";
+    file.etag = file_cache::make_etag(file.body);
+    files.push_back(file);
+  }
+  std::string path = "/tmp/request_handler_bench.pak";
+  archive::write(path, files);
+  boost::asio::io_context io_context;
+  archive_source source(io_context, path);
+
+  request_handler handler(HTTP_SERVER_SOURCE_DIR);
+  handler.set_archive(&source);
+  request req;
+  req.method = "GET";
+  req.uri = "/data/text/data.txt";
+  req.http_version_major = 1;
+  req.http_version_minor = 1;
+  for (auto _ : state)
+  {
+    reply rep;
+    handler.handle_request(req, rep);
+    benchmark::DoNotOptimize(rep.mapped.data());
+  }
+  std::remove(path.c_str());
+}
+
+} // namespace
+
+BENCHMARK(BM_UrlDecode_Plain);
+BENCHMARK(BM_UrlDecode_Escaped);
+BENCHMARK(BM_HandleRequest);
+BENCHMARK(BM_HandleRequest_Archive);
+
+BENCHMARK_MAIN();
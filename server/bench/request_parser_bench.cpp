@@ -0,0 +1,123 @@
+// Parses a typical browser request with the byte-at-a-time state machine
+// (through a non-pointer iterator) and with the vectorised scanner (through
+// char pointers), and compares interned header lookup with a linear search.
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <strings.h>
+
+#include "header_scanner.hpp"
+#include "request.hpp"
+#include "request_parser.hpp"
+
+using namespace http::server;
+
+namespace {
+
+const std::string browser_request =
+    "GET /data/images/2.png?size=large&format=webp HTTP/1.1\r\n"
+    "Host: www.example.com:8443\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", "
+    "\"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;"
+    "q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Referer: https://www.example.com:8443/data/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,ru;q=0.8\r\n"
+    "Cookie: session=4f9d2c1be0a84e6f9a7d3c2b1a0f9e8d; theme=dark; "
+    "_ga=GA1.1.1234567890.1700000000\r\n"
+    "If-None-Match: \"5d8c72a5edda8d6a:0\"\r\n"
+    "If-Modified-Since: Sat, 25 Feb 2024 10:00:00 GMT\r\n"
+    "\r\n";
+
+void BM_Parse_Bytewise(benchmark::State& state)
+{
+  request req;
+  request_parser parser;
+  for (auto _ : state)
+  {
+    req.clear();
+    parser.reset();
+    auto result = parser.parse(req, browser_request.cbegin(),
+        browser_request.cend());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * browser_request.size()));
+}
+
+void BM_Parse_Scanner(benchmark::State& state)
+{
+  const char* begin = browser_request.data();
+  const char* end = begin + browser_request.size();
+  request req;
+  request_parser parser;
+  for (auto _ : state)
+  {
+    req.clear();
+    parser.reset();
+    auto result = parser.parse(req, begin, end);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * browser_request.size()));
+  state.SetLabel(header_scanner::implementation());
+}
+
+const request& parsed_request()
+{
+  static request req;
+  static bool parsed = false;
+  if (!parsed)
+  {
+    request_parser parser;
+    parser.parse(req, browser_request.data(),
+        browser_request.data() + browser_request.size());
+    parsed = true;
+  }
+  return req;
+}
+
+void BM_FindHeader_Table(benchmark::State& state)
+{
+  const request& req = parsed_request();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(req.find_header(if_none_match_header));
+}
+
+void BM_FindHeader_Linear(benchmark::State& state)
+{
+  const request& req = parsed_request();
+  const std::string name = "If-None-Match";
+  for (auto _ : state)
+  {
+    const header_view* found = nullptr;
+    for (const header_view& h : req.headers)
+    {
+      if (h.name.size() == name.size()
+          && ::strncasecmp(h.name.data(), name.data(), name.size()) == 0)
+      {
+        found = &h;
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(found);
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_Parse_Bytewise);
+BENCHMARK(BM_Parse_Scanner);
+BENCHMARK(BM_FindHeader_Table);
+BENCHMARK(BM_FindHeader_Linear);
+
+BENCHMARK_MAIN();
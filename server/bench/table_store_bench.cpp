@@ -0,0 +1,121 @@
+// Table queries on a generated two-column file of range(0) rows: parsing
+// the text on every request (what a client does with the whole file)
+// against querying the parsed columns, and the scan behind aggregates and
+// downsampling, labelled with the implementation selected for this CPU.
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <string>
+
+#include "table_scan.hpp"
+#include "table_store.hpp"
+
+using namespace http::server;
+
+namespace {
+
+std::string make_text(std::size_t rows)
+{
+  std::string text = "# x y\n";
+  for (std::size_t i = 0; i < rows; ++i)
+  {
+    text += std::to_string(i * 0.5);
+    text += '\t';
+    text += std::to_string(std::sin(i * 0.01) * 100);
+    text += '\n';
+  }
+  return text;
+}
+
+table_store::table make_table(std::size_t rows)
+{
+  table_store::table t;
+  table_store::parse(make_text(rows), t);
+  return t;
+}
+
+void BM_ParseEveryTime(benchmark::State& state)
+{
+  std::string text = make_text(state.range(0));
+  table_store::query q;
+  q.stats = true;
+  std::string out;
+  for (auto _ : state)
+  {
+    table_store::table t;
+    table_store::parse(text, t);
+    table_store::run(t, q, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ParseEveryTime)->Arg(1000)->Arg(100000);
+
+void BM_Stats(benchmark::State& state)
+{
+  table_store::table t = make_table(state.range(0));
+  table_store::query q;
+  q.stats = true;
+  std::string out;
+  for (auto _ : state)
+  {
+    table_store::run(t, q, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetLabel(table_scan::implementation());
+}
+BENCHMARK(BM_Stats)->Arg(1000)->Arg(100000);
+
+void BM_Range(benchmark::State& state)
+{
+  // A tenth of the rows, as binary.
+  std::size_t rows = state.range(0);
+  table_store::table t = make_table(rows);
+  table_store::query q;
+  q.x_min = rows * 0.2;
+  q.x_max = rows * 0.25;
+  q.fmt = table_store::binary;
+  std::string out;
+  for (auto _ : state)
+  {
+    table_store::run(t, q, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_Range)->Arg(1000)->Arg(100000);
+
+void BM_Downsample(benchmark::State& state)
+{
+  table_store::table t = make_table(state.range(0));
+  table_store::query q;
+  q.points = 500;
+  q.fmt = table_store::json;
+  std::string out;
+  for (auto _ : state)
+  {
+    table_store::run(t, q, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetLabel(table_scan::implementation());
+}
+BENCHMARK(BM_Downsample)->Arg(100000);
+
+void BM_Summarize(benchmark::State& state)
+{
+  table_store::table t = make_table(state.range(0));
+  for (auto _ : state)
+  {
+    table_scan::summary s =
+        table_scan::summarize(t.y.data(), t.y.data() + t.y.size());
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetBytesProcessed(
+      state.iterations() * t.y.size() * sizeof(double));
+  state.SetLabel(table_scan::implementation());
+}
+BENCHMARK(BM_Summarize)->Arg(1000)->Arg(100000);
+
+} // namespace
+
+BENCHMARK_MAIN();
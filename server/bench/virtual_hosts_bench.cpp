@@ -0,0 +1,35 @@
+// Routing a request on its Host header, for tables of different sizes, for
+// a name that is served and one that falls through to the default site.
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+
+#include "request_handler.hpp"
+#include "virtual_hosts.hpp"
+
+using namespace http::server;
+
+namespace {
+
+void BM_Route(benchmark::State& state, std::string host_header)
+{
+  virtual_hosts hosts(std::make_unique<request_handler>("."));
+  for (int64_t i = 0; i < state.range(0); ++i)
+    hosts.add("site" + std::to_string(i) + ".example.com",
+        std::make_unique<request_handler>("."));
+  for (auto _ : state)
+  {
+    request_handler& handler = hosts.route(host_header);
+    benchmark::DoNotOptimize(&handler);
+  }
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_Route, hit, std::string("Site1.Example.com:8443"))
+    ->Arg(2)->Arg(16)->Arg(256);
+BENCHMARK_CAPTURE(BM_Route, miss, std::string("www.example.org"))
+    ->Arg(2)->Arg(16)->Arg(256);
+
+BENCHMARK_MAIN();
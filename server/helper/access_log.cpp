@@ -0,0 +1,261 @@
+#include "access_log.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace http {
+namespace server {
+
+namespace {
+
+std::atomic<std::uint64_t> next_log_id{1};
+
+std::size_t round_up_pow2(std::size_t n)
+{
+  std::size_t size = 1;
+  while (size < n)
+    size <<= 1;
+  return size;
+}
+
+/// Increment a counter that only one thread writes.
+void bump(std::atomic<std::uint64_t>& counter)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+}
+
+void append_json_string(std::string& out, const char* data, std::size_t size)
+{
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += static_cast<char>(c);
+    }
+    else if (c < 0x20 || c >= 0x7f)
+    {
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 0xf];
+    }
+    else
+      out += static_cast<char>(c);
+  }
+  out += '"';
+}
+
+void append_record(std::string& out, const access_record& r)
+{
+  char time[64];
+  std::time_t seconds = static_cast<std::time_t>(r.time_us / 1000000);
+  std::tm tm;
+  gmtime_r(&seconds, &tm);
+  std::size_t n = std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &tm);
+  std::snprintf(time + n, sizeof(time) - n, ".%06dZ",
+      static_cast<int>(r.time_us % 1000000));
+
+  char numbers[192];
+  std::snprintf(numbers, sizeof(numbers),
+      ",\"status\":%u,\"bytes\":%llu,\"records\":%u"
+      ",\"handshake_us\":%u,\"resumed\":%s"
+      ",\"ttfb_us\":%u,\"total_us\":%u}\n",
+      static_cast<unsigned>(r.status),
+      static_cast<unsigned long long>(r.bytes),
+      static_cast<unsigned>(r.records),
+      static_cast<unsigned>(r.handshake_us), r.resumed ? "true" : "false",
+      static_cast<unsigned>(r.ttfb_us), static_cast<unsigned>(r.total_us));
+
+  out += "{\"time\":\"";
+  out += time;
+  out += "\",\"method\":";
+  append_json_string(out, r.method, strnlen(r.method, sizeof(r.method)));
+  out += ",\"uri\":";
+  append_json_string(out, r.uri, r.uri_length);
+  out += numbers;
+}
+
+} // namespace
+
+void access_record::set_request(std::string_view m, std::string_view u)
+{
+  std::memset(method, 0, sizeof(method));
+  std::memcpy(method, m.data(), std::min(m.size(), sizeof(method)));
+  uri_length = static_cast<std::uint16_t>(std::min(u.size(), sizeof(uri)));
+  std::memcpy(uri, u.data(), uri_length);
+}
+
+/// Single-producer single-consumer ring of records. The producer is the
+/// thread that owns it, the consumer is the flusher.
+class access_log::ring
+{
+public:
+  ring(std::size_t size, std::thread::id owner)
+    : owner_(owner), slots_(size), mask_(size - 1) {}
+
+  bool push(const access_record& record)
+  {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    std::size_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail == slots_.size())
+      return false;
+    slots_[head & mask_] = record;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename Function>
+  std::size_t drain(Function f)
+  {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    std::size_t head = head_.load(std::memory_order_acquire);
+    std::size_t count = head - tail;
+    for (; tail != head; ++tail)
+      f(slots_[tail & mask_]);
+    tail_.store(tail, std::memory_order_release);
+    return count;
+  }
+
+  std::thread::id owner() const { return owner_; }
+
+  /// Requests seen by the sampler, owner thread only.
+  unsigned sample_count = 0;
+
+  std::atomic<std::uint64_t> logged{0};
+  std::atomic<std::uint64_t> sampled_out{0};
+  std::atomic<std::uint64_t> dropped{0};
+
+private:
+  std::thread::id owner_;
+  std::vector<access_record> slots_;
+  std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> head_{0};
+  alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+access_log::access_log(const std::string& path, unsigned sample_rate,
+    std::size_t ring_size, std::chrono::milliseconds flush_interval)
+  : file_(std::fopen(path.c_str(), "a")),
+    sample_rate_(std::max(sample_rate, 1u)),
+    ring_size_(round_up_pow2(std::max<std::size_t>(ring_size, 2))),
+    flush_interval_(flush_interval),
+    id_(next_log_id.fetch_add(1))
+{
+  if (!file_)
+    throw std::runtime_error("cannot open access log " + path);
+  flusher_ = std::thread([this]() { run(); });
+}
+
+access_log::~access_log()
+{
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_one();
+  flusher_.join();
+  std::fclose(file_);
+}
+
+access_log::ring& access_log::local_ring()
+{
+  // Cache the ring of the log this thread used last. A thread that logs to
+  // several logs finds its existing ring again under the lock.
+  thread_local std::uint64_t cached_id = 0;
+  thread_local ring* cached = nullptr;
+  if (cached_id == id_)
+    return *cached;
+
+  std::thread::id self = std::this_thread::get_id();
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  auto it = std::find_if(rings_.begin(), rings_.end(),
+      [self](const std::unique_ptr<ring>& r) { return r->owner() == self; });
+  if (it == rings_.end())
+  {
+    rings_.emplace_back(new ring(ring_size_, self));
+    it = rings_.end() - 1;
+  }
+  cached_id = id_;
+  cached = it->get();
+  return *cached;
+}
+
+bool access_log::sample(unsigned status)
+{
+  if (status >= 400 || sample_rate_ == 1)
+    return true;
+  ring& r = local_ring();
+  if (++r.sample_count % sample_rate_ == 0)
+    return true;
+  bump(r.sampled_out);
+  return false;
+}
+
+void access_log::log(const access_record& record)
+{
+  ring& r = local_ring();
+  if (r.push(record))
+    bump(r.logged);
+  else
+    bump(r.dropped);
+}
+
+access_log::counters access_log::stats() const
+{
+  counters c{ 0, 0, 0, 0 };
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  for (const std::unique_ptr<ring>& r : rings_)
+  {
+    c.logged += r->logged.load(std::memory_order_relaxed);
+    c.sampled_out += r->sampled_out.load(std::memory_order_relaxed);
+    c.dropped += r->dropped.load(std::memory_order_relaxed);
+  }
+  c.written = written_.load(std::memory_order_relaxed);
+  return c;
+}
+
+void access_log::drain()
+{
+  std::vector<ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (const std::unique_ptr<ring>& r : rings_)
+      rings.push_back(r.get());
+  }
+
+  batch_.clear();
+  std::uint64_t count = 0;
+  for (ring* r : rings)
+    count += r->drain(
+        [this](const access_record& record)
+        {
+          append_record(batch_, record);
+        });
+  if (count == 0)
+    return;
+  std::fwrite(batch_.data(), 1, batch_.size(), file_);
+  std::fflush(file_);
+  written_.fetch_add(count, std::memory_order_relaxed);
+}
+
+void access_log::run()
+{
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_)
+  {
+    stop_cv_.wait_for(lock, flush_interval_);
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+  lock.unlock();
+  drain();
+}
+
+} // namespace server
+} // namespace http
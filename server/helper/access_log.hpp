@@ -0,0 +1,128 @@
+#ifndef HTTP_ACCESS_LOG_HPP
+#define HTTP_ACCESS_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// One request as recorded in the access log. Fixed size so that it can be
+/// copied into a ring slot without allocating; long URIs are truncated.
+struct access_record
+{
+  /// Wall clock time the request arrived, in microseconds since the epoch.
+  std::int64_t time_us;
+
+  /// Time spent in the TLS handshake, only set for the first request on a
+  /// connection, and whether the handshake resumed a session.
+  std::uint32_t handshake_us;
+  bool resumed;
+
+  /// Time from the arrival of the request to the first byte of the reply,
+  /// and to the last.
+  std::uint32_t ttfb_us;
+  std::uint32_t total_us;
+
+  std::uint16_t status;
+  std::uint64_t bytes;
+
+  /// TLS records the reply took.
+  std::uint32_t records;
+
+  char method[8];
+  std::uint16_t uri_length;
+  char uri[190];
+
+  /// Copy the method and URI, truncating them if needed.
+  void set_request(std::string_view m, std::string_view u);
+};
+
+/// Asynchronous access log written as JSON lines.
+///
+/// Every thread that logs gets its own single-producer ring, registered on
+/// its first record. The I/O thread only ever copies a record into its ring;
+/// if the ring is full the record is counted as dropped rather than waited
+/// for. A background thread drains all rings in batches and appends them
+/// to the file.
+class access_log
+{
+public:
+  access_log(const access_log&) = delete;
+  access_log& operator=(const access_log&) = delete;
+
+  /// Open (append to) the log file. One in sample_rate successful requests
+  /// is logged; errors (status 400 and above) always are. ring_size is
+  /// rounded up to a power of two.
+  access_log(const std::string& path, unsigned sample_rate = 1,
+      std::size_t ring_size = 4096,
+      std::chrono::milliseconds flush_interval =
+        std::chrono::milliseconds(200));
+
+  /// Flush what is left and close the file.
+  ~access_log();
+
+  /// Whether a request with the given status should be recorded. Cheap, so
+  /// that the caller can skip building the record otherwise.
+  bool sample(unsigned status);
+
+  /// Queue a record. Never blocks.
+  void log(const access_record& record);
+
+  /// Counters since the log was opened.
+  struct counters
+  {
+    std::uint64_t logged;
+    std::uint64_t sampled_out;
+    std::uint64_t dropped;
+    std::uint64_t written;
+  };
+  counters stats() const;
+
+private:
+  class ring;
+
+  /// The calling thread's ring, created on first use.
+  ring& local_ring();
+
+  /// Move everything queued so far to the file. Flusher thread only.
+  void drain();
+
+  void run();
+
+  std::FILE* file_;
+  unsigned sample_rate_;
+  std::size_t ring_size_;
+  std::chrono::milliseconds flush_interval_;
+
+  /// Distinguishes this log from earlier ones in the threads' ring caches.
+  std::uint64_t id_;
+
+  /// Rings of every thread that has logged. Only grows.
+  mutable std::mutex rings_mutex_;
+  std::vector<std::unique_ptr<ring>> rings_;
+
+  /// Records written to the file, and the flusher's formatting buffer.
+  std::atomic<std::uint64_t> written_{0};
+  std::string batch_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+  std::thread flusher_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_ACCESS_LOG_HPP
@@ -0,0 +1,82 @@
+#include "admission.hpp"
+#include <cmath>
+
+namespace http {
+namespace server {
+
+admission_controller::admission_controller(const admission_limits& limits)
+  : limits_(limits)
+{
+}
+
+bool admission_controller::admit(clock::duration sojourn, bool established,
+    clock::time_point now)
+{
+  last_sojourn_ = sojourn;
+  if (limits_.target == clock::duration::zero())
+  {
+    ++admitted_;
+    return true;
+  }
+
+  // Only a delay that has stayed above target for an interval counts: a
+  // burst that is worked off quickly is what a queue is for.
+  bool above = false;
+  if (sojourn < limits_.target)
+    first_above_ = clock::time_point();
+  else if (first_above_ == clock::time_point())
+    first_above_ = now + limits_.interval;
+  else
+    above = now >= first_above_;
+
+  bool shed = false;
+  if (dropping_)
+  {
+    if (!above)
+    {
+      dropping_ = false;
+    }
+    else if (!established)
+    {
+      shed = true;
+    }
+    else if (now >= drop_next_)
+    {
+      shed = true;
+      ++count_;
+      drop_next_ += control_law(count_);
+    }
+  }
+  else if (above)
+  {
+    dropping_ = true;
+    shed = true;
+    // Coming back soon after the last episode, carry on near the rate
+    // that episode reached instead of starting over.
+    std::uint32_t delta = count_ - last_count_;
+    if (delta > 1 && now - drop_next_ < 16 * limits_.interval)
+      count_ = delta;
+    else
+      count_ = 1;
+    drop_next_ = now + control_law(count_);
+    last_count_ = count_;
+  }
+
+  if (!shed)
+    ++admitted_;
+  else if (established)
+    ++shed_established_;
+  else
+    ++shed_new_;
+  return !shed;
+}
+
+admission_controller::clock::duration admission_controller::control_law(
+    std::uint32_t count) const
+{
+  return std::chrono::duration_cast<clock::duration>(
+      limits_.interval / std::sqrt(static_cast<double>(count)));
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,79 @@
+#ifndef HTTP_ADMISSION_HPP
+#define HTTP_ADMISSION_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace http {
+namespace server {
+
+/// The queueing delay the server aims for and how long it may be exceeded
+/// before load is shed. A zero target turns shedding off.
+struct admission_limits
+{
+  std::chrono::steady_clock::duration target = std::chrono::milliseconds(10);
+  std::chrono::steady_clock::duration interval =
+      std::chrono::milliseconds(100);
+};
+
+/// Decides which requests to refuse with 503 when the server falls behind,
+/// after CoDel (RFC 8289). Every request brings a sample of how long it
+/// waited on the io_context before it could be handled. Once the delay has
+/// stayed above the target for a whole interval the controller starts
+/// shedding, and keeps shedding until a request gets through in time.
+///
+/// While shedding, every new connection's first request is refused, since
+/// turning newcomers away is what brings the delay down for everyone else.
+/// Requests on established keep-alive connections are only refused at
+/// CoDel's rate, one per interval / sqrt(n) for the n-th refusal, so that
+/// they see a trickle of 503s rather than a wall of them.
+///
+/// Not thread-safe: use one per io_context thread.
+class admission_controller
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  explicit admission_controller(const admission_limits& limits);
+
+  /// Account for a request that waited sojourn and decide whether to
+  /// handle it. Established is set for connections that have already been
+  /// answered at least once.
+  bool admit(clock::duration sojourn, bool established, clock::time_point now);
+
+  /// Whether requests are being shed at the moment.
+  bool shedding() const { return dropping_; }
+
+  std::uint64_t admitted() const { return admitted_; }
+  std::uint64_t shed_new() const { return shed_new_; }
+  std::uint64_t shed_established() const { return shed_established_; }
+
+  /// The delay of the last request seen.
+  clock::duration last_sojourn() const { return last_sojourn_; }
+
+private:
+  /// The time between refusals after the count-th one.
+  clock::duration control_law(std::uint32_t count) const;
+
+  admission_limits limits_;
+
+  /// When the delay will have been above target for an interval, or the
+  /// epoch if it is below target.
+  clock::time_point first_above_;
+  bool dropping_ = false;
+  /// Refusals of established requests in this shedding episode, and when
+  /// the next one is due.
+  std::uint32_t count_ = 0;
+  std::uint32_t last_count_ = 0;
+  clock::time_point drop_next_;
+
+  clock::duration last_sojourn_{};
+  std::uint64_t admitted_ = 0;
+  std::uint64_t shed_new_ = 0;
+  std::uint64_t shed_established_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_ADMISSION_HPP
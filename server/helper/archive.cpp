@@ -0,0 +1,287 @@
+#include "archive.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+const char magic[8] = { 'H', 'T', 'T', 'P', 'P', 'A', 'K', '1' };
+const std::uint32_t version = 1;
+
+enum
+{
+  header_size = 64,
+  record_size = 64,
+  /// Bodies start on a multiple of this, so each can be mapped or read
+  /// ahead on its own.
+  body_alignment = 4096
+};
+
+void put_u32(char* p, std::uint32_t v)
+{
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<char>(v >> (8 * i));
+}
+
+void put_u64(char* p, std::uint64_t v)
+{
+  for (int i = 0; i < 8; ++i)
+    p[i] = static_cast<char>(v >> (8 * i));
+}
+
+std::uint32_t get_u32(const char* p)
+{
+  std::uint32_t v = 0;
+  for (int i = 0; i < 4; ++i)
+    v |= std::uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+  return v;
+}
+
+std::uint64_t get_u64(const char* p)
+{
+  std::uint64_t v = 0;
+  for (int i = 0; i < 8; ++i)
+    v |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+  return v;
+}
+
+std::runtime_error error(const std::string& path, const std::string& what)
+{
+  return std::runtime_error(path + ": " + what);
+}
+
+std::int64_t mtime_ns(const struct stat& st)
+{
+  return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+std::shared_ptr<const archive> archive::open(const std::string& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw error(path, std::strerror(errno));
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size < header_size)
+  {
+    ::close(fd);
+    throw error(path, "not an archive");
+  }
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw error(path, std::strerror(errno));
+
+  std::shared_ptr<archive> a(new archive);
+  a->data_ = static_cast<const char*>(data);
+  a->size_ = size;
+
+  // Check everything once here, so that lookups can trust the index.
+  const char* h = a->data_;
+  if (std::memcmp(h, magic, sizeof(magic)) != 0
+      || get_u32(h + 8) != version)
+    throw error(path, "not an archive, or a different version");
+  std::uint64_t count = get_u32(h + 12);
+  std::uint64_t index = get_u64(h + 16);
+  std::uint64_t strings = get_u64(h + 24);
+  std::uint64_t strings_size = get_u64(h + 32);
+  if (get_u64(h + 40) != size || index > size
+      || count > (size - index) / record_size
+      || strings > size || strings_size > size - strings)
+    throw error(path, "truncated or corrupt");
+
+  auto slice = [&](std::uint64_t offset, std::uint64_t length,
+      std::uint64_t base, std::uint64_t limit, std::string_view& out)
+  {
+    if (offset > limit || length > limit - offset)
+      throw error(path, "corrupt index");
+    out = std::string_view(a->data_ + base + offset, length);
+  };
+
+  a->entries_.resize(count);
+  for (std::uint64_t i = 0; i < count; ++i)
+  {
+    const char* r = a->data_ + index + i * record_size;
+    entry& e = a->entries_[i];
+    slice(get_u32(r), get_u32(r + 4), strings, strings_size, e.path);
+    slice(get_u32(r + 8), get_u32(r + 12), strings, strings_size,
+        e.content_type);
+    slice(get_u32(r + 16), get_u32(r + 20), strings, strings_size, e.etag);
+    slice(get_u64(r + 24), get_u64(r + 32), 0, size, e.body);
+    slice(get_u64(r + 40), get_u64(r + 48), 0, size, e.gzip_body);
+    e.mtime = static_cast<std::int64_t>(get_u64(r + 56));
+    if (i > 0 && !(a->entries_[i - 1].path < e.path))
+      throw error(path, "index not sorted");
+  }
+  return a;
+}
+
+archive::~archive()
+{
+  if (data_)
+    ::munmap(const_cast<char*>(data_), size_);
+}
+
+const archive::entry* archive::find(std::string_view path) const
+{
+  auto it = std::lower_bound(entries_.begin(), entries_.end(), path,
+      [](const entry& e, std::string_view p) { return e.path < p; });
+  if (it == entries_.end() || it->path != path)
+    return nullptr;
+  return &*it;
+}
+
+void archive::write(const std::string& path, std::vector<source> files)
+{
+  std::sort(files.begin(), files.end(),
+      [](const source& a, const source& b) { return a.path < b.path; });
+
+  // The strings, then the positions of the bodies.
+  std::string strings;
+  auto add_string = [&strings](const std::string& s)
+  {
+    std::uint32_t offset = static_cast<std::uint32_t>(strings.size());
+    strings += s;
+    return offset;
+  };
+  std::string index(files.size() * record_size, '\0');
+  std::uint64_t strings_offset = header_size + index.size();
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    char* r = &index[i * record_size];
+    put_u32(r, add_string(files[i].path));
+    put_u32(r + 4, static_cast<std::uint32_t>(files[i].path.size()));
+    put_u32(r + 8, add_string(files[i].content_type));
+    put_u32(r + 12, static_cast<std::uint32_t>(files[i].content_type.size()));
+    put_u32(r + 16, add_string(files[i].etag));
+    put_u32(r + 20, static_cast<std::uint32_t>(files[i].etag.size()));
+  }
+  auto align = [](std::uint64_t offset)
+  {
+    return (offset + body_alignment - 1) / body_alignment * body_alignment;
+  };
+  std::uint64_t end = strings_offset + strings.size();
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    char* r = &index[i * record_size];
+    std::uint64_t body = align(end);
+    end = body + files[i].body.size();
+    std::uint64_t gzip = files[i].gzip_body.empty() ? 0 : align(end);
+    if (gzip)
+      end = gzip + files[i].gzip_body.size();
+    put_u64(r + 24, body);
+    put_u64(r + 32, files[i].body.size());
+    put_u64(r + 40, gzip);
+    put_u64(r + 48, files[i].gzip_body.size());
+    put_u64(r + 56, static_cast<std::uint64_t>(files[i].mtime));
+  }
+
+  char header[header_size] = {};
+  std::memcpy(header, magic, sizeof(magic));
+  put_u32(header + 8, version);
+  put_u32(header + 12, static_cast<std::uint32_t>(files.size()));
+  put_u64(header + 16, header_size);
+  put_u64(header + 24, strings_offset);
+  put_u64(header + 32, strings.size());
+  put_u64(header + 40, end);
+
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(header, sizeof(header));
+    out << index << strings;
+    std::uint64_t written = strings_offset + strings.size();
+    auto pad_to = [&out, &written](std::uint64_t offset)
+    {
+      std::string zeros(offset - written, '\0');
+      out << zeros;
+      written = offset;
+    };
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      const char* r = &index[i * record_size];
+      pad_to(get_u64(r + 24));
+      out << files[i].body;
+      written += files[i].body.size();
+      if (!files[i].gzip_body.empty())
+      {
+        pad_to(get_u64(r + 40));
+        out << files[i].gzip_body;
+        written += files[i].gzip_body.size();
+      }
+    }
+    out.flush();
+    if (!out)
+      throw error(temporary, "write failed");
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    throw error(path, std::strerror(errno));
+}
+
+archive_source::archive_source(boost::asio::io_context& io_context,
+    const std::string& path, std::chrono::steady_clock::duration interval)
+  : path_(path),
+    timer_(io_context),
+    interval_(interval)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) == 0)
+  {
+    device_ = st.st_dev;
+    inode_ = st.st_ino;
+    mtime_ns_ = mtime_ns(st);
+  }
+  current_ = archive::open(path);
+  schedule_check();
+}
+
+void archive_source::schedule_check()
+{
+  timer_.expires_after(interval_);
+  timer_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (ec)
+          return;
+        check();
+        schedule_check();
+      });
+}
+
+void archive_source::check()
+{
+  struct stat st;
+  if (::stat(path_.c_str(), &st) != 0)
+    return;
+  if (st.st_dev == device_ && st.st_ino == inode_
+      && mtime_ns(st) == mtime_ns_)
+    return;
+  // Noted even if the new file is bad, so that it is reported once.
+  device_ = st.st_dev;
+  inode_ = st.st_ino;
+  mtime_ns_ = mtime_ns(st);
+  try
+  {
+    current_ = archive::open(path_);
+    ++swaps_;
+  }
+  catch (const std::runtime_error& e)
+  {
+    std::cerr << "Keeping the current archive: " << e.what() << "\n";
+  }
+}
+
+} // namespace server
+} // namespace http
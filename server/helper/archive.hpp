@@ -0,0 +1,124 @@
+#ifndef HTTP_ARCHIVE_HPP
+#define HTTP_ARCHIVE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+#include <sys/types.h>
+
+namespace http {
+namespace server {
+
+/// A doc root packed into one read-only file by https-pack and mapped into
+/// memory whole. Lookups are a binary search of a sorted path index, and
+/// bodies are served as slices of the mapping, so a request costs no
+/// system calls and no copies before the socket write.
+///
+/// Layout: a header, the index, a block of strings (paths, content types
+/// and ETags) and the bodies, each starting on a page boundary. A file may
+/// also have a gzip-compressed body, stored when it was worth it. All
+/// numbers are little-endian.
+class archive
+{
+public:
+  archive(const archive&) = delete;
+  archive& operator=(const archive&) = delete;
+
+  /// A file in the archive. The views point into the mapping.
+  struct entry
+  {
+    std::string_view path;
+    std::string_view content_type;
+    std::string_view etag;
+    std::string_view body;
+    /// Empty if there is no compressed variant.
+    std::string_view gzip_body;
+    std::int64_t mtime;
+  };
+
+  /// A file to be packed.
+  struct source
+  {
+    std::string path;
+    std::string content_type;
+    std::string etag;
+    std::string body;
+    std::string gzip_body;
+    std::int64_t mtime = 0;
+  };
+
+  /// Map the archive at path. Throws std::runtime_error if it cannot be
+  /// read or is not a valid archive.
+  static std::shared_ptr<const archive> open(const std::string& path);
+
+  /// Write an archive of the given files, sorted by path, to path. It is
+  /// written to a temporary file first and renamed into place, so that a
+  /// server never maps a half-written archive. Throws std::runtime_error.
+  static void write(const std::string& path, std::vector<source> files);
+
+  ~archive();
+
+  /// The file at path ("/dir/name"), or null.
+  const entry* find(std::string_view path) const;
+
+  std::size_t size() const { return entries_.size(); }
+
+  /// The size of the mapping.
+  std::size_t mapped_size() const { return size_; }
+
+private:
+  archive() = default;
+
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+  /// The index, decoded once into views, sorted by path.
+  std::vector<entry> entries_;
+};
+
+/// The archive currently being served, replaced when the file is. A
+/// deployment writes a new archive and renames it over the old one; the
+/// next check maps the new file and later requests see it, while replies
+/// still being sent keep the old mapping alive until they are done.
+///
+/// Not thread-safe: use one per io_context thread.
+class archive_source
+{
+public:
+  archive_source(const archive_source&) = delete;
+  archive_source& operator=(const archive_source&) = delete;
+
+  /// Map the archive at path, then check every interval whether the file
+  /// has been replaced. Throws std::runtime_error if the first map fails.
+  archive_source(boost::asio::io_context& io_context, const std::string& path,
+      std::chrono::steady_clock::duration interval = std::chrono::seconds(1));
+
+  /// The archive to serve from.
+  const std::shared_ptr<const archive>& current() const { return current_; }
+
+  /// The times the archive has been replaced.
+  std::size_t swaps() const { return swaps_; }
+
+private:
+  void schedule_check();
+  void check();
+
+  std::string path_;
+  boost::asio::steady_timer timer_;
+  std::chrono::steady_clock::duration interval_;
+  std::shared_ptr<const archive> current_;
+  /// What stat said about the mapped file, to notice a replacement.
+  dev_t device_ = 0;
+  ino_t inode_ = 0;
+  std::int64_t mtime_ns_ = 0;
+  std::size_t swaps_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_ARCHIVE_HPP
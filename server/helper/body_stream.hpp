@@ -0,0 +1,35 @@
+#ifndef HTTP_BODY_STREAM_HPP
+#define HTTP_BODY_STREAM_HPP
+
+#include <cstddef>
+#include <functional>
+#include <boost/asio.hpp>
+
+namespace http {
+namespace server {
+
+/// Completion handler for body_stream reads: the error, if any, and the
+/// number of bytes read.
+typedef std::function<void(const boost::system::error_code&, std::size_t)>
+    body_handler;
+
+/// A body read piece by piece as it becomes available: a request body still
+/// arriving from the client, or a reply body produced elsewhere (e.g. by an
+/// upstream server). The consumer bounds the buffering by the size of the
+/// buffers it passes in.
+class body_stream
+{
+public:
+  virtual ~body_stream() = default;
+
+  /// Read some of the body into buffer. Completes with zero bytes and no
+  /// error at the end of the body. The handler is never invoked from within
+  /// this call.
+  virtual void async_read_some(boost::asio::mutable_buffer buffer,
+      body_handler handler) = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_BODY_STREAM_HPP
@@ -0,0 +1,76 @@
+#include "buffer_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace http {
+namespace server {
+
+buffer_pool::buffer_pool(std::size_t min_size, std::size_t max_size,
+    std::size_t slab_bytes)
+  : min_size_(min_size),
+    max_size_(std::max(min_size, max_size)),
+    slab_bytes_(slab_bytes)
+{
+  for (std::size_t size = min_size_; size <= max_size_; size *= 2)
+  {
+    free_.emplace_back();
+    if (size * 2 > max_size_)
+      max_size_ = size;
+  }
+}
+
+buffer_pool::~buffer_pool() = default;
+
+std::size_t buffer_pool::class_index(std::size_t size) const
+{
+  std::size_t index = 0;
+  for (std::size_t s = min_size_; s < size && s < max_size_; s *= 2)
+    ++index;
+  return index;
+}
+
+buffer_pool::buffer buffer_pool::acquire(std::size_t size)
+{
+  std::size_t index = class_index(size);
+  std::size_t class_size = min_size_ << index;
+  std::vector<char*>& list = free_[index];
+  if (list.empty())
+  {
+    // Carve a new slab into buffers of this class.
+    std::size_t count = std::max<std::size_t>(1, slab_bytes_ / class_size);
+    slabs_.emplace_back(new char[count * class_size]);
+    char* slab = slabs_.back().get();
+    for (std::size_t i = count; i-- > 0;)
+      list.push_back(slab + i * class_size);
+    reserved_ += count * class_size;
+  }
+  char* data = list.back();
+  list.pop_back();
+  in_use_ += class_size;
+  return buffer(this, data, class_size);
+}
+
+void buffer_pool::put_back(char* data, std::size_t size)
+{
+  free_[class_index(size)].push_back(data);
+  in_use_ -= size;
+}
+
+void buffer_pool::buffer::release()
+{
+  if (pool_)
+    pool_->put_back(data_, size_);
+  pool_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void buffer_pool::buffer::swap(buffer& other) noexcept
+{
+  std::swap(pool_, other.pool_);
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+}
+
+} // namespace server
+} // namespace http
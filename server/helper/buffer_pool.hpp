@@ -0,0 +1,89 @@
+#ifndef HTTP_BUFFER_POOL_HPP
+#define HTTP_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// Read buffers shared by the sessions of one io_context. Buffers come in a
+/// few power-of-two size classes and are carved out of slabs; a released
+/// buffer goes back on its class's free list for the next session that has
+/// data to read. Not thread-safe: use one pool per io_context thread.
+class buffer_pool
+{
+public:
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  /// Size classes run from min_size to max_size, doubling. Each slab holds
+  /// slab_bytes worth of buffers of one class.
+  buffer_pool(std::size_t min_size = 4096, std::size_t max_size = 65536,
+      std::size_t slab_bytes = 256 * 1024);
+
+  ~buffer_pool();
+
+  /// A buffer on loan from the pool, returned when destroyed.
+  class buffer
+  {
+  public:
+    buffer() = default;
+    buffer(buffer&& other) noexcept { swap(other); }
+    buffer& operator=(buffer&& other) noexcept
+    {
+      buffer(std::move(other)).swap(*this);
+      return *this;
+    }
+    ~buffer() { release(); }
+
+    char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+    /// Give the memory back to the pool now.
+    void release();
+
+  private:
+    friend class buffer_pool;
+    buffer(buffer_pool* pool, char* data, std::size_t size)
+      : pool_(pool), data_(data), size_(size) {}
+    void swap(buffer& other) noexcept;
+
+    buffer_pool* pool_ = nullptr;
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+  };
+
+  /// Borrow a buffer of at least size bytes (capped at the largest class).
+  buffer acquire(std::size_t size);
+
+  /// The smallest and largest buffers handed out.
+  std::size_t min_size() const { return min_size_; }
+  std::size_t max_size() const { return max_size_; }
+
+  /// Bytes obtained from the system and bytes currently on loan.
+  std::size_t reserved() const { return reserved_; }
+  std::size_t in_use() const { return in_use_; }
+
+private:
+  void put_back(char* data, std::size_t size);
+  std::size_t class_index(std::size_t size) const;
+
+  std::size_t min_size_;
+  std::size_t max_size_;
+  std::size_t slab_bytes_;
+
+  /// Free buffers per size class, and every slab for freeing at the end.
+  std::vector<std::vector<char*>> free_;
+  std::vector<std::unique_ptr<char[]>> slabs_;
+
+  std::size_t reserved_ = 0;
+  std::size_t in_use_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_BUFFER_POOL_HPP
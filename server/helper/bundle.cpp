@@ -0,0 +1,270 @@
+#include "bundle.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "file_cache.hpp"
+#include "file_reader.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+enum { tar_block = 512 };
+
+/// Write value as a zero-padded octal number of width - 1 digits and a
+/// terminating NUL, as tar headers have it.
+void put_octal(char* field, std::size_t width, std::uint64_t value)
+{
+  std::snprintf(field, width, "%0*llo", static_cast<int>(width - 1),
+      static_cast<unsigned long long>(value));
+}
+
+/// A delimiter that does not occur in the parts, with overwhelming
+/// likelihood.
+std::string make_boundary()
+{
+  thread_local std::mt19937_64 random{ std::random_device()() };
+  char text[40];
+  std::snprintf(text, sizeof(text), "bundle-%016llx",
+      static_cast<unsigned long long>(random()));
+  return text;
+}
+
+} // namespace
+
+bundle::bundle(file_reader& reader, file_cache* cache, format fmt,
+    std::vector<part> parts)
+  : reader_(reader),
+    cache_(cache),
+    fmt_(fmt),
+    parts_(std::move(parts))
+{
+  init();
+}
+
+bundle::bundle(file_reader& reader, std::shared_ptr<const void> archive,
+    format fmt, std::vector<part> parts)
+  : reader_(reader),
+    cache_(nullptr),
+    archive_(std::move(archive)),
+    fmt_(fmt),
+    parts_(std::move(parts))
+{
+  init();
+}
+
+void bundle::init()
+{
+  if (fmt_ == multipart)
+    boundary_ = make_boundary();
+  for (std::size_t i = 0; i < parts_.size(); ++i)
+    content_length_ += make_head(i).size() + parts_[i].size
+        + make_trailer(i).size();
+  content_length_ += make_head(parts_.size()).size();
+  head_ = make_head(0);
+}
+
+std::string bundle::content_type() const
+{
+  if (fmt_ == tar)
+    return "application/x-tar";
+  return "multipart/mixed; boundary=" + boundary_;
+}
+
+bool bundle::fits_tar(const std::string& name)
+{
+  if (name.size() <= 100)
+    return true;
+  // The prefix ends at a '/', which is not stored.
+  std::size_t slash = name.find('/', name.size() - 101);
+  return slash != std::string::npos && slash <= 155
+      && name.size() - slash - 1 <= 100 && slash + 1 < name.size();
+}
+
+std::string bundle::make_head(std::size_t i) const
+{
+  if (fmt_ == multipart)
+  {
+    if (i == parts_.size())
+      return "--" + boundary_ + "--\r\n";
+    const part& p = parts_[i];
+    return "--" + boundary_ + "\r\n"
+        "Content-Type: " + p.content_type + "\r\n"
+        "Content-Location: " + p.name + "\r\n"
+        "Content-Length: " + std::to_string(p.size) + "\r\n"
+        "\r\n";
+  }
+
+  // Two zero blocks end the archive.
+  if (i == parts_.size())
+    return std::string(2 * tar_block, '\0');
+
+  // A ustar header. The names have been checked with fits_tar().
+  const part& p = parts_[i];
+  std::string block(tar_block, '\0');
+  char* h = &block[0];
+  if (p.name.size() <= 100)
+    std::memcpy(h, p.name.data(), p.name.size());
+  else
+  {
+    std::size_t slash = p.name.find('/', p.name.size() - 101);
+    std::memcpy(h + 345, p.name.data(), slash);
+    std::memcpy(h, p.name.data() + slash + 1, p.name.size() - slash - 1);
+  }
+  put_octal(h + 100, 8, 0644);
+  put_octal(h + 108, 8, 0);
+  put_octal(h + 116, 8, 0);
+  put_octal(h + 124, 12, p.size);
+  put_octal(h + 136, 12, static_cast<std::uint64_t>(p.mtime));
+  h[156] = '0';
+  std::memcpy(h + 257, "ustar", 6);
+  std::memcpy(h + 263, "00", 2);
+  // The checksum is taken with its own field as spaces.
+  std::memset(h + 148, ' ', 8);
+  unsigned sum = 0;
+  for (char c : block)
+    sum += static_cast<unsigned char>(c);
+  std::snprintf(h + 148, 8, "%06o", sum);
+  h[155] = ' ';
+  return block;
+}
+
+std::string bundle::make_trailer(std::size_t i) const
+{
+  if (fmt_ == multipart)
+    return "\r\n";
+  return std::string((tar_block - parts_[i].size % tar_block) % tar_block,
+      '\0');
+}
+
+void bundle::async_read_some(boost::asio::mutable_buffer buffer,
+    body_handler handler)
+{
+  std::size_t n = fill(buffer);
+  if (n > 0 || finished())
+  {
+    boost::asio::post(reader_.get_io_context(), [handler, n]()
+        { handler(boost::system::error_code(), n); });
+    return;
+  }
+  load(buffer, std::move(handler));
+}
+
+std::size_t bundle::fill(boost::asio::mutable_buffer buffer)
+{
+  char* out = static_cast<char*>(buffer.data());
+  std::size_t n = 0;
+  while (n < buffer.size() && !finished())
+  {
+    std::string_view piece;
+    if (phase_ == head_phase)
+      piece = head_;
+    else if (phase_ == trailer_phase)
+      piece = trailer_;
+    else if (content_owner_)
+      piece = content_;
+    else
+      break;
+    std::size_t take = std::min(buffer.size() - n, piece.size() - offset_);
+    std::memcpy(out + n, piece.data() + offset_, take);
+    n += take;
+    offset_ += take;
+    if (offset_ == piece.size())
+      advance();
+  }
+  return n;
+}
+
+void bundle::advance()
+{
+  offset_ = 0;
+  switch (phase_)
+  {
+  case head_phase:
+    if (index_ == parts_.size())
+      ++index_;
+    else if (parts_[index_].size == 0)
+    {
+      phase_ = trailer_phase;
+      trailer_ = make_trailer(index_);
+    }
+    else
+    {
+      phase_ = content_phase;
+      if (archive_)
+      {
+        content_ = parts_[index_].body;
+        content_owner_ = archive_;
+      }
+    }
+    break;
+  case content_phase:
+    content_ = std::string_view();
+    content_owner_.reset();
+    phase_ = trailer_phase;
+    trailer_ = make_trailer(index_);
+    break;
+  case trailer_phase:
+    ++index_;
+    phase_ = head_phase;
+    head_ = make_head(index_);
+    break;
+  }
+}
+
+void bundle::load(boost::asio::mutable_buffer buffer, body_handler handler)
+{
+  auto self = shared_from_this();
+  auto loaded = [self, buffer, handler](const boost::system::error_code& ec,
+      std::shared_ptr<const std::string> content)
+  {
+    // The cache may complete within async_get; don't call back from
+    // within async_read_some.
+    boost::asio::post(self->reader_.get_io_context(),
+        [self, buffer, handler, ec, content]()
+        {
+          if (ec)
+          {
+            handler(ec, 0);
+            return;
+          }
+          if (content->size() != self->parts_[self->index_].size)
+          {
+            // Changed since it was measured for the Content-Length.
+            handler(boost::asio::error::message_size, 0);
+            return;
+          }
+          self->content_ = *content;
+          self->content_owner_ = content;
+          handler(boost::system::error_code(), self->fill(buffer));
+        });
+  };
+
+  const std::string& path = parts_[index_].path;
+  if (cache_)
+  {
+    cache_->async_get(path,
+        [loaded](const boost::system::error_code& ec,
+          std::shared_ptr<const file_cache::file> file)
+        {
+          if (ec)
+            loaded(ec, nullptr);
+          else
+            loaded(ec, std::shared_ptr<const std::string>(file,
+                  &file->content));
+        });
+    return;
+  }
+  reader_.async_read(path,
+      [loaded](const boost::system::error_code& ec, std::string content)
+      {
+        loaded(ec, ec ? nullptr
+            : std::make_shared<const std::string>(std::move(content)));
+      });
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,120 @@
+#ifndef HTTP_BUNDLE_HPP
+#define HTTP_BUNDLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "body_stream.hpp"
+
+namespace http {
+namespace server {
+
+class file_cache;
+class file_reader;
+
+/// Several files sent as one reply body, either as a multipart/mixed
+/// document or as an uncompressed tar archive. The files are read one at a
+/// time, from the file cache if there is one, and copied straight into the
+/// consumer's buffers, so at most one file is held at once. Files from an
+/// archive are already in memory and are copied from there.
+///
+/// The length of the whole body is known up front from the files' sizes.
+/// A file whose size has changed by the time it is read fails the stream,
+/// since the body can then no longer match its Content-Length.
+class bundle : public body_stream, public std::enable_shared_from_this<bundle>
+{
+public:
+  bundle(const bundle&) = delete;
+  bundle& operator=(const bundle&) = delete;
+
+  enum format { multipart, tar };
+
+  /// One file: where it is read from, the name it is given in the bundle,
+  /// and what stat said about it. For a file from an archive, body holds
+  /// its bytes and path is unused.
+  struct part
+  {
+    std::string path;
+    std::string name;
+    std::string content_type;
+    std::uint64_t size;
+    std::time_t mtime;
+    std::string_view body;
+  };
+
+  /// Bundle the given parts, reading them through the cache if it is not
+  /// null and through the reader otherwise.
+  bundle(file_reader& reader, file_cache* cache, format fmt,
+      std::vector<part> parts);
+
+  /// Bundle parts whose bodies are in the archive, which is kept alive
+  /// until the bundle is done with.
+  bundle(file_reader& reader, std::shared_ptr<const void> archive,
+      format fmt, std::vector<part> parts);
+
+  /// The Content-Type and Content-Length of the whole body.
+  std::string content_type() const;
+  std::uint64_t content_length() const { return content_length_; }
+
+  void async_read_some(boost::asio::mutable_buffer buffer,
+      body_handler handler) override;
+
+  /// Check if a name can be stored in a tar header: at most 100 bytes, or
+  /// up to 255 bytes if it can be split at a '/' into a prefix of at most
+  /// 155 and a name of at most 100.
+  static bool fits_tar(const std::string& name);
+
+private:
+  enum phase { head_phase, content_phase, trailer_phase };
+
+  /// Work out the length of the whole body and the first head.
+  void init();
+
+  /// The bytes before part i: its delimiter and headers, or its tar
+  /// header. For i == parts_.size(), the end of the bundle.
+  std::string make_head(std::size_t i) const;
+
+  /// The bytes after part i's content.
+  std::string make_trailer(std::size_t i) const;
+
+  /// Copy as much as is available into buffer, stopping at a file that
+  /// has not been read yet.
+  std::size_t fill(boost::asio::mutable_buffer buffer);
+
+  /// Move on to the next piece of the body.
+  void advance();
+
+  bool finished() const { return index_ > parts_.size(); }
+
+  /// Read the current part's file, then fill buffer.
+  void load(boost::asio::mutable_buffer buffer, body_handler handler);
+
+  file_reader& reader_;
+  file_cache* cache_;
+  std::shared_ptr<const void> archive_;
+  format fmt_;
+  std::vector<part> parts_;
+  std::string boundary_;
+  std::uint64_t content_length_ = 0;
+
+  /// Where the stream is: the part, the piece of it, and the offset into
+  /// that piece.
+  std::size_t index_ = 0;
+  phase phase_ = head_phase;
+  std::size_t offset_ = 0;
+  std::string head_;
+  std::string_view content_;
+  std::shared_ptr<const void> content_owner_;
+  std::string trailer_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_BUNDLE_HPP
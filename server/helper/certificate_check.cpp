@@ -0,0 +1,87 @@
+#include "certificate_check.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// ServerHello, the handshake framing, CertificateVerify and Finished,
+/// roughly, with a 2048-bit RSA signature.
+const std::size_t handshake_overhead = 1000;
+
+/// Per certificate in the Certificate message: its 3-byte length and, in
+/// TLS 1.3, an empty extensions block.
+const std::size_t per_certificate_overhead = 5;
+
+struct x509_deleter
+{
+  void operator()(X509* x) const { X509_free(x); }
+};
+typedef std::unique_ptr<X509, x509_deleter> x509_ptr;
+
+std::string name_of(X509* x)
+{
+  char buffer[256];
+  X509_NAME_oneline(X509_get_subject_name(x), buffer, sizeof(buffer));
+  return buffer;
+}
+
+} // namespace
+
+chain_report check_chain(const std::string& certificate_chain,
+    std::size_t stapled_bytes)
+{
+  std::unique_ptr<BIO, decltype(&BIO_free)> file(
+      BIO_new_file(certificate_chain.c_str(), "r"), &BIO_free);
+  if (!file)
+    throw std::runtime_error("cannot read " + certificate_chain);
+  std::vector<x509_ptr> chain;
+  while (X509* x = PEM_read_bio_X509(file.get(), nullptr, nullptr, nullptr))
+    chain.emplace_back(x);
+  if (chain.empty())
+    throw std::runtime_error("no certificates in " + certificate_chain);
+
+  chain_report report;
+  report.certificates = chain.size();
+  for (std::size_t i = 0; i < chain.size(); ++i)
+  {
+    X509* x = chain[i].get();
+    int size = i2d_X509(x, nullptr);
+    report.bytes += size > 0 ? static_cast<std::size_t>(size) : 0;
+    if (i == 0)
+      continue;
+
+    std::string name = name_of(x);
+    if (X509_check_issued(x, x) == X509_V_OK)
+      report.warnings.push_back("sends the root " + name
+          + ", which clients must already have to trust it");
+    auto same = [x](const x509_ptr& other)
+    {
+      return X509_cmp(x, other.get()) == 0;
+    };
+    if (std::any_of(chain.begin(), chain.begin() + i, same))
+      report.warnings.push_back("sends " + name + " twice");
+    else if (X509_check_issued(x, chain[i - 1].get()) != X509_V_OK)
+      report.warnings.push_back("sends " + name + ", which does not sign "
+          + name_of(chain[i - 1].get()) + " before it");
+  }
+
+  report.first_flight = handshake_overhead + report.bytes
+      + report.certificates * per_certificate_overhead + stapled_bytes;
+  if (report.first_flight > initial_window_bytes)
+    report.warnings.push_back("the first flight of about "
+        + std::to_string(report.first_flight)
+        + " bytes is more than the initial congestion window of "
+        + std::to_string(initial_window_bytes)
+        + " bytes, costing clients a round trip");
+  return report;
+}
+
+} // namespace server
+} // namespace http
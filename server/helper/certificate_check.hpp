@@ -0,0 +1,42 @@
+#ifndef HTTP_CERTIFICATE_CHECK_HPP
+#define HTTP_CERTIFICATE_CHECK_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// What a certificate chain costs the server's first flight.
+struct chain_report
+{
+  /// The certificates in the file, leaf first, and their DER size in all.
+  std::size_t certificates = 0;
+  std::size_t bytes = 0;
+
+  /// The server's first flight with this chain, estimated: the
+  /// certificates, the stapled response and the rest of the handshake.
+  std::size_t first_flight = 0;
+
+  /// Anything that makes the chain bigger than it needs to be, one line
+  /// each.
+  std::vector<std::string> warnings;
+};
+
+/// The initial congestion window of RFC 6928: ten segments. A first flight
+/// bigger than this costs the client another round trip.
+enum { initial_window_bytes = 10 * 1460 };
+
+/// Check the PEM chain in certificate_chain for certificates the client
+/// does not need (the root, duplicates, ones that do not sign the one
+/// before them) and for a first flight beyond the initial window, given
+/// stapled_bytes of OCSP response. Throws std::runtime_error if the file
+/// cannot be read.
+chain_report check_chain(const std::string& certificate_chain,
+    std::size_t stapled_bytes = 0);
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_CERTIFICATE_CHECK_HPP
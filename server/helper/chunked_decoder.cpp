@@ -0,0 +1,120 @@
+#include "chunked_decoder.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace http {
+namespace server {
+
+namespace {
+
+int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+} // namespace
+
+chunked_decoder::result_type chunked_decoder::decode(char* data,
+    std::size_t size, std::size_t& decoded, std::size_t& consumed)
+{
+  std::size_t in = 0;
+  std::size_t out = 0;
+  while (in < size && state_ != finished_state)
+  {
+    if (state_ == chunk_data)
+    {
+      // The payload is moved, not parsed, a run at a time.
+      std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(
+            chunk_remaining_, size - in));
+      std::memmove(data + out, data + in, n);
+      in += n;
+      out += n;
+      chunk_remaining_ -= n;
+      if (chunk_remaining_ == 0)
+        state_ = data_cr;
+      continue;
+    }
+
+    char c = data[in++];
+    if (++line_length_ > max_line)
+      return bad;
+    switch (state_)
+    {
+    case size_start:
+    case size_digits:
+    {
+      int digit = hex_value(c);
+      if (digit >= 0)
+      {
+        // Sixteen hex digits are all a 64-bit size can hold.
+        if (chunk_remaining_ >> 60)
+          return bad;
+        chunk_remaining_ = chunk_remaining_ * 16 + digit;
+        state_ = size_digits;
+      }
+      else if (state_ == size_start)
+        return bad;
+      else if (c == ';' || c == ' ' || c == '\t')
+        state_ = extension;
+      else if (c == '\r')
+        state_ = size_lf;
+      else
+        return bad;
+      break;
+    }
+    case extension:
+      if (c == '\r')
+        state_ = size_lf;
+      break;
+    case size_lf:
+      if (c != '\n')
+        return bad;
+      line_length_ = 0;
+      state_ = chunk_remaining_ ? chunk_data : trailer_start;
+      break;
+    case data_cr:
+      if (c != '\r')
+        return bad;
+      state_ = data_lf;
+      break;
+    case data_lf:
+      if (c != '\n')
+        return bad;
+      line_length_ = 0;
+      state_ = size_start;
+      break;
+    case trailer_start:
+      state_ = c == '\r' ? final_lf : trailer_line;
+      break;
+    case trailer_line:
+      if (c == '\r')
+        state_ = trailer_lf;
+      break;
+    case trailer_lf:
+      if (c != '\n')
+        return bad;
+      line_length_ = 0;
+      state_ = trailer_start;
+      break;
+    case final_lf:
+      if (c != '\n')
+        return bad;
+      state_ = finished_state;
+      break;
+    default:
+      return bad;
+    }
+  }
+  decoded = out;
+  consumed = in;
+  return state_ == finished_state ? done : more;
+}
+
+} // namespace server
+} // namespace http
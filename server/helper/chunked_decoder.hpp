@@ -0,0 +1,55 @@
+#ifndef HTTP_CHUNKED_DECODER_HPP
+#define HTTP_CHUNKED_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+namespace server {
+
+/// Decodes a chunked request body (RFC 9112, section 7.1) in place, a
+/// piece at a time as it arrives. Chunk extensions and trailers are
+/// skipped.
+class chunked_decoder
+{
+public:
+  enum result_type { more, done, bad };
+
+  /// Decode the size bytes at data, moving the payload they contain to the
+  /// front of data. Sets decoded to the payload bytes and consumed to the
+  /// input bytes used, which is less than size only once the body is done.
+  result_type decode(char* data, std::size_t size, std::size_t& decoded,
+      std::size_t& consumed);
+
+  /// Whether the last chunk and the trailers have been seen.
+  bool finished() const { return state_ == finished_state; }
+
+private:
+  enum state
+  {
+    size_start,
+    size_digits,
+    extension,
+    size_lf,
+    chunk_data,
+    data_cr,
+    data_lf,
+    trailer_start,
+    trailer_line,
+    trailer_lf,
+    final_lf,
+    finished_state
+  };
+
+  /// The longest chunk-size line or trailer line accepted.
+  enum { max_line = 4096 };
+
+  state state_ = size_start;
+  std::uint64_t chunk_remaining_ = 0;
+  std::size_t line_length_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_CHUNKED_DECODER_HPP
@@ -0,0 +1,288 @@
+#include "directory_index.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs_watcher.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+void append_html_escaped(std::string& out, const std::string& s)
+{
+  for (char c : s)
+  {
+    switch (c)
+    {
+    case '&': out += "&amp;"; break;
+    case '<': out += "&lt;"; break;
+    case '>': out += "&gt;"; break;
+    case '"': out += "&quot;"; break;
+    default: out += c; break;
+    }
+  }
+}
+
+void append_url_encoded(std::string& out, const std::string& s)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  for (char ch : s)
+  {
+    unsigned char c = static_cast<unsigned char>(ch);
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'
+        || c == '~')
+      out += ch;
+    else
+    {
+      out += '%';
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+  }
+}
+
+void append_json_string(std::string& out, const std::string& s)
+{
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  for (char ch : s)
+  {
+    unsigned char c = static_cast<unsigned char>(ch);
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += ch;
+    }
+    else if (c < 0x20)
+    {
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+    else
+      out += ch;
+  }
+  out += '"';
+}
+
+} // namespace
+
+directory_index::directory_index(fs_watcher& watcher,
+    std::size_t max_directories)
+  : watcher_(watcher),
+    max_directories_(max_directories)
+{
+  watcher_.subscribe([this](const std::string& path, bool directory)
+      {
+        invalidate(path, directory);
+      });
+}
+
+bool directory_index::render(const std::string& path,
+    const std::string& url_path, format_type format, std::string& out)
+{
+  snapshot* s = find(path);
+  if (!s)
+    return false;
+  if (format == json)
+  {
+    if (s->json.empty())
+      render_json(*s, s->json);
+    out = s->json;
+  }
+  else
+  {
+    if (s->html.empty() || s->html_path != url_path)
+    {
+      render_html(*s, url_path, s->html);
+      s->html_path = url_path;
+    }
+    out = s->html;
+  }
+  return true;
+}
+
+bool directory_index::contains(const std::string& path,
+    const std::string& name)
+{
+  snapshot* s = find(path);
+  return s && s->entries.count(name) != 0;
+}
+
+directory_index::snapshot* directory_index::find(const std::string& path)
+{
+  std::string key = path;
+  while (key.size() > 1 && key.back() == '/')
+    key.pop_back();
+
+  auto it = snapshots_.find(key);
+  if (it != snapshots_.end())
+    return it->second.get();
+
+  // Unless the watcher sees changes to the names in the directory, the
+  // listing cannot be trusted later, so it is read into scratch space and
+  // used just this once. A change during the read is still reported, and
+  // re-stats the name it is about, so the snapshot cannot stay stale.
+  if (max_directories_ == 0 || !watcher_.covers(key + '/'))
+  {
+    scratch_ = snapshot();
+    return load(key, scratch_) ? &scratch_ : nullptr;
+  }
+
+  if (snapshots_.size() >= max_directories_)
+    snapshots_.clear();
+  std::unique_ptr<snapshot> s(new snapshot);
+  if (!load(key, *s))
+    return nullptr;
+  return (snapshots_[key] = std::move(s)).get();
+}
+
+bool directory_index::load(const std::string& path, snapshot& s)
+{
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    return false;
+  ++reads_;
+  int fd = dirfd(dir);
+  while (dirent* d = readdir(dir))
+  {
+    if (std::strcmp(d->d_name, ".") == 0 || std::strcmp(d->d_name, "..") == 0)
+      continue;
+    struct stat st;
+    if (fstatat(fd, d->d_name, &st, 0) != 0)
+      continue;
+    entry& e = s.entries[d->d_name];
+    e.directory = S_ISDIR(st.st_mode);
+    e.size = static_cast<std::uint64_t>(st.st_size);
+    e.mtime = static_cast<std::int64_t>(st.st_mtime);
+  }
+  closedir(dir);
+  return true;
+}
+
+void directory_index::refresh(const std::string& path,
+    const std::string& name, snapshot& s)
+{
+  struct stat st;
+  if (stat((path + '/' + name).c_str(), &st) != 0)
+  {
+    s.entries.erase(name);
+    return;
+  }
+  entry& e = s.entries[name];
+  e.directory = S_ISDIR(st.st_mode);
+  e.size = static_cast<std::uint64_t>(st.st_size);
+  e.mtime = static_cast<std::int64_t>(st.st_mtime);
+}
+
+void directory_index::invalidate(const std::string& path, bool directory)
+{
+  // The change is to a name in the parent's listing.
+  std::size_t slash = path.rfind('/');
+  if (slash != std::string::npos)
+  {
+    auto parent = snapshots_.find(path.substr(0, slash));
+    if (parent != snapshots_.end())
+    {
+      snapshot& s = *parent->second;
+      refresh(parent->first, path.substr(slash + 1), s);
+      s.html.clear();
+      s.json.clear();
+    }
+  }
+  if (!directory)
+    return;
+  // Anything below it may have changed too, unseen.
+  std::string prefix = path + '/';
+  for (auto i = snapshots_.begin(); i != snapshots_.end();)
+  {
+    if (i->first == path || i->first.compare(0, prefix.size(), prefix) == 0)
+      i = snapshots_.erase(i);
+    else
+      ++i;
+  }
+}
+
+void directory_index::render_html(const snapshot& s,
+    const std::string& url_path, std::string& out)
+{
+  out.clear();
+  out += "<html><head><title>Index of ";
+  append_html_escaped(out, url_path);
+  out += "</title></head><body><h1>Index of ";
+  append_html_escaped(out, url_path);
+  out += "</h1><hr><pre><a href=\"../\">../</a>\n";
+  // Directories first, then files, each by name. Hidden names are left
+  // out.
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (const auto& e : s.entries)
+    {
+      if (e.first[0] == '.' || e.second.directory != (pass == 0))
+        continue;
+      out += "<a href=\"";
+      append_url_encoded(out, e.first);
+      if (e.second.directory)
+        out += '/';
+      out += "\">";
+      append_html_escaped(out, e.first);
+      if (e.second.directory)
+        out += '/';
+      out += "</a>";
+      std::size_t width = e.first.size() + (e.second.directory ? 1 : 0);
+      out.append(width < 50 ? 51 - width : 1, ' ');
+
+      char line[64];
+      std::time_t mtime = static_cast<std::time_t>(e.second.mtime);
+      std::tm tm;
+      gmtime_r(&mtime, &tm);
+      std::size_t n =
+          std::strftime(line, sizeof(line), "%d-%b-%Y %H:%M", &tm);
+      out.append(line, n);
+      if (e.second.directory)
+        out += "                   -\n";
+      else
+      {
+        std::snprintf(line, sizeof(line), " %19llu\n",
+            static_cast<unsigned long long>(e.second.size));
+        out += line;
+      }
+    }
+  }
+  out += "</pre><hr></body></html>\n";
+}
+
+void directory_index::render_json(const snapshot& s, std::string& out)
+{
+  out.clear();
+  out += '[';
+  bool first = true;
+  for (const auto& e : s.entries)
+  {
+    if (e.first[0] == '.')
+      continue;
+    if (!first)
+      out += ',';
+    first = false;
+    out += "{\"name\":";
+    append_json_string(out, e.first);
+    out += e.second.directory
+        ? ",\"type\":\"directory\"" : ",\"type\":\"file\"";
+    out += ",\"size\":";
+    out += std::to_string(e.second.size);
+    out += ",\"mtime\":";
+    out += std::to_string(e.second.mtime);
+    out += '}';
+  }
+  out += "]\n";
+}
+
+} // namespace server
+} // namespace http
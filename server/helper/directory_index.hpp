@@ -0,0 +1,97 @@
+#ifndef HTTP_DIRECTORY_INDEX_HPP
+#define HTTP_DIRECTORY_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace http {
+namespace server {
+
+class fs_watcher;
+
+/// Directory listings for autoindex pages. Each directory is read once and
+/// then kept up to date from the changes the watcher reports, one entry at
+/// a time, so that serving a listing never touches the disk. Rendered
+/// pages are cached until the directory changes.
+///
+/// Not thread-safe: changes are handled on the watcher's io_context, which
+/// must be the one the requests are handled on. A directory the watcher
+/// does not cover is read afresh for every listing.
+class directory_index
+{
+public:
+  directory_index(const directory_index&) = delete;
+  directory_index& operator=(const directory_index&) = delete;
+
+  /// What is known about each name in a directory.
+  struct entry
+  {
+    bool directory = false;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+  };
+
+  enum format_type { html, json };
+
+  /// Keep at most max_directories listings; past that all are dropped and
+  /// reloaded as they are asked for. Zero turns the cache off.
+  explicit directory_index(fs_watcher& watcher,
+      std::size_t max_directories = 4096);
+
+  /// Set out to the listing of the directory at path, titled with the URL
+  /// path it was asked for by. Returns false if it cannot be read.
+  bool render(const std::string& path, const std::string& url_path,
+      format_type format, std::string& out);
+
+  /// Check if the directory at path has an entry with the given name.
+  bool contains(const std::string& path, const std::string& name);
+
+  /// Directories currently cached, and how many times one has been read.
+  std::size_t cached() const { return snapshots_.size(); }
+  std::size_t reads() const { return reads_; }
+
+private:
+  struct snapshot
+  {
+    std::map<std::string, entry> entries;
+    /// The last rendering of each format, and the URL path of the HTML one.
+    std::string html;
+    std::string html_path;
+    std::string json;
+  };
+
+  /// The snapshot of the directory at path, reading it if need be. Null if
+  /// it cannot be read.
+  snapshot* find(const std::string& path);
+
+  /// Read the directory at path into s. Returns false if it cannot be read.
+  bool load(const std::string& path, snapshot& s);
+
+  /// Stat one name in the directory, updating or removing its entry.
+  static void refresh(const std::string& path, const std::string& name,
+      snapshot& s);
+
+  /// Bring the listings up to date with a change the watcher reported.
+  void invalidate(const std::string& path, bool directory);
+
+  static void render_html(const snapshot& s, const std::string& url_path,
+      std::string& out);
+  static void render_json(const snapshot& s, std::string& out);
+
+  fs_watcher& watcher_;
+  std::size_t max_directories_;
+
+  std::unordered_map<std::string, std::unique_ptr<snapshot>> snapshots_;
+  /// Used for directories that are not cached.
+  snapshot scratch_;
+  std::size_t reads_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_DIRECTORY_INDEX_HPP
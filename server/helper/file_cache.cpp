@@ -0,0 +1,126 @@
+#include "file_cache.hpp"
+#include <cstdio>
+
+#include "file_reader.hpp"
+#include "fs_watcher.hpp"
+
+namespace http {
+namespace server {
+
+file_cache::file_cache(file_reader& reader, fs_watcher& watcher,
+    std::size_t max_bytes, std::size_t max_file_size)
+  : reader_(reader),
+    watcher_(watcher),
+    max_bytes_(max_bytes),
+    max_file_size_(max_file_size)
+{
+  watcher_.subscribe([this](const std::string& path, bool directory)
+      {
+        invalidate(path, directory);
+      });
+}
+
+void file_cache::async_get(const std::string& path, handler_type handler)
+{
+  auto it = entries_.find(path);
+  if (it != entries_.end())
+  {
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    handler(boost::system::error_code(), it->second.value);
+    return;
+  }
+
+  ++misses_;
+  auto waiting = waiting_.find(path);
+  if (waiting != waiting_.end())
+  {
+    waiting->second.push_back(std::move(handler));
+    return;
+  }
+  waiting_[path].push_back(std::move(handler));
+
+  // If the file changes while it is being read, what was read may be
+  // either version, so it is handed out but not kept. Any change in the
+  // meantime counts; it only costs a second read.
+  bool cacheable = watcher_.covers(path);
+  std::size_t batches = watcher_.batches();
+  reader_.async_read(path,
+      [this, path, cacheable, batches](
+        const boost::system::error_code& ec, std::string content)
+      {
+        std::shared_ptr<file> value;
+        if (!ec)
+        {
+          value = std::make_shared<file>();
+          value->content = std::move(content);
+          if (cacheable && value->content.size() <= max_file_size_
+              && watcher_.batches() == batches)
+          {
+            value->etag = make_etag(value->content);
+            insert(path, value);
+          }
+        }
+        std::vector<handler_type> handlers;
+        handlers.swap(waiting_[path]);
+        waiting_.erase(path);
+        for (const handler_type& h : handlers)
+          h(ec, value);
+      });
+}
+
+std::string file_cache::make_etag(const std::string& content)
+{
+  // FNV-1a, 64 bits.
+  std::uint64_t h = 14695981039346656037ull;
+  for (char c : content)
+    h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  char etag[24];
+  std::snprintf(etag, sizeof(etag), "\"%016llx\"",
+      static_cast<unsigned long long>(h));
+  return etag;
+}
+
+void file_cache::insert(const std::string& path,
+    std::shared_ptr<const file> value)
+{
+  auto old = entries_.find(path);
+  if (old != entries_.end())
+    erase(old);
+  bytes_ += value->content.size();
+  lru_.push_front(path);
+  entries_[path] = entry{ std::move(value), lru_.begin() };
+  while (bytes_ > max_bytes_ && !lru_.empty())
+    erase(entries_.find(lru_.back()));
+}
+
+void file_cache::erase(std::unordered_map<std::string, entry>::iterator it)
+{
+  bytes_ -= it->second.value->content.size();
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void file_cache::invalidate(const std::string& path, bool directory)
+{
+  auto it = entries_.find(path);
+  if (it != entries_.end())
+    erase(it);
+  if (!directory)
+    return;
+  std::string prefix = path + '/';
+  for (auto i = entries_.begin(); i != entries_.end();)
+  {
+    if (i->first.compare(0, prefix.size(), prefix) == 0)
+    {
+      bytes_ -= i->second.value->content.size();
+      lru_.erase(i->second.lru);
+      i = entries_.erase(i);
+    }
+    else
+      ++i;
+  }
+}
+
+} // namespace server
+} // namespace http
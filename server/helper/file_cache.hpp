@@ -0,0 +1,97 @@
+#ifndef HTTP_FILE_CACHE_HPP
+#define HTTP_FILE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace http {
+namespace server {
+
+class file_reader;
+class fs_watcher;
+
+/// File contents kept in memory, with their ETags, and dropped as soon as
+/// the fs_watcher reports the file changed. Files the watcher does not
+/// cover are read every time. Concurrent misses on one file share a single
+/// read, so a file invalidated under load is read once, not once per
+/// waiting request.
+///
+/// Not thread-safe: use one per io_context thread.
+class file_cache
+{
+public:
+  file_cache(const file_cache&) = delete;
+  file_cache& operator=(const file_cache&) = delete;
+
+  /// A file's content and entity tag, shared by every reply that uses it.
+  /// Only files that are kept get a tag; hashing the others on every
+  /// request would cost more than it saves.
+  struct file
+  {
+    std::string content;
+    std::string etag;
+  };
+
+  typedef std::function<void(const boost::system::error_code&,
+      std::shared_ptr<const file>)> handler_type;
+
+  /// Hold up to max_bytes of content, least recently used first out.
+  /// Files bigger than max_file_size are not kept.
+  file_cache(file_reader& reader, fs_watcher& watcher,
+      std::size_t max_bytes = 64 * 1024 * 1024,
+      std::size_t max_file_size = 1024 * 1024);
+
+  /// Get the file at path. A hit completes within this call; a miss when
+  /// the reader completes.
+  void async_get(const std::string& path, handler_type handler);
+
+  /// The entity tag for some content: a hash of it, so that it survives
+  /// restarts and is the same for every server with the same files.
+  static std::string make_etag(const std::string& content);
+
+  std::size_t hits() const { return hits_; }
+  std::size_t misses() const { return misses_; }
+  std::size_t entries() const { return entries_.size(); }
+  std::size_t bytes() const { return bytes_; }
+
+private:
+  struct entry
+  {
+    std::shared_ptr<const file> value;
+    std::list<std::string>::iterator lru;
+  };
+
+  void insert(const std::string& path, std::shared_ptr<const file> value);
+  void erase(std::unordered_map<std::string, entry>::iterator it);
+
+  /// Drop path, or everything under it if it is a directory.
+  void invalidate(const std::string& path, bool directory);
+
+  file_reader& reader_;
+  fs_watcher& watcher_;
+  std::size_t max_bytes_;
+  std::size_t max_file_size_;
+
+  std::unordered_map<std::string, entry> entries_;
+  /// Paths from most to least recently used.
+  std::list<std::string> lru_;
+  std::size_t bytes_ = 0;
+
+  /// Requests waiting for a read already under way, by path.
+  std::unordered_map<std::string, std::vector<handler_type>> waiting_;
+
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_FILE_CACHE_HPP
@@ -0,0 +1,621 @@
+#include "file_reader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+boost::system::error_code errno_code(int error)
+{
+  return boost::system::error_code(error, boost::system::system_category());
+}
+
+} // namespace
+
+/// Minimal io_uring driver, talking to the kernel through the raw system
+/// calls so that no liburing is needed. Each read is an openat followed by
+/// as many reads as it takes to fill a buffer of the file's size, and each
+/// stat a single statx. Completions are signalled through an eventfd
+/// watched by the io_context.
+class file_reader::uring
+{
+public:
+  explicit uring(boost::asio::io_context& io_context)
+    : event_descriptor_(io_context)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, queue_depth, &params));
+    if (ring_fd_ < 0)
+      throw boost::system::system_error(errno_code(errno), "io_uring_setup");
+
+    try
+    {
+      map_rings(params);
+      probe_opcodes();
+
+      int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (event_fd < 0)
+        throw boost::system::system_error(errno_code(errno), "eventfd");
+      event_descriptor_.assign(event_fd);
+      if (::syscall(__NR_io_uring_register, ring_fd_,
+            IORING_REGISTER_EVENTFD, &event_fd, 1) < 0)
+        throw boost::system::system_error(errno_code(errno),
+            "io_uring_register");
+    }
+    catch (...)
+    {
+      unmap_rings();
+      ::close(ring_fd_);
+      throw;
+    }
+
+    wait_completions();
+  }
+
+  ~uring()
+  {
+    // The kernel may still be writing into the buffers of in-flight reads,
+    // so wait for them before releasing anything.
+    while (!operations_.empty() && in_flight_ > 0)
+    {
+      if (::syscall(__NR_io_uring_enter, ring_fd_, 0, in_flight_,
+            IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+        break;
+      reap(false);
+    }
+    for (operation* op : operations_)
+    {
+      if (op->fd >= 0)
+        ::close(op->fd);
+      delete op;
+    }
+    boost::system::error_code ignored_ec;
+    event_descriptor_.close(ignored_ec);
+    unmap_rings();
+    ::close(ring_fd_);
+  }
+
+  void async_read(const std::string& path, handler_type handler)
+  {
+    operation* op = new operation;
+    op->path = path;
+    op->handler = std::move(handler);
+    operations_.insert(op);
+    if (!submit_open(op))
+      backlog_.push_back(op);
+  }
+
+  void async_stat(std::vector<std::string> paths, stat_handler handler)
+  {
+    auto batch = std::make_shared<stat_batch>();
+    batch->status.resize(paths.size());
+    batch->left = paths.size();
+    batch->handler = std::move(handler);
+    if (paths.empty())
+    {
+      boost::asio::post(event_descriptor_.get_executor(),
+          [batch]()
+          {
+            batch->handler(boost::system::error_code(),
+                std::move(batch->status));
+          });
+      return;
+    }
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+      operation* op = new operation;
+      op->stage = operation::statting;
+      op->path = std::move(paths[i]);
+      op->batch = batch;
+      op->index = i;
+      operations_.insert(op);
+      if (!submit_statx(op))
+        backlog_.push_back(op);
+    }
+  }
+
+private:
+  enum { queue_depth = 256 };
+
+  /// The stats of one async_stat call, complete once none is left.
+  struct stat_batch
+  {
+    std::vector<file_status> status;
+    std::size_t left = 0;
+    boost::system::error_code ec;
+    stat_handler handler;
+  };
+
+  /// State of one file read, or of one stat in a batch.
+  struct operation
+  {
+    enum { opening, reading, statting } stage = opening;
+    std::string path;
+    handler_type handler;
+    std::string content;
+    std::size_t offset = 0;
+    int fd = -1;
+    std::shared_ptr<stat_batch> batch;
+    std::size_t index = 0;
+    struct statx stx;
+  };
+
+  void map_rings(const io_uring_params& params)
+  {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    single_mmap_ = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap_)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+    {
+      sq_ring_ = nullptr;
+      throw boost::system::system_error(errno_code(errno), "mmap");
+    }
+    if (single_mmap_)
+      cq_ring_ = sq_ring_;
+    else
+    {
+      cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED)
+      {
+        cq_ring_ = nullptr;
+        throw boost::system::system_error(errno_code(errno), "mmap");
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      throw boost::system::system_error(errno_code(errno), "mmap");
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  void unmap_rings()
+  {
+    if (sqes_)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+      ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_)
+      ::munmap(sq_ring_, sq_ring_size_);
+    sqes_ = nullptr;
+    sq_ring_ = cq_ring_ = nullptr;
+  }
+
+  /// Make sure the kernel knows the opcodes we use (openat, statx and read
+  /// need 5.6).
+  void probe_opcodes()
+  {
+    const std::size_t ops = 256;
+    std::vector<char> storage(
+        sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op));
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE,
+          probe, ops) < 0)
+      throw boost::system::system_error(errno_code(errno), "io_uring probe");
+    for (int opcode : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ})
+    {
+      if (opcode > probe->last_op
+          || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+        throw boost::system::system_error(
+            errno_code(EOPNOTSUPP), "io_uring opcode");
+    }
+  }
+
+  /// Get a free submission queue entry, or null if the queue is full.
+  io_uring_sqe* get_sqe()
+  {
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sq_entries_
+        || in_flight_ >= static_cast<unsigned>(queue_depth))
+      return nullptr;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+  }
+
+  /// Publish the entry obtained by get_sqe() and hand it to the kernel.
+  /// An entry the kernel did not take is withdrawn before failing, so that
+  /// a later submission does not pass it on for an operation long gone.
+  bool submit(io_uring_sqe* sqe, operation* op)
+  {
+    sqe->user_data = reinterpret_cast<__u64>(op);
+    unsigned tail = *sq_tail_;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    int error = EAGAIN;
+    for (;;)
+    {
+      long n = ::syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0);
+      if (n > 0)
+        break;
+      if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        continue;
+      if (n < 0)
+        error = errno;
+      break;
+    }
+    // Without SQPOLL the kernel only takes entries during io_uring_enter,
+    // so if the head has not moved, the entry is still ours.
+    if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail)
+    {
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      errno = error;
+      return false;
+    }
+    ++in_flight_;
+    return true;
+  }
+
+  bool submit_open(operation* op)
+  {
+    io_uring_sqe* sqe = get_sqe();
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<__u64>(op->path.c_str());
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    op->stage = operation::opening;
+    if (!submit(sqe, op))
+      complete(op, errno_code(errno));
+    return true;
+  }
+
+  bool submit_read(operation* op)
+  {
+    io_uring_sqe* sqe = get_sqe();
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = op->fd;
+    sqe->addr = reinterpret_cast<__u64>(&op->content[op->offset]);
+    sqe->len = static_cast<__u32>(op->content.size() - op->offset);
+    sqe->off = op->offset;
+    op->stage = operation::reading;
+    if (!submit(sqe, op))
+      complete(op, errno_code(errno));
+    return true;
+  }
+
+  bool submit_statx(operation* op)
+  {
+    io_uring_sqe* sqe = get_sqe();
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<__u64>(op->path.c_str());
+    sqe->len = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+    sqe->off = reinterpret_cast<__u64>(&op->stx);
+    if (!submit(sqe, op))
+      complete(op, errno_code(errno));
+    return true;
+  }
+
+  void wait_completions()
+  {
+    event_descriptor_.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [this](boost::system::error_code ec)
+        {
+          if (ec)
+            return;
+          std::uint64_t value;
+          while (::read(event_descriptor_.native_handle(), &value,
+                sizeof(value)) > 0)
+            ;
+          reap(true);
+          wait_completions();
+        });
+  }
+
+  /// Consume the completion queue. Handlers are only run if dispatch is set.
+  void reap(bool dispatch)
+  {
+    unsigned head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+    {
+      io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+      operation* op = reinterpret_cast<operation*>(cqe->user_data);
+      int result = cqe->res;
+      __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+      --in_flight_;
+      if (dispatch)
+        on_completion(op, result);
+    }
+    while (dispatch && !backlog_.empty()
+        && (backlog_.front()->stage == operation::statting
+          ? submit_statx(backlog_.front()) : submit_open(backlog_.front())))
+      backlog_.pop_front();
+  }
+
+  void on_completion(operation* op, int result)
+  {
+    if (result < 0)
+    {
+      complete(op, errno_code(-result));
+      return;
+    }
+
+    if (op->stage == operation::statting)
+    {
+      if (!S_ISREG(op->stx.stx_mode))
+      {
+        complete(op, errno_code(EISDIR));
+        return;
+      }
+      file_status& status = op->batch->status[op->index];
+      status.size = op->stx.stx_size;
+      status.mtime = static_cast<std::time_t>(op->stx.stx_mtime.tv_sec);
+      complete(op, boost::system::error_code());
+      return;
+    }
+
+    if (op->stage == operation::opening)
+    {
+      op->fd = result;
+      struct stat st;
+      if (::fstat(op->fd, &st) != 0)
+      {
+        complete(op, errno_code(errno));
+        return;
+      }
+      if (!S_ISREG(st.st_mode))
+      {
+        complete(op, errno_code(EISDIR));
+        return;
+      }
+      op->content.resize(static_cast<std::size_t>(st.st_size));
+    }
+    else if (result == 0)
+    {
+      // The file shrank while we were reading it.
+      op->content.resize(op->offset);
+    }
+    else
+    {
+      op->offset += static_cast<std::size_t>(result);
+    }
+
+    if (op->offset < op->content.size())
+    {
+      if (!submit_read(op))
+      {
+        // No room in the queue: finish the read on the next completion.
+        backlog_reads_.push_back(op);
+      }
+      return;
+    }
+    complete(op, boost::system::error_code());
+  }
+
+  void complete(operation* op, const boost::system::error_code& ec)
+  {
+    if (op->fd >= 0)
+      ::close(op->fd);
+    op->fd = -1;
+    operations_.erase(op);
+    if (op->batch)
+    {
+      // The first error is the one reported.
+      std::shared_ptr<stat_batch> batch = std::move(op->batch);
+      delete op;
+      if (ec && !batch->ec)
+        batch->ec = ec;
+      if (--batch->left == 0)
+        batch->handler(batch->ec, std::move(batch->status));
+    }
+    else
+    {
+      handler_type handler = std::move(op->handler);
+      std::string content = std::move(op->content);
+      delete op;
+      handler(ec, std::move(content));
+    }
+    while (!backlog_reads_.empty() && submit_read(backlog_reads_.front()))
+      backlog_reads_.pop_front();
+  }
+
+  int ring_fd_ = -1;
+  boost::asio::posix::stream_descriptor event_descriptor_;
+
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  std::size_t sq_ring_size_ = 0;
+  std::size_t cq_ring_size_ = 0;
+  std::size_t sqes_size_ = 0;
+  bool single_mmap_ = false;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* sq_array_ = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  /// Number of submitted entries whose completion has not been reaped yet.
+  unsigned in_flight_ = 0;
+
+  /// Opens that did not fit into the submission queue.
+  std::deque<operation*> backlog_;
+
+  /// Reads that did not fit into the submission queue.
+  std::deque<operation*> backlog_reads_;
+
+  /// All operations that have not completed yet.
+  std::unordered_set<operation*> operations_;
+};
+
+file_reader::file_reader(boost::asio::io_context& io_context,
+    backend_type backend, std::size_t threads)
+  : io_context_(io_context)
+{
+  if (backend == io_uring)
+  {
+    try
+    {
+      uring_.reset(new uring(io_context_));
+    }
+    catch (std::exception&)
+    {
+      // Kernel too old, io_uring disabled or blocked: use the thread pool.
+    }
+  }
+  if (!uring_)
+    pool_.reset(new boost::asio::thread_pool(threads ? threads : 1));
+}
+
+file_reader::~file_reader()
+{
+  if (pool_)
+    pool_->join();
+}
+
+file_reader::backend_type file_reader::backend() const
+{
+  return uring_ ? io_uring : thread_pool;
+}
+
+void file_reader::async_read(const std::string& path, handler_type handler)
+{
+  if (uring_)
+  {
+    uring_->async_read(path, std::move(handler));
+    return;
+  }
+
+  boost::asio::post(*pool_,
+      [this, path, handler]() mutable
+      {
+        std::string content;
+        boost::system::error_code ec = read_file(path, content);
+        boost::asio::post(io_context_,
+            [handler = std::move(handler), ec,
+              content = std::move(content)]() mutable
+            {
+              handler(ec, std::move(content));
+            });
+      });
+}
+
+void file_reader::async_stat(std::vector<std::string> paths,
+    stat_handler handler)
+{
+  if (uring_)
+  {
+    uring_->async_stat(std::move(paths), std::move(handler));
+    return;
+  }
+
+  boost::asio::post(*pool_,
+      [this, paths = std::move(paths), handler = std::move(handler)]() mutable
+      {
+        std::vector<file_status> status(paths.size());
+        boost::system::error_code ec;
+        for (std::size_t i = 0; i < paths.size() && !ec; ++i)
+          ec = stat_file(paths[i], status[i]);
+        boost::asio::post(io_context_,
+            [handler = std::move(handler), ec,
+              status = std::move(status)]() mutable
+            {
+              handler(ec, std::move(status));
+            });
+      });
+}
+
+boost::system::error_code file_reader::read_file(const std::string& path,
+    std::string& content)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errno_code(errno);
+
+  boost::system::error_code ec;
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+    ec = errno_code(errno);
+  else if (!S_ISREG(st.st_mode))
+    ec = errno_code(EISDIR);
+  else
+  {
+    content.resize(static_cast<std::size_t>(st.st_size));
+    std::size_t offset = 0;
+    while (offset < content.size())
+    {
+      ssize_t n = ::pread(fd, &content[offset], content.size() - offset,
+          static_cast<off_t>(offset));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+      {
+        ec = errno_code(errno);
+        break;
+      }
+      if (n == 0)
+        break;
+      offset += static_cast<std::size_t>(n);
+    }
+    content.resize(offset);
+  }
+  ::close(fd);
+  return ec;
+}
+
+boost::system::error_code file_reader::stat_file(const std::string& path,
+    file_status& status)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return errno_code(errno);
+  if (!S_ISREG(st.st_mode))
+    return errno_code(EISDIR);
+  status.size = static_cast<std::uint64_t>(st.st_size);
+  status.mtime = st.st_mtime;
+  return boost::system::error_code();
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,90 @@
+#ifndef HTTP_FILE_READER_HPP
+#define HTTP_FILE_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace http {
+namespace server {
+
+/// Reads whole files without blocking the io_context thread. When the kernel
+/// supports it the reads are submitted to an io_uring whose completions are
+/// reaped on the io_context; otherwise they run on a small thread pool. In
+/// both cases the completion handler is invoked on the io_context.
+class file_reader
+{
+public:
+  file_reader(const file_reader&) = delete;
+  file_reader& operator=(const file_reader&) = delete;
+
+  /// The mechanism used to perform the reads.
+  enum backend_type { thread_pool, io_uring };
+
+  /// Completion handler. The error is set if the file could not be read.
+  typedef std::function<void(const boost::system::error_code&, std::string)>
+      handler_type;
+
+  /// What async_stat finds out about one file.
+  struct file_status
+  {
+    std::uint64_t size = 0;
+    std::time_t mtime = 0;
+  };
+
+  /// Completion handler for async_stat, with one status per path. The error
+  /// is set if any of the paths is missing or not a regular file.
+  typedef std::function<void(const boost::system::error_code&,
+      std::vector<file_status>)> stat_handler;
+
+  /// Construct a reader delivering completions to the given io_context. If
+  /// io_uring is requested but not available the thread pool is used.
+  file_reader(boost::asio::io_context& io_context, backend_type backend,
+      std::size_t threads = 2);
+
+  ~file_reader();
+
+  /// The backend actually in use.
+  backend_type backend() const;
+
+  /// The io_context on which completion handlers are invoked.
+  boost::asio::io_context& get_io_context() { return io_context_; }
+
+  /// Start reading the file at the given path.
+  void async_read(const std::string& path, handler_type handler);
+
+  /// Start looking up the size and modification time of the regular files
+  /// at the given paths.
+  void async_stat(std::vector<std::string> paths, stat_handler handler);
+
+private:
+  class uring;
+
+  /// Read the file with blocking calls. Used by the thread pool backend.
+  static boost::system::error_code read_file(const std::string& path,
+      std::string& content);
+
+  /// Stat a regular file with a blocking call. Used by the thread pool
+  /// backend.
+  static boost::system::error_code stat_file(const std::string& path,
+      file_status& status);
+
+  /// The io_context on which handlers are invoked.
+  boost::asio::io_context& io_context_;
+
+  /// The io_uring backend, if in use.
+  std::unique_ptr<uring> uring_;
+
+  /// The pool used when io_uring is not available.
+  std::unique_ptr<boost::asio::thread_pool> pool_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_FILE_READER_HPP
@@ -0,0 +1,221 @@
+#include "fs_watcher.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Everything that can change what a path serves.
+const std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM
+    | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+    | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+bool is_below(const std::string& path, const std::string& dir)
+{
+  return path.size() > dir.size() && path[dir.size()] == '/'
+      && path.compare(0, dir.size(), dir) == 0;
+}
+
+} // namespace
+
+fs_watcher::fs_watcher(boost::asio::io_context& io_context,
+    clock::duration settle, clock::duration max_delay)
+  : inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+    descriptor_(io_context),
+    event_buffer_(65536),
+    settle_(settle),
+    max_delay_(max_delay),
+    settle_timer_(io_context)
+{
+  if (inotify_fd_ >= 0)
+  {
+    descriptor_.assign(inotify_fd_);
+    read_events();
+  }
+}
+
+fs_watcher::~fs_watcher() = default;
+
+bool fs_watcher::watch(const std::string& root)
+{
+  if (inotify_fd_ < 0)
+    return false;
+  std::string dir = root;
+  while (dir.size() > 1 && dir.back() == '/')
+    dir.pop_back();
+  roots_.push_back(dir);
+  add_tree(dir);
+  return directories_.count(dir) != 0;
+}
+
+bool fs_watcher::covers(const std::string& path) const
+{
+  std::size_t slash = path.rfind('/');
+  return slash != std::string::npos
+      && directories_.count(path.substr(0, slash)) != 0;
+}
+
+void fs_watcher::subscribe(listener l)
+{
+  listeners_.push_back(std::move(l));
+}
+
+void fs_watcher::add_tree(const std::string& root)
+{
+  std::vector<std::string> stack(1, root);
+  while (!stack.empty())
+  {
+    std::string dir = std::move(stack.back());
+    stack.pop_back();
+    if (directories_.count(dir))
+      continue;
+    // Watch before listing so that nothing created meanwhile is missed.
+    int watch = inotify_add_watch(inotify_fd_, dir.c_str(), watch_mask);
+    if (watch < 0)
+      continue;
+    watches_[watch] = dir;
+    directories_[dir] = watch;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+      continue;
+    while (dirent* e = readdir(d))
+    {
+      if (std::strcmp(e->d_name, ".") == 0
+          || std::strcmp(e->d_name, "..") == 0)
+        continue;
+      bool is_dir = e->d_type == DT_DIR;
+      if (e->d_type == DT_UNKNOWN)
+      {
+        struct stat st;
+        is_dir = fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+            && S_ISDIR(st.st_mode);
+      }
+      if (is_dir)
+        stack.push_back(dir + '/' + e->d_name);
+    }
+    closedir(d);
+  }
+}
+
+void fs_watcher::remove_tree(const std::string& dir)
+{
+  for (auto it = directories_.begin(); it != directories_.end();)
+  {
+    if (it->first == dir || is_below(it->first, dir))
+    {
+      inotify_rm_watch(inotify_fd_, it->second);
+      watches_.erase(it->second);
+      it = directories_.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void fs_watcher::read_events()
+{
+  descriptor_.async_read_some(boost::asio::buffer(event_buffer_),
+      [this](const boost::system::error_code& ec, std::size_t n)
+      {
+        if (ec == boost::asio::error::operation_aborted)
+          return;
+        if (!ec)
+          handle_events(event_buffer_.data(), n);
+        read_events();
+      });
+}
+
+void fs_watcher::handle_events(const char* data, std::size_t size)
+{
+  for (std::size_t offset = 0; offset + sizeof(inotify_event) <= size;)
+  {
+    const inotify_event* event =
+        reinterpret_cast<const inotify_event*>(data + offset);
+    offset += sizeof(inotify_event) + event->len;
+    ++events_;
+
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      // Events were lost, so anything may have changed.
+      for (const std::string& root : roots_)
+        changed(root, true);
+      continue;
+    }
+    auto w = watches_.find(event->wd);
+    if (w == watches_.end())
+      continue;
+    if (event->mask & IN_IGNORED)
+    {
+      directories_.erase(w->second);
+      watches_.erase(w);
+      continue;
+    }
+
+    std::string dir = w->second;
+    if (event->len == 0)
+    {
+      // The watched directory itself. Its parent reports it being moved
+      // or deleted too, unless it is a root.
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+      {
+        remove_tree(dir);
+        changed(dir, true);
+      }
+      continue;
+    }
+
+    std::string path = dir + '/' + event->name;
+    if (event->mask & IN_ISDIR)
+    {
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        remove_tree(path);
+      else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        add_tree(path);
+      changed(path, true);
+    }
+    else
+      changed(path, false);
+  }
+}
+
+void fs_watcher::changed(const std::string& path, bool directory)
+{
+  clock::time_point now = clock::now();
+  if (pending_.empty())
+    first_pending_ = now;
+  bool& pending = pending_[path];
+  pending = pending || directory;
+
+  // Wait for the burst to settle, but not for ever.
+  settle_timer_.expires_at(
+      std::min(now + settle_, first_pending_ + max_delay_));
+  settle_timer_.async_wait(
+      [this](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          apply();
+      });
+}
+
+void fs_watcher::apply()
+{
+  if (pending_.empty())
+    return;
+  ++batches_;
+  std::unordered_map<std::string, bool> batch;
+  batch.swap(pending_);
+  for (const auto& change : batch)
+    for (const listener& l : listeners_)
+      l(change.first, change.second);
+}
+
+} // namespace server
+} // namespace http
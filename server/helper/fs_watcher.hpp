@@ -0,0 +1,103 @@
+#ifndef HTTP_FS_WATCHER_HPP
+#define HTTP_FS_WATCHER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace http {
+namespace server {
+
+/// Watches directory trees with inotify and hands changes to subscribers in
+/// batches. Caches subscribe to changes instead of calling stat on every
+/// request, and compare batch counts to tell if anything changed while
+/// they were reading.
+///
+/// Changes are not applied as they arrive but in batches: a batch is
+/// applied once no event has come for the settle time, or at the latest
+/// max_delay after its first event. A deployment that rewrites a file many
+/// times, or many files at once, thus invalidates each file once rather
+/// than once per write.
+///
+/// Not thread-safe: events are handled on the io_context given.
+class fs_watcher
+{
+public:
+  fs_watcher(const fs_watcher&) = delete;
+  fs_watcher& operator=(const fs_watcher&) = delete;
+
+  typedef std::chrono::steady_clock clock;
+
+  /// Called once per changed path in each batch. If directory is set, the
+  /// whole tree under path has changed.
+  typedef std::function<void(const std::string& path, bool directory)>
+      listener;
+
+  explicit fs_watcher(boost::asio::io_context& io_context,
+      clock::duration settle = std::chrono::milliseconds(100),
+      clock::duration max_delay = std::chrono::seconds(1));
+
+  ~fs_watcher();
+
+  /// Watch root and every directory below it, including ones created
+  /// later. Returns false if root cannot be watched at all; directories
+  /// beyond the kernel's watch limit are left out.
+  bool watch(const std::string& root);
+
+  /// Check if changes to the file at path are seen, i.e. its directory is
+  /// watched. Only then may it be cached.
+  bool covers(const std::string& path) const;
+
+  /// Call l with every batch of changes.
+  void subscribe(listener l);
+
+  /// Events received and batches applied so far. A read that began and
+  /// ended with the same number of batches saw no change to any watched
+  /// file.
+  std::size_t events() const { return events_; }
+  std::size_t batches() const { return batches_; }
+
+private:
+  /// Add a watch for dir and for the directories below it.
+  void add_tree(const std::string& dir);
+  void remove_tree(const std::string& dir);
+
+  void read_events();
+  void handle_events(const char* data, std::size_t size);
+
+  /// Note a change and make sure the batch will be applied.
+  void changed(const std::string& path, bool directory);
+  void apply();
+
+  int inotify_fd_;
+  boost::asio::posix::stream_descriptor descriptor_;
+  std::vector<char> event_buffer_;
+  clock::duration settle_;
+  clock::duration max_delay_;
+  boost::asio::steady_timer settle_timer_;
+
+  /// The trees given to watch().
+  std::vector<std::string> roots_;
+
+  /// Watched directories, by watch descriptor and by path.
+  std::unordered_map<int, std::string> watches_;
+  std::unordered_map<std::string, int> directories_;
+
+  /// Changes waiting to be applied, and when the first of them came.
+  std::unordered_map<std::string, bool> pending_;
+  clock::time_point first_pending_;
+
+  std::vector<listener> listeners_;
+  std::size_t events_ = 0;
+  std::size_t batches_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_FS_WATCHER_HPP
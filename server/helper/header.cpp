@@ -0,0 +1,47 @@
+#include "header.hpp"
+#include <strings.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+struct known_name
+{
+  const char* name;
+  std::size_t size;
+  known_header id;
+} known_names[] =
+{
+  { "Host", 4, host_header },
+  { "Connection", 10, connection_header },
+  { "Range", 5, range_header },
+  { "If-Range", 8, if_range_header },
+  { "If-None-Match", 13, if_none_match_header },
+  { "If-Modified-Since", 17, if_modified_since_header },
+  { "Accept", 6, accept_header },
+  { "Accept-Encoding", 15, accept_encoding_header },
+  { "Content-Length", 14, content_length_header },
+  { "Content-Type", 12, content_type_header },
+  { "Transfer-Encoding", 17, transfer_encoding_header },
+  { "Expect", 6, expect_header },
+  { "Cache-Control", 13, cache_control_header },
+  { "User-Agent", 10, user_agent_header }
+};
+
+} // namespace
+
+known_header lookup_known_header(const char* name, std::size_t size)
+{
+  // Few names share a length, so the size check rejects almost everything
+  // before any characters are compared.
+  for (const known_name& k : known_names)
+  {
+    if (k.size == size && ::strncasecmp(k.name, name, size) == 0)
+      return k.id;
+  }
+  return known_header_count;
+}
+
+} // namespace server
+} // namespace http
@@ -1,7 +1,9 @@
 #ifndef HTTP_HEADER_HPP
 #define HTTP_HEADER_HPP
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 namespace http {
 namespace server {
@@ -12,7 +14,40 @@ struct header
   std::string value;
 };
 
+/// A header of an incoming request. The name and value refer to memory
+/// owned by the arena the request was parsed into.
+struct header_view
+{
+  std::string_view name;
+  std::string_view value;
+};
+
+/// Headers the server cares about. The parser interns them into a fixed slot
+/// table in the request so they can be found without scanning all headers.
+enum known_header
+{
+  host_header,
+  connection_header,
+  range_header,
+  if_range_header,
+  if_none_match_header,
+  if_modified_since_header,
+  accept_header,
+  accept_encoding_header,
+  content_length_header,
+  content_type_header,
+  transfer_encoding_header,
+  expect_header,
+  cache_control_header,
+  user_agent_header,
+  known_header_count
+};
+
+/// Map a header name to its slot, ignoring case. Returns known_header_count
+/// if the name is not one of the known headers.
+known_header lookup_known_header(const char* name, std::size_t size);
+
 } // namespace server
 } // namespace http
 
-#endif // HTTP_HEADER_HPP
\ No newline at end of file
+#endif // HTTP_HEADER_HPP
@@ -0,0 +1,261 @@
+#include "header_scanner.hpp"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_HEADER_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+namespace server {
+namespace header_scanner {
+
+namespace {
+
+/// Same classification as request_parser::is_char/is_ctl/is_tspecial.
+constexpr bool is_token(unsigned char c)
+{
+  if (c <= 32 || c >= 127)
+    return false;
+  switch (c)
+  {
+  case '(': case ')': case '<': case '>': case '@':
+  case ',': case ';': case ':': case '\\': case '"':
+  case '/': case '[': case ']': case '?': case '=':
+  case '{': case '}':
+    return false;
+  default:
+    return true;
+  }
+}
+
+constexpr bool is_ctl(unsigned char c)
+{
+  return c <= 31 || c == 127;
+}
+
+struct token_table
+{
+  bool token[256];
+
+  /// For the AVX2 lookup: bit h of low_nibble[l] is set if (h << 4 | l) is
+  /// a token. Only h < 8 can be set since tokens are 7-bit.
+  std::uint8_t low_nibble[16];
+
+  constexpr token_table() : token(), low_nibble()
+  {
+    for (int c = 0; c < 256; ++c)
+    {
+      token[c] = is_token(static_cast<unsigned char>(c));
+      if (token[c])
+        low_nibble[c & 0x0f] |= static_cast<std::uint8_t>(1 << (c >> 4));
+    }
+  }
+};
+
+constexpr token_table tokens;
+
+const char* scalar_non_token(const char* begin, const char* end)
+{
+  while (begin != end && tokens.token[static_cast<unsigned char>(*begin)])
+    ++begin;
+  return begin;
+}
+
+const char* scalar_ctl(const char* begin, const char* end)
+{
+  while (begin != end && !is_ctl(static_cast<unsigned char>(*begin)))
+    ++begin;
+  return begin;
+}
+
+const char* scalar_space_or_ctl(const char* begin, const char* end)
+{
+  while (begin != end && *begin != ' '
+      && !is_ctl(static_cast<unsigned char>(*begin)))
+    ++begin;
+  return begin;
+}
+
+#if defined(HTTP_HEADER_SCANNER_X86)
+
+__attribute__((target("sse2")))
+const char* sse2_non_token(const char* begin, const char* end)
+{
+  const __m128i low = _mm_set1_epi8(0x20);
+  const __m128i high = _mm_set1_epi8(0x7f);
+  static const char specials[] = "()<>@,;:\\\"/[]?={}";
+  while (end - begin >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    // Bytes >= 0x80 are negative, so the signed compare rejects them too.
+    __m128i bad = _mm_andnot_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high)),
+        _mm_set1_epi8(-1));
+    for (const char* s = specials; *s; ++s)
+      bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8(*s)));
+    int mask = _mm_movemask_epi8(bad);
+    if (mask)
+      return begin + __builtin_ctz(static_cast<unsigned>(mask));
+    begin += 16;
+  }
+  return scalar_non_token(begin, end);
+}
+
+__attribute__((target("sse2")))
+int sse2_ctl_mask(__m128i v)
+{
+  __m128i below_space =
+      _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+  __m128i del = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f));
+  return _mm_movemask_epi8(_mm_or_si128(below_space, del));
+}
+
+__attribute__((target("sse2")))
+const char* sse2_ctl(const char* begin, const char* end)
+{
+  while (end - begin >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    int mask = sse2_ctl_mask(v);
+    if (mask)
+      return begin + __builtin_ctz(static_cast<unsigned>(mask));
+    begin += 16;
+  }
+  return scalar_ctl(begin, end);
+}
+
+__attribute__((target("sse2")))
+const char* sse2_space_or_ctl(const char* begin, const char* end)
+{
+  while (end - begin >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    int mask = sse2_ctl_mask(v)
+        | _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    if (mask)
+      return begin + __builtin_ctz(static_cast<unsigned>(mask));
+    begin += 16;
+  }
+  return scalar_space_or_ctl(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* avx2_non_token(const char* begin, const char* end)
+{
+  // Classify each byte with two nibble lookups: the low nibble selects the
+  // set of allowed high nibbles, the high nibble selects its own bit.
+  const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(tokens.low_nibble)));
+  const __m256i high_table = _mm256_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+      1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  while (end - begin >= 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i hit = _mm256_and_si256(_mm256_shuffle_epi8(low_table, lo),
+        _mm256_shuffle_epi8(high_table, hi));
+    unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, zero)));
+    if (mask)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return sse2_non_token(begin, end);
+}
+
+__attribute__((target("avx2")))
+unsigned avx2_ctl_mask(__m256i v)
+{
+  __m256i below_space =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+  __m256i del = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f));
+  return static_cast<unsigned>(
+      _mm256_movemask_epi8(_mm256_or_si256(below_space, del)));
+}
+
+__attribute__((target("avx2")))
+const char* avx2_ctl(const char* begin, const char* end)
+{
+  while (end - begin >= 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    unsigned mask = avx2_ctl_mask(v);
+    if (mask)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return sse2_ctl(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* avx2_space_or_ctl(const char* begin, const char* end)
+{
+  while (end - begin >= 32)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    unsigned mask = avx2_ctl_mask(v)
+        | static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '))));
+    if (mask)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return sse2_space_or_ctl(begin, end);
+}
+
+#endif // defined(HTTP_HEADER_SCANNER_X86)
+
+typedef const char* (*scan_function)(const char*, const char*);
+
+struct dispatch_table
+{
+  const char* name;
+  scan_function non_token;
+  scan_function ctl;
+  scan_function space_or_ctl;
+};
+
+dispatch_table select_implementation()
+{
+#if defined(HTTP_HEADER_SCANNER_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return { "avx2", avx2_non_token, avx2_ctl, avx2_space_or_ctl };
+  if (__builtin_cpu_supports("sse2"))
+    return { "sse2", sse2_non_token, sse2_ctl, sse2_space_or_ctl };
+#endif
+  return { "scalar", scalar_non_token, scalar_ctl, scalar_space_or_ctl };
+}
+
+const dispatch_table selected = select_implementation();
+
+} // namespace
+
+const char* find_non_token(const char* begin, const char* end)
+{
+  return selected.non_token(begin, end);
+}
+
+const char* find_ctl(const char* begin, const char* end)
+{
+  return selected.ctl(begin, end);
+}
+
+const char* find_space_or_ctl(const char* begin, const char* end)
+{
+  return selected.space_or_ctl(begin, end);
+}
+
+const char* implementation()
+{
+  return selected.name;
+}
+
+} // namespace header_scanner
+} // namespace server
+} // namespace http
@@ -0,0 +1,27 @@
+#ifndef HTTP_HEADER_SCANNER_HPP
+#define HTTP_HEADER_SCANNER_HPP
+
+namespace http {
+namespace server {
+namespace header_scanner {
+
+/// Find the first byte that is not an HTTP token character (a CHAR that is
+/// neither a CTL nor a tspecial). Returns end if there is none.
+const char* find_non_token(const char* begin, const char* end);
+
+/// Find the first HTTP control character. Returns end if there is none.
+const char* find_ctl(const char* begin, const char* end);
+
+/// Find the first space or HTTP control character. Returns end if there is
+/// none.
+const char* find_space_or_ctl(const char* begin, const char* end);
+
+/// Name of the implementation selected for this CPU: "avx2", "sse2" or
+/// "scalar".
+const char* implementation();
+
+} // namespace header_scanner
+} // namespace server
+} // namespace http
+
+#endif // HTTP_HEADER_SCANNER_HPP
@@ -10,10 +10,12 @@ struct mapping
   const char* mime_type;
 } mappings[] =
 {
+  { "bin", "application/octet-stream" },
   { "gif", "image/gif" },
   { "htm", "text/html" },
   { "html", "text/html" },
   { "jpg", "image/jpeg" },
+  { "json", "application/json" },
   { "png", "image/png" }
 };
 
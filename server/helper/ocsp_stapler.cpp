@@ -0,0 +1,402 @@
+#include "ocsp_stapler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// How often the response file is checked for changes, how long a fetch
+/// may take, how soon a failed one is tried again, and the least time
+/// between fetches however short-lived the responses are.
+const std::chrono::seconds file_check_interval(5);
+const std::chrono::seconds fetch_timeout(10);
+const std::chrono::seconds retry_delay(60);
+const std::chrono::seconds min_refresh(60);
+
+/// Responders' replies are a few kilobytes; anything much bigger is wrong.
+const std::size_t max_reply_size = 64 * 1024;
+
+/// A response without a next update is used for this long.
+const std::time_t default_validity = 3600;
+
+/// Clock skew allowed when checking a response's validity, in seconds.
+const long max_skew = 300;
+
+std::time_t to_time(const ASN1_GENERALIZEDTIME* t)
+{
+  struct tm tm = {};
+  if (!t || ASN1_TIME_to_tm(t, &tm) != 1)
+    return 0;
+  return ::timegm(&tm);
+}
+
+std::int64_t mtime_ns(const struct stat& st)
+{
+  return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+ocsp_stapler::ocsp_stapler(boost::asio::io_context& io_context,
+    const std::string& certificate_chain, const std::string& response_file,
+    bool fetch)
+  : response_file_(response_file),
+    fetch_(fetch),
+    file_timer_(io_context),
+    fetch_timer_(io_context),
+    resolver_(io_context),
+    socket_(io_context),
+    deadline_(io_context)
+{
+  std::unique_ptr<BIO, decltype(&BIO_free)> file(
+      BIO_new_file(certificate_chain.c_str(), "r"), &BIO_free);
+  if (!file)
+    throw std::runtime_error("cannot read " + certificate_chain);
+  certificate_.reset(PEM_read_bio_X509(file.get(), nullptr, nullptr, nullptr));
+  while (X509* x = PEM_read_bio_X509(file.get(), nullptr, nullptr, nullptr))
+  {
+    x509_ptr candidate(x);
+    if (!issuer_ && certificate_
+        && X509_check_issued(x, certificate_.get()) == X509_V_OK)
+      issuer_ = std::move(candidate);
+  }
+  if (!certificate_ || !issuer_)
+    throw std::runtime_error("OCSP stapling needs the certificate's issuer"
+        " after it in " + certificate_chain);
+
+  if (fetch_)
+  {
+    STACK_OF(OPENSSL_STRING)* urls = X509_get1_ocsp(certificate_.get());
+    std::string url = urls && sk_OPENSSL_STRING_num(urls) > 0
+        ? sk_OPENSSL_STRING_value(urls, 0) : "";
+    X509_email_free(urls);
+    char* host = nullptr;
+    char* port = nullptr;
+    char* path = nullptr;
+    int tls = 0;
+    if (url.empty() || OCSP_parse_url(url.c_str(), &host, &port, &path,
+          &tls) != 1)
+      throw std::runtime_error("the certificate in " + certificate_chain
+          + " names no OCSP responder");
+    host_ = host;
+    port_ = port;
+    path_ = path;
+    OPENSSL_free(host);
+    OPENSSL_free(port);
+    OPENSSL_free(path);
+    if (tls)
+      throw std::runtime_error("HTTPS OCSP responders are not supported: "
+          + url);
+  }
+
+  if (!response_file_.empty())
+  {
+    check_file();
+    schedule_file_check();
+  }
+  if (fetch_)
+  {
+    // Fetch now unless the file had a response good for a while yet.
+    std::time_t now = std::time(nullptr);
+    std::time_t refresh = this_update_ + (next_update_ - this_update_) / 2;
+    schedule_fetch(response_.empty() || refresh <= now
+        ? std::chrono::steady_clock::duration::zero()
+        : std::chrono::seconds(refresh - now));
+  }
+}
+
+ocsp_stapler::~ocsp_stapler() = default;
+
+void ocsp_stapler::attach(boost::asio::ssl::context& context)
+{
+  SSL_CTX_set_tlsext_status_cb(context.native_handle(),
+      &ocsp_stapler::status_callback);
+  SSL_CTX_set_tlsext_status_arg(context.native_handle(), this);
+}
+
+int ocsp_stapler::status_callback(SSL* ssl, void* arg)
+{
+  // Only called when the client asked for a staple.
+  ocsp_stapler* self = static_cast<ocsp_stapler*>(arg);
+  if (self->response_.empty() || std::time(nullptr) >= self->next_update_)
+    return SSL_TLSEXT_ERR_NOACK;
+  // OpenSSL takes ownership of the copy.
+  unsigned char* copy = static_cast<unsigned char*>(
+      OPENSSL_malloc(self->response_.size()));
+  if (!copy)
+    return SSL_TLSEXT_ERR_NOACK;
+  std::memcpy(copy, self->response_.data(), self->response_.size());
+  SSL_set_tlsext_status_ocsp_resp(ssl, copy,
+      static_cast<long>(self->response_.size()));
+  return SSL_TLSEXT_ERR_OK;
+}
+
+bool ocsp_stapler::accept(const std::string& der, const std::string& source)
+{
+  auto reject = [&source](const std::string& why)
+  {
+    std::cerr << "Not stapling the OCSP response from " << source << ": "
+              << why << "\n";
+    return false;
+  };
+
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(der.data());
+  std::unique_ptr<OCSP_RESPONSE, decltype(&OCSP_RESPONSE_free)> response(
+      d2i_OCSP_RESPONSE(nullptr, &p, static_cast<long>(der.size())),
+      &OCSP_RESPONSE_free);
+  if (!response)
+    return reject("not an OCSP response");
+  int status = OCSP_response_status(response.get());
+  if (status != OCSP_RESPONSE_STATUS_SUCCESSFUL)
+    return reject(std::string("the responder said ")
+        + OCSP_response_status_str(status));
+  std::unique_ptr<OCSP_BASICRESP, decltype(&OCSP_BASICRESP_free)> basic(
+      OCSP_response_get1_basic(response.get()), &OCSP_BASICRESP_free);
+  if (!basic)
+    return reject("not a basic response");
+
+  // Signed by the issuer, or by a responder the issuer has delegated to.
+  auto free_stack = [](STACK_OF(X509)* s) { sk_X509_free(s); };
+  std::unique_ptr<STACK_OF(X509), decltype(free_stack)> certificates(
+      sk_X509_new_null(), free_stack);
+  sk_X509_push(certificates.get(), issuer_.get());
+  std::unique_ptr<X509_STORE, decltype(&X509_STORE_free)> store(
+      X509_STORE_new(), &X509_STORE_free);
+  X509_STORE_add_cert(store.get(), issuer_.get());
+  X509_STORE_set_flags(store.get(), X509_V_FLAG_PARTIAL_CHAIN);
+  if (OCSP_basic_verify(basic.get(), certificates.get(), store.get(), 0) != 1)
+    return reject("its signature does not check out");
+
+  std::unique_ptr<OCSP_CERTID, decltype(&OCSP_CERTID_free)> id(
+      OCSP_cert_to_id(nullptr, certificate_.get(), issuer_.get()),
+      &OCSP_CERTID_free);
+  int reason;
+  ASN1_GENERALIZEDTIME* revoked;
+  ASN1_GENERALIZEDTIME* this_update;
+  ASN1_GENERALIZEDTIME* next_update;
+  if (OCSP_resp_find_status(basic.get(), id.get(), &status, &reason,
+        &revoked, &this_update, &next_update) != 1)
+    return reject("it is about another certificate");
+  if (OCSP_check_validity(this_update, next_update, max_skew, -1) != 1)
+    return reject("it has expired or is not valid yet");
+  if (status == V_OCSP_CERTSTATUS_REVOKED)
+    std::cerr << "The OCSP response from " << source
+              << " says the certificate has been revoked\n";
+
+  response_ = der;
+  this_update_ = to_time(this_update);
+  next_update_ = next_update ? to_time(next_update)
+                             : this_update_ + default_validity;
+  return true;
+}
+
+void ocsp_stapler::check_file()
+{
+  struct stat st;
+  if (::stat(response_file_.c_str(), &st) != 0)
+    return;
+  if (st.st_ino == file_inode_ && mtime_ns(st) == file_mtime_ns_)
+    return;
+  file_inode_ = st.st_ino;
+  file_mtime_ns_ = mtime_ns(st);
+  std::ifstream in(response_file_, std::ios::binary);
+  std::string der((std::istreambuf_iterator<char>(in)),
+      std::istreambuf_iterator<char>());
+  // An older response than the one in use is of no help.
+  std::string previous = response_;
+  std::time_t previous_update = this_update_;
+  std::time_t previous_next = next_update_;
+  if (accept(der, response_file_) && this_update_ < previous_update)
+  {
+    response_ = previous;
+    this_update_ = previous_update;
+    next_update_ = previous_next;
+  }
+}
+
+void ocsp_stapler::schedule_file_check()
+{
+  file_timer_.expires_after(file_check_interval);
+  file_timer_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (ec)
+          return;
+        check_file();
+        schedule_file_check();
+      });
+}
+
+void ocsp_stapler::schedule_fetch(std::chrono::steady_clock::duration delay)
+{
+  fetch_timer_.expires_after(delay);
+  fetch_timer_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          fetch();
+      });
+}
+
+void ocsp_stapler::fetch()
+{
+  std::unique_ptr<OCSP_REQUEST, decltype(&OCSP_REQUEST_free)> request(
+      OCSP_REQUEST_new(), &OCSP_REQUEST_free);
+  OCSP_CERTID* id = OCSP_cert_to_id(nullptr, certificate_.get(),
+      issuer_.get());
+  if (!id || !OCSP_request_add0_id(request.get(), id))
+  {
+    OCSP_CERTID_free(id);
+    fetch_failed("cannot make a request");
+    return;
+  }
+  int size = i2d_OCSP_REQUEST(request.get(), nullptr);
+  std::string der(size > 0 ? size : 0, '\0');
+  unsigned char* p = reinterpret_cast<unsigned char*>(&der[0]);
+  i2d_OCSP_REQUEST(request.get(), &p);
+
+  request_ = "POST " + path_ + " HTTP/1.0\r\n"
+      "Host: " + host_ + "\r\n"
+      "Content-Type: application/ocsp-request\r\n"
+      "Content-Length: " + std::to_string(der.size()) + "\r\n"
+      "\r\n" + der;
+  reply_.clear();
+
+  deadline_.expires_after(fetch_timeout);
+  deadline_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (ec)
+          return;
+        resolver_.cancel();
+        boost::system::error_code ignored_ec;
+        socket_.close(ignored_ec);
+      });
+
+  resolver_.async_resolve(host_, port_,
+      [this](const boost::system::error_code& ec,
+        boost::asio::ip::tcp::resolver::results_type endpoints)
+      {
+        if (ec)
+        {
+          fetch_failed("cannot resolve " + host_ + ": " + ec.message());
+          return;
+        }
+        boost::asio::async_connect(socket_, endpoints,
+            [this](const boost::system::error_code& ec,
+              const boost::asio::ip::tcp::endpoint&)
+            {
+              if (ec)
+              {
+                fetch_failed("cannot connect: " + ec.message());
+                return;
+              }
+              boost::asio::async_write(socket_,
+                  boost::asio::buffer(request_),
+                  [this](const boost::system::error_code& ec, std::size_t)
+                  {
+                    if (ec)
+                    {
+                      fetch_failed(ec.message());
+                      return;
+                    }
+                    // HTTP/1.0: the reply ends when the responder closes.
+                    boost::asio::async_read(socket_,
+                        boost::asio::dynamic_buffer(reply_, max_reply_size),
+                        [this](const boost::system::error_code& ec,
+                          std::size_t)
+                        {
+                          if (!ec)
+                            fetch_failed("the reply is too large");
+                          else if (ec != boost::asio::error::eof)
+                            fetch_failed(ec.message());
+                          else
+                            fetch_done();
+                        });
+                  });
+            });
+      });
+}
+
+void ocsp_stapler::fetch_failed(const std::string& what)
+{
+  deadline_.cancel();
+  boost::system::error_code ignored_ec;
+  socket_.close(ignored_ec);
+  ++failures_;
+  std::cerr << "OCSP fetch from " << host_ << " failed: " << what << "\n";
+  schedule_fetch(retry_delay);
+}
+
+void ocsp_stapler::fetch_done()
+{
+  deadline_.cancel();
+  boost::system::error_code ignored_ec;
+  socket_.close(ignored_ec);
+
+  std::size_t end = reply_.find("\r\n\r\n");
+  if (reply_.compare(0, 5, "HTTP/") != 0 || end == std::string::npos)
+  {
+    fetch_failed("not an HTTP reply");
+    return;
+  }
+  std::size_t space = reply_.find(' ');
+  if (space == std::string::npos || reply_.compare(space + 1, 3, "200") != 0)
+  {
+    fetch_failed(reply_.substr(0, reply_.find("\r\n")));
+    return;
+  }
+  if (!accept(reply_.substr(end + 4), host_))
+  {
+    fetch_failed("bad response");
+    return;
+  }
+  ++fetches_;
+  save();
+  std::time_t now = std::time(nullptr);
+  std::time_t refresh = this_update_ + (next_update_ - this_update_) / 2;
+  schedule_fetch(std::max<std::chrono::steady_clock::duration>(
+        std::chrono::seconds(refresh - now), min_refresh));
+}
+
+void ocsp_stapler::save()
+{
+  if (response_file_.empty())
+    return;
+  std::string temporary = response_file_ + ".XXXXXX";
+  int fd = ::mkstemp(&temporary[0]);
+  if (fd < 0)
+    return;
+  // Public anyway, and other users' servers may staple it too.
+  ::fchmod(fd, 0644);
+  bool ok = ::write(fd, response_.data(), response_.size())
+      == static_cast<ssize_t>(response_.size());
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || std::rename(temporary.c_str(), response_file_.c_str()) != 0)
+  {
+    std::remove(temporary.c_str());
+    std::cerr << "Cannot save the OCSP response to " << response_file_
+              << "\n";
+    return;
+  }
+  // Not read back at the next check.
+  struct stat st;
+  if (::stat(response_file_.c_str(), &st) == 0)
+  {
+    file_inode_ = st.st_ino;
+    file_mtime_ns_ = mtime_ns(st);
+  }
+}
+
+} // namespace server
+} // namespace http
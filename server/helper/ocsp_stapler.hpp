@@ -0,0 +1,116 @@
+#ifndef HTTP_OCSP_STAPLER_HPP
+#define HTTP_OCSP_STAPLER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <openssl/x509.h>
+#include <sys/types.h>
+
+namespace http {
+namespace server {
+
+/// Staples an OCSP response for the server's certificate to its
+/// handshakes, so that clients checking revocation need not ask the
+/// certificate authority themselves.
+///
+/// The response comes from a file, which is re-read when it changes, or
+/// from the responder named in the certificate, asked again halfway
+/// through each response's validity. Fetched responses are saved to the
+/// file, so that a restart staples at once. Every response is checked
+/// against the issuer before it is used; a bad or expired one is not
+/// stapled.
+///
+/// Not thread-safe: use one per io_context thread. Of several for the same
+/// certificate, only one should fetch, or they race to save the file; the
+/// others follow the file it saves to.
+class ocsp_stapler
+{
+public:
+  ocsp_stapler(const ocsp_stapler&) = delete;
+  ocsp_stapler& operator=(const ocsp_stapler&) = delete;
+
+  /// Staple for the first certificate in certificate_chain (PEM), whose
+  /// issuer must follow it there. Either response_file or fetch is needed.
+  /// Throws std::runtime_error if the chain is unusable, or if fetch is
+  /// set and the certificate names no HTTP responder.
+  ocsp_stapler(boost::asio::io_context& io_context,
+      const std::string& certificate_chain, const std::string& response_file,
+      bool fetch);
+
+  ~ocsp_stapler();
+
+  /// Staple on the connections of context, whose certificate must be the
+  /// one given above.
+  void attach(boost::asio::ssl::context& context);
+
+  /// The DER response being stapled, or empty.
+  const std::string& response() const { return response_; }
+
+  /// Responses fetched from the responder, and failed attempts.
+  std::size_t fetches() const { return fetches_; }
+  std::size_t failures() const { return failures_; }
+
+private:
+  struct x509_deleter
+  {
+    void operator()(X509* x) const { X509_free(x); }
+  };
+  typedef std::unique_ptr<X509, x509_deleter> x509_ptr;
+
+  static int status_callback(SSL* ssl, void* arg);
+
+  /// Check a DER response and use it if it is good. Source names it in
+  /// warnings. Returns false if it was not used.
+  bool accept(const std::string& der, const std::string& source);
+
+  /// Re-read the response file if it has changed.
+  void check_file();
+  void schedule_file_check();
+
+  /// Ask the responder for a new response.
+  void fetch();
+  void schedule_fetch(std::chrono::steady_clock::duration delay);
+  void fetch_failed(const std::string& what);
+  void fetch_done();
+
+  /// Write the response to the file, by way of a temporary one.
+  void save();
+
+  x509_ptr certificate_;
+  x509_ptr issuer_;
+  std::string response_file_;
+  bool fetch_;
+
+  /// The response and until when it may be stapled.
+  std::string response_;
+  std::time_t this_update_ = 0;
+  std::time_t next_update_ = 0;
+
+  /// What stat said about the file when it was last read.
+  std::int64_t file_mtime_ns_ = 0;
+  ino_t file_inode_ = 0;
+  boost::asio::steady_timer file_timer_;
+
+  /// The responder, and the exchange with it in progress.
+  std::string host_;
+  std::string port_;
+  std::string path_;
+  boost::asio::steady_timer fetch_timer_;
+  boost::asio::ip::tcp::resolver resolver_;
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::steady_timer deadline_;
+  std::string request_;
+  std::string reply_;
+  std::size_t fetches_ = 0;
+  std::size_t failures_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_OCSP_STAPLER_HPP
@@ -0,0 +1,571 @@
+#include "proxy.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "reply.hpp"
+#include "request.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Largest upstream status line plus headers accepted.
+const std::size_t max_head_size = 65536;
+
+/// Size of the pieces request bodies are forwarded in.
+const std::size_t body_piece_size = 16384;
+
+bool equals(std::string_view a, std::string_view b)
+{
+  return a.size() == b.size()
+      && ::strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    s.remove_suffix(1);
+  return s;
+}
+
+/// Check if name is one of the comma-separated tokens in list.
+bool listed(std::string_view list, std::string_view name)
+{
+  while (!list.empty())
+  {
+    std::size_t comma = list.find(',');
+    if (equals(trim(list.substr(0, comma)), name))
+      return true;
+    if (comma == std::string_view::npos)
+      break;
+    list.remove_prefix(comma + 1);
+  }
+  return false;
+}
+
+/// Headers that describe one connection rather than the message, and so
+/// are not passed on in either direction (RFC 7230 section 6.1), plus any
+/// the Connection header names.
+bool is_hop_by_hop(std::string_view name, std::string_view connection)
+{
+  static const char* const names[] = { "Connection", "Keep-Alive",
+    "Proxy-Connection", "Proxy-Authenticate", "Proxy-Authorization", "TE",
+    "Trailer", "Transfer-Encoding", "Upgrade" };
+  for (const char* n : names)
+    if (equals(name, n))
+      return true;
+  return listed(connection, name);
+}
+
+} // namespace
+
+/// One request on its way through an upstream, and then the body of its
+/// reply as read by the session.
+class proxy_exchange
+  : public body_stream,
+    public std::enable_shared_from_this<proxy_exchange>
+{
+public:
+  proxy_exchange(boost::asio::io_context& io_context, upstream& up,
+      reply& rep,
+      std::shared_ptr<body_stream> request_body, std::size_t body_size,
+      bool head_request, std::function<void()> handler)
+    : io_context_(io_context),
+      deadline_(io_context),
+      upstream_(up),
+      reply_(rep),
+      request_body_(std::move(request_body)),
+      body_left_(body_size),
+      head_request_(head_request),
+      handler_(std::move(handler)) {}
+
+  ~proxy_exchange()
+  {
+    if (connection_)
+      upstream_.release(std::move(connection_), false);
+  }
+
+  /// The request line and headers to send.
+  std::string request_head;
+
+  /// Give up with 504 if the reply's head has not arrived in time.
+  void set_timeout(std::chrono::steady_clock::duration timeout)
+  {
+    if (timeout == std::chrono::steady_clock::duration::zero())
+      return;
+    auto self = shared_from_this();
+    deadline_.expires_after(timeout);
+    deadline_.async_wait([self](const boost::system::error_code& ec)
+        {
+          if (!ec)
+            self->fail(reply::gateway_timeout);
+        });
+  }
+
+  /// Get a connection and send the request. A fresh connection is used
+  /// when retrying after a pooled one turned out to be closed.
+  void start(bool fresh = false)
+  {
+    auto self = shared_from_this();
+    upstream_.acquire(
+        [self](const boost::system::error_code& ec,
+          std::shared_ptr<upstream_connection> connection)
+        {
+          if (self->answered_)
+          {
+            // Timed out meanwhile.
+            if (connection)
+              self->upstream_.release(std::move(connection), false);
+            return;
+          }
+          if (ec)
+          {
+            self->fail(reply::bad_gateway);
+            return;
+          }
+          self->connection_ = std::move(connection);
+          self->send_head();
+        }, fresh);
+  }
+
+  void async_read_some(boost::asio::mutable_buffer buffer,
+      body_handler handler) override;
+
+private:
+  void send_head();
+  void send_body();
+  void read_head();
+  void parse_head(std::size_t head_size);
+
+  /// The upstream failed before answering. A pooled connection may simply
+  /// have been closed by the upstream while idle, so if nothing of the
+  /// request body has been consumed, try once more on a new connection.
+  void retry_or_fail();
+
+  /// Answer the client with an error of our own.
+  void fail(reply::status_type status);
+
+  /// Done with the upstream connection.
+  void finish(bool reusable);
+
+  boost::asio::io_context& io_context_;
+  boost::asio::steady_timer deadline_;
+  upstream& upstream_;
+  std::shared_ptr<upstream_connection> connection_;
+  reply& reply_;
+  std::shared_ptr<body_stream> request_body_;
+  std::size_t body_left_;
+  bool body_started_ = false;
+  bool head_request_;
+  bool retried_ = false;
+  /// Set once the handler has been called, with a reply head or an error.
+  bool answered_ = false;
+  std::function<void()> handler_;
+
+  /// Request body pieces on their way to the upstream.
+  std::vector<char> piece_;
+
+  /// The upstream's reply head as it is read, then the part of its body
+  /// that came with the head.
+  std::string response_;
+  std::size_t pending_offset_ = 0;
+
+  /// Reply body bytes still to come if the length is known; otherwise the
+  /// body runs until the upstream closes.
+  bool length_known_ = false;
+  std::size_t content_left_ = 0;
+  bool reusable_ = false;
+};
+
+void proxy_exchange::send_head()
+{
+  auto self = shared_from_this();
+  connection_->async_write({ boost::asio::buffer(request_head) },
+      [self](const boost::system::error_code& ec, std::size_t)
+      {
+        if (ec)
+          self->retry_or_fail();
+        else
+          self->send_body();
+      });
+}
+
+void proxy_exchange::send_body()
+{
+  if (body_left_ == 0)
+  {
+    read_head();
+    return;
+  }
+  piece_.resize(body_piece_size);
+  auto self = shared_from_this();
+  request_body_->async_read_some(
+      boost::asio::buffer(piece_.data(), std::min(body_left_, piece_.size())),
+      [self](const boost::system::error_code& ec, std::size_t n)
+      {
+        if (self->answered_)
+          return;
+        if (ec || n == 0)
+        {
+          // The client stopped sending.
+          self->fail(reply::bad_request);
+          return;
+        }
+        self->body_started_ = true;
+        self->body_left_ -= n;
+        self->connection_->async_write(
+            { boost::asio::buffer(self->piece_.data(), n) },
+            [self](const boost::system::error_code& ec, std::size_t)
+            {
+              if (ec)
+                self->fail(reply::bad_gateway);
+              else
+                self->send_body();
+            });
+      });
+}
+
+void proxy_exchange::read_head()
+{
+  std::size_t used = response_.size();
+  if (used == max_head_size)
+  {
+    fail(reply::bad_gateway);
+    return;
+  }
+  response_.resize(std::min(used + 4096, max_head_size));
+  auto self = shared_from_this();
+  connection_->async_read_some(
+      boost::asio::buffer(&response_[used], response_.size() - used),
+      [self, used](const boost::system::error_code& ec, std::size_t n)
+      {
+        self->response_.resize(used + n);
+        if (ec)
+        {
+          if (used == 0)
+            self->retry_or_fail();
+          else
+            self->fail(reply::bad_gateway);
+          return;
+        }
+        std::size_t end = self->response_.find("\r\n\r\n",
+            used >= 3 ? used - 3 : 0);
+        if (end == std::string::npos)
+          self->read_head();
+        else
+          self->parse_head(end + 4);
+      });
+}
+
+void proxy_exchange::parse_head(std::size_t head_size)
+{
+  std::string_view head(response_.data(), head_size - 2);
+
+  // Status line: HTTP/x.y code reason
+  std::size_t eol = head.find("\r\n");
+  std::string_view line = head.substr(0, eol);
+  if (line.size() < 12 || line.compare(0, 5, "HTTP/") != 0
+      || line[8] != ' ')
+  {
+    fail(reply::bad_gateway);
+    return;
+  }
+  int status = std::atoi(std::string(line.substr(9, 3)).c_str());
+  if (status < 100 || status > 599)
+  {
+    fail(reply::bad_gateway);
+    return;
+  }
+
+  if (status < 200)
+  {
+    // An interim reply such as 100 Continue; the real one follows.
+    response_.erase(0, head_size);
+    std::size_t end = response_.find("\r\n\r\n");
+    if (end == std::string::npos)
+      read_head();
+    else
+      parse_head(end + 4);
+    return;
+  }
+
+  reply rep;
+  rep.status = static_cast<reply::status_type>(status);
+  if (line.size() > 13)
+    rep.reason = std::string(line.substr(13));
+
+  // First find the Connection header, which names more headers to drop.
+  std::vector<std::pair<std::string_view, std::string_view>> fields;
+  std::string_view connection;
+  for (std::size_t pos = eol + 2; pos < head.size();)
+  {
+    std::size_t next = head.find("\r\n", pos);
+    std::string_view field = head.substr(pos, next - pos);
+    pos = next == std::string_view::npos ? head.size() : next + 2;
+    std::size_t colon = field.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+    std::string_view name = trim(field.substr(0, colon));
+    std::string_view value = trim(field.substr(colon + 1));
+    if (equals(name, "Connection"))
+      connection = value;
+    fields.emplace_back(name, value);
+  }
+
+  bool close = listed(connection, "close");
+  for (const auto& field : fields)
+  {
+    if (equals(field.first, "Transfer-Encoding")
+        && !equals(field.second, "identity"))
+    {
+      // Not expected in answer to an HTTP/1.0 request.
+      fail(reply::bad_gateway);
+      return;
+    }
+    if (equals(field.first, "Content-Length"))
+    {
+      length_known_ = true;
+      content_left_ = std::strtoull(std::string(field.second).c_str(),
+          nullptr, 10);
+    }
+    if (!is_hop_by_hop(field.first, connection))
+      rep.headers.push_back(
+          header{ std::string(field.first), std::string(field.second) });
+  }
+
+  if (head_request_ || status == 204 || status == 304)
+  {
+    length_known_ = true;
+    content_left_ = 0;
+  }
+  // Some servers send a body with the answer to HEAD anyway; rather than
+  // risk it turning up in front of the next reply, don't reuse.
+  reusable_ = length_known_ && !close && !head_request_;
+
+  // Whatever followed the head is the start of the body.
+  pending_offset_ = head_size;
+  if (length_known_ && response_.size() - pending_offset_ > content_left_)
+  {
+    response_.resize(pending_offset_ + content_left_);
+    reusable_ = false;
+  }
+
+  bool has_body = !length_known_ || content_left_ > 0;
+  if (has_body)
+    rep.body = shared_from_this();
+  else
+    finish(reusable_);
+  reply_ = std::move(rep);
+  answered_ = true;
+  deadline_.cancel();
+  handler_();
+}
+
+void proxy_exchange::async_read_some(boost::asio::mutable_buffer buffer,
+    body_handler handler)
+{
+  auto self = shared_from_this();
+  if (pending_offset_ < response_.size())
+  {
+    std::size_t n =
+        std::min(buffer.size(), response_.size() - pending_offset_);
+    std::memcpy(buffer.data(), response_.data() + pending_offset_, n);
+    pending_offset_ += n;
+    if (pending_offset_ == response_.size())
+      std::string().swap(response_);
+    if (length_known_)
+      content_left_ -= n;
+    boost::asio::post(io_context_,
+        [handler, n]() { handler(boost::system::error_code(), n); });
+    return;
+  }
+
+  if ((length_known_ && content_left_ == 0) || !connection_)
+  {
+    finish(reusable_);
+    boost::asio::post(io_context_,
+        [handler]() { handler(boost::system::error_code(), 0); });
+    return;
+  }
+
+  if (length_known_)
+    buffer = boost::asio::buffer(buffer, content_left_);
+  connection_->async_read_some(buffer,
+      [self, handler](const boost::system::error_code& ec, std::size_t n)
+      {
+        if (!ec)
+        {
+          if (self->length_known_)
+            self->content_left_ -= n;
+          handler(ec, n);
+          return;
+        }
+        self->finish(false);
+        // Without a length the body ends when the upstream closes.
+        bool end = !self->length_known_
+            && (ec == boost::asio::error::eof
+              || ec == boost::asio::ssl::error::stream_truncated);
+        handler(end ? boost::system::error_code() : ec, 0);
+      });
+}
+
+void proxy_exchange::retry_or_fail()
+{
+  if (answered_)
+    return;
+  bool reused = connection_ && connection_->reused;
+  finish(false);
+  if (reused && !retried_ && !body_started_)
+  {
+    retried_ = true;
+    start(true);
+  }
+  else
+    fail(reply::bad_gateway);
+}
+
+void proxy_exchange::fail(reply::status_type status)
+{
+  if (answered_)
+    return;
+  answered_ = true;
+  deadline_.cancel();
+  finish(false);
+  reply_ = reply::stock_reply(status);
+  handler_();
+}
+
+void proxy_exchange::finish(bool reusable)
+{
+  if (connection_)
+    upstream_.release(std::move(connection_), reusable);
+  connection_.reset();
+}
+
+upstream* proxy_route::pick()
+{
+  upstream* best = nullptr;
+  std::size_t count = upstreams.size();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    upstream* u = upstreams[(next_ + i) % count].get();
+    if (u->healthy() && (!best || u->outstanding() < best->outstanding()))
+      best = u;
+  }
+  ++next_;
+  return best;
+}
+
+proxy::proxy(boost::asio::io_context& io_context,
+    std::chrono::steady_clock::duration timeout)
+  : io_context_(io_context),
+    timeout_(timeout),
+    context_(boost::asio::ssl::context::sslv23_client)
+{
+  context_.set_verify_mode(boost::asio::ssl::verify_peer);
+  context_.set_default_verify_paths();
+}
+
+void proxy::add_certificate_authority(const std::string& ca_file)
+{
+  context_.load_verify_file(ca_file);
+}
+
+void proxy::add_route(const std::string& prefix,
+    const std::vector<std::string>& urls)
+{
+  auto route = std::make_unique<proxy_route>(prefix);
+  for (const std::string& url : urls)
+  {
+    route->upstreams.push_back(
+        std::make_unique<upstream>(io_context_, context_, url));
+    route->upstreams.back()->start_health_checks();
+  }
+  routes_.push_back(std::move(route));
+}
+
+proxy_route* proxy::match(std::string_view uri) const
+{
+  proxy_route* best = nullptr;
+  for (const auto& route : routes_)
+  {
+    const std::string& prefix = route->prefix;
+    if (uri.compare(0, prefix.size(), prefix) != 0
+        || (best && prefix.size() <= best->prefix.size()))
+      continue;
+    // Whole path segments only: /api matches /api and /api/x but not
+    // /apix.
+    if (!prefix.empty() && prefix.back() != '/' && uri.size() > prefix.size()
+        && uri[prefix.size()] != '/' && uri[prefix.size()] != '?')
+      continue;
+    best = route.get();
+  }
+  return best;
+}
+
+void proxy::async_handle_request(proxy_route& route, const request& req,
+    reply& rep, std::shared_ptr<body_stream> request_body,
+    std::size_t body_size, const boost::asio::ip::address& peer,
+    std::string_view scheme, std::function<void()> handler)
+{
+  upstream* up = route.pick();
+  if (!up)
+  {
+    rep = reply::stock_reply(reply::service_unavailable);
+    boost::asio::post(io_context_, std::move(handler));
+    return;
+  }
+
+  auto exchange = std::make_shared<proxy_exchange>(io_context_, *up, rep,
+      std::move(request_body), body_size, req.method == "HEAD",
+      std::move(handler));
+
+  const header_view* connection = req.find_header(connection_header);
+  std::string_view connection_value =
+      connection ? connection->value : std::string_view();
+  std::string forwarded_for = peer.to_string();
+  std::string& head = exchange->request_head;
+  head.reserve(512);
+  head.append(req.method).append(" ").append(req.uri)
+      .append(" HTTP/1.0\r\nHost: ").append(up->authority()).append("\r\n");
+  // The body is framed by the length the session read, whatever the
+  // client's own headers say, so that the upstream cannot be made to see
+  // a different end to it on a shared connection.
+  if (body_size > 0 || req.find_header(content_length_header))
+    head.append("Content-Length: ").append(std::to_string(body_size))
+        .append("\r\n");
+  for (const header_view& h : req.headers)
+  {
+    if (equals(h.name, "Content-Length")
+        || is_hop_by_hop(h.name, connection_value))
+      continue;
+    if (equals(h.name, "Host"))
+    {
+      head.append("X-Forwarded-Host: ").append(h.value).append("\r\n");
+      continue;
+    }
+    if (equals(h.name, "X-Forwarded-For"))
+    {
+      forwarded_for = std::string(h.value) + ", " + forwarded_for;
+      continue;
+    }
+    // The session answers Expect itself, and an HTTP/1.0 upstream would
+    // not know what to make of it.
+    if (equals(h.name, "X-Forwarded-Proto") || equals(h.name, "Expect"))
+      continue;
+    head.append(h.name).append(": ").append(h.value).append("\r\n");
+  }
+  head.append("X-Forwarded-For: ").append(forwarded_for)
+      .append("\r\nX-Forwarded-Proto: ").append(scheme)
+      .append("\r\nConnection: keep-alive\r\n\r\n");
+  exchange->set_timeout(timeout_);
+  exchange->start();
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,100 @@
+#ifndef HTTP_PROXY_HPP
+#define HTTP_PROXY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "body_stream.hpp"
+#include "upstream.hpp"
+
+namespace http {
+namespace server {
+
+struct reply;
+struct request;
+
+/// Requests whose URI starts with a prefix, and the upstreams that serve
+/// them.
+class proxy_route
+{
+public:
+  explicit proxy_route(const std::string& prefix) : prefix(prefix) {}
+
+  /// The healthy upstream with the fewest outstanding requests, taking
+  /// turns between equals, or null if none is healthy.
+  upstream* pick();
+
+  const std::string prefix;
+  std::vector<std::unique_ptr<upstream>> upstreams;
+
+private:
+  std::size_t next_ = 0;
+};
+
+/// Forwards requests to upstream HTTP or HTTPS servers by URI prefix.
+/// Request and reply bodies are streamed through a piece at a time rather
+/// than buffered whole.
+///
+/// Upstream requests are sent as HTTP/1.0 with Connection: keep-alive so
+/// that replies are never chunked; a reply with a Content-Length leaves its
+/// connection in the pool unless the upstream says Connection: close, and
+/// one without is read until the upstream closes. Interim 1xx replies are
+/// skipped; Expect is not forwarded, since the session sends the client
+/// its 100 Continue itself.
+class proxy
+{
+public:
+  proxy(const proxy&) = delete;
+  proxy& operator=(const proxy&) = delete;
+
+  /// Construct with no routes. HTTPS upstreams are verified against the
+  /// system's default CAs. An upstream that has not sent the head of its
+  /// reply within the timeout (zero for none) is answered for with 504.
+  explicit proxy(boost::asio::io_context& io_context,
+      std::chrono::steady_clock::duration timeout = std::chrono::seconds(30));
+
+  /// Also trust the CA certificates in the given PEM file.
+  void add_certificate_authority(const std::string& ca_file);
+
+  /// Forward requests whose URI starts with prefix to the given upstreams
+  /// (http[s]://host[:port]), balanced between them. The URI is passed on
+  /// unchanged.
+  void add_route(const std::string& prefix,
+      const std::vector<std::string>& urls);
+
+  /// The route with the longest prefix of uri, or null. A prefix must end
+  /// in '/' or be followed in uri by '/', '?' or nothing.
+  proxy_route* match(std::string_view uri) const;
+
+  /// Forward a request and fill in the reply from the upstream's answer.
+  /// The request body, body_size bytes long, is read from request_body.
+  /// The handler is invoked once the reply's headers are known; its body,
+  /// if any, is left in rep.body to be read by the caller. The client's
+  /// address and scheme ("http" or "https") are passed on in
+  /// X-Forwarded-For and X-Forwarded-Proto.
+  void async_handle_request(proxy_route& route, const request& req,
+      reply& rep, std::shared_ptr<body_stream> request_body,
+      std::size_t body_size, const boost::asio::ip::address& peer,
+      std::string_view scheme, std::function<void()> handler);
+
+  /// Whether any routes have been added.
+  bool empty() const { return routes_.empty(); }
+
+private:
+  boost::asio::io_context& io_context_;
+  std::chrono::steady_clock::duration timeout_;
+  boost::asio::ssl::context context_;
+  std::vector<std::unique_ptr<proxy_route>> routes_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_PROXY_HPP
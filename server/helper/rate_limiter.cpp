@@ -0,0 +1,173 @@
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Do not hand out byte grants smaller than this unless that is all that is
+/// wanted, so a throttled connection is not fed byte by byte.
+const std::size_t min_byte_grant = 1024;
+
+} // namespace
+
+token_bucket::token_bucket(double rate, double burst)
+  : rate_(rate),
+    burst_(burst > 0 ? burst : rate),
+    tokens_(burst_),
+    last_(rate_clock::now()) {}
+
+double token_bucket::available(rate_clock::time_point now)
+{
+  if (!limited())
+    return std::numeric_limits<double>::max();
+  std::chrono::duration<double> elapsed = now - last_;
+  if (elapsed.count() > 0)
+  {
+    tokens_ = std::min(burst_, tokens_ + rate_ * elapsed.count());
+    last_ = now;
+  }
+  return tokens_;
+}
+
+rate_clock::duration token_bucket::wait_time(double tokens,
+    rate_clock::time_point now)
+{
+  if (!limited())
+    return rate_clock::duration::zero();
+  tokens = std::min(tokens, burst_);
+  double missing = tokens - available(now);
+  if (missing <= 0)
+    return rate_clock::duration::zero();
+  return std::chrono::duration_cast<rate_clock::duration>(
+      std::chrono::duration<double>(missing / rate_));
+}
+
+bool rate_limiter::ticket::admit_request(rate_clock::time_point now,
+    rate_clock::duration& retry_after)
+{
+  token_bucket* limits[] = {
+      client_ ? &client_->requests : nullptr, &connection_.requests };
+  retry_after = rate_clock::duration::zero();
+  for (token_bucket* bucket : limits)
+  {
+    if (bucket && bucket->available(now) < 1)
+      retry_after = std::max(retry_after, bucket->wait_time(1, now));
+  }
+  if (retry_after > rate_clock::duration::zero())
+    return false;
+  for (token_bucket* bucket : limits)
+  {
+    if (bucket && bucket->limited())
+      bucket->consume(1);
+  }
+  return true;
+}
+
+std::size_t rate_limiter::ticket::grant_bytes(std::size_t wanted,
+    rate_clock::time_point now, rate_clock::duration& delay)
+{
+  token_bucket* limits[] = {
+      client_ ? &client_->bytes : nullptr, &connection_.bytes };
+  double allowed = static_cast<double>(wanted);
+  double threshold = static_cast<double>(std::min(wanted, min_byte_grant));
+  for (token_bucket* bucket : limits)
+  {
+    if (!bucket || !bucket->limited())
+      continue;
+    allowed = std::min(allowed, std::floor(bucket->available(now)));
+    // A bucket smaller than the threshold could never satisfy it.
+    threshold = std::min(threshold, std::max(1.0, bucket->burst()));
+  }
+  delay = rate_clock::duration::zero();
+  if (allowed >= threshold && allowed >= 1)
+  {
+    for (token_bucket* bucket : limits)
+    {
+      if (bucket && bucket->limited())
+        bucket->consume(allowed);
+    }
+    return static_cast<std::size_t>(allowed);
+  }
+  for (token_bucket* bucket : limits)
+  {
+    if (bucket && bucket->limited())
+      delay = std::max(delay, bucket->wait_time(threshold, now));
+  }
+  if (delay == rate_clock::duration::zero())
+    delay = std::chrono::milliseconds(1);
+  return 0;
+}
+
+std::size_t rate_limiter::key_hash::operator()(const key_type& key) const
+{
+  std::uint64_t a, b;
+  std::memcpy(&a, key.data(), 8);
+  std::memcpy(&b, key.data() + 8, 8);
+  return static_cast<std::size_t>(a * 0x9e3779b97f4a7c15ull ^ b);
+}
+
+rate_limiter::rate_limiter(const rate_limits& per_client,
+    const rate_limits& per_connection)
+  : per_client_(per_client), per_connection_(per_connection) {}
+
+rate_limiter::ticket rate_limiter::attach(
+    const boost::asio::ip::address& address)
+{
+  ticket t;
+  t.connection_.requests = token_bucket(per_connection_.requests_per_second,
+      per_connection_.request_burst);
+  t.connection_.bytes = token_bucket(per_connection_.bytes_per_second,
+      per_connection_.byte_burst);
+
+  if (per_client_.requests_per_second <= 0
+      && per_client_.bytes_per_second <= 0)
+    return t;
+
+  rate_clock::time_point now = rate_clock::now();
+  if (++attaches_since_sweep_ >= 1024)
+    sweep(now);
+
+  key_type key;
+  if (address.is_v4())
+    key = boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped,
+        address.to_v4()).to_bytes();
+  else
+    key = address.to_v6().to_bytes();
+
+  std::shared_ptr<buckets>& client = clients_[key];
+  if (!client)
+  {
+    client = std::make_shared<buckets>();
+    client->requests = token_bucket(per_client_.requests_per_second,
+        per_client_.request_burst);
+    client->bytes = token_bucket(per_client_.bytes_per_second,
+        per_client_.byte_burst);
+  }
+  t.client_ = client;
+  return t;
+}
+
+void rate_limiter::sweep(rate_clock::time_point now)
+{
+  attaches_since_sweep_ = 0;
+  for (auto i = clients_.begin(); i != clients_.end();)
+  {
+    buckets& b = *i->second;
+    bool full = (!b.requests.limited()
+          || b.requests.available(now) >= b.requests.burst())
+        && (!b.bytes.limited() || b.bytes.available(now) >= b.bytes.burst());
+    if (i->second.use_count() == 1 && full)
+      i = clients_.erase(i);
+    else
+      ++i;
+  }
+}
+
+} // namespace server
+} // namespace http
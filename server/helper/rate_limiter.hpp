@@ -0,0 +1,121 @@
+#ifndef HTTP_RATE_LIMITER_HPP
+#define HTTP_RATE_LIMITER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <boost/asio/ip/address.hpp>
+
+namespace http {
+namespace server {
+
+typedef std::chrono::steady_clock rate_clock;
+
+/// Classic token bucket. A rate of zero means unlimited.
+class token_bucket
+{
+public:
+  token_bucket(double rate = 0, double burst = 0);
+
+  /// Whether the bucket imposes any limit.
+  bool limited() const { return rate_ > 0; }
+
+  /// The most tokens the bucket can hold.
+  double burst() const { return burst_; }
+
+  /// Tokens available now.
+  double available(rate_clock::time_point now);
+
+  /// Take tokens. The caller must have checked available() first.
+  void consume(double tokens) { tokens_ -= tokens; }
+
+  /// How long until the given number of tokens (capped at the burst size)
+  /// will be available.
+  rate_clock::duration wait_time(double tokens, rate_clock::time_point now);
+
+private:
+  double rate_;
+  double burst_;
+  double tokens_;
+  rate_clock::time_point last_;
+};
+
+/// Rates applied either to one client address or to one connection.
+struct rate_limits
+{
+  /// Requests per second and the burst allowed above it. Zero is unlimited.
+  double requests_per_second = 0;
+  double request_burst = 0;
+
+  /// Response bytes per second and the burst allowed above it.
+  double bytes_per_second = 0;
+  double byte_burst = 0;
+};
+
+/// Per-client-address and per-connection token bucket rate limiting.
+class rate_limiter
+{
+public:
+  rate_limiter(const rate_limiter&) = delete;
+  rate_limiter& operator=(const rate_limiter&) = delete;
+
+  rate_limiter(const rate_limits& per_client,
+      const rate_limits& per_connection);
+
+  /// Buckets for one client address or one connection.
+  struct buckets
+  {
+    token_bucket requests;
+    token_bucket bytes;
+  };
+
+  /// The limits that apply to one connection: its own buckets and those of
+  /// its client address, shared with the client's other connections.
+  class ticket
+  {
+  public:
+    ticket() = default;
+
+    /// Account for a new request. Returns false if it must be refused, in
+    /// which case retry_after is set to when it would be accepted.
+    bool admit_request(rate_clock::time_point now,
+        rate_clock::duration& retry_after);
+
+    /// How many of the wanted bytes may be written now. If none, delay is
+    /// set to how long to wait.
+    std::size_t grant_bytes(std::size_t wanted, rate_clock::time_point now,
+        rate_clock::duration& delay);
+
+  private:
+    friend class rate_limiter;
+    std::shared_ptr<buckets> client_;
+    buckets connection_;
+  };
+
+  /// Get the ticket for a new connection from the given address.
+  ticket attach(const boost::asio::ip::address& address);
+
+private:
+  typedef std::array<unsigned char, 16> key_type;
+
+  struct key_hash
+  {
+    std::size_t operator()(const key_type& key) const;
+  };
+
+  /// Drop clients with no connections whose buckets have refilled.
+  void sweep(rate_clock::time_point now);
+
+  rate_limits per_client_;
+  rate_limits per_connection_;
+  std::unordered_map<key_type, std::shared_ptr<buckets>, key_hash> clients_;
+  std::size_t attaches_since_sweep_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_RATE_LIMITER_HPP
@@ -1,4 +1,5 @@
 #include "reply.hpp"
+#include <algorithm>
 #include <string>
 
 namespace http {
@@ -30,6 +31,20 @@ const std::string forbidden =
   "HTTP/1.0 403 Forbidden\r\n";
 const std::string not_found =
   "HTTP/1.0 404 Not Found\r\n";
+const std::string conflict =
+  "HTTP/1.0 409 Conflict\r\n";
+const std::string length_required =
+  "HTTP/1.0 411 Length Required\r\n";
+const std::string payload_too_large =
+  "HTTP/1.0 413 Payload Too Large\r\n";
+const std::string uri_too_long =
+  "HTTP/1.0 414 URI Too Long\r\n";
+const std::string expectation_failed =
+  "HTTP/1.0 417 Expectation Failed\r\n";
+const std::string too_many_requests =
+  "HTTP/1.0 429 Too Many Requests\r\n";
+const std::string request_header_fields_too_large =
+  "HTTP/1.0 431 Request Header Fields Too Large\r\n";
 const std::string internal_server_error =
   "HTTP/1.0 500 Internal Server Error\r\n";
 const std::string not_implemented =
@@ -38,48 +53,72 @@ const std::string bad_gateway =
   "HTTP/1.0 502 Bad Gateway\r\n";
 const std::string service_unavailable =
   "HTTP/1.0 503 Service Unavailable\r\n";
+const std::string gateway_timeout =
+  "HTTP/1.0 504 Gateway Timeout\r\n";
 
-boost::asio::const_buffer to_buffer(reply::status_type status)
+const std::string* find(reply::status_type status)
 {
   switch (status)
   {
   case reply::ok:
-    return boost::asio::buffer(ok);
+    return &ok;
   case reply::created:
-    return boost::asio::buffer(created);
+    return &created;
   case reply::accepted:
-    return boost::asio::buffer(accepted);
+    return &accepted;
   case reply::no_content:
-    return boost::asio::buffer(no_content);
+    return &no_content;
   case reply::multiple_choices:
-    return boost::asio::buffer(multiple_choices);
+    return &multiple_choices;
   case reply::moved_permanently:
-    return boost::asio::buffer(moved_permanently);
+    return &moved_permanently;
   case reply::moved_temporarily:
-    return boost::asio::buffer(moved_temporarily);
+    return &moved_temporarily;
   case reply::not_modified:
-    return boost::asio::buffer(not_modified);
+    return &not_modified;
   case reply::bad_request:
-    return boost::asio::buffer(bad_request);
+    return &bad_request;
   case reply::unauthorized:
-    return boost::asio::buffer(unauthorized);
+    return &unauthorized;
   case reply::forbidden:
-    return boost::asio::buffer(forbidden);
+    return &forbidden;
   case reply::not_found:
-    return boost::asio::buffer(not_found);
+    return &not_found;
+  case reply::conflict:
+    return &conflict;
+  case reply::length_required:
+    return &length_required;
+  case reply::payload_too_large:
+    return &payload_too_large;
+  case reply::uri_too_long:
+    return &uri_too_long;
+  case reply::expectation_failed:
+    return &expectation_failed;
+  case reply::too_many_requests:
+    return &too_many_requests;
+  case reply::request_header_fields_too_large:
+    return &request_header_fields_too_large;
   case reply::internal_server_error:
-    return boost::asio::buffer(internal_server_error);
+    return &internal_server_error;
   case reply::not_implemented:
-    return boost::asio::buffer(not_implemented);
+    return &not_implemented;
   case reply::bad_gateway:
-    return boost::asio::buffer(bad_gateway);
+    return &bad_gateway;
   case reply::service_unavailable:
-    return boost::asio::buffer(service_unavailable);
+    return &service_unavailable;
+  case reply::gateway_timeout:
+    return &gateway_timeout;
   default:
-    return boost::asio::buffer(internal_server_error);
+    return nullptr;
   }
 }
 
+boost::asio::const_buffer to_buffer(reply::status_type status)
+{
+  const std::string* line = find(status);
+  return boost::asio::buffer(line ? *line : internal_server_error);
+}
+
 } // namespace status_strings
 
 namespace misc_strings {
@@ -102,7 +141,45 @@ std::vector<boost::asio::const_buffer> reply::to_buffers()
     buffers.push_back(boost::asio::buffer(misc_strings::crlf));
   }
   buffers.push_back(boost::asio::buffer(misc_strings::crlf));
-  buffers.push_back(boost::asio::buffer(content));
+  buffers.push_back(content_buffer());
+  return buffers;
+}
+
+std::vector<boost::asio::const_buffer> reply::to_coalesced_buffers(
+    std::string& out, std::size_t inline_limit)
+{
+  out.clear();
+  if (const std::string* line = status_strings::find(status))
+    out += *line;
+  else
+  {
+    out += "HTTP/1.0 ";
+    out += std::to_string(static_cast<int>(status));
+    out += ' ';
+    out += reason;
+    out += "\r\n";
+  }
+  for (const header& h : headers)
+  {
+    out += h.name;
+    out.append(misc_strings::name_value_separator,
+        sizeof(misc_strings::name_value_separator));
+    out += h.value;
+    out.append(misc_strings::crlf, sizeof(misc_strings::crlf));
+  }
+  out.append(misc_strings::crlf, sizeof(misc_strings::crlf));
+
+  // Fill the first buffer up to the limit with as much content as fits.
+  boost::asio::const_buffer body = content_buffer();
+  std::size_t inlined = 0;
+  if (out.size() < inline_limit)
+    inlined = std::min(body.size(), inline_limit - out.size());
+  out.append(static_cast<const char*>(body.data()), inlined);
+
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.push_back(boost::asio::buffer(out));
+  if (inlined < body.size())
+    buffers.push_back(body + inlined);
   return buffers;
 }
 
@@ -164,6 +241,41 @@ const char not_found[] =
   "<head><title>Not Found</title></head>"
   "<body><h1>404 Not Found</h1></body>"
   "</html>";
+const char conflict[] =
+  "<html>"
+  "<head><title>Conflict</title></head>"
+  "<body><h1>409 Conflict</h1></body>"
+  "</html>";
+const char length_required[] =
+  "<html>"
+  "<head><title>Length Required</title></head>"
+  "<body><h1>411 Length Required</h1></body>"
+  "</html>";
+const char payload_too_large[] =
+  "<html>"
+  "<head><title>Payload Too Large</title></head>"
+  "<body><h1>413 Payload Too Large</h1></body>"
+  "</html>";
+const char uri_too_long[] =
+  "<html>"
+  "<head><title>URI Too Long</title></head>"
+  "<body><h1>414 URI Too Long</h1></body>"
+  "</html>";
+const char expectation_failed[] =
+  "<html>"
+  "<head><title>Expectation Failed</title></head>"
+  "<body><h1>417 Expectation Failed</h1></body>"
+  "</html>";
+const char too_many_requests[] =
+  "<html>"
+  "<head><title>Too Many Requests</title></head>"
+  "<body><h1>429 Too Many Requests</h1></body>"
+  "</html>";
+const char request_header_fields_too_large[] =
+  "<html>"
+  "<head><title>Request Header Fields Too Large</title></head>"
+  "<body><h1>431 Request Header Fields Too Large</h1></body>"
+  "</html>";
 const char internal_server_error[] =
   "<html>"
   "<head><title>Internal Server Error</title></head>"
@@ -184,6 +296,11 @@ const char service_unavailable[] =
   "<head><title>Service Unavailable</title></head>"
   "<body><h1>503 Service Unavailable</h1></body>"
   "</html>";
+const char gateway_timeout[] =
+  "<html>"
+  "<head><title>Gateway Timeout</title></head>"
+  "<body><h1>504 Gateway Timeout</h1></body>"
+  "</html>";
 
 std::string to_string(reply::status_type status)
 {
@@ -213,6 +330,20 @@ std::string to_string(reply::status_type status)
     return forbidden;
   case reply::not_found:
     return not_found;
+  case reply::conflict:
+    return conflict;
+  case reply::length_required:
+    return length_required;
+  case reply::payload_too_large:
+    return payload_too_large;
+  case reply::uri_too_long:
+    return uri_too_long;
+  case reply::expectation_failed:
+    return expectation_failed;
+  case reply::too_many_requests:
+    return too_many_requests;
+  case reply::request_header_fields_too_large:
+    return request_header_fields_too_large;
   case reply::internal_server_error:
     return internal_server_error;
   case reply::not_implemented:
@@ -221,6 +352,8 @@ std::string to_string(reply::status_type status)
     return bad_gateway;
   case reply::service_unavailable:
     return service_unavailable;
+  case reply::gateway_timeout:
+    return gateway_timeout;
   default:
     return internal_server_error;
   }
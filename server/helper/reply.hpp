@@ -1,9 +1,11 @@
 #ifndef HTTP_REPLY_HPP
 #define HTTP_REPLY_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <boost/asio.hpp>
+#include "body_stream.hpp"
 #include "header.hpp"
 
 namespace http {
@@ -13,7 +15,7 @@ namespace server {
 struct reply
 {
   /// The status of the reply.
-  enum status_type
+  enum status_type : int
   {
     ok = 200,
     created = 201,
@@ -27,10 +29,18 @@ struct reply
     unauthorized = 401,
     forbidden = 403,
     not_found = 404,
+    conflict = 409,
+    length_required = 411,
+    payload_too_large = 413,
+    uri_too_long = 414,
+    expectation_failed = 417,
+    too_many_requests = 429,
+    request_header_fields_too_large = 431,
     internal_server_error = 500,
     not_implemented = 501,
     bad_gateway = 502,
-    service_unavailable = 503
+    service_unavailable = 503,
+    gateway_timeout = 504
   } status;
 
   /// The headers to be included in the reply.
@@ -39,11 +49,39 @@ struct reply
   /// The content to be sent in the reply.
   std::string content;
 
+  /// The reason phrase for a status that has no stock status line, e.g. one
+  /// passed on from an upstream server.
+  std::string reason;
+
+  /// If set, the body is read from here after the headers have been sent,
+  /// instead of being taken from content.
+  std::shared_ptr<body_stream> body;
+
+  /// If mapped_owner is set, the content is the memory in mapped instead,
+  /// kept valid by the owner (e.g. a mapped archive) and sent without being
+  /// copied.
+  boost::asio::const_buffer mapped;
+  std::shared_ptr<const void> mapped_owner;
+
+  /// The content to be sent: mapped if there is an owner, else content.
+  boost::asio::const_buffer content_buffer() const
+  {
+    return mapped_owner ? mapped : boost::asio::buffer(content);
+  }
+
   /// Convert the reply into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the reply object must remain valid and
   /// not be changed until the write operation has completed.
   std::vector<boost::asio::const_buffer> to_buffers();
 
+  /// Convert the reply into at most two buffers: the status line and headers
+  /// serialised into out, followed by the start of the content up to
+  /// inline_limit bytes in total, then the rest of the content. A small reply
+  /// thus becomes one contiguous buffer that fits in a single TLS record. The
+  /// reply and out must remain valid until the write has completed.
+  std::vector<boost::asio::const_buffer> to_coalesced_buffers(
+      std::string& out, std::size_t inline_limit);
+
   /// Get a stock reply.
   static reply stock_reply(status_type status);
 };
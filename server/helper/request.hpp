@@ -1,26 +1,69 @@
 #ifndef HTTP_REQUEST_HPP
 #define HTTP_REQUEST_HPP
 
-#include <string>
+#include <array>
+#include <memory_resource>
+#include <string_view>
 #include <vector>
+#include <strings.h>
 #include "header.hpp"
 
 namespace http {
 namespace server {
 
-/// A request received from a client.
+/// A request received from a client. The strings refer to memory owned by
+/// the request_arena the parser was given, so the request must be cleared
+/// before that arena is reset.
 struct request
 {
-  std::string method;
-  std::string uri;
-  int http_version_major;
-  int http_version_minor;
-  std::vector<header> headers;
-  //
-  std::string temp;
+  std::string_view method;
+  std::string_view uri;
+  int http_version_major = 0;
+  int http_version_minor = 0;
+  std::pmr::vector<header_view> headers;
+
+  /// One plus the index in headers of each known header, zero if absent.
+  std::array<unsigned short, known_header_count> known_headers{};
+
+  request() = default;
+
+  /// Construct a request whose header table is allocated from resource.
+  explicit request(std::pmr::memory_resource* resource)
+    : headers(resource) {}
+
+  /// Forget the contents, keeping the memory resource.
+  void clear()
+  {
+    method = uri = std::string_view();
+    http_version_major = http_version_minor = 0;
+    headers = std::pmr::vector<header_view>(headers.get_allocator());
+    known_headers.fill(0);
+  }
+
+  /// Get a known header, or null if the request does not have it.
+  const header_view* find_header(known_header id) const
+  {
+    unsigned short slot = known_headers[id];
+    return slot ? &headers[slot - 1] : nullptr;
+  }
+
+  /// Get any header by name, ignoring case, or null if there is none.
+  const header_view* find_header(std::string_view name) const
+  {
+    known_header id = lookup_known_header(name.data(), name.size());
+    if (id != known_header_count)
+      return find_header(id);
+    for (const header_view& h : headers)
+    {
+      if (h.name.size() == name.size()
+          && ::strncasecmp(h.name.data(), name.data(), name.size()) == 0)
+        return &h;
+    }
+    return nullptr;
+  }
 };
 
 } // namespace server
 } // namespace http
 
-#endif // HTTP_REQUEST_HPP
\ No newline at end of file
+#endif // HTTP_REQUEST_HPP
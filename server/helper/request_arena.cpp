@@ -0,0 +1,130 @@
+#include "request_arena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace http {
+namespace server {
+
+namespace {
+
+char* align_up(char* p, std::size_t alignment)
+{
+  std::uintptr_t value = reinterpret_cast<std::uintptr_t>(p);
+  value = (value + alignment - 1) & ~(alignment - 1);
+  return reinterpret_cast<char*>(value);
+}
+
+} // namespace
+
+request_arena::request_arena(std::size_t capacity, std::size_t block_size)
+  : capacity_(capacity), block_size_(std::min(block_size, capacity)) {}
+
+request_arena::~request_arena()
+{
+  block* b = first_;
+  while (b)
+  {
+    block* next = b->next;
+    ::operator delete(b);
+    b = next;
+  }
+}
+
+bool request_arena::append(std::string_view& field, const char* data,
+    std::size_t size)
+{
+  if (size == 0)
+    return true;
+
+  // Grow in place if the field is the last allocation and still fits.
+  if (!field.empty() && field.data() + field.size() == top_
+      && size <= static_cast<std::size_t>(end_ - top_))
+  {
+    std::memcpy(top_, data, size);
+    top_ += size;
+    used_ += size;
+    field = std::string_view(field.data(), field.size() + size);
+    return true;
+  }
+
+  // Otherwise move the field to the top. The space it used is not reclaimed
+  // until the next reset.
+  std::size_t total = field.size() + size;
+  if (!reserve(total, 1))
+    return false;
+  char* p = top_;
+  if (!field.empty())
+    std::memcpy(p, field.data(), field.size());
+  std::memcpy(p + field.size(), data, size);
+  top_ += total;
+  used_ += total;
+  field = std::string_view(p, total);
+  return true;
+}
+
+void request_arena::reset()
+{
+  if (!first_)
+    return;
+  block* b = first_->next;
+  while (b)
+  {
+    block* next = b->next;
+    ::operator delete(b);
+    b = next;
+  }
+  first_->next = nullptr;
+  current_ = first_;
+  top_ = first_->data();
+  end_ = top_ + first_->size;
+  used_ = 0;
+  reserved_ = first_->size;
+}
+
+bool request_arena::reserve(std::size_t size, std::size_t alignment)
+{
+  if (top_)
+  {
+    char* p = align_up(top_, alignment);
+    if (p <= end_ && size <= static_cast<std::size_t>(end_ - p))
+    {
+      top_ = p;
+      return true;
+    }
+  }
+
+  std::size_t needed = size + alignment;
+  if (needed > capacity_ - reserved_)
+    return false;
+  // Leave room for the field to keep growing in place.
+  std::size_t block_size = std::max(block_size_, 2 * needed);
+  block_size = std::min(block_size, capacity_ - reserved_);
+
+  block* b = static_cast<block*>(::operator new(sizeof(block) + block_size));
+  b->next = nullptr;
+  b->size = block_size;
+  if (current_)
+    current_->next = b;
+  else
+    first_ = b;
+  current_ = b;
+  reserved_ += block_size;
+  top_ = align_up(b->data(), alignment);
+  end_ = b->data() + block_size;
+  return true;
+}
+
+void* request_arena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+  if (!reserve(bytes, alignment))
+    throw std::bad_alloc();
+  void* p = top_;
+  top_ += bytes;
+  used_ += bytes;
+  return p;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,88 @@
+#ifndef HTTP_REQUEST_ARENA_HPP
+#define HTTP_REQUEST_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+
+namespace http {
+namespace server {
+
+/// Bounded monotonic arena holding everything allocated while parsing one
+/// request: the bytes of the method, URI and headers, and the header table.
+/// Nothing is freed individually; reset() releases it all at once.
+///
+/// Besides being a memory_resource, the arena can grow a string in place
+/// as long as it is the last thing allocated, which is how the parser
+/// builds every field.
+class request_arena : public std::pmr::memory_resource
+{
+public:
+  request_arena(const request_arena&) = delete;
+  request_arena& operator=(const request_arena&) = delete;
+
+  /// Construct an arena that will never hold more than capacity bytes. No
+  /// memory is allocated until it is first needed.
+  explicit request_arena(std::size_t capacity,
+      std::size_t block_size = 4096);
+
+  ~request_arena();
+
+  /// Append data to a field previously built by this arena (or empty).
+  /// Returns false if the arena is full.
+  bool append(std::string_view& field, const char* data, std::size_t size);
+
+  /// Forget all allocations. The first block is kept for the next request,
+  /// any others are returned to the system.
+  void reset();
+
+  /// Number of bytes handed out since the last reset.
+  std::size_t used() const { return used_; }
+
+  /// Number of bytes currently reserved from the system.
+  std::size_t reserved() const { return reserved_; }
+
+  /// The most the arena will ever reserve.
+  std::size_t capacity() const { return capacity_; }
+
+private:
+  /// A chunk of memory obtained from the system. The data follows the header.
+  struct block
+  {
+    block* next;
+    std::size_t size;
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  /// Make sure size bytes aligned to alignment are available at the top.
+  bool reserve(std::size_t size, std::size_t alignment);
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void*, std::size_t, std::size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override
+  {
+    return this == &other;
+  }
+
+  std::size_t capacity_;
+  std::size_t block_size_;
+
+  /// The first block, kept across resets.
+  block* first_ = nullptr;
+
+  /// The block allocations are currently taken from.
+  block* current_ = nullptr;
+
+  /// Next free byte and end of the current block.
+  char* top_ = nullptr;
+  char* end_ = nullptr;
+
+  std::size_t used_ = 0;
+  std::size_t reserved_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_REQUEST_ARENA_HPP
@@ -2,7 +2,13 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <iostream>
+#include "archive.hpp"
+#include "bundle.hpp"
+#include "directory_index.hpp"
+#include "file_cache.hpp"
+#include "file_reader.hpp"
 #include "mime_types.hpp"
 #include "reply.hpp"
 #include "request.hpp"
@@ -11,51 +17,425 @@ namespace http {
 namespace server {
 
 request_handler::request_handler(const std::string& doc_root)
-  : doc_root_(doc_root) {}
+  : doc_root_(doc_root), file_reader_(nullptr) {}
+
+request_handler::request_handler(const std::string& doc_root,
+    file_reader& reader)
+  : doc_root_(doc_root), file_reader_(&reader) {}
 
 void request_handler::handle_request(const request& req, reply& rep)
 {
-  // Decode url to path.
+  if (archive_)
+  {
+    serve_archived(req, rep);
+    return;
+  }
+
+  std::string full_path, extension;
+  if (!resolve(req, rep, full_path, extension))
+    return;
+
+  // Open the file to send back.
+  std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
+  if (!is)
+  {
+    rep = reply::stock_reply(reply::not_found);
+    return;
+  }
+  std::string content;
+  char buf[512];
+  while (is.read(buf, sizeof(buf)).gcount() > 0)
+    content.append(buf, is.gcount());
+  fill_reply(rep, std::move(content), extension);
+}
+
+void request_handler::async_handle_request(const request& req, reply& rep,
+    std::function<void()> handler)
+{
+  std::size_t mark = req.uri.find('?');
+  if (max_bundle_files_ && file_reader_
+      && req.uri.substr(0, mark) == "/_bundle")
+  {
+    bundle_files(mark == std::string_view::npos
+        ? std::string_view() : req.uri.substr(mark + 1), rep,
+        std::move(handler));
+    return;
+  }
+  if (archive_)
+  {
+    serve_archived(req, rep);
+    handler();
+    return;
+  }
+
+  std::string full_path, extension;
+  if (!file_reader_ || !resolve(req, rep, full_path, extension))
+  {
+    if (!file_reader_)
+      handle_request(req, rep);
+    handler();
+    return;
+  }
+
+  if (table_store_)
+  {
+    table_store::query query;
+    table_store::query_result result = mark == std::string_view::npos
+        ? table_store::not_a_query
+        : table_store::parse_query(req.uri.substr(mark + 1), query);
+    if (result == table_store::bad)
+    {
+      rep = reply::stock_reply(reply::bad_request);
+      handler();
+      return;
+    }
+    if (result == table_store::good)
+    {
+      query_table(full_path, query, rep, std::move(handler));
+      return;
+    }
+  }
+
+  if (file_cache_)
+  {
+    const header_view* h = req.find_header(if_none_match_header);
+    std::string if_none_match = h ? std::string(h->value) : std::string();
+    file_cache_->async_get(full_path,
+        [&rep, extension, if_none_match, handler](
+          const boost::system::error_code& ec,
+          std::shared_ptr<const file_cache::file> file)
+        {
+          if (ec)
+            rep = reply::stock_reply(reply::not_found);
+          else
+            fill_cached_reply(rep, std::move(file), if_none_match,
+                extension);
+          handler();
+        });
+    return;
+  }
+
+  file_reader_->async_read(full_path,
+      [&rep, extension, handler](const boost::system::error_code& ec,
+        std::string content)
+      {
+        if (ec)
+          rep = reply::stock_reply(reply::not_found);
+        else
+          fill_reply(rep, std::move(content), extension);
+        handler();
+      });
+}
+
+bool request_handler::resolve(const request& req, reply& rep,
+    std::string& full_path, std::string& extension)
+{
+  // Decode url to path, leaving out the query.
   std::string request_path;
-  if (!url_decode(req.uri, request_path))
+  if (!url_decode(req.uri.substr(0, req.uri.find('?')), request_path))
   {
     rep = reply::stock_reply(reply::bad_request);
-    return;
+    return false;
   }
   // Request path must be absolute and not contain "..".
   if (request_path.empty() || request_path[0] != '/'
       || request_path.find("..") != std::string::npos)
   {
     rep = reply::stock_reply(reply::bad_request);
-    return;
+    return false;
   }
-  // If path ends in slash (i.e. is a directory) then add "index.html".
+  // If path ends in slash (i.e. is a directory) then add "index.html", or
+  // list the directory if it has none and listings are enabled.
   if (request_path[request_path.size() - 1] == '/')
   {
+    if (directory_index_
+        && !directory_index_->contains(doc_root_ + request_path, "index.html"))
+    {
+      list_directory(req, request_path, rep);
+      return false;
+    }
     request_path += "index.html";
   }
   // Determine the file extension.
   std::size_t last_slash_pos = request_path.find_last_of("/");
   std::size_t last_dot_pos = request_path.find_last_of(".");
-  std::string extension;
+  extension.clear();
   if (last_dot_pos != std::string::npos && last_dot_pos > last_slash_pos)
   {
     extension = request_path.substr(last_dot_pos + 1);
   }
 
-  // Open the file to send back.
-  std::string full_path = doc_root_ + request_path;
-  std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
-  if (!is)
+  full_path = doc_root_ + request_path;
+  return true;
+}
+
+void request_handler::query_table(const std::string& full_path,
+    const table_store::query& query, reply& rep,
+    std::function<void()> handler)
+{
+  table_store_->async_get(full_path,
+      [&rep, query, handler](const boost::system::error_code& ec,
+        std::shared_ptr<const table_store::table> table)
+      {
+        if (ec == boost::asio::error::invalid_argument)
+          rep = reply::stock_reply(reply::bad_request);
+        else if (ec)
+          rep = reply::stock_reply(reply::not_found);
+        else
+        {
+          std::string content;
+          table_store::run(*table, query, content);
+          fill_reply(rep, std::move(content),
+              query.fmt == table_store::json ? "json"
+              : query.fmt == table_store::binary ? "bin" : "txt");
+        }
+        handler();
+      });
+}
+
+void request_handler::bundle_files(std::string_view query_string,
+    reply& rep, std::function<void()> handler)
+{
+  bundle::format fmt = bundle::multipart;
+  std::vector<bundle::part> parts;
+  while (!query_string.empty())
+  {
+    std::size_t amp = query_string.find('&');
+    std::string_view param = query_string.substr(0, amp);
+    query_string = amp == std::string_view::npos
+        ? std::string_view() : query_string.substr(amp + 1);
+
+    if (param == "fmt=tar")
+      fmt = bundle::tar;
+    else if (param == "fmt=multipart")
+      fmt = bundle::multipart;
+    else if (param.substr(0, 2) == "f=")
+    {
+      bundle::part part;
+      if (parts.size() == max_bundle_files_
+          || !url_decode(param.substr(2), part.name)
+          || part.name.empty() || part.name[0] != '/'
+          || part.name.find("..") != std::string::npos)
+      {
+        rep = reply::stock_reply(reply::bad_request);
+        handler();
+        return;
+      }
+      part.path = archive_ ? part.name : doc_root_ + part.name;
+      std::size_t slash = part.name.find_last_of('/');
+      std::size_t dot = part.name.find_last_of('.');
+      part.content_type = mime_types::extension_to_type(
+          dot != std::string::npos && dot > slash
+          ? part.name.substr(dot + 1) : std::string());
+      parts.push_back(std::move(part));
+    }
+    else
+    {
+      rep = reply::stock_reply(reply::bad_request);
+      handler();
+      return;
+    }
+  }
+  if (parts.empty())
+  {
+    rep = reply::stock_reply(reply::bad_request);
+    handler();
+    return;
+  }
+  if (fmt == bundle::tar)
+  {
+    // Names are stored without the leading '/'.
+    for (bundle::part& part : parts)
+    {
+      part.name.erase(0, 1);
+      if (!bundle::fits_tar(part.name))
+      {
+        rep = reply::stock_reply(reply::bad_request);
+        handler();
+        return;
+      }
+    }
+  }
+
+  if (archive_)
+  {
+    // The bundle holds on to the archive, which may be swapped meanwhile.
+    std::shared_ptr<const archive> current = archive_->current();
+    for (bundle::part& part : parts)
+    {
+      const archive::entry* e = current->find(part.path);
+      if (!e)
+      {
+        rep = reply::stock_reply(reply::not_found);
+        handler();
+        return;
+      }
+      part.content_type = std::string(e->content_type);
+      part.size = e->body.size();
+      part.mtime = static_cast<std::time_t>(e->mtime);
+      part.body = e->body;
+      if (fmt == bundle::tar && part.size >= (1ull << 33))
+      {
+        rep = reply::stock_reply(reply::bad_request);
+        handler();
+        return;
+      }
+    }
+    fill_bundle_reply(rep, std::make_shared<bundle>(*file_reader_,
+          std::move(current), fmt, std::move(parts)));
+    handler();
+    return;
+  }
+
+  // Only regular files; a missing one fails the whole bundle, before
+  // anything is sent.
+  std::vector<std::string> paths;
+  paths.reserve(parts.size());
+  for (const bundle::part& part : parts)
+    paths.push_back(part.path);
+  file_reader& reader = *file_reader_;
+  file_cache* cache = file_cache_;
+  reader.async_stat(std::move(paths),
+      [&reader, cache, fmt, parts = std::move(parts), &rep, handler](
+        const boost::system::error_code& ec,
+        std::vector<file_reader::file_status> status) mutable
+      {
+        if (ec)
+        {
+          rep = reply::stock_reply(reply::not_found);
+          handler();
+          return;
+        }
+        for (std::size_t i = 0; i < parts.size(); ++i)
+        {
+          parts[i].size = status[i].size;
+          parts[i].mtime = status[i].mtime;
+          // Tar sizes must fit in eleven octal digits.
+          if (fmt == bundle::tar && parts[i].size >= (1ull << 33))
+          {
+            rep = reply::stock_reply(reply::bad_request);
+            handler();
+            return;
+          }
+        }
+
+        fill_bundle_reply(rep, std::make_shared<bundle>(reader, cache, fmt,
+              std::move(parts)));
+        handler();
+      });
+}
+
+void request_handler::serve_archived(const request& req, reply& rep)
+{
+  std::string request_path;
+  if (!url_decode(req.uri.substr(0, req.uri.find('?')), request_path)
+      || request_path.empty() || request_path[0] != '/'
+      || request_path.find("..") != std::string::npos)
+  {
+    rep = reply::stock_reply(reply::bad_request);
+    return;
+  }
+  if (request_path.back() == '/')
+    request_path += "index.html";
+
+  // The reply holds on to the archive, which may be swapped meanwhile.
+  const std::shared_ptr<const archive>& current = archive_->current();
+  const archive::entry* e = current->find(request_path);
+  if (!e)
+  {
+    rep = reply::stock_reply(reply::not_found);
+    return;
+  }
+
+  // The compressed body is another representation, so it has its own tag.
+  bool gzip = !e->gzip_body.empty() && accepts_gzip(req);
+  std::string etag(e->etag);
+  if (gzip && etag.size() >= 2)
+    etag.insert(etag.size() - 1, "-gzip");
+  const header_view* if_none_match = req.find_header(if_none_match_header);
+  if (if_none_match && !etag.empty()
+      && (if_none_match->value == "*"
+        || if_none_match->value.find(etag) != std::string_view::npos))
+  {
+    rep.status = reply::not_modified;
+    rep.content.clear();
+    rep.headers.assign(1, header{ "ETag", etag });
+    return;
+  }
+
+  std::string_view body = gzip ? e->gzip_body : e->body;
+  rep.status = reply::ok;
+  rep.content.clear();
+  rep.mapped = boost::asio::buffer(body.data(), body.size());
+  rep.mapped_owner = current;
+  rep.headers.resize(3);
+  rep.headers[0].name = "Content-Length";
+  rep.headers[0].value = std::to_string(body.size());
+  rep.headers[1].name = "Content-Type";
+  rep.headers[1].value = e->content_type;
+  rep.headers[2].name = "ETag";
+  rep.headers[2].value = std::move(etag);
+  if (!e->gzip_body.empty())
+    rep.headers.push_back(header{ "Vary", "Accept-Encoding" });
+  if (gzip)
+    rep.headers.push_back(header{ "Content-Encoding", "gzip" });
+}
+
+bool request_handler::accepts_gzip(const request& req)
+{
+  const header_view* h = req.find_header(accept_encoding_header);
+  if (!h)
+    return false;
+  // A list of codings, each with an optional q; q=0 refuses it.
+  std::string_view list = h->value;
+  while (!list.empty())
+  {
+    std::size_t comma = list.find(',');
+    std::string_view item = list.substr(0, comma);
+    list = comma == std::string_view::npos
+        ? std::string_view() : list.substr(comma + 1);
+    std::size_t semicolon = item.find(';');
+    std::string_view coding = item.substr(0, semicolon);
+    while (!coding.empty() && coding.front() == ' ')
+      coding.remove_prefix(1);
+    while (!coding.empty() && coding.back() == ' ')
+      coding.remove_suffix(1);
+    if (coding != "gzip" && coding != "x-gzip" && coding != "*")
+      continue;
+    if (semicolon == std::string_view::npos)
+      return true;
+    std::string_view params = item.substr(semicolon + 1);
+    std::size_t q = params.find("q=");
+    if (q == std::string_view::npos)
+      return true;
+    std::string_view value = params.substr(q + 2);
+    return value.find_first_of("123456789") < value.find_first_of(",; ");
+  }
+  return false;
+}
+
+void request_handler::list_directory(const request& req,
+    const std::string& request_path, reply& rep)
+{
+  const header_view* accept = req.find_header(accept_header);
+  bool json = accept
+      && accept->value.find("application/json") != std::string_view::npos;
+  std::string content;
+  if (!directory_index_->render(doc_root_ + request_path, request_path,
+        json ? directory_index::json : directory_index::html, content))
   {
     rep = reply::stock_reply(reply::not_found);
     return;
   }
+  fill_reply(rep, std::move(content), json ? "json" : "html");
+}
+
+void request_handler::fill_reply(reply& rep, std::string content,
+    const std::string& extension)
+{
   // Fill out the reply to be sent to the client.
   rep.status = reply::ok;
-  char buf[512];
-  while (is.read(buf, sizeof(buf)).gcount() > 0)
-    rep.content.append(buf, is.gcount());
+  rep.content = std::move(content);
   rep.headers.resize(2);
   rep.headers[0].name = "Content-Length";
   rep.headers[0].value = std::to_string(rep.content.size());
@@ -63,7 +443,49 @@ void request_handler::handle_request(const request& req, reply& rep)
   rep.headers[1].value = mime_types::extension_to_type(extension);
 }
 
-bool request_handler::url_decode(const std::string& in, std::string& out)
+void request_handler::fill_bundle_reply(reply& rep,
+    std::shared_ptr<bundle> body)
+{
+  rep.status = reply::ok;
+  rep.content.clear();
+  rep.headers.resize(2);
+  rep.headers[0].name = "Content-Length";
+  rep.headers[0].value = std::to_string(body->content_length());
+  rep.headers[1].name = "Content-Type";
+  rep.headers[1].value = body->content_type();
+  rep.body = std::move(body);
+}
+
+void request_handler::fill_cached_reply(reply& rep,
+    std::shared_ptr<const file_cache::file> file,
+    const std::string& if_none_match, const std::string& extension)
+{
+  const std::string& etag = file->etag;
+  if (!etag.empty() && !if_none_match.empty()
+      && (if_none_match == "*"
+        || if_none_match.find(etag) != std::string::npos))
+  {
+    rep.status = reply::not_modified;
+    rep.content.clear();
+    rep.headers.resize(1);
+    rep.headers[0].name = "ETag";
+    rep.headers[0].value = etag;
+    return;
+  }
+  rep.status = reply::ok;
+  rep.content.clear();
+  rep.mapped = boost::asio::buffer(file->content);
+  rep.headers.resize(2);
+  rep.headers[0].name = "Content-Length";
+  rep.headers[0].value = std::to_string(file->content.size());
+  rep.headers[1].name = "Content-Type";
+  rep.headers[1].value = mime_types::extension_to_type(extension);
+  if (!etag.empty())
+    rep.headers.push_back(header{ "ETag", etag });
+  rep.mapped_owner = std::move(file);
+}
+
+bool request_handler::url_decode(std::string_view in, std::string& out)
 {
   out.clear();
   out.reserve(in.size());
@@ -74,7 +496,7 @@ bool request_handler::url_decode(const std::string& in, std::string& out)
       if (i + 3 <= in.size())
       {
         int value = 0;
-        std::istringstream is(in.substr(i + 1, 2));
+        std::istringstream is(std::string(in.substr(i + 1, 2)));
         if (is >> std::hex >> value)
         {
           out += static_cast<char>(value);
@@ -1,11 +1,23 @@
 #ifndef HTTP_REQUEST_HANDLER_HPP
 #define HTTP_REQUEST_HANDLER_HPP
 
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+
+#include "file_cache.hpp"
+#include "table_store.hpp"
 
 namespace http {
 namespace server {
 
+class archive_source;
+class bundle;
+class directory_index;
+class file_reader;
+class table_store;
 struct reply;
 struct request;
 
@@ -19,16 +31,113 @@ public:
   /// Construct with a directory containing files to be served.
   explicit request_handler(const std::string& doc_root);
 
+  /// Construct with a directory containing files to be served and a reader
+  /// used to load them without blocking.
+  request_handler(const std::string& doc_root, file_reader& reader);
+
   /// Handle a request and produce a reply.
   void handle_request(const request& req, reply& rep);
 
+  /// Handle a request and produce a reply, reading the file asynchronously.
+  /// The handler is invoked on the reader's io_context once the reply is
+  /// complete. Falls back to handle_request() if there is no reader.
+  void async_handle_request(const request& req, reply& rep,
+      std::function<void()> handler);
+
+  /// List directories that have no index.html, as HTML or, for clients
+  /// that accept it, JSON. Null turns listings off again.
+  void set_directory_index(directory_index* index)
+  {
+    directory_index_ = index;
+  }
+
+  /// Serve files through the given cache, with ETags and 304 replies to
+  /// matching If-None-Match requests. Null reads every file again.
+  void set_file_cache(file_cache* cache) { file_cache_ = cache; }
+
+  /// Answer requests for tabular files whose query string asks for rows,
+  /// downsampling or aggregates (see table_store) from the given store.
+  /// Null serves such files whole, ignoring the query.
+  void set_table_store(table_store* store) { table_store_ = store; }
+
+  /// Serve the site from a packed archive instead of its doc root. Null
+  /// goes back to the doc root.
+  void set_archive(archive_source* source) { archive_ = source; }
+
+  /// Answer GET /_bundle?f=<path>&f=<path>...[&fmt=multipart|tar] with the
+  /// files named, up to max_files of them, streamed as one reply. Zero
+  /// turns the endpoint off.
+  void set_bundle_limit(std::size_t max_files)
+  {
+    max_bundle_files_ = max_files;
+  }
+
+  /// Perform URL-decoding on a string. Returns false if the encoding was
+  /// invalid.
+  static bool url_decode(std::string_view in, std::string& out);
+
 private:
+  /// Map the request to a file. Returns false if the reply has already been
+  /// filled in with an error.
+  bool resolve(const request& req, reply& rep, std::string& full_path,
+      std::string& extension);
+
+  /// Fill in the reply with the result of a table query on a file.
+  void query_table(const std::string& full_path,
+      const table_store::query& query, reply& rep,
+      std::function<void()> handler);
+
+  /// Fill in the reply with a bundle of the files named in the query. The
+  /// files are looked up through the reader, or in the archive if the site
+  /// is served from one, so that a missing one fails the request before
+  /// anything is sent without blocking the thread.
+  void bundle_files(std::string_view query_string, reply& rep,
+      std::function<void()> handler);
+
+  /// Fill in the reply with a file from the archive, as a slice of its
+  /// mapping, compressed if the client accepts it and that was worth it.
+  void serve_archived(const request& req, reply& rep);
+
+  /// Check if the request's Accept-Encoding allows gzip.
+  static bool accepts_gzip(const request& req);
+
+  /// Fill in the reply with the listing of a directory.
+  void list_directory(const request& req, const std::string& request_path,
+      reply& rep);
+
+  /// Fill in a successful reply for the given content.
+  static void fill_reply(reply& rep, std::string content,
+      const std::string& extension);
+
+  /// Fill in a successful reply streaming the bundle.
+  static void fill_bundle_reply(reply& rep, std::shared_ptr<bundle> body);
+
+  /// Fill in the reply for a file from the cache, or a 304 if the client
+  /// already has it. The reply shares the cached content, not a copy.
+  static void fill_cached_reply(reply& rep,
+      std::shared_ptr<const file_cache::file> file,
+      const std::string& if_none_match, const std::string& extension);
+
   /// The directory containing the files to be served.
   std::string doc_root_;
 
-  /// Perform URL-decoding on a string. Returns false if the encoding was
-  /// invalid.
-  static bool url_decode(const std::string& in, std::string& out);
+  /// The reader used for asynchronous requests, if any.
+  file_reader* file_reader_;
+
+  /// Where directory listings come from, if they are enabled.
+  directory_index* directory_index_ = nullptr;
+
+  /// Where files come from when caching is enabled.
+  file_cache* file_cache_ = nullptr;
+
+  /// Where table queries are answered, if they are enabled.
+  table_store* table_store_ = nullptr;
+
+  /// Where files come from instead of the doc root, if anywhere.
+  archive_source* archive_ = nullptr;
+
+  /// The most files in one bundle, zero if bundles are off.
+  std::size_t max_bundle_files_ = 0;
 };
 
 } // namespace server
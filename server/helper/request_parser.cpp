@@ -1,15 +1,143 @@
 #include "request_parser.hpp"
+#include <new>
+#include <strings.h>
+#include "header_scanner.hpp"
 #include "request.hpp"
 
 namespace http {
 namespace server {
 
 request_parser::request_parser()
-  : state_(method_start) {}
+  : state_(method_start),
+    own_arena_(new request_arena(request_limits().arena_capacity())),
+    arena_(own_arena_.get()),
+    request_line_bytes_(0),
+    header_bytes_(0) {}
+
+request_parser::request_parser(request_arena& arena,
+    const request_limits& limits)
+  : state_(method_start),
+    arena_(&arena),
+    limits_(limits),
+    request_line_bytes_(0),
+    header_bytes_(0) {}
 
 void request_parser::reset()
 {
   state_ = method_start;
+  request_line_bytes_ = 0;
+  header_bytes_ = 0;
+  if (own_arena_)
+    own_arena_->reset();
+}
+
+request_parser::result_type request_parser::scan(request& req,
+    const char*& begin, const char* end)
+{
+  const char* stop = begin;
+  result_type result = indeterminate;
+  switch (state_)
+  {
+  case method:
+    stop = header_scanner::find_non_token(begin, end);
+    result = append(req.method, begin, stop - begin);
+    break;
+  case uri:
+    stop = header_scanner::find_space_or_ctl(begin, end);
+    result = append(req.uri, begin, stop - begin);
+    break;
+  case header_name:
+    stop = header_scanner::find_non_token(begin, end);
+    result = append(req.headers.back().name, begin, stop - begin);
+    break;
+  case header_value:
+    stop = header_scanner::find_ctl(begin, end);
+    result = append(req.headers.back().value, begin, stop - begin);
+    break;
+  default:
+    break;
+  }
+  std::size_t consumed = static_cast<std::size_t>(stop - begin);
+  begin = stop;
+  if (result == indeterminate && consumed > 0)
+    result = account(req, consumed);
+  return result;
+}
+
+request_parser::result_type request_parser::account(const request& req,
+    std::size_t bytes)
+{
+  if (state_ < header_line_start)
+  {
+    request_line_bytes_ += bytes;
+    if (request_line_bytes_ > limits_.max_request_line)
+      return uri_too_long;
+    return indeterminate;
+  }
+
+  header_bytes_ += bytes;
+  if (header_bytes_ > limits_.max_header_bytes)
+    return headers_too_large;
+  if (!req.headers.empty())
+  {
+    const header_view& h = req.headers.back();
+    if (h.name.size() + h.value.size() > limits_.max_header_size)
+      return headers_too_large;
+  }
+  return indeterminate;
+}
+
+request_parser::result_type request_parser::append(std::string_view& field,
+    const char* data, std::size_t size)
+{
+  if (arena_->append(field, data, size))
+    return indeterminate;
+  return state_ < header_line_start ? uri_too_long : headers_too_large;
+}
+
+request_parser::result_type request_parser::add_header(request& req,
+    char input)
+{
+  if (req.headers.size() >= limits_.max_header_count)
+    return headers_too_large;
+  try
+  {
+    if (req.headers.empty())
+      req.headers.reserve(16);
+    req.headers.push_back(header_view());
+  }
+  catch (std::bad_alloc&)
+  {
+    return headers_too_large;
+  }
+  state_ = header_name;
+  return push(req.headers.back().name, input);
+}
+
+bool request_parser::is_shutdown_command(const request& req)
+{
+  static const std::string_view commands[] =
+  {
+    "SERVER SHUTDOWN", "SERVER EXIT", "SERVER STOP", "SERVER FINISH"
+  };
+  if (req.uri.size() < 11 || req.uri.size() > 15)
+    return false;
+  for (std::string_view command : commands)
+  {
+    if (command.size() == req.uri.size()
+        && ::strncasecmp(command.data(), req.uri.data(), command.size()) == 0)
+      return true;
+  }
+  return false;
+}
+
+void request_parser::intern_header(request& req)
+{
+  const header_view& h = req.headers.back();
+  known_header id = lookup_known_header(h.name.data(), h.name.size());
+  if (id != known_header_count && !req.known_headers[id]
+      && req.headers.size() <= 0xffff)
+    req.known_headers[id] = static_cast<unsigned short>(req.headers.size());
 }
 
 request_parser::result_type request_parser::consume(request& req, char input)
@@ -24,8 +152,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     else
     {
       state_ = method;
-      req.method.push_back(input);
-      return indeterminate;
+      return push(req.method, input);
     }
   case method:
     if (input == ' ')
@@ -39,11 +166,12 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.method.push_back(input);
-      return indeterminate;
+      return push(req.method, input);
     }
   case uri:
-    if (input == ' ' && req.temp != "SERVER")
+    if (input == ' '
+        && !(req.uri.size() == 6
+          && ::strncasecmp(req.uri.data(), "SERVER", 6) == 0))
     {
       state_ = http_version_h;
       return indeterminate;
@@ -54,10 +182,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.uri.push_back(input);
-      req.temp=req.uri;
-      boost::to_upper(req.temp);
-      return indeterminate;
+      return push(req.uri, input);
     }
   case http_version_h:
     if (input == 'H')
@@ -190,10 +315,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.headers.push_back(header());
-      req.headers.back().name.push_back(input);
-      state_ = header_name;
-      return indeterminate;
+      return add_header(req, input);
     }
   case header_lws:
     if (input == '\r')
@@ -212,12 +334,12 @@ request_parser::result_type request_parser::consume(request& req, char input)
     else
     {
       state_ = header_value;
-      req.headers.back().value.push_back(input);
-      return indeterminate;
+      return push(req.headers.back().value, input);
     }
   case header_name:
     if (input == ':')
     {
+      intern_header(req);
       state_ = space_before_header_value;
       return indeterminate;
     }
@@ -227,8 +349,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.headers.back().name.push_back(input);
-      return indeterminate;
+      return push(req.headers.back().name, input);
     }
   case space_before_header_value:
     if (input == ' ')
@@ -252,8 +373,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.headers.back().value.push_back(input);
-      return indeterminate;
+      return push(req.headers.back().value, input);
     }
   case expecting_newline_2:
     if (input == '\n')
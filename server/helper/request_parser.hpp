@@ -1,29 +1,73 @@
 #ifndef HTTP_REQUEST_PARSER_HPP
 #define HTTP_REQUEST_PARSER_HPP
 
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <string_view>
 #include <tuple>
-#include <boost/algorithm/string.hpp>
+#include <type_traits>
 
 #include "request.hpp"
+#include "request_arena.hpp"
 
 namespace http {
 namespace server {
 
 struct request;
 
+/// Limits on the size of a request. Exceeding the request line limit gives
+/// uri_too_long (414), exceeding any of the header limits gives
+/// headers_too_large (431).
+struct request_limits
+{
+  /// Bytes in the request line, including the CRLF.
+  std::size_t max_request_line = 8192;
+
+  /// Bytes in a single header name plus value.
+  std::size_t max_header_size = 8192;
+
+  /// Number of header lines.
+  std::size_t max_header_count = 100;
+
+  /// Bytes in all header lines together.
+  std::size_t max_header_bytes = 65536;
+
+  /// Arena capacity that can hold any request within these limits, allowing
+  /// for fields that had to be moved while growing.
+  std::size_t arena_capacity() const
+  {
+    return 2 * (max_request_line + max_header_bytes)
+        + 4 * max_header_count * sizeof(header_view) + 4096;
+  }
+};
+
 /// Parser for incoming requests.
 class request_parser
 {
 public:
-  /// Construct ready to parse the request method.
+  /// Construct ready to parse the request method, with default limits and an
+  /// arena of its own.
   request_parser();
 
-  /// Reset to initial parser state.
+  /// Construct ready to parse the request method into the given arena. The
+  /// arena must outlive the parser.
+  request_parser(request_arena& arena, const request_limits& limits);
+
+  /// Reset to initial parser state. If the parser owns its arena, that is
+  /// reset too, so the previous request must have been cleared.
   void reset();
 
   /// Result of parse.
-  enum result_type { good, bad, indeterminate, shutdown };
+  enum result_type
+  {
+    good,
+    bad,
+    indeterminate,
+    shutdown,
+    uri_too_long,
+    headers_too_large
+  };
 
   /// Parse some data. The enum return value is good when a complete request has
   /// been parsed, bad if the data is invalid, indeterminate when more data is
@@ -34,15 +78,28 @@ public:
   {
     while (begin != end)
     {
-      result_type result = consume(req, *begin++);
-      std::string URI=req.uri;
-      boost::to_upper(URI);
-      if(URI == "SERVER SHUTDOWN" ||
-         URI == "SERVER EXIT"     ||
-         URI == "SERVER STOP"     ||
-         URI == "SERVER FINISH")
-        result=shutdown;
-      if (result == good || result == bad || result == shutdown)
+      result_type result;
+      // Contiguous input lets whole runs of ordinary bytes be scanned and
+      // copied at once instead of going through consume() one by one.
+      if constexpr (std::is_pointer<InputIterator>::value)
+      {
+        const char* p = begin;
+        result = scan(req, p, end);
+        begin += p - begin;
+        if (result == indeterminate && state_ == uri
+            && is_shutdown_command(req))
+          result = shutdown;
+        if (result != indeterminate)
+          return std::make_tuple(result, begin);
+        if (begin == end)
+          break;
+      }
+      result = consume(req, *begin++);
+      if (result == indeterminate)
+        result = account(req, 1);
+      if (is_shutdown_command(req))
+        result = shutdown;
+      if (result != indeterminate)
         return std::make_tuple(result, begin);
     }
     return std::make_tuple(indeterminate, begin);
@@ -52,6 +109,33 @@ private:
   /// Handle the next character of input.
   result_type consume(request& req, char input);
 
+  /// Consume the longest run of input that cannot change the parser state,
+  /// i.e. the rest of the current method, URI, header name or header value,
+  /// advancing begin past it.
+  result_type scan(request& req, const char*& begin, const char* end);
+
+  /// Count consumed bytes against the limits.
+  result_type account(const request& req, std::size_t bytes);
+
+  /// Append to a field in the arena.
+  result_type append(std::string_view& field, const char* data,
+      std::size_t size);
+
+  /// Append one character to a field in the arena.
+  result_type push(std::string_view& field, char input)
+  {
+    return append(field, &input, 1);
+  }
+
+  /// Start a new header line.
+  result_type add_header(request& req, char input);
+
+  /// Check if the URI so far is one of the server control commands.
+  static bool is_shutdown_command(const request& req);
+
+  /// Record the header just completed if it is one of the known headers.
+  static void intern_header(request& req);
+
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
 
@@ -88,6 +172,19 @@ private:
     expecting_newline_2,
     expecting_newline_3
   } state_;
+
+  /// The arena used when none was supplied.
+  std::unique_ptr<request_arena> own_arena_;
+
+  /// Where the strings of the request are built.
+  request_arena* arena_;
+
+  /// The limits in force.
+  request_limits limits_;
+
+  /// Bytes consumed so far in the request line and in the headers.
+  std::size_t request_line_bytes_;
+  std::size_t header_bytes_;
 };
 
 } // namespace server
@@ -0,0 +1,155 @@
+#include "request_trace.hpp"
+#include <stdexcept>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// A phase of a request as shown in the slow-request report and the trace.
+struct phase
+{
+  const char* name;
+  trace_point from;
+  trace_point to;
+};
+
+const phase phases[] =
+{
+  { "handshake", trace_accepted, trace_handshaken },
+  { "read", trace_received, trace_parsed },
+  { "handle", trace_parsed, trace_handled },
+  { "queue", trace_handled, trace_first_write },
+  { "write", trace_first_write, trace_written }
+};
+
+/// Flush the pending events once they reach this size.
+const std::size_t flush_size = 64 * 1024;
+
+void append_json_string(std::string& out, std::string_view s)
+{
+  out += '"';
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if (static_cast<unsigned char>(c) < 0x20)
+      c = '?';
+    out += c;
+  }
+  out += '"';
+}
+
+} // namespace
+
+std::chrono::microseconds request_trace::between(trace_point from,
+    trace_point to) const
+{
+  if (!has(from) || !has(to))
+    return std::chrono::microseconds(0);
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      at[to] - at[from]);
+}
+
+request_tracer::request_tracer(std::chrono::microseconds slow_threshold,
+    const std::string& trace_path)
+  : slow_threshold_(slow_threshold),
+    origin_(trace_clock::now())
+{
+  if (!trace_path.empty())
+  {
+    file_ = std::fopen(trace_path.c_str(), "w");
+    if (!file_)
+      throw std::runtime_error("cannot open trace file " + trace_path);
+    pending_ = "[\n";
+  }
+}
+
+request_tracer::~request_tracer()
+{
+  if (file_)
+  {
+    pending_ += "\n]\n";
+    std::fwrite(pending_.data(), 1, pending_.size(), file_);
+    std::fclose(file_);
+  }
+}
+
+void request_tracer::finish(std::uint64_t connection,
+    const request_trace& trace, std::string_view method,
+    std::string_view uri, unsigned status)
+{
+  std::chrono::microseconds total =
+      trace.between(trace.has(trace_accepted) ? trace_accepted
+          : trace_received, trace_written);
+  if (slow_threshold_.count() > 0 && total >= slow_threshold_)
+  {
+    std::string line = "slow request: ";
+    line.append(method.data(), method.size());
+    line += ' ';
+    line.append(uri.data(), uri.size());
+    char numbers[64];
+    std::snprintf(numbers, sizeof(numbers), " %u %.3f ms:", status,
+        total.count() / 1000.0);
+    line += numbers;
+    for (const phase& p : phases)
+    {
+      std::snprintf(numbers, sizeof(numbers), " %s %.3f", p.name,
+          trace.between(p.from, p.to).count() / 1000.0);
+      line += numbers;
+    }
+    line += '\n';
+    std::fputs(line.c_str(), stderr);
+  }
+
+  if (file_)
+    write_events(connection, trace, method, uri, status);
+}
+
+void request_tracer::write_events(std::uint64_t connection,
+    const request_trace& trace, std::string_view method,
+    std::string_view uri, unsigned status)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  std::string events;
+  char numbers[128];
+  for (const phase& p : phases)
+  {
+    if (!trace.has(p.from) || !trace.has(p.to))
+      continue;
+    events += events.empty() ? "" : ",\n";
+    events += "{\"name\":\"";
+    events += p.name;
+    std::snprintf(numbers, sizeof(numbers),
+        "\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%lld,\"dur\":%lld",
+        static_cast<unsigned long long>(connection),
+        static_cast<long long>(duration_cast<microseconds>(
+            trace.at[p.from] - origin_).count()),
+        static_cast<long long>(trace.between(p.from, p.to).count()));
+    events += numbers;
+    events += ",\"args\":{\"method\":";
+    append_json_string(events, method);
+    events += ",\"uri\":";
+    append_json_string(events, uri);
+    std::snprintf(numbers, sizeof(numbers), ",\"status\":%u}}", status);
+    events += numbers;
+  }
+  if (events.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!first_event_)
+    pending_ += ",\n";
+  first_event_ = false;
+  pending_ += events;
+  if (pending_.size() >= flush_size)
+  {
+    std::fwrite(pending_.data(), 1, pending_.size(), file_);
+    pending_.clear();
+  }
+}
+
+} // namespace server
+} // namespace http
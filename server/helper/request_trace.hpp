@@ -0,0 +1,105 @@
+#ifndef HTTP_REQUEST_TRACE_HPP
+#define HTTP_REQUEST_TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace http {
+namespace server {
+
+typedef std::chrono::steady_clock trace_clock;
+
+/// The points in the life of a request that are timestamped.
+enum trace_point
+{
+  /// The connection was accepted and its handshake completed. Only set for
+  /// the first request on a connection.
+  trace_accepted,
+  trace_handshaken,
+
+  /// The first bytes of the request arrived.
+  trace_received,
+
+  /// The parser finished with the request (successfully or not).
+  trace_parsed,
+
+  /// The reply is ready, e.g. the file has been read.
+  trace_handled,
+
+  /// The first and the last byte of the reply were written.
+  trace_first_write,
+  trace_written,
+
+  trace_point_count
+};
+
+/// Timestamps of one request, kept by its session. Marking is a single
+/// steady_clock read, which is a vDSO call reading the TSC on Linux.
+struct request_trace
+{
+  std::array<trace_clock::time_point, trace_point_count> at{};
+
+  void mark(trace_point p) { at[p] = trace_clock::now(); }
+
+  bool has(trace_point p) const
+  {
+    return at[p] != trace_clock::time_point();
+  }
+
+  /// Forget the timestamps of the last request. The connection ones are
+  /// dropped too, since they belong to the first request only.
+  void clear() { at.fill(trace_clock::time_point()); }
+
+  /// The time between two points, or zero if either is missing.
+  std::chrono::microseconds between(trace_point from, trace_point to) const;
+};
+
+/// Reports requests slower than a threshold with their phase breakdown,
+/// and optionally writes every request as Chrome trace events (load the
+/// file in chrome://tracing or Perfetto).
+class request_tracer
+{
+public:
+  request_tracer(const request_tracer&) = delete;
+  request_tracer& operator=(const request_tracer&) = delete;
+
+  /// Requests taking longer than slow_threshold are printed to stderr. If
+  /// trace_path is not empty all requests are written there.
+  request_tracer(std::chrono::microseconds slow_threshold,
+      const std::string& trace_path = std::string());
+
+  /// Flush and terminate the trace file.
+  ~request_tracer();
+
+  /// A number identifying a connection in the trace.
+  std::uint64_t new_connection() { return next_connection_++; }
+
+  /// Account for a finished request.
+  void finish(std::uint64_t connection, const request_trace& trace,
+      std::string_view method, std::string_view uri, unsigned status);
+
+private:
+  void write_events(std::uint64_t connection, const request_trace& trace,
+      std::string_view method, std::string_view uri, unsigned status);
+
+  std::chrono::microseconds slow_threshold_;
+  trace_clock::time_point origin_;
+  std::atomic<std::uint64_t> next_connection_{1};
+
+  /// The trace file and events not yet written to it.
+  std::mutex mutex_;
+  std::FILE* file_ = nullptr;
+  std::string pending_;
+  bool first_event_ = true;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_REQUEST_TRACE_HPP
@@ -0,0 +1,397 @@
+#include "server.hpp"
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// The configuration of a server given only a port and a doc root.
+server_config default_config(unsigned short port, const std::string& doc_root)
+{
+  server_config config;
+  config.port = port;
+  config.doc_root = doc_root;
+  return config;
+}
+
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    reuse_port;
+
+} // namespace
+
+server::server(boost::asio::io_context& io_context, unsigned short port,
+       const std::string& doc_root, std::unique_ptr<access_log> log,
+       std::unique_ptr<request_tracer> tracer)
+  : server(io_context, default_config(port, doc_root), log.get(),
+      tracer.get())
+{
+  owned_log_ = std::move(log);
+  owned_tracer_ = std::move(tracer);
+}
+
+server::server(boost::asio::io_context& io_context,
+       const server_config& config, access_log* log, request_tracer* tracer)
+  : io_context(io_context),
+    password_(config.password),
+    dh_file_(config.dh_file),
+    ciphers_(config.ciphers),
+    min_tls_version_(config.min_tls_version),
+    context_(boost::asio::ssl::context::sslv23),
+    file_reader_(io_context,
+        config.io_uring ? file_reader::io_uring : file_reader::thread_pool,
+        config.file_reader_threads),
+    hosts_(std::make_unique<request_handler>(config.doc_root, file_reader_)),
+    request_limits_(config.limits),
+    write_scheduler_(io_context, config.write_quantum,
+      config.writes_in_flight),
+    rate_limiter_(config.per_client, config.per_connection),
+    timeouts_(config.timeouts),
+    admission_(config.admission),
+    publish_timer_(io_context),
+    buffer_pool_(config.read_buffer_min, config.read_buffer_max),
+    doc_roots_(1, config.doc_root),
+    proxy_(io_context, config.upstream_timeout),
+    services_{ hosts_, request_limits_, write_scheduler_,
+      rate_limiter_, buffer_pool_, log, tracer, &proxy_, nullptr,
+      timeouts_, admission_, nullptr }
+{
+  configure_context(context_, config.certificate_chain, config.private_key);
+  if (!config.ocsp_response.empty() || config.ocsp_fetch)
+  {
+    ocsp_ = std::make_unique<ocsp_stapler>(io_context,
+        config.certificate_chain, config.ocsp_response, config.ocsp_fetch);
+    ocsp_->attach(context_);
+  }
+  // Let OpenSSL free its per-connection record buffers while a connection
+  // is idle instead of keeping them for its whole life.
+  SSL_CTX_set_mode(context_.native_handle(), SSL_MODE_RELEASE_BUFFERS);
+  hosts_.attach(context_);
+
+  for (const server_config::host& h : config.hosts)
+    add_host(h.name, h.doc_root, h.certificate_chain, h.private_key);
+  if (config.autoindex)
+    enable_autoindex();
+  if (config.file_cache_bytes > 0)
+    enable_file_cache(config.file_cache_bytes, config.file_cache_max_file);
+  if (config.table_cache_bytes > 0)
+    enable_table_queries(config.table_cache_bytes);
+  if (config.bundle_max_files > 0)
+    enable_bundles(config.bundle_max_files);
+  if (!config.archive.empty())
+    serve_archive(config.archive);
+  if (!config.upload.root.empty())
+    enable_uploads(config.upload);
+  if (config.stats)
+    enable_stats();
+  for (const server_config::proxy_route& r : config.routes)
+    add_proxy_route(r.prefix, r.upstreams, config.upstream_ca_file);
+
+  listen(config);
+  for (boost::asio::ip::tcp::acceptor& acceptor : acceptors_)
+    start_accept<session>(acceptor);
+  for (boost::asio::ip::tcp::acceptor& acceptor : plain_acceptors_)
+    start_accept<plain_session>(acceptor);
+}
+
+void server::listen(const server_config& config)
+{
+  // The accept handlers refer to the acceptors, so they must not move.
+  std::vector<boost::asio::ip::tcp::endpoint> endpoints = config.endpoints();
+  acceptors_.reserve(endpoints.size());
+  for (const boost::asio::ip::tcp::endpoint& endpoint : endpoints)
+    acceptors_.push_back(open_acceptor(endpoint, config));
+  plain_acceptors_.reserve(config.listen_plain.size());
+  for (const boost::asio::ip::tcp::endpoint& endpoint : config.listen_plain)
+    plain_acceptors_.push_back(open_acceptor(endpoint, config));
+}
+
+boost::asio::ip::tcp::acceptor server::open_acceptor(
+    const boost::asio::ip::tcp::endpoint& endpoint,
+    const server_config& config)
+{
+  boost::asio::ip::tcp::acceptor acceptor(io_context);
+  acceptor.open(endpoint.protocol());
+  acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+  // Servers on other threads or in other workers listen on the same
+  // address; the kernel spreads the connections between them.
+  if (config.threads > 1 || config.workers > 0)
+    acceptor.set_option(reuse_port(true));
+  acceptor.bind(endpoint);
+  acceptor.listen(config.backlog);
+  return acceptor;
+}
+
+void server::configure_context(boost::asio::ssl::context& context,
+    const std::string& certificate_chain, const std::string& private_key)
+{
+  context.set_options(
+      boost::asio::ssl::context::default_workarounds
+      | boost::asio::ssl::context::no_sslv2
+      | boost::asio::ssl::context::single_dh_use);
+  context.set_password_callback(boost::bind(&server::get_password, this));
+  context.use_certificate_chain_file(certificate_chain);
+  context.use_private_key_file(private_key, boost::asio::ssl::context::pem);
+  context.use_tmp_dh_file(dh_file_);
+  if (!ciphers_.empty() && SSL_CTX_set_cipher_list(context.native_handle(),
+        ciphers_.c_str()) != 1)
+    throw std::invalid_argument("no usable ciphers in: " + ciphers_);
+  if (!min_tls_version_.empty())
+    SSL_CTX_set_min_proto_version(context.native_handle(),
+        min_tls_version_ == "1.3" ? TLS1_3_VERSION : TLS1_2_VERSION);
+}
+
+void server::add_host(const std::string& name, const std::string& doc_root,
+    const std::string& certificate_chain, const std::string& private_key)
+{
+  std::unique_ptr<boost::asio::ssl::context> context;
+  if (!certificate_chain.empty())
+  {
+    context = std::make_unique<boost::asio::ssl::context>(
+        boost::asio::ssl::context::sslv23);
+    configure_context(*context, certificate_chain,
+        private_key.empty() ? certificate_chain : private_key);
+  }
+  auto handler = std::make_unique<request_handler>(doc_root, file_reader_);
+  handler->set_directory_index(directory_index_.get());
+  handler->set_file_cache(file_cache_.get());
+  handler->set_table_store(table_store_.get());
+  handler->set_bundle_limit(bundle_max_files_);
+  doc_roots_.push_back(doc_root);
+  if (fs_watcher_)
+    fs_watcher_->watch(doc_root);
+  hosts_.add(name, std::move(handler), std::move(context));
+}
+
+void server::enable_autoindex()
+{
+  if (!directory_index_)
+    directory_index_ = std::make_unique<directory_index>(watch_doc_roots());
+  hosts_.for_each_handler([this](request_handler& handler)
+      {
+        handler.set_directory_index(directory_index_.get());
+      });
+}
+
+void server::add_proxy_route(const std::string& prefix,
+    const std::vector<std::string>& upstreams, const std::string& ca_file)
+{
+  if (!ca_file.empty())
+    proxy_.add_certificate_authority(ca_file);
+  proxy_.add_route(prefix, upstreams);
+}
+
+void server::enable_file_cache(std::size_t max_bytes,
+    std::size_t max_file_size)
+{
+  if (!file_cache_)
+    file_cache_ = std::make_unique<file_cache>(file_reader_,
+        watch_doc_roots(), max_bytes, max_file_size);
+  hosts_.for_each_handler([this](request_handler& handler)
+      {
+        handler.set_file_cache(file_cache_.get());
+      });
+}
+
+void server::enable_table_queries(std::size_t max_bytes)
+{
+  if (!table_store_)
+    table_store_ = std::make_unique<table_store>(file_reader_,
+        watch_doc_roots(), max_bytes);
+  hosts_.for_each_handler([this](request_handler& handler)
+      {
+        handler.set_table_store(table_store_.get());
+      });
+}
+
+void server::serve_archive(const std::string& path)
+{
+  archive_ = std::make_unique<archive_source>(io_context, path);
+  hosts_.default_handler().set_archive(archive_.get());
+}
+
+void server::enable_bundles(std::size_t max_files)
+{
+  bundle_max_files_ = max_files;
+  hosts_.for_each_handler([max_files](request_handler& handler)
+      {
+        handler.set_bundle_limit(max_files);
+      });
+}
+
+void server::enable_uploads(const upload_config& config)
+{
+  uploads_ = std::make_unique<upload_store>(io_context, config);
+  services_.uploads = uploads_.get();
+}
+
+void server::enable_stats()
+{
+  services_.stats = [this]() { return stats(); };
+}
+
+void server::share_stats(shared_stats& stats, std::size_t worker)
+{
+  shared_stats_ = &stats;
+  worker_ = worker;
+  publish_stats();
+}
+
+void server::publish_stats()
+{
+  worker_counters& slot = (*shared_stats_)[worker_];
+  auto add = [](std::atomic<std::uint64_t>& to,
+      std::atomic<std::uint64_t>& published, std::uint64_t now)
+  {
+    std::uint64_t before = published.load(std::memory_order_relaxed);
+    to.fetch_add(now - before, std::memory_order_relaxed);
+    published.store(now, std::memory_order_relaxed);
+  };
+  add(slot.connections, published_.connections, connections_);
+  add(slot.requests, published_.requests, admission_.admitted());
+  add(slot.shed, published_.shed,
+      admission_.shed_new() + admission_.shed_established());
+
+  publish_timer_.expires_after(std::chrono::seconds(1));
+  publish_timer_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          publish_stats();
+      });
+}
+
+std::string server::stats() const
+{
+  auto us = [](std::chrono::steady_clock::duration d)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  std::ostringstream out;
+  out << "{\"admission\":{\"admitted\":" << admission_.admitted()
+      << ",\"shed_new\":" << admission_.shed_new()
+      << ",\"shed_established\":" << admission_.shed_established()
+      << ",\"shedding\":" << (admission_.shedding() ? "true" : "false")
+      << ",\"last_delay_us\":" << us(admission_.last_sojourn()) << "}";
+  out << ",\"buffers\":{\"reserved\":" << buffer_pool_.reserved()
+      << ",\"in_use\":" << buffer_pool_.in_use() << "}";
+  out << ",\"writes_waiting\":" << write_scheduler_.waiting()
+      << ",\"writes_stalled\":" << write_scheduler_.stalled();
+  out << ",\"sessions\":" << session::live() + plain_session::live();
+  if (file_cache_)
+    out << ",\"file_cache\":{\"hits\":" << file_cache_->hits()
+        << ",\"misses\":" << file_cache_->misses()
+        << ",\"entries\":" << file_cache_->entries()
+        << ",\"bytes\":" << file_cache_->bytes() << "}";
+  if (table_store_)
+    out << ",\"tables\":{\"hits\":" << table_store_->hits()
+        << ",\"misses\":" << table_store_->misses()
+        << ",\"parses\":" << table_store_->parses()
+        << ",\"entries\":" << table_store_->entries() << "}";
+  if (uploads_)
+    out << ",\"uploads\":{\"stored\":" << uploads_->stored()
+        << ",\"bytes\":" << uploads_->bytes()
+        << ",\"failed\":" << uploads_->failed() << "}";
+  if (ocsp_)
+    out << ",\"ocsp\":{\"stapled_bytes\":" << ocsp_->response().size()
+        << ",\"fetches\":" << ocsp_->fetches()
+        << ",\"failures\":" << ocsp_->failures() << "}";
+  if (archive_)
+    out << ",\"archive\":{\"files\":" << archive_->current()->size()
+        << ",\"swaps\":" << archive_->swaps() << "}";
+  if (shared_stats_)
+  {
+    // Everyone's counters as of their last publication, this worker's
+    // included.
+    out << ",\"workers\":[";
+    for (std::size_t i = 0; i < shared_stats_->size(); ++i)
+    {
+      const worker_counters& w = (*shared_stats_)[i];
+      auto get = [](const auto& counter)
+      {
+        return counter.load(std::memory_order_relaxed);
+      };
+      out << (i ? "," : "") << "{\"pid\":" << get(w.pid)
+          << ",\"restarts\":" << get(w.restarts)
+          << ",\"connections\":" << get(w.connections)
+          << ",\"requests\":" << get(w.requests)
+          << ",\"shed\":" << get(w.shed) << "}";
+    }
+    out << "],\"worker\":" << worker_;
+  }
+  out << "}\n";
+  return out.str();
+}
+
+fs_watcher& server::watch_doc_roots()
+{
+  if (!fs_watcher_)
+  {
+    fs_watcher_ = std::make_unique<fs_watcher>(io_context);
+    for (const std::string& root : doc_roots_)
+      fs_watcher_->watch(root);
+  }
+  return *fs_watcher_;
+}
+
+unsigned short server::port() const
+{
+  return acceptors_.front().local_endpoint().port();
+}
+
+unsigned short server::plain_port() const
+{
+  if (plain_acceptors_.empty())
+    return 0;
+  return plain_acceptors_.front().local_endpoint().port();
+}
+
+template <typename Session>
+void server::start_accept(boost::asio::ip::tcp::acceptor& acceptor)
+{
+  Session* new_session = new Session(io_context, &context_, services_);
+  acceptor.async_accept(new_session->socket(),
+      boost::bind(&server::handle_accept<Session>, this,
+        boost::ref(acceptor), new_session,
+        boost::asio::placeholders::error));
+}
+
+template <typename Session>
+void server::handle_accept(boost::asio::ip::tcp::acceptor& acceptor,
+    Session* new_session, const boost::system::error_code& error)
+{
+  if (!error)
+  {
+    ++connections_;
+    new_session->start();
+  }
+  else
+  {
+    delete new_session;
+    if (error == boost::asio::error::operation_aborted)
+      return;
+    // Out of descriptors or memory: accepting again at once would fail
+    // the same way in a busy loop. Give closing sessions a moment.
+    if (error == boost::asio::error::no_descriptors
+        || error == boost::asio::error::no_buffer_space
+        || error == boost::asio::error::no_memory
+        || error.value() == ENFILE)
+    {
+      auto timer = std::make_shared<boost::asio::steady_timer>(io_context,
+          std::chrono::milliseconds(100));
+      timer->async_wait([this, &acceptor, timer](
+            const boost::system::error_code& ec)
+          {
+            if (!ec)
+              start_accept<Session>(acceptor);
+          });
+      return;
+    }
+  }
+  start_accept<Session>(acceptor);
+}
+
+} // namespace server
+} // namespace http
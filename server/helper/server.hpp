@@ -0,0 +1,212 @@
+#ifndef HTTP_SERVER_HPP
+#define HTTP_SERVER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "access_log.hpp"
+#include "admission.hpp"
+#include "archive.hpp"
+#include "buffer_pool.hpp"
+#include "directory_index.hpp"
+#include "file_cache.hpp"
+#include "file_reader.hpp"
+#include "fs_watcher.hpp"
+#include "ocsp_stapler.hpp"
+#include "proxy.hpp"
+#include "rate_limiter.hpp"
+#include "request_handler.hpp"
+#include "request_parser.hpp"
+#include "request_trace.hpp"
+#include "server_config.hpp"
+#include "session.hpp"
+#include "shared_stats.hpp"
+#include "table_store.hpp"
+#include "upload_store.hpp"
+#include "virtual_hosts.hpp"
+#include "write_scheduler.hpp"
+
+namespace http {
+namespace server {
+
+/// Accepts TLS connections, and plain ones if configured, and starts a
+/// session for each. Everything runs on one io_context; to use more threads,
+/// run one server per thread on the same ports.
+class server
+{
+public:
+  server(const server&) = delete;
+  server& operator=(const server&) = delete;
+
+  /// Listen on the given port (0 picks a free one) and serve files from
+  /// doc_root, with the default certificate, key and DH parameters from the
+  /// current directory. Requests are recorded in the access log and traced
+  /// by the tracer if they are given.
+  server(boost::asio::io_context& io_context, unsigned short port,
+         const std::string& doc_root,
+         std::unique_ptr<access_log> log = nullptr,
+         std::unique_ptr<request_tracer> tracer = nullptr);
+
+  /// Serve as configured. The log and tracer, which may be shared with
+  /// servers on other threads, must outlive the server.
+  server(boost::asio::io_context& io_context, const server_config& config,
+         access_log* log = nullptr, request_tracer* tracer = nullptr);
+
+  std::string get_password() const { return password_; }
+
+  /// Serve another site, chosen by the Host header and by SNI. If a
+  /// certificate chain and key are given, clients asking for this name get
+  /// that certificate instead of the default one. Must be called before the
+  /// io_context runs.
+  void add_host(const std::string& name, const std::string& doc_root,
+      const std::string& certificate_chain = std::string(),
+      const std::string& private_key = std::string());
+
+  /// Forward requests whose URI starts with prefix to the given upstream
+  /// servers (http[s]://host[:port]), using the longest matching prefix.
+  /// HTTPS upstreams are verified against the system CAs and, if given,
+  /// those in ca_file. Must be called before the io_context runs.
+  void add_proxy_route(const std::string& prefix,
+      const std::vector<std::string>& upstreams,
+      const std::string& ca_file = std::string());
+
+  /// List directories that have no index.html on every site, from
+  /// listings cached and kept up to date with inotify.
+  void enable_autoindex();
+
+  /// Keep up to max_bytes of files in memory on every site, none bigger
+  /// than max_file_size. The doc roots are watched with inotify so that
+  /// changed files are read again.
+  void enable_file_cache(std::size_t max_bytes,
+      std::size_t max_file_size = 1024 * 1024);
+
+  /// Answer range, downsampling and aggregate queries on two-column
+  /// numeric files on every site, keeping up to max_bytes of parsed
+  /// tables. The doc roots are watched as for the file cache.
+  void enable_table_queries(std::size_t max_bytes);
+
+  /// Serve the default site from an archive packed by https-pack instead of
+  /// its doc root, switching to a new archive renamed over the file.
+  void serve_archive(const std::string& path);
+
+  /// Serve /_bundle on every site: up to max_files files, named in the
+  /// query, streamed back as one multipart/mixed or tar reply.
+  void enable_bundles(std::size_t max_files);
+
+  /// Store the bodies of PUT and POST requests under the configured root,
+  /// for every site.
+  void enable_uploads(const upload_config& config);
+
+  /// Answer /_stats on every site with this server's counters as JSON:
+  /// requests admitted and shed, and the caches in use.
+  void enable_stats();
+
+  /// Add this server's counters to the given worker's slot every second,
+  /// and report every worker's at /_stats. For worker processes; stats must
+  /// outlive the server.
+  void share_stats(shared_stats& stats, std::size_t worker);
+
+  /// The counters served at /_stats.
+  std::string stats() const;
+
+  /// The port the server is listening on (the first one if several).
+  unsigned short port() const;
+
+  /// The port of the first plain HTTP listener, 0 if there is none.
+  unsigned short plain_port() const;
+
+private:
+  /// Accept the next connection on acceptor into a new Session, which is
+  /// session or plain_session.
+  template <typename Session>
+  void start_accept(boost::asio::ip::tcp::acceptor& acceptor);
+
+  template <typename Session>
+  void handle_accept(boost::asio::ip::tcp::acceptor& acceptor,
+      Session* new_session, const boost::system::error_code& error);
+
+  /// Add what has been counted since last time to the shared counters.
+  void publish_stats();
+
+  /// Start watching the doc roots, if nothing has yet.
+  fs_watcher& watch_doc_roots();
+
+  /// Open, bind and listen on every configured address.
+  void listen(const server_config& config);
+
+  /// Open, bind and listen on one address.
+  boost::asio::ip::tcp::acceptor open_acceptor(
+      const boost::asio::ip::tcp::endpoint& endpoint,
+      const server_config& config);
+
+  /// Apply the server's TLS settings and load a certificate into context.
+  void configure_context(boost::asio::ssl::context& context,
+      const std::string& certificate_chain, const std::string& private_key);
+
+  boost::asio::io_context& io_context;
+  /// The private key password and the TLS settings for every context.
+  std::string password_;
+  std::string dh_file_;
+  std::string ciphers_;
+  std::string min_tls_version_;
+  std::vector<boost::asio::ip::tcp::acceptor> acceptors_;
+  std::vector<boost::asio::ip::tcp::acceptor> plain_acceptors_;
+  boost::asio::ssl::context context_;
+  /// Staples OCSP responses for the default certificate, if configured.
+  std::unique_ptr<ocsp_stapler> ocsp_;
+  /// The reader used to load files without blocking the io_context.
+  file_reader file_reader_;
+  /// The sites served, with a handler each.
+  virtual_hosts hosts_;
+  /// Limits applied to every incoming request.
+  request_limits request_limits_;
+  /// Deficit round-robin over the sessions' pending replies.
+  write_scheduler write_scheduler_;
+  /// Request and bandwidth limits per client address and per connection.
+  rate_limiter rate_limiter_;
+  /// The access log and tracer when the server owns them.
+  std::unique_ptr<access_log> owned_log_;
+  std::unique_ptr<request_tracer> owned_tracer_;
+  /// Connection timeouts.
+  session_timeouts timeouts_;
+  /// Load shedding when requests wait too long to be handled.
+  admission_controller admission_;
+  /// Connections accepted.
+  std::uint64_t connections_ = 0;
+  /// The counters shared between worker processes, this worker's slot in
+  /// them and what has been added to it so far.
+  shared_stats* shared_stats_ = nullptr;
+  std::size_t worker_ = 0;
+  worker_counters published_{};
+  boost::asio::steady_timer publish_timer_;
+  /// Read buffers lent to sessions while they have data to parse.
+  buffer_pool buffer_pool_;
+  /// The doc root of every site, the default one first.
+  std::vector<std::string> doc_roots_;
+  /// The watcher that keeps the caches below fresh, and the file cache, if
+  /// enabled.
+  std::unique_ptr<fs_watcher> fs_watcher_;
+  std::unique_ptr<file_cache> file_cache_;
+  /// Parsed tables for queries, if enabled.
+  std::unique_ptr<table_store> table_store_;
+  /// The packed archive of the default site, if it is served from one.
+  std::unique_ptr<archive_source> archive_;
+  /// Where uploads are stored, if they are accepted.
+  std::unique_ptr<upload_store> uploads_;
+  /// The most files per /_bundle request, zero if bundles are off.
+  std::size_t bundle_max_files_ = 0;
+  /// Directory listings, if enabled.
+  std::unique_ptr<directory_index> directory_index_;
+  /// Forwarding to upstream servers by URI prefix.
+  proxy proxy_;
+  /// Everything above, as handed to each session.
+  session_services services_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_HPP
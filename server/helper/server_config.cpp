@@ -0,0 +1,516 @@
+#include "server_config.hpp"
+#include <cmath>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Split "key=a,b,c" into key and the comma-separated values.
+bool split_spec(const std::string& spec, std::string& key,
+    std::vector<std::string>& values)
+{
+  std::size_t eq = spec.find('=');
+  if (eq == std::string::npos || eq == 0)
+    return false;
+  key = spec.substr(0, eq);
+  values.clear();
+  std::size_t begin = eq + 1;
+  for (std::size_t comma; (comma = spec.find(',', begin)) != std::string::npos;
+      begin = comma + 1)
+    values.push_back(spec.substr(begin, comma - begin));
+  values.push_back(spec.substr(begin));
+  return true;
+}
+
+/// "port", "address:port" or "[v6-address]:port".
+boost::asio::ip::tcp::endpoint parse_endpoint(const std::string& spec)
+{
+  std::string address = "0.0.0.0";
+  std::string port = spec;
+  std::size_t colon = spec.rfind(':');
+  if (colon != std::string::npos)
+  {
+    address = spec.substr(0, colon);
+    port = spec.substr(colon + 1);
+    if (address.size() > 1 && address.front() == '['
+        && address.back() == ']')
+      address = address.substr(1, address.size() - 2);
+    else if (address == "*")
+      address = "0.0.0.0";
+  }
+  boost::system::error_code ec;
+  boost::asio::ip::address a = boost::asio::ip::make_address(address, ec);
+  char* end = nullptr;
+  unsigned long p = std::strtoul(port.c_str(), &end, 10);
+  if (ec || port.empty() || *end != '\0' || p > 65535)
+    throw std::invalid_argument("bad listen address: " + spec);
+  return boost::asio::ip::tcp::endpoint(a, static_cast<unsigned short>(p));
+}
+
+/// Convert a time given in seconds. NaN, or a value beyond what a duration
+/// can hold, would make the conversion undefined, so anything negative or
+/// over a million hours is refused.
+std::chrono::steady_clock::duration seconds(const std::string& name, double s)
+{
+  if (!(s >= 0 && s <= 3.6e9))
+    throw std::invalid_argument(name + " is negative, not a number or too"
+        " large");
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(s));
+}
+
+bool is_rate(double r)
+{
+  return std::isfinite(r) && r >= 0;
+}
+
+bool is_valid(const rate_limits& limits)
+{
+  return is_rate(limits.requests_per_second) && is_rate(limits.request_burst)
+      && is_rate(limits.bytes_per_second) && is_rate(limits.byte_burst);
+}
+
+void require_file(const std::string& what, const std::string& path)
+{
+  if (::access(path.c_str(), R_OK) != 0)
+    throw std::invalid_argument(what + " cannot be read: " + path);
+}
+
+void require_directory(const std::string& what, const std::string& path)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    throw std::invalid_argument(what + " is not a directory: " + path);
+}
+
+} // namespace
+
+std::vector<boost::asio::ip::tcp::endpoint> server_config::endpoints() const
+{
+  if (!listen.empty())
+    return listen;
+  return { boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port) };
+}
+
+void server_config::validate() const
+{
+  if (threads < 1 || threads > 1024)
+    throw std::invalid_argument("threads must be between 1 and 1024");
+  if (workers > 1024)
+    throw std::invalid_argument("workers must be at most 1024");
+  if (threads > 1 || workers > 0)
+  {
+    std::vector<boost::asio::ip::tcp::endpoint> all = endpoints();
+    all.insert(all.end(), listen_plain.begin(), listen_plain.end());
+    for (const auto& endpoint : all)
+      if (endpoint.port() == 0)
+        throw std::invalid_argument(
+            "several threads or workers need a fixed port to share");
+  }
+  if (backlog < 1)
+    throw std::invalid_argument("backlog must be positive");
+  if (read_buffer_min < 512 || read_buffer_max < read_buffer_min)
+    throw std::invalid_argument("read buffer sizes must be at least 512"
+        " and the largest no smaller than the smallest");
+  if (write_quantum == 0 || writes_in_flight == 0)
+    throw std::invalid_argument(
+        "write quantum and writes in flight must be positive");
+  if (file_reader_threads == 0)
+    throw std::invalid_argument("file reader threads must be positive");
+  if (limits.max_request_line == 0 || limits.max_header_size == 0
+      || limits.max_header_count == 0 || limits.max_header_bytes == 0)
+    throw std::invalid_argument("request limits must be positive");
+  if (!is_valid(per_client) || !is_valid(per_connection))
+    throw std::invalid_argument("rate limits must be finite and not negative");
+  const std::chrono::steady_clock::duration zero =
+      std::chrono::steady_clock::duration::zero();
+  if (timeouts.handshake < zero || timeouts.request < zero
+      || timeouts.idle < zero || timeouts.write < zero
+      || upstream_timeout < zero)
+    throw std::invalid_argument("timeouts must not be negative");
+  if (admission.target < zero || admission.interval <= zero)
+    throw std::invalid_argument("admission target must not be negative"
+        " and its interval must be positive");
+  if (sample_rate == 0)
+    throw std::invalid_argument("sample rate must be at least 1");
+  if (!min_tls_version.empty() && min_tls_version != "1.2"
+      && min_tls_version != "1.3")
+    throw std::invalid_argument("TLS version must be 1.2 or 1.3");
+
+  require_directory("doc root", doc_root);
+  if (!archive.empty())
+  {
+    require_file("archive", archive);
+    // Both need the files of the doc root, which the archive replaces.
+    if (autoindex || table_cache_bytes > 0)
+      throw std::invalid_argument("an archive cannot be combined with"
+          " autoindex or table queries");
+  }
+  if (!upload.root.empty())
+  {
+    require_directory("upload root", upload.root);
+    if (::access(upload.root.c_str(), W_OK) != 0)
+      throw std::invalid_argument("upload root cannot be written: "
+          + upload.root);
+  }
+  require_file("certificate chain", certificate_chain);
+  require_file("private key", private_key);
+  require_file("DH parameters", dh_file);
+  // Without fetching, the response file is all there is.
+  if (!ocsp_response.empty() && !ocsp_fetch)
+    require_file("OCSP response", ocsp_response);
+  // Only one thread fetches; the file passes its responses to the others.
+  if (ocsp_fetch && ocsp_response.empty() && (threads > 1 || workers > 0))
+    throw std::invalid_argument("fetching OCSP responses with several"
+        " threads or workers needs a response file to share them");
+  for (const host& h : hosts)
+  {
+    if (h.name.empty())
+      throw std::invalid_argument("host without a name");
+    require_directory("doc root of " + h.name, h.doc_root);
+    if (!h.certificate_chain.empty())
+      require_file("certificate chain of " + h.name, h.certificate_chain);
+    if (!h.private_key.empty())
+      require_file("private key of " + h.name, h.private_key);
+  }
+  for (const proxy_route& r : routes)
+  {
+    if (r.prefix.empty() || r.prefix[0] != '/')
+      throw std::invalid_argument("proxy prefix must start with '/': "
+          + r.prefix);
+    for (const std::string& url : r.upstreams)
+      if (url.compare(0, 7, "http://") != 0
+          && url.compare(0, 8, "https://") != 0)
+        throw std::invalid_argument("upstream must be an http:// or"
+            " https:// URL: " + url);
+  }
+  if (!upstream_ca_file.empty())
+    require_file("upstream CA file", upstream_ca_file);
+}
+
+bool parse_config(int argc, char* argv[], server_config& config,
+    std::ostream& out)
+{
+  po::options_description general("General");
+  general.add_options()
+    ("help,h", "show this help")
+    ("config", po::value<std::string>(),
+      "read further settings from this file (key = value, [section]s)")
+    ("port", po::value<unsigned short>(), "port on all IPv4 addresses")
+    ("listen", po::value<std::vector<std::string>>(),
+      "address:port to listen on, e.g. [::]:8443 (repeatable)")
+    ("listen-plain", po::value<std::vector<std::string>>(),
+      "port or address:port to serve plain HTTP on (repeatable)")
+    ("threads", po::value<unsigned>(), "threads, each with its own server")
+    ("workers", po::value<unsigned>(),
+      "worker processes, each with that many threads (0: none)")
+    ("cpu-affinity", po::value<std::string>(),
+      "pin each thread to a CPU: on|off")
+    ("backlog", po::value<int>(), "listen backlog")
+    ("doc-root", po::value<std::string>(), "directory served")
+    ("archive", po::value<std::string>(),
+      "serve the default site from this https-pack archive instead")
+    ("host,H", po::value<std::vector<std::string>>()->composing(),
+      "host=doc-root[,cert-chain[,key]]: another site (repeatable)")
+    ("autoindex,a", po::value<std::string>(), "list directories: on|off")
+    ("stats", po::value<std::string>(), "serve counters at /_stats: on|off");
+
+  po::options_description tls("TLS");
+  tls.add_options()
+    ("tls.certificate", po::value<std::string>(), "certificate chain file")
+    ("tls.private-key", po::value<std::string>(), "private key file")
+    ("tls.password", po::value<std::string>(), "private key password")
+    ("tls.dh", po::value<std::string>(), "DH parameters file")
+    ("tls.ciphers", po::value<std::string>(), "OpenSSL cipher list")
+    ("tls.min-version", po::value<std::string>(), "1.2 or 1.3")
+    ("tls.ocsp-response", po::value<std::string>(),
+      "DER OCSP response to staple; fetched responses are saved here")
+    ("tls.ocsp-fetch", po::value<std::string>(),
+      "fetch OCSP responses from the certificate's responder: on|off");
+
+  po::options_description io("I/O");
+  io.add_options()
+    ("io.read-buffer-min", po::value<std::size_t>(), "smallest read buffer")
+    ("io.read-buffer-max", po::value<std::size_t>(), "largest read buffer")
+    ("io.write-quantum", po::value<std::size_t>(),
+      "bytes a connection may write per turn")
+    ("io.writes-in-flight", po::value<std::size_t>(),
+      "writes in progress at once per thread, not counting stalled ones")
+    ("io.uring", po::value<bool>(), "read files with io_uring if possible")
+    ("io.reader-threads", po::value<std::size_t>(),
+      "file reader threads when io_uring is not used");
+
+  po::options_description limits("Limits");
+  limits.add_options()
+    ("limits.request-line", po::value<std::size_t>(), "bytes")
+    ("limits.header-size", po::value<std::size_t>(), "bytes per header")
+    ("limits.header-count", po::value<std::size_t>(), "headers")
+    ("limits.header-bytes", po::value<std::size_t>(), "bytes of headers")
+    ("limits.client-requests", po::value<double>(),
+      "requests per second per client address, in each thread")
+    ("limits.client-request-burst", po::value<double>(), "requests")
+    ("limits.client-bytes", po::value<double>(),
+      "reply bytes per second per client address, in each thread")
+    ("limits.client-byte-burst", po::value<double>(), "bytes")
+    ("limits.connection-requests", po::value<double>(),
+      "requests per second per connection")
+    ("limits.connection-request-burst", po::value<double>(), "requests")
+    ("limits.connection-bytes", po::value<double>(),
+      "reply bytes per second per connection")
+    ("limits.connection-byte-burst", po::value<double>(), "bytes");
+
+  po::options_description timeouts("Timeouts (seconds, 0 for none)");
+  timeouts.add_options()
+    ("timeouts.handshake", po::value<double>(), "TLS handshake")
+    ("timeouts.request", po::value<double>(), "reading a request")
+    ("timeouts.idle", po::value<double>(), "keep-alive wait")
+    ("timeouts.write", po::value<double>(), "one write to the client")
+    ("timeouts.upstream", po::value<double>(),
+      "upstream connect and reply headers");
+
+  po::options_description admission("Load shedding");
+  admission.add_options()
+    ("admission.target-ms", po::value<double>(),
+      "queueing delay to keep requests under (0 never sheds)")
+    ("admission.interval-ms", po::value<double>(),
+      "how long the delay may stay above target before requests are shed");
+
+  po::options_description cache("Caches and logs");
+  cache.add_options()
+    ("cache.file-mb,c", po::value<std::size_t>(),
+      "file cache size in megabytes (0 for none)")
+    ("cache.max-file-kb", po::value<std::size_t>(),
+      "largest file kept in the cache")
+    ("cache.table-mb", po::value<std::size_t>(),
+      "parsed tables for ?x_min=&x_max=&points=&stats&fmt= queries, in "
+      "megabytes (0 turns the queries off)")
+    ("bundle.max-files", po::value<std::size_t>(),
+      "files per /_bundle?f=...&f=... request (0 turns bundles off)")
+    ("upload.root", po::value<std::string>(),
+      "accept PUT and POST uploads into this directory")
+    ("upload.max-mb", po::value<std::size_t>(),
+      "largest upload in megabytes (0 for no limit)")
+    ("upload.fsync", po::value<std::string>(),
+      "flush uploads to disk: none, file (before the rename) or full "
+      "(the directory too)")
+    ("log.access,l", po::value<std::string>(), "JSON-lines access log")
+    ("log.sample-rate,s", po::value<unsigned>(),
+      "log every n-th successful request")
+    ("log.slow-ms,t", po::value<int>(), "report requests slower than this")
+    ("log.trace-file,T", po::value<std::string>(), "Chrome trace file");
+
+  po::options_description proxy("Reverse proxy");
+  proxy.add_options()
+    ("proxy.route,P", po::value<std::vector<std::string>>()->composing(),
+      "prefix=url[,url]: forward matching URIs (repeatable)")
+    ("proxy.ca-file,C", po::value<std::string>(),
+      "CA certificates for HTTPS upstreams");
+
+  po::options_description all("Usage: server <port> [options]");
+  all.add(general).add(tls).add(io).add(limits).add(timeouts)
+      .add(admission).add(cache)
+      .add(proxy);
+  po::positional_options_description positional;
+  positional.add("port", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv)
+        .options(all).positional(positional).run(), vm);
+    if (vm.count("help"))
+    {
+      out << all << "\n";
+      return false;
+    }
+    // Values already stored from the command line are kept.
+    if (vm.count("config"))
+    {
+      const std::string& path = vm["config"].as<std::string>();
+      std::ifstream file(path);
+      if (!file)
+        throw std::invalid_argument("cannot read config file: " + path);
+      po::store(po::parse_config_file(file, all), vm);
+    }
+    po::notify(vm);
+  }
+  catch (const po::error& e)
+  {
+    throw std::invalid_argument(e.what());
+  }
+
+  auto get = [&vm](const char* name, auto& field)
+  {
+    if (vm.count(name))
+      field = vm[name].as<std::decay_t<decltype(field)>>();
+  };
+  auto get_seconds = [&vm](const char* name,
+      std::chrono::steady_clock::duration& field)
+  {
+    if (vm.count(name))
+      field = seconds(name, vm[name].as<double>());
+  };
+
+  if (!vm.count("port") && !vm.count("listen"))
+    throw std::invalid_argument("a port or --listen is required");
+  get("port", config.port);
+  if (vm.count("listen"))
+    for (const std::string& spec : vm["listen"].as<std::vector<std::string>>())
+      config.listen.push_back(parse_endpoint(spec));
+  if (vm.count("listen-plain"))
+    for (const std::string& spec :
+        vm["listen-plain"].as<std::vector<std::string>>())
+      config.listen_plain.push_back(parse_endpoint(spec));
+  get("threads", config.threads);
+  get("workers", config.workers);
+  if (vm.count("cpu-affinity"))
+  {
+    const std::string& value = vm["cpu-affinity"].as<std::string>();
+    if (value != "on" && value != "off")
+      throw std::invalid_argument("cpu-affinity must be on or off");
+    config.cpu_affinity = value == "on";
+  }
+  get("backlog", config.backlog);
+  get("doc-root", config.doc_root);
+  get("archive", config.archive);
+  if (vm.count("autoindex"))
+  {
+    const std::string& value = vm["autoindex"].as<std::string>();
+    if (value != "on" && value != "off")
+      throw std::invalid_argument("autoindex must be on or off");
+    config.autoindex = value == "on";
+  }
+  if (vm.count("host"))
+  {
+    for (const std::string& spec : vm["host"].as<std::vector<std::string>>())
+    {
+      server_config::host h;
+      std::vector<std::string> parts;
+      if (!split_spec(spec, h.name, parts))
+        throw std::invalid_argument("bad host: " + spec);
+      parts.resize(3);
+      h.doc_root = parts[0];
+      h.certificate_chain = parts[1];
+      h.private_key = parts[2].empty() ? parts[1] : parts[2];
+      config.hosts.push_back(h);
+    }
+  }
+
+  get("tls.certificate", config.certificate_chain);
+  get("tls.private-key", config.private_key);
+  get("tls.password", config.password);
+  get("tls.dh", config.dh_file);
+  get("tls.ciphers", config.ciphers);
+  get("tls.min-version", config.min_tls_version);
+  get("tls.ocsp-response", config.ocsp_response);
+  if (vm.count("tls.ocsp-fetch"))
+  {
+    const std::string& value = vm["tls.ocsp-fetch"].as<std::string>();
+    if (value != "on" && value != "off")
+      throw std::invalid_argument("tls.ocsp-fetch must be on or off");
+    config.ocsp_fetch = value == "on";
+  }
+
+  get("io.read-buffer-min", config.read_buffer_min);
+  get("io.read-buffer-max", config.read_buffer_max);
+  get("io.write-quantum", config.write_quantum);
+  get("io.writes-in-flight", config.writes_in_flight);
+  get("io.uring", config.io_uring);
+  get("io.reader-threads", config.file_reader_threads);
+
+  get("limits.request-line", config.limits.max_request_line);
+  get("limits.header-size", config.limits.max_header_size);
+  get("limits.header-count", config.limits.max_header_count);
+  get("limits.header-bytes", config.limits.max_header_bytes);
+  get("limits.client-requests", config.per_client.requests_per_second);
+  get("limits.client-request-burst", config.per_client.request_burst);
+  get("limits.client-bytes", config.per_client.bytes_per_second);
+  get("limits.client-byte-burst", config.per_client.byte_burst);
+  get("limits.connection-requests",
+      config.per_connection.requests_per_second);
+  get("limits.connection-request-burst",
+      config.per_connection.request_burst);
+  get("limits.connection-bytes", config.per_connection.bytes_per_second);
+  get("limits.connection-byte-burst", config.per_connection.byte_burst);
+
+  get_seconds("timeouts.handshake", config.timeouts.handshake);
+  get_seconds("timeouts.request", config.timeouts.request);
+  get_seconds("timeouts.idle", config.timeouts.idle);
+  get_seconds("timeouts.write", config.timeouts.write);
+  get_seconds("timeouts.upstream", config.upstream_timeout);
+
+  if (vm.count("admission.target-ms"))
+    config.admission.target =
+        seconds("admission.target-ms",
+            vm["admission.target-ms"].as<double>() / 1000);
+  if (vm.count("admission.interval-ms"))
+    config.admission.interval =
+        seconds("admission.interval-ms",
+            vm["admission.interval-ms"].as<double>() / 1000);
+  if (vm.count("stats"))
+  {
+    const std::string& value = vm["stats"].as<std::string>();
+    if (value != "on" && value != "off")
+      throw std::invalid_argument("stats must be on or off");
+    config.stats = value == "on";
+  }
+
+  if (vm.count("cache.file-mb"))
+    config.file_cache_bytes = vm["cache.file-mb"].as<std::size_t>() << 20;
+  if (vm.count("cache.max-file-kb"))
+    config.file_cache_max_file =
+        vm["cache.max-file-kb"].as<std::size_t>() << 10;
+  if (vm.count("cache.table-mb"))
+    config.table_cache_bytes = vm["cache.table-mb"].as<std::size_t>() << 20;
+  get("bundle.max-files", config.bundle_max_files);
+  get("upload.root", config.upload.root);
+  if (vm.count("upload.max-mb"))
+    config.upload.max_bytes =
+        std::uint64_t(vm["upload.max-mb"].as<std::size_t>()) << 20;
+  if (vm.count("upload.fsync"))
+  {
+    const std::string& value = vm["upload.fsync"].as<std::string>();
+    if (value == "none")
+      config.upload.sync = upload_config::sync_none;
+    else if (value == "file")
+      config.upload.sync = upload_config::sync_file;
+    else if (value == "full")
+      config.upload.sync = upload_config::sync_full;
+    else
+      throw std::invalid_argument("upload.fsync must be none, file or full");
+  }
+  get("log.access", config.access_log);
+  get("log.sample-rate", config.sample_rate);
+  if (vm.count("log.slow-ms"))
+    config.slow_threshold =
+        std::chrono::milliseconds(vm["log.slow-ms"].as<int>());
+  get("log.trace-file", config.trace_file);
+
+  if (vm.count("proxy.route"))
+  {
+    for (const std::string& spec :
+        vm["proxy.route"].as<std::vector<std::string>>())
+    {
+      server_config::proxy_route r;
+      if (!split_spec(spec, r.prefix, r.upstreams))
+        throw std::invalid_argument("bad proxy route: " + spec);
+      config.routes.push_back(r);
+    }
+  }
+  get("proxy.ca-file", config.upstream_ca_file);
+
+  config.validate();
+  return true;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,163 @@
+#ifndef HTTP_SERVER_CONFIG_HPP
+#define HTTP_SERVER_CONFIG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "admission.hpp"
+#include "rate_limiter.hpp"
+#include "request_parser.hpp"
+#include "upload_store.hpp"
+
+namespace http {
+namespace server {
+
+/// Timeouts applied to each connection. Zero means none.
+struct session_timeouts
+{
+  /// From accept to the end of the TLS handshake.
+  std::chrono::steady_clock::duration handshake = std::chrono::seconds(10);
+
+  /// From the first byte of a request to its end, and between the pieces
+  /// of a request body.
+  std::chrono::steady_clock::duration request = std::chrono::seconds(30);
+
+  /// How long a keep-alive connection may wait for its next request.
+  std::chrono::steady_clock::duration idle = std::chrono::seconds(60);
+
+  /// How long a single write to the client may take.
+  std::chrono::steady_clock::duration write = std::chrono::seconds(60);
+};
+
+/// Everything about a server that can be tuned without a rebuild. The
+/// defaults are what the server did before it could be configured.
+struct server_config
+{
+  /// Addresses to listen on. Without any, port is used on all IPv4
+  /// addresses.
+  std::vector<boost::asio::ip::tcp::endpoint> listen;
+  unsigned short port = 0;
+
+  /// Addresses to serve plain HTTP on as well, for traffic whose TLS ends
+  /// at a load balancer in front of the server, and for benchmarks.
+  std::vector<boost::asio::ip::tcp::endpoint> listen_plain;
+  int backlog = boost::asio::socket_base::max_listen_connections;
+
+  /// Threads, each running its own server on the same sockets
+  /// (SO_REUSEPORT) so that they share nothing.
+  unsigned threads = 1;
+
+  /// Worker processes, each with threads of its own, run by a supervisor
+  /// that restarts them if they die; 0 serves from this process. With
+  /// cpu_affinity every thread is pinned to a CPU of its own, as far as
+  /// they go round.
+  unsigned workers = 0;
+  bool cpu_affinity = false;
+
+  std::string doc_root = ".";
+
+  /// If set, the default site is served from this archive (made by
+  /// https-pack) instead of doc_root, bundles included. Directory
+  /// listings and table queries read the doc root, so they cannot be
+  /// turned on with it.
+  std::string archive;
+
+  /// TLS: the default certificate, its key and the key's password, the DH
+  /// parameters, and optionally the ciphers and oldest version allowed
+  /// ("1.2" or "1.3").
+  std::string certificate_chain = "server.crt";
+  std::string private_key = "server.key";
+  std::string password = "test";
+  std::string dh_file = "dh2048.pem";
+  std::string ciphers;
+  std::string min_tls_version;
+
+  /// OCSP stapling for the default certificate: a DER response file,
+  /// re-read when it changes, and whether to fetch responses from the
+  /// certificate's responder (saving them to the file, if given). With
+  /// several threads or workers only the first thread of worker 0 fetches
+  /// and the others read the file, which is then required.
+  std::string ocsp_response;
+  bool ocsp_fetch = false;
+
+  /// Read buffer sizes, the write scheduler's quantum and concurrency, and
+  /// the file reader.
+  std::size_t read_buffer_min = 4096;
+  std::size_t read_buffer_max = 65536;
+  std::size_t write_quantum = 16384;
+  std::size_t writes_in_flight = 64;
+  bool io_uring = true;
+  std::size_t file_reader_threads = 2;
+
+  request_limits limits;
+  rate_limits per_client;
+  rate_limits per_connection;
+  session_timeouts timeouts;
+  admission_limits admission;
+
+  /// Caches: file contents (0 disables), directory listings, and parsed
+  /// tables for queries (0 disables the queries).
+  std::size_t file_cache_bytes = 0;
+  std::size_t file_cache_max_file = 1024 * 1024;
+  bool autoindex = false;
+  std::size_t table_cache_bytes = 0;
+
+  /// The most files one /_bundle request may ask for; 0 turns it off.
+  std::size_t bundle_max_files = 0;
+
+  /// PUT and POST uploads, accepted if the root is set.
+  upload_config upload;
+
+  /// Whether /_stats serves the server's counters.
+  bool stats = false;
+
+  /// Logging and tracing.
+  std::string access_log;
+  unsigned sample_rate = 1;
+  std::chrono::milliseconds slow_threshold{0};
+  std::string trace_file;
+
+  /// Further sites, chosen by Host header and SNI.
+  struct host
+  {
+    std::string name;
+    std::string doc_root;
+    std::string certificate_chain;
+    std::string private_key;
+  };
+  std::vector<host> hosts;
+
+  /// URI prefixes forwarded to upstream servers.
+  struct proxy_route
+  {
+    std::string prefix;
+    std::vector<std::string> upstreams;
+  };
+  std::vector<proxy_route> routes;
+  std::string upstream_ca_file;
+  std::chrono::steady_clock::duration upstream_timeout =
+      std::chrono::seconds(30);
+
+  /// The addresses to listen on, from listen or port.
+  std::vector<boost::asio::ip::tcp::endpoint> endpoints() const;
+
+  /// Check the settings for consistency and that the files they name can
+  /// be read. Throws std::invalid_argument naming the first problem.
+  void validate() const;
+};
+
+/// Fill config from the command line and from the configuration file it
+/// names (--config), command-line values taking precedence. Returns false,
+/// after writing the usage to out, if help was asked for. Throws
+/// std::invalid_argument on a bad option or value.
+bool parse_config(int argc, char* argv[], server_config& config,
+    std::ostream& out);
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SERVER_CONFIG_HPP
@@ -0,0 +1,804 @@
+#include "session.hpp"
+#include <algorithm>
+#include <csignal>
+#include <strings.h>
+#include <boost/bind.hpp>
+
+#include "access_log.hpp"
+#include "proxy.hpp"
+#include "request_handler.hpp"
+#include "upload_store.hpp"
+#include "virtual_hosts.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+const char continue_line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+} // namespace
+
+/// The body of the session's current request, for the proxy to forward or
+/// an upload to store, with any chunked framing removed. It outlives the
+/// session if the proxy still holds it; reads then fail.
+template <typename Stream>
+class basic_session<Stream>::request_body : public body_stream
+{
+public:
+  explicit request_body(basic_session* owner)
+    : owner_(owner), io_context_(owner->m_io_context) {}
+
+  void async_read_some(boost::asio::mutable_buffer buffer,
+      body_handler handler) override
+  {
+    basic_session* s = owner_;
+    if (!s)
+    {
+      boost::asio::post(io_context_, [handler]()
+          { handler(boost::asio::error::operation_aborted, 0); });
+      return;
+    }
+    if (s->chunked_)
+    {
+      read_chunked(s, buffer, handler);
+      return;
+    }
+
+    // First the bytes that were read along with the headers.
+    if (s->body_prefix_offset_ < s->body_prefix_.size())
+    {
+      std::size_t n = boost::asio::buffer_copy(buffer, boost::asio::buffer(
+            s->body_prefix_) + s->body_prefix_offset_);
+      s->body_prefix_offset_ += n;
+      boost::asio::post(io_context_, [handler, n]()
+          { handler(boost::system::error_code(), n); });
+      return;
+    }
+    if (s->body_remaining_ == 0)
+    {
+      boost::asio::post(io_context_, [handler]()
+          { handler(boost::system::error_code(), 0); });
+      return;
+    }
+
+    read_socket(s, boost::asio::buffer(buffer, s->body_remaining_),
+        [s, handler](const boost::system::error_code& ec, std::size_t n)
+        {
+          // After an error the session may be gone.
+          if (!ec)
+            s->body_remaining_ -= n;
+          handler(ec, n);
+        });
+  }
+
+  basic_session* owner_;
+
+private:
+  /// Read what the client sends, first telling it to go ahead if it is
+  /// waiting for that.
+  void read_socket(basic_session* s, boost::asio::mutable_buffer buffer,
+      body_handler done)
+  {
+    s->body_reading_ = true;
+    if (s->continue_pending_)
+    {
+      s->continue_pending_ = false;
+      s->arm(s->timeouts_.write);
+      boost::asio::async_write(s->socket_, boost::asio::buffer(
+            continue_line, sizeof(continue_line) - 1),
+          [this, s, buffer, done](const boost::system::error_code& ec,
+            std::size_t)
+          {
+            if (finished(s, ec, done))
+              return;
+            if (ec)
+              done(ec, 0);
+            else
+              read_socket(s, buffer, done);
+          });
+      return;
+    }
+    s->arm(s->timeouts_.request);
+    s->socket_.async_read_some(buffer,
+        [s, done](const boost::system::error_code& ec, std::size_t n)
+        {
+          if (!finished(s, ec, done))
+            done(ec, n);
+        });
+  }
+
+  /// Note that an operation on the socket has completed. If the session
+  /// was closed while it was pending, delete it now and fail the read.
+  static bool finished(basic_session* s, boost::system::error_code ec,
+      const body_handler& done)
+  {
+    s->body_reading_ = false;
+    s->arm(std::chrono::steady_clock::duration::zero());
+    if (!s->closing_)
+      return false;
+    delete s;
+    done(ec ? ec : boost::asio::error::operation_aborted, 0);
+    return true;
+  }
+
+  /// Read raw bytes into the caller's buffer and decode them there.
+  void read_chunked(basic_session* s, boost::asio::mutable_buffer buffer,
+      body_handler handler)
+  {
+    if (s->chunked_decoder_.finished())
+    {
+      boost::asio::post(io_context_, [handler]()
+          { handler(boost::system::error_code(), 0); });
+      return;
+    }
+    if (s->body_prefix_offset_ < s->body_prefix_.size())
+    {
+      std::size_t n = boost::asio::buffer_copy(buffer, boost::asio::buffer(
+            s->body_prefix_) + s->body_prefix_offset_);
+      s->body_prefix_offset_ += n;
+      decode(s, buffer, n, [this, handler](
+            const boost::system::error_code& ec, std::size_t n)
+          {
+            boost::asio::post(io_context_, [handler, ec, n]()
+                { handler(ec, n); });
+          });
+      return;
+    }
+    read_socket(s, buffer, [this, s, buffer, handler](
+          const boost::system::error_code& ec, std::size_t n)
+        {
+          if (ec)
+            handler(ec, 0);
+          else
+            decode(s, buffer, n, handler);
+        });
+  }
+
+  /// Decode n raw bytes at the start of buffer and pass on the payload.
+  /// If there is none yet, read on.
+  void decode(basic_session* s, boost::asio::mutable_buffer buffer,
+      std::size_t n, body_handler handler)
+  {
+    std::size_t decoded, consumed;
+    chunked_decoder::result_type result = s->chunked_decoder_.decode(
+        static_cast<char*>(buffer.data()), n, decoded, consumed);
+    if (result == chunked_decoder::bad)
+      handler(boost::system::errc::make_error_code(
+            boost::system::errc::bad_message), 0);
+    else if (decoded == 0 && result == chunked_decoder::more)
+      read_chunked(s, buffer, handler);
+    else
+      handler(boost::system::error_code(), decoded);
+  }
+
+  boost::asio::io_context& io_context_;
+};
+
+template <typename Stream>
+std::atomic<std::size_t> basic_session<Stream>::live_{ 0 };
+
+template <typename Stream>
+Stream basic_session<Stream>::open(boost::asio::io_context& io_context,
+    boost::asio::ssl::context* context)
+{
+  if constexpr (is_tls)
+    return Stream(io_context, *context);
+  else
+    return Stream(io_context);
+}
+
+template <typename Stream>
+basic_session<Stream>::basic_session(boost::asio::io_context& io_context,
+    boost::asio::ssl::context* context,
+    const session_services& services)
+  : m_io_context(io_context),
+    socket_(open(io_context, context)),
+    hosts_(services.hosts),
+    buffer_pool_(services.buffers),
+    read_size_(services.buffers.min_size()),
+    request_arena_(services.limits.arena_capacity()),
+    request_(&request_arena_),
+    request_parser_(request_arena_, services.limits),
+    admission_(services.admission),
+    stats_(services.stats),
+    write_scheduler_(services.scheduler),
+    proxy_(services.forwarding),
+    uploads_(services.uploads),
+    rate_limiter_(services.limiter),
+    throttle_timer_(io_context),
+    timeouts_(services.timeouts),
+    deadline_(io_context),
+    alive_(std::make_shared<basic_session*>(this)),
+    access_log_(services.log),
+    tracer_(services.tracer)
+{
+  live_.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Stream>
+basic_session<Stream>::~basic_session()
+{
+  live_.fetch_sub(1, std::memory_order_relaxed);
+  if (request_body_)
+    request_body_->owner_ = nullptr;
+  write_scheduler_.remove(this);
+}
+
+template <typename Stream>
+void basic_session<Stream>::arm(std::chrono::steady_clock::duration timeout)
+{
+  if (timeout == std::chrono::steady_clock::duration::zero())
+  {
+    deadline_.expires_at(std::chrono::steady_clock::time_point::max());
+    return;
+  }
+  deadline_.expires_after(timeout);
+  std::weak_ptr<basic_session*> alive = alive_;
+  deadline_.async_wait([alive](const boost::system::error_code& ec)
+      {
+        std::shared_ptr<basic_session*> s = alive.lock();
+        if (ec || !s)
+          return;
+        // The deadline may have been moved after this wait completed.
+        basic_session* self = *s;
+        if (self->deadline_.expiry() > std::chrono::steady_clock::now())
+          return;
+        boost::system::error_code ignored_ec;
+        self->socket().close(ignored_ec);
+      });
+}
+
+template <typename Stream>
+void basic_session<Stream>::start()
+{
+  trace_.mark(trace_accepted);
+  if (tracer_)
+    connection_id_ = tracer_->new_connection();
+  boost::system::error_code ec;
+  boost::asio::ip::tcp::endpoint peer = socket().remote_endpoint(ec);
+  peer_ = peer.address();
+  // Replies are written a record at a time, so there is nothing for Nagle
+  // to merge; it would only hold back the last segment of each reply.
+  socket().set_option(boost::asio::ip::tcp::no_delay(true), ec);
+  rate_ticket_ = rate_limiter_.attach(peer.address());
+  if constexpr (is_tls)
+  {
+    if (access_log_)
+    {
+      SSL_set_msg_callback(socket_.native_handle(),
+          &basic_session::count_records);
+      SSL_set_msg_callback_arg(socket_.native_handle(), this);
+    }
+    arm(timeouts_.handshake);
+    socket_.async_handshake(boost::asio::ssl::stream_base::server,
+        boost::bind(&basic_session::handle_handshake, this,
+          boost::asio::placeholders::error));
+  }
+  else
+  {
+    handle_handshake(boost::system::error_code());
+  }
+}
+
+template <typename Stream>
+void basic_session<Stream>::handle_handshake(
+    const boost::system::error_code& error)
+{
+  if (!error)
+  {
+    trace_.mark(trace_handshaken);
+    if constexpr (is_tls)
+      resumed_ = SSL_session_reused(socket_.native_handle()) == 1;
+    do_read();
+  }
+  else
+  {
+    delete this;
+  }
+}
+
+template <typename Stream>
+void basic_session<Stream>::do_read()
+{
+  // Data may already be waiting inside the TLS layer: decrypted bytes in
+  // OpenSSL or undecrypted records in its read BIO. Only when both are
+  // empty is it safe to wait for the socket. (asio can also hold back
+  // ciphertext that did not fit in the BIO, but only when a client sends
+  // more than a record's worth ahead of our replies.) A plain socket
+  // holds nothing back.
+  if constexpr (is_tls)
+  {
+    SSL* ssl = socket_.native_handle();
+    if (SSL_pending(ssl) > 0 || BIO_ctrl_pending(SSL_get_rbio(ssl)) > 0)
+    {
+      read_request();
+      return;
+    }
+  }
+
+  // An idle connection waits for readiness without a buffer. Once part of
+  // a request is in, the rest must follow within the request timeout.
+  arm(trace_.has(trace_received) ? timeouts_.request : timeouts_.idle);
+  socket().async_wait(boost::asio::ip::tcp::socket::wait_read,
+      [this](boost::system::error_code ec)
+      {
+        if (!ec)
+          read_request();
+        else
+          delete this;
+      });
+}
+
+template <typename Stream>
+void basic_session<Stream>::read_request()
+{
+  read_start_ = std::chrono::steady_clock::now();
+  auto buffer = std::make_shared<buffer_pool::buffer>(
+      buffer_pool_.acquire(read_size_));
+  socket_.async_read_some(boost::asio::buffer(buffer->data(), buffer->size()),
+      [this, buffer](boost::system::error_code ec,
+        std::size_t bytes_transferred)
+      {
+        if (!ec)
+        {
+          if (!trace_.has(trace_received))
+          {
+            trace_.mark(trace_received);
+            request_time_ = std::chrono::system_clock::now();
+            sojourn_ = std::chrono::steady_clock::now() - read_start_;
+          }
+
+          const char* data = buffer->data();
+          const char* end = data + bytes_transferred;
+          request_parser::result_type result;
+          const char* consumed;
+          std::tie(result, consumed) = request_parser_.parse(
+              request_, data, end);
+
+          // The parser has copied what it needs, and the start of any body
+          // is copied below; return the buffer before doing anything slow.
+          // A request that fills the buffer gets a bigger one next time, up
+          // to the largest size class.
+          if (bytes_transferred == buffer->size())
+            read_size_ = std::min(read_size_ * 2, buffer_pool_.max_size());
+          else if (result != request_parser::indeterminate)
+            read_size_ = buffer_pool_.min_size();
+          if (result == request_parser::good)
+            body_prefix_.assign(consumed, end);
+          buffer->release();
+
+          if (result != request_parser::indeterminate)
+          {
+            trace_.mark(trace_parsed);
+            arm(std::chrono::steady_clock::duration::zero());
+          }
+
+          rate_clock::duration retry_after;
+          if (result == request_parser::good
+              && !admission_.admit(sojourn_, established_,
+                rate_clock::now()))
+          {
+            // A new client is turned away altogether, which is what
+            // relieves the server; an established one keeps its
+            // connection.
+            reply_ = reply::stock_reply(reply::service_unavailable);
+            reply_.headers.push_back(header{ "Retry-After", "1" });
+            if (!established_ || announces_body())
+              close_after_reply_ = true;
+            do_write();
+          }
+          else if (result == request_parser::good
+              && !rate_ticket_.admit_request(rate_clock::now(),
+                retry_after))
+          {
+            reply_ = reply::stock_reply(reply::too_many_requests);
+            auto seconds = std::chrono::duration_cast<
+              std::chrono::seconds>(retry_after).count() + 1;
+            reply_.headers.push_back(
+                header{ "Retry-After", std::to_string(seconds) });
+            if (announces_body())
+              close_after_reply_ = true;
+            do_write();
+          }
+          else if (result == request_parser::good)
+          {
+            handle_request();
+          }
+          else if (result == request_parser::bad)
+          {
+            // After a request that could not be parsed, or was cut off at
+            // a limit, there is no telling where the next one starts.
+            reply_ = reply::stock_reply(reply::bad_request);
+            close_after_reply_ = true;
+            do_write();
+          }
+          else if (result == request_parser::uri_too_long)
+          {
+            reply_ = reply::stock_reply(reply::uri_too_long);
+            close_after_reply_ = true;
+            do_write();
+          }
+          else if (result == request_parser::headers_too_large)
+          {
+            reply_ = reply::stock_reply(
+                reply::request_header_fields_too_large);
+            close_after_reply_ = true;
+            do_write();
+          }
+          else if (result == request_parser::shutdown)
+          {
+            // Initiate graceful connection closure.
+            // server::do_await_stop() is waiting for it:
+            std::raise(SIGINT);
+            close();
+          }
+          else
+          {
+            do_read();
+          }
+        }
+        else
+        {
+          delete this;
+        }
+      });
+}
+
+template <typename Stream>
+void basic_session<Stream>::handle_request()
+{
+  if (stats_ && request_.uri == "/_stats")
+  {
+    reply_.status = reply::ok;
+    reply_.content = stats_();
+    reply_.headers.push_back(header{ "Content-Length",
+        std::to_string(reply_.content.size()) });
+    reply_.headers.push_back(header{ "Content-Type", "application/json" });
+    reply_.headers.push_back(header{ "Cache-Control", "no-store" });
+    if (announces_body())
+      close_after_reply_ = true;
+    do_write();
+    return;
+  }
+
+  proxy_route* route = proxy_ ? proxy_->match(request_.uri) : nullptr;
+  bool upload = uploads_ && !route
+      && (request_.method == "PUT" || request_.method == "POST");
+  auto refuse = [this](reply::status_type status)
+  {
+    reply_ = reply::stock_reply(status);
+    close_after_reply_ = true;
+    do_write();
+  };
+
+  // The body is delimited by Content-Length, or for uploads, which can
+  // take a body of unknown length, by chunked framing. Anything else is
+  // refused rather than mistaken for the next request.
+  std::size_t body_size = 0;
+  const header_view* length = request_.find_header(content_length_header);
+  if (length && std::count_if(request_.headers.begin(),
+        request_.headers.end(), [](const header_view& h)
+        {
+          return lookup_known_header(h.name.data(), h.name.size())
+              == content_length_header;
+        }) > 1)
+  {
+    // Only the first would be used here, and an upstream might go by
+    // another.
+    refuse(reply::bad_request);
+    return;
+  }
+  if (const header_view* coding =
+      request_.find_header(transfer_encoding_header))
+  {
+    if (!upload || length || coding->value.size() != 7
+        || ::strncasecmp(coding->value.data(), "chunked", 7) != 0)
+    {
+      refuse(reply::not_implemented);
+      return;
+    }
+    chunked_ = true;
+  }
+  else if (length)
+  {
+    std::string_view value = length->value;
+    if (value.empty() || value.size() > 18
+        || value.find_first_not_of("0123456789") != std::string_view::npos)
+    {
+      refuse(reply::bad_request);
+      return;
+    }
+    for (char c : value)
+      body_size = body_size * 10 + (c - '0');
+  }
+  else if (upload)
+  {
+    refuse(reply::length_required);
+    return;
+  }
+  // Bytes past the body belong to a pipelined request, which is not
+  // supported, so they are dropped as before.
+  if (!chunked_ && body_prefix_.size() > body_size)
+    body_prefix_.resize(body_size);
+  body_prefix_offset_ = 0;
+  body_remaining_ = chunked_ ? 0 : body_size - body_prefix_.size();
+
+  // A client that asks first is told to go ahead on the first read of
+  // the body, so that a refused request never sends it.
+  const header_view* expect = request_.find_header(expect_header);
+  if (expect && (route || upload))
+  {
+    if (expect->value.size() != 12
+        || ::strncasecmp(expect->value.data(), "100-continue", 12) != 0)
+    {
+      refuse(reply::expectation_failed);
+      return;
+    }
+    continue_pending_ = body_prefix_.empty()
+        && (request_.http_version_major > 1
+          || request_.http_version_minor >= 1);
+  }
+
+  if (route)
+  {
+    if (!request_body_)
+      request_body_ = std::make_shared<request_body>(this);
+    proxy_->async_handle_request(*route, request_, reply_, request_body_,
+        body_size, peer_, is_tls ? "https" : "http",
+        [this]() { do_write(); });
+    return;
+  }
+
+  if (upload)
+  {
+    if (!request_body_)
+      request_body_ = std::make_shared<request_body>(this);
+    uploads_->async_store(request_, request_body_,
+        chunked_ ? upload_store::unknown_length : body_size, reply_,
+        [this]() { do_write(); });
+    return;
+  }
+
+  const header_view* host = request_.find_header(host_header);
+  request_handler& handler =
+      hosts_.route(host ? host->value : std::string_view());
+  handler.async_handle_request(request_, reply_,
+      [this]() { do_write(); });
+}
+
+template <typename Stream>
+bool basic_session<Stream>::announces_body() const
+{
+  const header_view* length = request_.find_header(content_length_header);
+  return request_.find_header(transfer_encoding_header)
+      || (length && length->value.find_first_not_of('0')
+        != std::string_view::npos);
+}
+
+template <typename Stream>
+void basic_session<Stream>::do_write()
+{
+  trace_.mark(trace_handled);
+
+  // The reply is sent in pieces handed out by the write scheduler.
+  write_buffers_ = reply_.to_coalesced_buffers(write_head_, tls_record_size);
+  if (reply_.body)
+  {
+    // Without a length the client can only see the end of the body when
+    // the connection closes.
+    bool has_length = std::any_of(reply_.headers.begin(),
+        reply_.headers.end(), [](const header& h)
+        { return ::strcasecmp(h.name.c_str(), "Content-Length") == 0; });
+    if (!has_length)
+      close_after_reply_ = true;
+  }
+  write_offset_ = 0;
+  write_total_ = boost::asio::buffer_size(write_buffers_);
+  write_scheduler_.schedule(this);
+}
+
+template <typename Stream>
+void basic_session<Stream>::write_some(std::size_t max_bytes,
+    write_scheduler::done_handler done)
+{
+  // One record per write: asio hands each buffer to its own SSL_write, and
+  // each SSL_write goes out as its own socket write. A plain socket takes
+  // the whole turn in one gathered write.
+  std::size_t wanted = std::min(max_bytes, write_total_ - write_offset_);
+  if constexpr (is_tls)
+    wanted = std::min(wanted, std::size_t(tls_record_size));
+  rate_clock::duration delay;
+  std::size_t granted =
+      rate_ticket_.grant_bytes(wanted, rate_clock::now(), delay);
+  if (granted == 0)
+  {
+    // Over the byte rate: give up the turn and queue again once there
+    // are tokens.
+    done(0, false);
+    throttle_timer_.expires_after(delay);
+    throttle_timer_.async_wait(
+        [this](boost::system::error_code ec)
+        {
+          if (!ec)
+            write_scheduler_.schedule(this);
+        });
+    return;
+  }
+
+  if (!trace_.has(trace_first_write))
+    trace_.mark(trace_first_write);
+  arm(timeouts_.write);
+  boost::asio::async_write(socket_,
+      slice_buffers(write_buffers_, write_offset_, granted),
+      [this, done](boost::system::error_code ec, std::size_t n)
+      {
+        arm(std::chrono::steady_clock::duration::zero());
+        write_offset_ += n;
+        bytes_sent_ += n;
+        bool more = !ec && write_offset_ < write_total_;
+        done(n, more);
+        if (ec)
+          close();
+        else if (!more && reply_.body)
+          write_body();
+        else if (!more)
+          handle_reply_sent();
+      });
+}
+
+template <typename Stream>
+void basic_session<Stream>::write_body()
+{
+  // One piece at a time, so at most a record's worth of the body is held
+  // here however fast the source is.
+  if (!body_buffer_)
+    body_buffer_ = buffer_pool_.acquire(tls_record_size);
+  std::shared_ptr<body_stream> body = reply_.body;
+  body->async_read_some(
+      boost::asio::buffer(body_buffer_.data(), body_buffer_.size()),
+      [this, body](const boost::system::error_code& ec, std::size_t n)
+      {
+        if (ec)
+        {
+          // The headers are out; all that can be done is to cut the reply
+          // short.
+          close();
+          return;
+        }
+        if (n == 0)
+        {
+          body_buffer_.release();
+          handle_reply_sent();
+          return;
+        }
+        write_buffers_.assign(1,
+            boost::asio::buffer(body_buffer_.data(), n));
+        write_offset_ = 0;
+        write_total_ = n;
+        write_scheduler_.schedule(this);
+      });
+}
+
+template <typename Stream>
+void basic_session<Stream>::handle_reply_sent()
+{
+  trace_.mark(trace_written);
+  if (access_log_)
+    log_request();
+  if (tracer_)
+    tracer_->finish(connection_id_, trace_, request_.method, request_.uri,
+        reply_.status);
+  trace_.clear();
+  established_ = true;
+  records_written_ = 0;
+  bytes_sent_ = 0;
+
+  // A body left unread would be taken for the next request.
+  if (close_after_reply_ || body_remaining_ > 0
+      || (chunked_ && !chunked_decoder_.finished()))
+  {
+    close();
+    return;
+  }
+  chunked_ = false;
+  chunked_decoder_ = chunked_decoder();
+  continue_pending_ = false;
+  std::string().swap(body_prefix_);
+
+  // Get ready for the next request on this connection. The request
+  // refers to the arena, so clear it first.
+  request_.clear();
+  request_arena_.reset();
+  request_parser_.reset();
+  reply_ = reply();
+  write_buffers_.clear();
+  // A large reply leaves a record-sized head behind; don't keep it idle.
+  if (write_head_.capacity() > buffer_pool_.min_size())
+    std::string().swap(write_head_);
+  do_read();
+}
+
+template <typename Stream>
+void basic_session<Stream>::close()
+{
+  boost::system::error_code ignored_ec;
+  socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both,
+      ignored_ec);
+  socket().close(ignored_ec);
+  // The read fails now that the socket is closed, and finishes the job.
+  if (body_reading_)
+  {
+    closing_ = true;
+    return;
+  }
+  delete this;
+}
+
+template <typename Stream>
+void basic_session<Stream>::log_request()
+{
+  if (!access_log_->sample(reply_.status))
+    return;
+
+  access_record record;
+  record.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      request_time_.time_since_epoch()).count();
+  record.handshake_us = static_cast<std::uint32_t>(
+      trace_.between(trace_accepted, trace_handshaken).count());
+  record.resumed = resumed_;
+  record.ttfb_us = static_cast<std::uint32_t>(
+      trace_.between(trace_received, trace_first_write).count());
+  record.total_us = static_cast<std::uint32_t>(
+      trace_.between(trace_received, trace_written).count());
+  record.status = static_cast<std::uint16_t>(reply_.status);
+  record.bytes = bytes_sent_;
+  record.records = static_cast<std::uint32_t>(records_written_);
+  record.set_request(request_.method, request_.uri);
+  access_log_->log(record);
+}
+
+template <typename Stream>
+void basic_session<Stream>::count_records(int write_p, int, int content_type,
+    const void* buf, std::size_t len, SSL* ssl, void* arg)
+{
+  // Count application data only. TLS 1.3 hides the real type inside the
+  // record and reports it separately; before that it is in the header.
+  const unsigned char* bytes = static_cast<const unsigned char*>(buf);
+  int wanted = SSL_version(ssl) == TLS1_3_VERSION
+      ? SSL3_RT_INNER_CONTENT_TYPE
+      : SSL3_RT_HEADER;
+  if (write_p && content_type == wanted && len >= 1
+      && bytes[0] == SSL3_RT_APPLICATION_DATA)
+    ++static_cast<basic_session*>(arg)->records_written_;
+}
+
+template <typename Stream>
+std::vector<boost::asio::const_buffer> basic_session<Stream>::slice_buffers(
+    const std::vector<boost::asio::const_buffer>& buffers,
+    std::size_t offset, std::size_t size)
+{
+  std::vector<boost::asio::const_buffer> result;
+  for (const boost::asio::const_buffer& b : buffers)
+  {
+    if (size == 0)
+      break;
+    if (offset >= b.size())
+    {
+      offset -= b.size();
+      continue;
+    }
+    std::size_t n = std::min(b.size() - offset, size);
+    result.push_back(boost::asio::buffer(
+          static_cast<const char*>(b.data()) + offset, n));
+    offset = 0;
+    size -= n;
+  }
+  return result;
+}
+
+template class basic_session<ssl_socket>;
+template class basic_session<boost::asio::ip::tcp::socket>;
+
+} // namespace server
+} // namespace http
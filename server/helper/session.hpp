@@ -0,0 +1,261 @@
+#ifndef HTTP_SESSION_HPP
+#define HTTP_SESSION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "admission.hpp"
+#include "buffer_pool.hpp"
+#include "chunked_decoder.hpp"
+#include "rate_limiter.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_arena.hpp"
+#include "request_parser.hpp"
+#include "request_trace.hpp"
+#include "server_config.hpp"
+#include "write_scheduler.hpp"
+
+namespace http {
+namespace server {
+
+class access_log;
+class proxy;
+class upload_store;
+class virtual_hosts;
+
+typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
+
+/// What the sessions of a server share. Everything must outlive them.
+struct session_services
+{
+  virtual_hosts& hosts;
+  const request_limits& limits;
+  write_scheduler& scheduler;
+  rate_limiter& limiter;
+  buffer_pool& buffers;
+
+  /// Optional: where requests are logged and traced.
+  access_log* log;
+  request_tracer* tracer;
+
+  /// Optional: URI prefixes forwarded to upstream servers.
+  proxy* forwarding;
+
+  /// Optional: where PUT and POST bodies are stored.
+  upload_store* uploads;
+
+  const session_timeouts& timeouts;
+
+  /// Decides which requests to shed when the server falls behind.
+  admission_controller& admission;
+
+  /// Optional: writes the server's counters as JSON, for /_stats.
+  std::function<std::string()> stats;
+};
+
+/// One connection from a client, over TLS or plain TCP. Requests are read,
+/// handled and answered one after another until the client goes away. The
+/// session deletes itself when it is done.
+///
+/// Stream is ssl_socket or a bare tcp::socket. The choice is made at compile
+/// time, so a plaintext session has no TLS code on its path: no handshake,
+/// no check for data buffered inside OpenSSL, no record counting.
+template <typename Stream>
+class basic_session final : public write_scheduler::writer
+{
+public:
+  /// Whether the session speaks TLS.
+  static constexpr bool is_tls = std::is_same<Stream, ssl_socket>::value;
+
+  /// The TLS context is only used, and may only be null, when !is_tls.
+  basic_session(boost::asio::io_context& io_context,
+      boost::asio::ssl::context* context,
+      const session_services& services);
+
+  ~basic_session();
+
+  /// The sessions of this kind alive in this process, including the one
+  /// each listener keeps ready for its next connection. It should come back
+  /// down once clients go away; if it does not, sessions are leaking.
+  static std::size_t live()
+  {
+    return live_.load(std::memory_order_relaxed);
+  }
+
+  typename Stream::lowest_layer_type& socket()
+  {
+    return socket_.lowest_layer();
+  }
+
+  /// Start the handshake, if any, once the socket has been accepted.
+  void start();
+
+  void handle_handshake(const boost::system::error_code& error);
+
+  /// Wait for the next request without holding a read buffer.
+  void do_read();
+
+  /// Read what has arrived into a buffer borrowed from the pool and parse it.
+  void read_request();
+
+  /// Hand a complete request to the proxy, the upload store or its site's
+  /// handler. The body, if any, starts with the bytes in body_prefix_.
+  void handle_request();
+
+  void do_write();
+
+  void write_some(std::size_t max_bytes,
+      write_scheduler::done_handler done) override;
+
+  /// Read the next piece of a streamed reply body and write it.
+  void write_body();
+
+  void handle_reply_sent();
+
+  /// Drop the connection and delete the session, or leave that to a
+  /// pending body read.
+  void close();
+
+  /// Record the request that has just been answered in the access log.
+  void log_request();
+
+  /// The part [offset, offset + size) of a buffer sequence.
+  static std::vector<boost::asio::const_buffer> slice_buffers(
+      const std::vector<boost::asio::const_buffer>& buffers,
+      std::size_t offset, std::size_t size);
+
+  /// The largest TLS record payload. Small replies are coalesced into one
+  /// record and large ones are written a record at a time.
+  enum { tls_record_size = 16384 };
+
+private:
+  class request_body;
+
+  static std::atomic<std::size_t> live_;
+
+  /// The stream for a new connection.
+  static Stream open(boost::asio::io_context& io_context,
+      boost::asio::ssl::context* context);
+
+  /// Whether the request says a body follows. A reply sent without reading
+  /// it must close the connection, or the body is taken for the next
+  /// request.
+  bool announces_body() const;
+
+  /// Close the socket if the next step takes longer than timeout, so that
+  /// the pending operation fails. Zero only cancels the current deadline.
+  void arm(std::chrono::steady_clock::duration timeout);
+
+  /// Counts the TLS records written, installed as the SSL message callback.
+  static void count_records(int write_p, int version, int content_type,
+      const void* buf, std::size_t len, SSL* ssl, void* arg);
+
+  boost::asio::io_context& m_io_context;
+  Stream socket_;
+  /// The client's address.
+  boost::asio::ip::address peer_;
+  /// The sites whose handlers process the incoming requests.
+  virtual_hosts& hosts_;
+  /// Where read buffers come from, and the size to ask for next time. It
+  /// grows while a request keeps filling the buffer.
+  buffer_pool& buffer_pool_;
+  std::size_t read_size_;
+  /// Memory for the incoming request, released between requests.
+  request_arena request_arena_;
+  /// The incoming request.
+  request request_;
+  /// The parser for the incoming request.
+  request_parser request_parser_;
+  /// The reply to be sent back to the client.
+  reply reply_;
+  /// Sheds requests when the io_context falls behind. A request's delay
+  /// is the time its first read took to complete once the data was there,
+  /// which is time spent waiting in the io_context's queue.
+  admission_controller& admission_;
+  std::chrono::steady_clock::time_point read_start_;
+  std::chrono::steady_clock::duration sojourn_{};
+  /// Set once a reply has been sent; such clients are shed last.
+  bool established_ = false;
+  /// Writes /_stats, if enabled.
+  const std::function<std::string()>& stats_;
+  /// Shares socket writes fairly between sessions.
+  write_scheduler& write_scheduler_;
+  /// Where matching requests are forwarded, if anywhere.
+  proxy* proxy_;
+  /// Where uploads are stored, if they are accepted.
+  upload_store* uploads_;
+  /// The body of the current request: the bytes that arrived with the
+  /// headers, and how many are still to be read from the socket.
+  std::shared_ptr<request_body> request_body_;
+  std::string body_prefix_;
+  std::size_t body_prefix_offset_ = 0;
+  std::size_t body_remaining_ = 0;
+  /// Whether the body is chunked, and its decoder if so, and whether the
+  /// client waits for "100 Continue" before sending it.
+  bool chunked_ = false;
+  chunked_decoder chunked_decoder_;
+  bool continue_pending_ = false;
+  /// Whether the body is being read from the socket for the proxy or an
+  /// upload. A session closed meanwhile only closes its socket and is
+  /// deleted when that read completes, since the read still refers to it.
+  bool body_reading_ = false;
+  bool closing_ = false;
+  /// Close the connection once the reply has been sent, because its end
+  /// is only marked by the close or the request body was not read.
+  bool close_after_reply_ = false;
+  /// Rate limits for this connection and its client address.
+  rate_limiter& rate_limiter_;
+  rate_limiter::ticket rate_ticket_;
+  /// Waits for byte tokens when the connection is over its rate.
+  boost::asio::steady_timer throttle_timer_;
+  /// Closes the connection when a step takes too long. The deadline's
+  /// handler holds a weak reference to alive_ in case it runs after the
+  /// session is gone.
+  const session_timeouts& timeouts_;
+  boost::asio::steady_timer deadline_;
+  std::shared_ptr<basic_session*> alive_;
+  /// The reply being written and how much of it has been sent. The head
+  /// holds the serialised headers and, for small replies, the content.
+  std::string write_head_;
+  std::vector<boost::asio::const_buffer> write_buffers_;
+  std::size_t write_offset_ = 0;
+  std::size_t write_total_ = 0;
+  /// A piece of a streamed reply body, and the bytes sent for the reply.
+  buffer_pool::buffer body_buffer_;
+  std::size_t bytes_sent_ = 0;
+  /// Where finished requests are recorded, if anywhere.
+  access_log* access_log_;
+  /// Where finished requests are traced, if anywhere, and this
+  /// connection's number in the trace.
+  request_tracer* tracer_;
+  std::uint64_t connection_id_ = 0;
+  /// Timestamps of the current request. The handshake is only reported
+  /// with the first request on the connection.
+  request_trace trace_;
+  std::chrono::system_clock::time_point request_time_;
+  bool resumed_ = false;
+  /// TLS records written for the current reply.
+  std::size_t records_written_ = 0;
+};
+
+/// A connection over TLS, and one over plain TCP for traffic whose TLS has
+/// already been terminated in front of the server.
+typedef basic_session<ssl_socket> session;
+typedef basic_session<boost::asio::ip::tcp::socket> plain_session;
+
+extern template class basic_session<ssl_socket>;
+extern template class basic_session<boost::asio::ip::tcp::socket>;
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SESSION_HPP
@@ -0,0 +1,38 @@
+#include "shared_stats.hpp"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+
+namespace http {
+namespace server {
+
+// Other processes see the same memory, so the atomics must not fall back
+// to a lock inside this one.
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+    "shared counters need lock-free 64-bit atomics");
+
+shared_stats::shared_stats(std::size_t workers)
+  : slots_(nullptr),
+    size_(workers)
+{
+  void* p = ::mmap(nullptr, workers * sizeof(worker_counters),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error(std::string("cannot map shared counters: ")
+        + std::strerror(errno));
+  // The mapping is zeroed, which is what the counters start from.
+  slots_ = static_cast<worker_counters*>(p);
+  for (std::size_t i = 0; i < workers; ++i)
+    new (&slots_[i]) worker_counters;
+}
+
+shared_stats::~shared_stats()
+{
+  ::munmap(slots_, size_ * sizeof(worker_counters));
+}
+
+} // namespace server
+} // namespace http
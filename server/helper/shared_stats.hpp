@@ -0,0 +1,57 @@
+#ifndef HTTP_SHARED_STATS_HPP
+#define HTTP_SHARED_STATS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+namespace server {
+
+/// The counters of one worker process. Each worker only adds to its own,
+/// with relaxed atomics; anyone may read them. A cache line each, so that
+/// workers on different cores do not contend.
+struct alignas(64) worker_counters
+{
+  /// The worker's process and how often it has been restarted.
+  std::atomic<std::int32_t> pid;
+  std::atomic<std::uint32_t> restarts;
+
+  std::atomic<std::uint64_t> connections;
+  /// Requests handled, and requests refused by load shedding.
+  std::atomic<std::uint64_t> requests;
+  std::atomic<std::uint64_t> shed;
+};
+
+/// Counters for every worker in one anonymous shared mapping. The
+/// supervisor makes it before forking, so that every worker inherits it
+/// and any of them can report on all the others.
+class shared_stats
+{
+public:
+  shared_stats(const shared_stats&) = delete;
+  shared_stats& operator=(const shared_stats&) = delete;
+
+  /// Map zeroed counters for the given number of workers. Throws
+  /// std::runtime_error if the mapping fails.
+  explicit shared_stats(std::size_t workers);
+
+  ~shared_stats();
+
+  std::size_t size() const { return size_; }
+
+  worker_counters& operator[](std::size_t worker) { return slots_[worker]; }
+  const worker_counters& operator[](std::size_t worker) const
+  {
+    return slots_[worker];
+  }
+
+private:
+  worker_counters* slots_;
+  std::size_t size_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SHARED_STATS_HPP
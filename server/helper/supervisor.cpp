@@ -0,0 +1,187 @@
+#include "supervisor.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// A worker that dies sooner than this after starting is restarted only
+/// after waiting as long, so that one that cannot start does not spin.
+const std::chrono::seconds min_lifetime(1);
+
+/// The CPUs the process could run on before any thread was pinned; threads
+/// inherit their creator's affinity, so asking later would be too late.
+const cpu_set_t& allowed_cpus()
+{
+  static const cpu_set_t allowed = []()
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    ::sched_getaffinity(0, sizeof(set), &set);
+    return set;
+  }();
+  return allowed;
+}
+
+} // namespace
+
+supervisor::supervisor(std::size_t workers, worker_function run,
+    shared_stats& stats)
+  : run_(std::move(run)),
+    stats_(stats),
+    pids_(workers, 0),
+    started_(workers)
+{
+}
+
+int supervisor::run()
+{
+  // Signals are taken synchronously with sigwaitinfo, so they must stay
+  // pending rather than be delivered.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGCHLD);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, &worker_mask_);
+
+  int status = 0;
+  for (std::size_t i = 0; i < pids_.size(); ++i)
+  {
+    if (!start(i))
+    {
+      status = 1;
+      stop();
+      break;
+    }
+  }
+
+  while (running_ > 0)
+  {
+    int signal = sigwaitinfo(&signals, nullptr);
+    if (signal == SIGCHLD)
+      reap();
+    else if (signal == SIGINT || signal == SIGTERM)
+      stop();
+  }
+
+  sigprocmask(SIG_SETMASK, &worker_mask_, nullptr);
+  return status;
+}
+
+bool supervisor::start(std::size_t i)
+{
+  // Anything still buffered would otherwise be written twice.
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+  pid_t pid = ::fork();
+  if (pid < 0)
+  {
+    std::cerr << "Cannot start worker " << i << ": "
+              << std::strerror(errno) << "\n";
+    return false;
+  }
+  if (pid == 0)
+  {
+    // Die with the supervisor rather than serve on unsupervised.
+    ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (::getppid() == 1)
+      std::_Exit(0);
+    sigprocmask(SIG_SETMASK, &worker_mask_, nullptr);
+    stats_[i].pid.store(::getpid(), std::memory_order_relaxed);
+    int status = 1;
+    try
+    {
+      status = run_(i);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "Worker " << i << ": " << e.what() << "\n";
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    // The supervisor's objects belong to the supervisor.
+    std::_Exit(status);
+  }
+  pids_[i] = pid;
+  started_[i] = std::chrono::steady_clock::now();
+  ++running_;
+  return true;
+}
+
+void supervisor::reap()
+{
+  int status;
+  pid_t pid;
+  while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+  {
+    std::size_t i = 0;
+    while (i < pids_.size() && pids_[i] != pid)
+      ++i;
+    if (i == pids_.size())
+      continue;
+    pids_[i] = 0;
+    --running_;
+    if (stopping_)
+      continue;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+      stop();
+      continue;
+    }
+    if (WIFSIGNALED(status))
+      std::cerr << "Worker " << i << " (pid " << pid << ") killed by signal "
+                << WTERMSIG(status) << ", restarting\n";
+    else
+      std::cerr << "Worker " << i << " (pid " << pid << ") exited with "
+                << WEXITSTATUS(status) << ", restarting\n";
+    if (std::chrono::steady_clock::now() - started_[i] < min_lifetime)
+      std::this_thread::sleep_for(min_lifetime);
+    stats_[i].restarts.fetch_add(1, std::memory_order_relaxed);
+    if (!start(i))
+      stop();
+  }
+}
+
+void supervisor::stop()
+{
+  stopping_ = true;
+  for (pid_t pid : pids_)
+    if (pid > 0)
+      ::kill(pid, SIGTERM);
+}
+
+int pin_to_cpu(std::size_t index)
+{
+  const cpu_set_t& allowed = allowed_cpus();
+  int count = CPU_COUNT(&allowed);
+  if (count == 0)
+    return -1;
+  int wanted = static_cast<int>(index % count);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+  {
+    if (!CPU_ISSET(cpu, &allowed) || wanted-- > 0)
+      continue;
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    return ::sched_setaffinity(0, sizeof(one), &one) == 0 ? cpu : -1;
+  }
+  return -1;
+}
+
+} // namespace server
+} // namespace http
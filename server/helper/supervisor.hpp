@@ -0,0 +1,68 @@
+#ifndef HTTP_SUPERVISOR_HPP
+#define HTTP_SUPERVISOR_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <signal.h>
+#include <sys/types.h>
+
+#include "shared_stats.hpp"
+
+namespace http {
+namespace server {
+
+/// Runs a number of worker processes and restarts any that die, so that a
+/// crash takes down one worker's connections rather than the server.
+///
+/// SIGINT or SIGTERM is passed on to the workers as SIGTERM, and the
+/// supervisor returns once they have all exited. A worker that exits with
+/// status 0 on its own (a shutdown request) stops the others the same way.
+class supervisor
+{
+public:
+  supervisor(const supervisor&) = delete;
+  supervisor& operator=(const supervisor&) = delete;
+
+  /// Called in the worker's process with its number; the result is the
+  /// process's exit status.
+  typedef std::function<int(std::size_t)> worker_function;
+
+  /// Workers record their pid and restarts in stats, which must have a
+  /// slot for each.
+  supervisor(std::size_t workers, worker_function run, shared_stats& stats);
+
+  /// Start the workers and look after them until they are stopped.
+  /// Returns 0, or 1 if a worker could not be started.
+  int run();
+
+private:
+  /// Fork worker i. Returns false if fork failed.
+  bool start(std::size_t i);
+
+  /// Reap the workers that have exited, restarting them unless stopping.
+  void reap();
+
+  /// Ask every running worker to stop.
+  void stop();
+
+  worker_function run_;
+  shared_stats& stats_;
+  std::vector<pid_t> pids_;
+  std::vector<std::chrono::steady_clock::time_point> started_;
+  std::size_t running_ = 0;
+  bool stopping_ = false;
+  /// The signal mask to restore in the workers.
+  sigset_t worker_mask_;
+};
+
+/// Pin the calling thread to the index-th of the CPUs it may run on,
+/// wrapping around. Memory it touches first is then allocated on that
+/// CPU's NUMA node. Returns the CPU, or -1 if it could not be pinned.
+int pin_to_cpu(std::size_t index);
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SUPERVISOR_HPP
@@ -0,0 +1,129 @@
+#include "table_scan.hpp"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_TABLE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+namespace server {
+namespace table_scan {
+
+namespace {
+
+/// Fold [begin, end) into s, one value at a time.
+summary scalar_tail(const double* begin, const double* end, summary s)
+{
+  for (; begin != end; ++begin)
+  {
+    s.min = std::min(s.min, *begin);
+    s.max = std::max(s.max, *begin);
+    s.sum += *begin;
+  }
+  return s;
+}
+
+summary scalar_summarize(const double* begin, const double* end)
+{
+  return scalar_tail(begin + 1, end, summary{ *begin, *begin, *begin });
+}
+
+#if defined(HTTP_TABLE_SCAN_X86)
+
+__attribute__((target("sse2")))
+summary sse2_summarize(const double* begin, const double* end)
+{
+  if (end - begin < 4)
+    return scalar_summarize(begin, end);
+
+  // Two accumulators of two lanes each, to keep the adds independent.
+  __m128d lo = _mm_loadu_pd(begin);
+  __m128d hi = lo;
+  __m128d sum0 = _mm_setzero_pd();
+  __m128d sum1 = _mm_setzero_pd();
+  for (; end - begin >= 4; begin += 4)
+  {
+    __m128d a = _mm_loadu_pd(begin);
+    __m128d b = _mm_loadu_pd(begin + 2);
+    lo = _mm_min_pd(lo, _mm_min_pd(a, b));
+    hi = _mm_max_pd(hi, _mm_max_pd(a, b));
+    sum0 = _mm_add_pd(sum0, a);
+    sum1 = _mm_add_pd(sum1, b);
+  }
+  double l[2], h[2], s[2];
+  _mm_storeu_pd(l, lo);
+  _mm_storeu_pd(h, hi);
+  _mm_storeu_pd(s, _mm_add_pd(sum0, sum1));
+  return scalar_tail(begin, end,
+      summary{ std::min(l[0], l[1]), std::max(h[0], h[1]), s[0] + s[1] });
+}
+
+__attribute__((target("avx2")))
+summary avx2_summarize(const double* begin, const double* end)
+{
+  if (end - begin < 8)
+    return sse2_summarize(begin, end);
+
+  __m256d lo = _mm256_loadu_pd(begin);
+  __m256d hi = lo;
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  for (; end - begin >= 8; begin += 8)
+  {
+    __m256d a = _mm256_loadu_pd(begin);
+    __m256d b = _mm256_loadu_pd(begin + 4);
+    lo = _mm256_min_pd(lo, _mm256_min_pd(a, b));
+    hi = _mm256_max_pd(hi, _mm256_max_pd(a, b));
+    sum0 = _mm256_add_pd(sum0, a);
+    sum1 = _mm256_add_pd(sum1, b);
+  }
+  double l[4], h[4], s[4];
+  _mm256_storeu_pd(l, lo);
+  _mm256_storeu_pd(h, hi);
+  _mm256_storeu_pd(s, _mm256_add_pd(sum0, sum1));
+  return scalar_tail(begin, end,
+      summary{ std::min({ l[0], l[1], l[2], l[3] }),
+        std::max({ h[0], h[1], h[2], h[3] }),
+        (s[0] + s[1]) + (s[2] + s[3]) });
+}
+
+#endif // defined(HTTP_TABLE_SCAN_X86)
+
+typedef summary (*summarize_function)(const double*, const double*);
+
+struct dispatch_table
+{
+  const char* name;
+  summarize_function summarize;
+};
+
+dispatch_table select_implementation()
+{
+#if defined(HTTP_TABLE_SCAN_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return { "avx2", avx2_summarize };
+  if (__builtin_cpu_supports("sse2"))
+    return { "sse2", sse2_summarize };
+#endif
+  return { "scalar", scalar_summarize };
+}
+
+const dispatch_table selected = select_implementation();
+
+} // namespace
+
+summary summarize(const double* begin, const double* end)
+{
+  return selected.summarize(begin, end);
+}
+
+const char* implementation()
+{
+  return selected.name;
+}
+
+} // namespace table_scan
+} // namespace server
+} // namespace http
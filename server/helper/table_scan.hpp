@@ -0,0 +1,29 @@
+#ifndef HTTP_TABLE_SCAN_HPP
+#define HTTP_TABLE_SCAN_HPP
+
+namespace http {
+namespace server {
+namespace table_scan {
+
+/// The smallest, largest and total of a run of values.
+struct summary
+{
+  double min;
+  double max;
+  double sum;
+};
+
+/// Summarize [begin, end), which must not be empty and must hold finite
+/// values only. The vector versions add in a different order from the
+/// scalar one, so sums may differ in the last bits.
+summary summarize(const double* begin, const double* end);
+
+/// Name of the implementation selected for this CPU: "avx2", "sse2" or
+/// "scalar".
+const char* implementation();
+
+} // namespace table_scan
+} // namespace server
+} // namespace http
+
+#endif // HTTP_TABLE_SCAN_HPP
@@ -0,0 +1,433 @@
+#include "table_store.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+#include "file_reader.hpp"
+#include "fs_watcher.hpp"
+#include "table_scan.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+bool is_blank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+/// Parse a whole string_view as a number.
+template <typename T>
+bool parse_number(std::string_view s, T& value)
+{
+  const char* end = s.data() + s.size();
+  std::from_chars_result r = std::from_chars(s.data(), end, value);
+  return r.ec == std::errc() && r.ptr == end;
+}
+
+void append_number(std::string& out, double value)
+{
+  char buffer[32];
+  std::to_chars_result r =
+      std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, r.ptr);
+}
+
+void append_binary(std::string& out, double value)
+{
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  bits = __builtin_bswap64(bits);
+#endif
+  char bytes[sizeof(bits)];
+  std::memcpy(bytes, &bits, sizeof(bits));
+  out.append(bytes, sizeof(bytes));
+}
+
+/// Writes rows or named values in one of the formats.
+class writer
+{
+public:
+  writer(std::string& out, table_store::format fmt)
+    : out_(out), fmt_(fmt) {}
+
+  void begin_rows()
+  {
+    if (fmt_ == table_store::json)
+      out_ += '[';
+  }
+
+  void row(double x, double y)
+  {
+    switch (fmt_)
+    {
+    case table_store::text:
+      append_number(out_, x);
+      out_ += '\t';
+      append_number(out_, y);
+      out_ += '\n';
+      break;
+    case table_store::json:
+      out_ += first_ ? "[" : ",[";
+      append_number(out_, x);
+      out_ += ',';
+      append_number(out_, y);
+      out_ += ']';
+      break;
+    case table_store::binary:
+      append_binary(out_, x);
+      append_binary(out_, y);
+      break;
+    }
+    first_ = false;
+  }
+
+  void end_rows()
+  {
+    if (fmt_ == table_store::json)
+      out_ += ']';
+  }
+
+  void begin_values()
+  {
+    if (fmt_ == table_store::json)
+      out_ += '{';
+  }
+
+  void value(const char* name, double v)
+  {
+    switch (fmt_)
+    {
+    case table_store::text:
+      out_ += name;
+      out_ += '\t';
+      append_number(out_, v);
+      out_ += '\n';
+      break;
+    case table_store::json:
+      out_ += first_ ? "\"" : ",\"";
+      out_ += name;
+      out_ += "\":";
+      append_number(out_, v);
+      break;
+    case table_store::binary:
+      append_binary(out_, v);
+      break;
+    }
+    first_ = false;
+  }
+
+  void end_values()
+  {
+    if (fmt_ == table_store::json)
+      out_ += '}';
+  }
+
+private:
+  std::string& out_;
+  table_store::format fmt_;
+  bool first_ = true;
+};
+
+} // namespace
+
+table_store::table_store(file_reader& reader, fs_watcher& watcher,
+    std::size_t max_bytes)
+  : reader_(reader),
+    watcher_(watcher),
+    max_bytes_(max_bytes)
+{
+  watcher_.subscribe([this](const std::string& path, bool directory)
+      {
+        invalidate(path, directory);
+      });
+}
+
+void table_store::async_get(const std::string& path, handler_type handler)
+{
+  auto it = entries_.find(path);
+  if (it != entries_.end())
+  {
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    handler(boost::system::error_code(), it->second.value);
+    return;
+  }
+
+  ++misses_;
+  auto waiting = waiting_.find(path);
+  if (waiting != waiting_.end())
+  {
+    waiting->second.push_back(std::move(handler));
+    return;
+  }
+  waiting_[path].push_back(std::move(handler));
+  load(path);
+}
+
+void table_store::load(const std::string& path)
+{
+  // As in file_cache: a table read while its file changed is handed out
+  // but not kept.
+  bool cacheable = watcher_.covers(path);
+  std::size_t batches = watcher_.batches();
+  reader_.async_read(path,
+      [this, path, cacheable, batches](
+        boost::system::error_code ec, std::string content)
+      {
+        std::shared_ptr<table> value;
+        if (!ec)
+        {
+          ++parses_;
+          value = std::make_shared<table>();
+          if (!parse(content, *value))
+          {
+            value.reset();
+            ec = boost::asio::error::invalid_argument;
+          }
+          else if (cacheable && watcher_.batches() == batches)
+            insert(path, value);
+        }
+        std::vector<handler_type> handlers;
+        handlers.swap(waiting_[path]);
+        waiting_.erase(path);
+        for (const handler_type& h : handlers)
+          h(ec, value);
+      });
+}
+
+table_store::query_result table_store::parse_query(
+    std::string_view query_string, query& q)
+{
+  query_result result = not_a_query;
+  while (!query_string.empty())
+  {
+    std::size_t amp = query_string.find('&');
+    std::string_view param = query_string.substr(0, amp);
+    query_string = amp == std::string_view::npos
+        ? std::string_view() : query_string.substr(amp + 1);
+
+    std::size_t eq = param.find('=');
+    std::string_view key = param.substr(0, eq);
+    std::string_view value = eq == std::string_view::npos
+        ? std::string_view() : param.substr(eq + 1);
+    bool ok = true;
+    if (key == "x_min")
+      ok = parse_number(value, q.x_min) && !std::isnan(q.x_min);
+    else if (key == "x_max")
+      ok = parse_number(value, q.x_max) && !std::isnan(q.x_max);
+    else if (key == "points")
+      ok = parse_number(value, q.points) && q.points > 0;
+    else if (key == "stats")
+    {
+      ok = value.empty() || value == "1" || value == "0";
+      q.stats = value != "0";
+    }
+    else if (key == "fmt")
+    {
+      if (value == "text")
+        q.fmt = text;
+      else if (value == "json")
+        q.fmt = json;
+      else if (value == "bin")
+        q.fmt = binary;
+      else
+        ok = false;
+    }
+    else
+      continue; // Not ours, e.g. a cache buster.
+    if (!ok)
+      return bad;
+    result = good;
+  }
+  return result;
+}
+
+bool table_store::parse(const std::string& text, table& out)
+{
+  out.x.clear();
+  out.y.clear();
+  const char* p = text.data();
+  const char* end = p + text.size();
+  while (p != end)
+  {
+    const char* eol = static_cast<const char*>(
+        std::memchr(p, '\n', end - p));
+    if (!eol)
+      eol = end;
+    while (p != eol && is_blank(*p))
+      ++p;
+    if (p != eol && *p != '#')
+    {
+      double x, y;
+      std::from_chars_result r = std::from_chars(p, eol, x);
+      if (r.ec != std::errc())
+        return false;
+      p = r.ptr;
+      const char* gap = p;
+      while (p != eol && (is_blank(*p) || *p == ','))
+        ++p;
+      if (p == gap)
+        return false;
+      r = std::from_chars(p, eol, y);
+      if (r.ec != std::errc())
+        return false;
+      p = r.ptr;
+      while (p != eol && is_blank(*p))
+        ++p;
+      if (p != eol || !std::isfinite(x) || !std::isfinite(y))
+        return false;
+      out.x.push_back(x);
+      out.y.push_back(y);
+    }
+    p = eol == end ? end : eol + 1;
+  }
+  if (out.x.empty())
+    return false;
+
+  if (!std::is_sorted(out.x.begin(), out.x.end()))
+  {
+    std::vector<std::size_t> order(out.x.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+        [&out](std::size_t a, std::size_t b) { return out.x[a] < out.x[b]; });
+    table sorted;
+    sorted.x.reserve(order.size());
+    sorted.y.reserve(order.size());
+    for (std::size_t i : order)
+    {
+      sorted.x.push_back(out.x[i]);
+      sorted.y.push_back(out.y[i]);
+    }
+    out = std::move(sorted);
+  }
+  out.x.shrink_to_fit();
+  out.y.shrink_to_fit();
+  return true;
+}
+
+void table_store::run(const table& t, const query& q, std::string& out)
+{
+  out.clear();
+  std::size_t first = std::lower_bound(t.x.begin(), t.x.end(), q.x_min)
+      - t.x.begin();
+  std::size_t last = std::upper_bound(t.x.begin(), t.x.end(), q.x_max)
+      - t.x.begin();
+  if (last < first)
+    last = first;
+  std::size_t n = last - first;
+  const double* x = t.x.data();
+  const double* y = t.y.data();
+  writer w(out, q.fmt);
+
+  if (q.stats)
+  {
+    w.begin_values();
+    w.value("count", static_cast<double>(n));
+    if (n > 0)
+    {
+      table_scan::summary sy = table_scan::summarize(y + first, y + last);
+      w.value("x_min", x[first]);
+      w.value("x_max", x[last - 1]);
+      w.value("y_min", sy.min);
+      w.value("y_max", sy.max);
+      w.value("y_mean", sy.sum / n);
+    }
+    w.end_values();
+    return;
+  }
+
+  w.begin_rows();
+  if (q.points == 0 || n <= q.points)
+  {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (q.fmt == binary)
+    {
+      // Interleave the columns straight into the output.
+      out.resize(n * 2 * sizeof(double));
+      char* p = &out[0];
+      for (std::size_t i = first; i < last; ++i)
+      {
+        std::memcpy(p, x + i, sizeof(double));
+        std::memcpy(p + sizeof(double), y + i, sizeof(double));
+        p += 2 * sizeof(double);
+      }
+      return;
+    }
+#endif
+    for (std::size_t i = first; i < last; ++i)
+      w.row(x[i], y[i]);
+  }
+  else
+  {
+    // Bucket b holds rows [n * b / points, n * (b + 1) / points) of the
+    // range, so buckets differ in size by at most one row.
+    for (std::size_t b = 0; b < q.points; ++b)
+    {
+      std::size_t begin = first + n * b / q.points;
+      std::size_t end = first + n * (b + 1) / q.points;
+      double size = static_cast<double>(end - begin);
+      w.row(table_scan::summarize(x + begin, x + end).sum / size,
+          table_scan::summarize(y + begin, y + end).sum / size);
+    }
+  }
+  w.end_rows();
+}
+
+void table_store::insert(const std::string& path,
+    std::shared_ptr<const table> value)
+{
+  auto old = entries_.find(path);
+  if (old != entries_.end())
+    erase(old);
+  bytes_ += size_of(*value);
+  lru_.push_front(path);
+  entries_[path] = entry{ std::move(value), lru_.begin() };
+  while (bytes_ > max_bytes_ && !lru_.empty())
+    erase(entries_.find(lru_.back()));
+}
+
+void table_store::erase(std::unordered_map<std::string, entry>::iterator it)
+{
+  bytes_ -= size_of(*it->second.value);
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void table_store::invalidate(const std::string& path, bool directory)
+{
+  auto it = entries_.find(path);
+  if (it != entries_.end())
+  {
+    erase(it);
+    // Parse the new version now rather than on the next query, unless a
+    // load is already under way.
+    if (!directory && waiting_.find(path) == waiting_.end())
+    {
+      waiting_[path];
+      load(path);
+    }
+  }
+  if (!directory)
+    return;
+  std::string prefix = path + '/';
+  for (auto i = entries_.begin(); i != entries_.end();)
+  {
+    if (i->first.compare(0, prefix.size(), prefix) == 0)
+    {
+      bytes_ -= size_of(*i->second.value);
+      lru_.erase(i->second.lru);
+      i = entries_.erase(i);
+    }
+    else
+      ++i;
+  }
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,146 @@
+#ifndef HTTP_TABLE_STORE_HPP
+#define HTTP_TABLE_STORE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace http {
+namespace server {
+
+class file_reader;
+class fs_watcher;
+
+/// Two-column numeric text files (such as data/text/data.txt) parsed into
+/// columns sorted by the first one, so that a client can ask for a range
+/// of rows, a downsampled series or aggregates instead of downloading the
+/// whole file and parsing it itself. A range is found by binary search and
+/// is contiguous in both columns, so downsampling and aggregates are
+/// vectorized scans over it.
+///
+/// Tables are parsed on first use and kept while the fs_watcher reports
+/// their file unchanged; a changed file that was in use is parsed again
+/// straight away. Concurrent misses on one file share a single read.
+///
+/// Not thread-safe: use one per io_context thread.
+class table_store
+{
+public:
+  table_store(const table_store&) = delete;
+  table_store& operator=(const table_store&) = delete;
+
+  /// The rows of a file, by column, in ascending order of x. Rows with
+  /// equal x keep their order in the file.
+  struct table
+  {
+    std::vector<double> x;
+    std::vector<double> y;
+  };
+
+  /// How the result of a query is written.
+  enum format { text, json, binary };
+
+  /// What a client asks of a table. The range is inclusive. With points
+  /// set, a range of more rows than that is cut into as many buckets and
+  /// each is given as the mean of its rows. With stats set, the result is
+  /// the number of rows and the extent and mean of each column.
+  struct query
+  {
+    double x_min = -std::numeric_limits<double>::infinity();
+    double x_max = std::numeric_limits<double>::infinity();
+    std::size_t points = 0;
+    bool stats = false;
+    format fmt = text;
+  };
+
+  /// The result of parsing a query string.
+  enum query_result
+  {
+    /// Nothing in it concerns tables: serve the file as it is.
+    not_a_query,
+    good,
+    bad
+  };
+
+  typedef std::function<void(const boost::system::error_code&,
+      std::shared_ptr<const table>)> handler_type;
+
+  /// Keep up to max_bytes of parsed tables, least recently used first out.
+  table_store(file_reader& reader, fs_watcher& watcher,
+      std::size_t max_bytes = 64 * 1024 * 1024);
+
+  /// Get the table in the file at path. A hit completes within this call;
+  /// a miss when the file has been read and parsed. A file that is not a
+  /// table fails with invalid_argument.
+  void async_get(const std::string& path, handler_type handler);
+
+  /// Parse the part of a URI after the '?': x_min, x_max, points, stats
+  /// and fmt (text, json or bin).
+  static query_result parse_query(std::string_view query_string, query& q);
+
+  /// Parse text with two numbers per line, separated by blanks or a comma.
+  /// Empty lines and lines starting with '#' are skipped. Returns false if
+  /// any other line is not two finite numbers, or if there are no rows.
+  static bool parse(const std::string& text, table& out);
+
+  /// Answer a query, replacing out. Binary results are little-endian
+  /// doubles: x, y for each row, or count, x_min, x_max, y_min, y_max,
+  /// y_mean for stats (only count if the range is empty).
+  static void run(const table& t, const query& q, std::string& out);
+
+  std::size_t hits() const { return hits_; }
+  std::size_t misses() const { return misses_; }
+  std::size_t parses() const { return parses_; }
+  std::size_t entries() const { return entries_.size(); }
+
+private:
+  struct entry
+  {
+    std::shared_ptr<const table> value;
+    std::list<std::string>::iterator lru;
+  };
+
+  /// Read and parse path, then answer whoever is waiting for it.
+  void load(const std::string& path);
+
+  void insert(const std::string& path, std::shared_ptr<const table> value);
+  void erase(std::unordered_map<std::string, entry>::iterator it);
+
+  /// Drop path, or everything under it if it is a directory. A file that
+  /// was in use is loaded again.
+  void invalidate(const std::string& path, bool directory);
+
+  static std::size_t size_of(const table& t)
+  {
+    return (t.x.size() + t.y.size()) * sizeof(double);
+  }
+
+  file_reader& reader_;
+  fs_watcher& watcher_;
+  std::size_t max_bytes_;
+
+  std::unordered_map<std::string, entry> entries_;
+  /// Paths from most to least recently used.
+  std::list<std::string> lru_;
+  std::size_t bytes_ = 0;
+
+  /// Requests waiting for a load under way, by path. A load started by a
+  /// change has no one waiting but still has an entry here.
+  std::unordered_map<std::string, std::vector<handler_type>> waiting_;
+
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  std::size_t parses_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_TABLE_STORE_HPP
@@ -0,0 +1,320 @@
+#include "upload_store.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// A fresh name for a POSTed file.
+std::string random_name()
+{
+  thread_local std::mt19937_64 random{ std::random_device()() };
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+      static_cast<unsigned long long>(random()));
+  return name;
+}
+
+/// The reply for a failed system call.
+reply::status_type status_for(int error)
+{
+  switch (error)
+  {
+  case ENOENT:
+  case ENOTDIR:
+  case EISDIR:
+    return reply::conflict;
+  case EACCES:
+  case EPERM:
+  case EROFS:
+    return reply::forbidden;
+  default:
+    return reply::internal_server_error;
+  }
+}
+
+/// Write all of data, retrying after interruptions and short writes.
+bool write_all(int fd, const char* data, std::size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+/// One upload in progress. Reads from the body happen on the io_context and
+/// everything that touches the disk on the pool, strictly in turn, so the
+/// chunk is never used by both at once.
+class upload_store::upload : public std::enable_shared_from_this<upload>
+{
+public:
+  upload(upload_store& store, std::shared_ptr<body_stream> body,
+      reply& rep, std::function<void()> handler, std::string path,
+      std::string location)
+    : store_(store),
+      body_(std::move(body)),
+      reply_(rep),
+      handler_(std::move(handler)),
+      path_(std::move(path)),
+      location_(std::move(location)),
+      chunk_(new char[chunk_size])
+  {
+  }
+
+  ~upload()
+  {
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  void start()
+  {
+    auto self = shared_from_this();
+    boost::asio::post(store_.pool_, [self]() { self->open(); });
+  }
+
+private:
+  /// Pool: make the temporary file next to the target.
+  void open()
+  {
+    std::string::size_type slash = path_.rfind('/');
+    temporary_ = path_.substr(0, slash + 1) + ".upload-XXXXXX";
+    fd_ = ::mkostemp(&temporary_[0], O_CLOEXEC);
+    if (fd_ < 0)
+    {
+      temporary_.clear();
+      fail(status_for(errno));
+      return;
+    }
+    auto self = shared_from_this();
+    boost::asio::post(store_.io_context_, [self]() { self->read(); });
+  }
+
+  /// io_context: read the next piece of the body.
+  void read()
+  {
+    auto self = shared_from_this();
+    body_->async_read_some(boost::asio::buffer(chunk_.get(), chunk_size),
+        [self](const boost::system::error_code& ec, std::size_t n)
+        {
+          self->body_read(ec, n);
+        });
+  }
+
+  void body_read(const boost::system::error_code& ec, std::size_t n)
+  {
+    if (ec)
+    {
+      failed_on_io(reply::bad_request);
+      return;
+    }
+    size_ += n;
+    if (store_.config_.max_bytes && size_ > store_.config_.max_bytes)
+    {
+      failed_on_io(reply::payload_too_large);
+      return;
+    }
+    auto self = shared_from_this();
+    if (n == 0)
+      boost::asio::post(store_.pool_, [self]() { self->finish(); });
+    else
+      boost::asio::post(store_.pool_, [self, n]() { self->write(n); });
+  }
+
+  /// Pool: append a piece to the temporary file.
+  void write(std::size_t n)
+  {
+    if (!write_all(fd_, chunk_.get(), n))
+    {
+      fail(status_for(errno));
+      return;
+    }
+    auto self = shared_from_this();
+    boost::asio::post(store_.io_context_, [self]() { self->read(); });
+  }
+
+  /// Pool: make the file durable as asked and move it into place.
+  void finish()
+  {
+    const upload_config& config = store_.config_;
+    if (config.sync != upload_config::sync_none && ::fsync(fd_) != 0)
+    {
+      fail(reply::internal_server_error);
+      return;
+    }
+    // mkstemp makes the file private; uploads are meant to be served.
+    ::fchmod(fd_, 0644);
+    ::close(fd_);
+    fd_ = -1;
+
+    struct stat st;
+    bool existed = ::stat(path_.c_str(), &st) == 0;
+    if (::rename(temporary_.c_str(), path_.c_str()) != 0)
+    {
+      fail(status_for(errno));
+      return;
+    }
+    temporary_.clear();
+    if (config.sync == upload_config::sync_full)
+    {
+      std::string directory = path_.substr(0, path_.rfind('/') + 1);
+      int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dir >= 0)
+      {
+        ::fsync(dir);
+        ::close(dir);
+      }
+    }
+
+    auto self = shared_from_this();
+    boost::asio::post(store_.io_context_, [self, existed]()
+        {
+          self->succeed(existed);
+        });
+  }
+
+  /// Pool: remove what was written and report the error.
+  void fail(reply::status_type status)
+  {
+    if (fd_ >= 0)
+    {
+      ::close(fd_);
+      fd_ = -1;
+    }
+    if (!temporary_.empty())
+      ::unlink(temporary_.c_str());
+    auto self = shared_from_this();
+    boost::asio::post(store_.io_context_, [self, status]()
+        {
+          ++self->store_.failed_;
+          self->complete(reply::stock_reply(status));
+        });
+  }
+
+  /// io_context: give up, cleaning up on the pool.
+  void failed_on_io(reply::status_type status)
+  {
+    auto self = shared_from_this();
+    boost::asio::post(store_.pool_, [self, status]() { self->fail(status); });
+  }
+
+  void succeed(bool existed)
+  {
+    ++store_.stored_;
+    store_.bytes_ += size_;
+    if (existed)
+    {
+      reply rep;
+      rep.status = reply::no_content;
+      rep.headers.push_back(header{ "Content-Length", "0" });
+      complete(std::move(rep));
+      return;
+    }
+    reply rep = reply::stock_reply(reply::created);
+    rep.headers.push_back(header{ "Location", location_ });
+    complete(std::move(rep));
+  }
+
+  void complete(reply rep)
+  {
+    reply_ = std::move(rep);
+    handler_();
+  }
+
+  upload_store& store_;
+  std::shared_ptr<body_stream> body_;
+  reply& reply_;
+  std::function<void()> handler_;
+  /// The target, the temporary file while it exists, and the target's URI.
+  std::string path_;
+  std::string temporary_;
+  std::string location_;
+  int fd_ = -1;
+  std::unique_ptr<char[]> chunk_;
+  std::uint64_t size_ = 0;
+};
+
+upload_store::upload_store(boost::asio::io_context& io_context,
+    const upload_config& config, std::size_t threads)
+  : io_context_(io_context),
+    config_(config),
+    pool_(threads)
+{
+  struct stat st;
+  if (::stat(config_.root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)
+      || ::access(config_.root.c_str(), W_OK) != 0)
+    throw std::invalid_argument("upload root is not a writable directory: "
+        + config_.root);
+  while (config_.root.size() > 1 && config_.root.back() == '/')
+    config_.root.pop_back();
+}
+
+upload_store::~upload_store()
+{
+  pool_.join();
+}
+
+void upload_store::async_store(const request& req,
+    std::shared_ptr<body_stream> body, std::uint64_t length, reply& rep,
+    std::function<void()> handler)
+{
+  auto refuse = [&](reply::status_type status)
+  {
+    ++failed_;
+    rep = reply::stock_reply(status);
+    boost::asio::post(io_context_, std::move(handler));
+  };
+
+  std::string_view location = req.uri.substr(0, req.uri.find('?'));
+  std::string path;
+  std::string name;
+  if (!request_handler::url_decode(location, path)
+      || path.empty() || path[0] != '/'
+      || path.find("..") != std::string::npos)
+  {
+    refuse(reply::bad_request);
+    return;
+  }
+  if (path.back() == '/')
+  {
+    if (req.method != "POST")
+    {
+      refuse(reply::bad_request);
+      return;
+    }
+    name = random_name();
+    path += name;
+  }
+  if (length != unknown_length && config_.max_bytes
+      && length > config_.max_bytes)
+  {
+    refuse(reply::payload_too_large);
+    return;
+  }
+
+  std::make_shared<upload>(*this, std::move(body), rep, std::move(handler),
+      config_.root + path, std::string(location) + name)->start();
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,89 @@
+#ifndef HTTP_UPLOAD_STORE_HPP
+#define HTTP_UPLOAD_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+
+#include "body_stream.hpp"
+
+namespace http {
+namespace server {
+
+struct reply;
+struct request;
+
+/// Where uploads go and how carefully they are written.
+struct upload_config
+{
+  /// The directory PUT and POST paths are relative to.
+  std::string root;
+
+  /// The largest body accepted, 0 for no limit.
+  std::uint64_t max_bytes = 0;
+
+  /// What is flushed to disk before an upload is reported done: nothing,
+  /// the file's data before it is renamed into place, or that and the
+  /// directory entry of the rename too.
+  enum sync_policy { sync_none, sync_file, sync_full };
+  sync_policy sync = sync_file;
+};
+
+/// Stores the bodies of PUT and POST requests as files under a writable
+/// root. PUT /a/b.txt writes root/a/b.txt, replacing it if it exists; POST
+/// to a directory path ending in '/' makes a new file with a random name
+/// there; POST to any other path works like PUT. Parent directories must
+/// exist.
+///
+/// The body is streamed to a temporary file next to the target a chunk at
+/// a time, so memory use does not depend on its size, and then renamed
+/// over the target: readers see the old file or the new one, never a part.
+/// Disk writes and fsyncs run on a thread pool, off the io_context.
+class upload_store
+{
+public:
+  upload_store(const upload_store&) = delete;
+  upload_store& operator=(const upload_store&) = delete;
+
+  /// The length to pass when the body is chunked.
+  static constexpr std::uint64_t unknown_length = ~std::uint64_t(0);
+
+  /// The most body bytes held per upload at any time.
+  enum { chunk_size = 65536 };
+
+  /// Throws std::invalid_argument if root is not a writable directory.
+  upload_store(boost::asio::io_context& io_context,
+      const upload_config& config, std::size_t threads = 2);
+
+  ~upload_store();
+
+  /// Store the body of req, length bytes or unknown_length, and fill in
+  /// rep: 201 with a Location for a new file, 204 for a replaced one, or an
+  /// error. The handler is invoked on the io_context when rep is complete.
+  /// The body may be left partly unread if the upload is refused.
+  void async_store(const request& req, std::shared_ptr<body_stream> body,
+      std::uint64_t length, reply& rep, std::function<void()> handler);
+
+  /// Uploads stored, their bytes, and uploads that failed.
+  std::size_t stored() const { return stored_; }
+  std::uint64_t bytes() const { return bytes_; }
+  std::size_t failed() const { return failed_; }
+
+private:
+  class upload;
+
+  boost::asio::io_context& io_context_;
+  upload_config config_;
+  boost::asio::thread_pool pool_;
+  std::size_t stored_ = 0;
+  std::uint64_t bytes_ = 0;
+  std::size_t failed_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_UPLOAD_STORE_HPP
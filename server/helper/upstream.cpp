@@ -0,0 +1,253 @@
+#include "upstream.hpp"
+#include <cstdlib>
+#include <stdexcept>
+
+namespace http {
+namespace server {
+
+upstream_connection::upstream_connection(boost::asio::io_context& io_context,
+    boost::asio::ssl::context& context, bool tls)
+  : stream(io_context, context), tls(tls) {}
+
+void upstream_connection::async_write(
+    const std::vector<boost::asio::const_buffer>& buffers,
+    body_handler handler)
+{
+  if (tls)
+    boost::asio::async_write(stream, buffers, std::move(handler));
+  else
+    boost::asio::async_write(stream.next_layer(), buffers,
+        std::move(handler));
+}
+
+void upstream_connection::async_read_some(boost::asio::mutable_buffer buffer,
+    body_handler handler)
+{
+  if (tls)
+    stream.async_read_some(buffer, std::move(handler));
+  else
+    stream.next_layer().async_read_some(buffer, std::move(handler));
+}
+
+void upstream_connection::async_read(boost::asio::mutable_buffer buffer,
+    body_handler handler)
+{
+  if (tls)
+    boost::asio::async_read(stream, buffer, std::move(handler));
+  else
+    boost::asio::async_read(stream.next_layer(), buffer, std::move(handler));
+}
+
+void upstream_connection::close()
+{
+  boost::system::error_code ignored_ec;
+  stream.lowest_layer().close(ignored_ec);
+}
+
+/// A health check in flight: its connection, its deadline and what has been
+/// read of the answer.
+struct upstream::health_check
+{
+  health_check(boost::asio::io_context& io_context)
+    : deadline(io_context) {}
+
+  std::shared_ptr<upstream_connection> connection;
+  boost::asio::steady_timer deadline;
+  std::string request;
+  char response[16] = {};
+  bool done = false;
+};
+
+upstream::upstream(boost::asio::io_context& io_context,
+    boost::asio::ssl::context& context, const std::string& url,
+    const std::string& health_path,
+    std::chrono::steady_clock::duration interval, std::size_t max_idle)
+  : io_context_(io_context),
+    context_(context),
+    health_path_(health_path),
+    interval_(interval),
+    max_idle_(max_idle),
+    health_timer_(io_context)
+{
+  std::string rest;
+  if (url.compare(0, 8, "https://") == 0)
+  {
+    tls_ = true;
+    rest = url.substr(8);
+  }
+  else if (url.compare(0, 7, "http://") == 0)
+    rest = url.substr(7);
+  else
+    throw std::invalid_argument("upstream URL must start with http:// or"
+        " https://: " + url);
+  rest = rest.substr(0, rest.find('/'));
+
+  std::string port = tls_ ? "443" : "80";
+  std::size_t colon = rest.rfind(':');
+  std::size_t bracket = rest.rfind(']');
+  if (colon != std::string::npos
+      && (bracket == std::string::npos || colon > bracket))
+  {
+    port = rest.substr(colon + 1);
+    host_ = rest.substr(0, colon);
+  }
+  else
+    host_ = rest;
+  authority_ = rest;
+  if (host_.size() > 1 && host_.front() == '[' && host_.back() == ']')
+    host_ = host_.substr(1, host_.size() - 2);
+
+  boost::asio::ip::tcp::resolver resolver(io_context_);
+  endpoints_ = resolver.resolve(host_, port);
+}
+
+void upstream::acquire(acquire_handler handler, bool fresh)
+{
+  ++outstanding_;
+  if (!fresh && !idle_.empty())
+  {
+    std::shared_ptr<upstream_connection> connection = std::move(idle_.back());
+    idle_.pop_back();
+    boost::asio::post(io_context_,
+        [handler, connection]()
+        {
+          handler(boost::system::error_code(), connection);
+        });
+    return;
+  }
+  connect([this, handler](const boost::system::error_code& ec,
+        std::shared_ptr<upstream_connection> connection)
+      {
+        if (ec)
+          --outstanding_;
+        handler(ec, connection);
+      });
+}
+
+void upstream::release(std::shared_ptr<upstream_connection> connection,
+    bool reusable)
+{
+  --outstanding_;
+  if (reusable && idle_.size() < max_idle_)
+  {
+    connection->reused = true;
+    idle_.push_back(std::move(connection));
+  }
+  else
+    connection->close();
+}
+
+void upstream::connect(acquire_handler handler)
+{
+  auto connection =
+      std::make_shared<upstream_connection>(io_context_, context_, tls_);
+  boost::asio::async_connect(connection->stream.lowest_layer(), endpoints_,
+      [this, connection, handler](const boost::system::error_code& ec,
+        const boost::asio::ip::tcp::endpoint&)
+      {
+        if (ec)
+        {
+          // Nothing is listening: stop sending requests here until a
+          // health check succeeds.
+          healthy_ = false;
+          handler(ec, nullptr);
+          return;
+        }
+        boost::system::error_code ignored_ec;
+        connection->stream.lowest_layer().set_option(
+            boost::asio::ip::tcp::no_delay(true), ignored_ec);
+        if (!connection->tls)
+        {
+          handler(ec, connection);
+          return;
+        }
+        SSL_set_tlsext_host_name(connection->stream.native_handle(),
+            host_.c_str());
+        connection->stream.set_verify_callback(
+            boost::asio::ssl::rfc2818_verification(host_));
+        connection->stream.async_handshake(
+            boost::asio::ssl::stream_base::client,
+            [connection, handler](const boost::system::error_code& ec)
+            {
+              handler(ec, ec ? nullptr : connection);
+            });
+      });
+}
+
+void upstream::start_health_checks()
+{
+  schedule_health_check();
+}
+
+void upstream::schedule_health_check()
+{
+  health_timer_.expires_after(interval_);
+  health_timer_.async_wait(
+      [this](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          check_health();
+      });
+}
+
+void upstream::check_health()
+{
+  auto check = std::make_shared<health_check>(io_context_);
+  auto finish = [this, check](bool healthy)
+  {
+    if (check->done)
+      return;
+    check->done = true;
+    healthy_ = healthy;
+    check->deadline.cancel();
+    if (check->connection)
+      check->connection->close();
+    schedule_health_check();
+  };
+
+  check->deadline.expires_after(interval_);
+  check->deadline.async_wait(
+      [finish](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          finish(false);
+      });
+
+  // The check does not count as an outstanding request and never uses or
+  // feeds the pool.
+  connect([this, check, finish](const boost::system::error_code& ec,
+        std::shared_ptr<upstream_connection> connection)
+      {
+        if (ec || check->done)
+        {
+          if (connection)
+            connection->close();
+          finish(false);
+          return;
+        }
+        check->connection = connection;
+        check->request = "GET " + health_path_ + " HTTP/1.0\r\nHost: "
+            + authority_ + "\r\nConnection: close\r\n\r\n";
+        connection->async_write({ boost::asio::buffer(check->request) },
+            [check, finish](const boost::system::error_code& ec, std::size_t)
+            {
+              if (ec)
+              {
+                finish(false);
+                return;
+              }
+              // "HTTP/1.x nnn" is all that is needed.
+              check->connection->async_read(
+                  boost::asio::buffer(check->response, 12),
+                  [check, finish](const boost::system::error_code& ec,
+                    std::size_t)
+                  {
+                    int status = ec ? 0 : std::atoi(check->response + 9);
+                    finish(status >= 100 && status < 500);
+                  });
+            });
+      });
+}
+
+} // namespace server
+} // namespace http
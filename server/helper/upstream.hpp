@@ -0,0 +1,117 @@
+#ifndef HTTP_UPSTREAM_HPP
+#define HTTP_UPSTREAM_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "body_stream.hpp"
+
+namespace http {
+namespace server {
+
+/// A connection to an upstream server, over TLS or plain TCP.
+class upstream_connection
+{
+public:
+  upstream_connection(boost::asio::io_context& io_context,
+      boost::asio::ssl::context& context, bool tls);
+
+  /// Write all of the buffers.
+  void async_write(const std::vector<boost::asio::const_buffer>& buffers,
+      body_handler handler);
+
+  /// Read some data.
+  void async_read_some(boost::asio::mutable_buffer buffer,
+      body_handler handler);
+
+  /// Fill the buffer.
+  void async_read(boost::asio::mutable_buffer buffer, body_handler handler);
+
+  /// Close the socket, cancelling anything outstanding.
+  void close();
+
+  boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream;
+  const bool tls;
+
+  /// True if the connection has already carried a request, in which case
+  /// the upstream may have closed it while it sat in the pool.
+  bool reused = false;
+};
+
+/// One upstream server: where it is, its pool of idle keep-alive
+/// connections and whether it is answering. Health is checked actively by
+/// a periodic request and passively by failed connects.
+class upstream
+{
+public:
+  upstream(const upstream&) = delete;
+  upstream& operator=(const upstream&) = delete;
+
+  typedef std::function<void(const boost::system::error_code&,
+      std::shared_ptr<upstream_connection>)> acquire_handler;
+
+  /// Construct from a URL of the form http[s]://host[:port]. The host is
+  /// resolved here. Every interval health_path is requested on a fresh
+  /// connection; an answer below 500 within the interval means healthy.
+  upstream(boost::asio::io_context& io_context,
+      boost::asio::ssl::context& context, const std::string& url,
+      const std::string& health_path = "/",
+      std::chrono::steady_clock::duration interval = std::chrono::seconds(5),
+      std::size_t max_idle = 32);
+
+  /// Get a connection, idle from the pool unless fresh is set, or newly
+  /// connected. A connection handed out counts as an outstanding request
+  /// until it is released.
+  void acquire(acquire_handler handler, bool fresh = false);
+
+  /// Give back a connection from acquire(). It goes back in the pool if it
+  /// can carry another request.
+  void release(std::shared_ptr<upstream_connection> connection,
+      bool reusable);
+
+  /// Start the periodic health checks.
+  void start_health_checks();
+
+  /// The value for the Host header of requests sent here.
+  const std::string& authority() const { return authority_; }
+
+  bool tls() const { return tls_; }
+  bool healthy() const { return healthy_; }
+  std::size_t outstanding() const { return outstanding_; }
+  std::size_t idle() const { return idle_.size(); }
+
+private:
+  struct health_check;
+
+  /// Open a new connection, with the TLS handshake if needed.
+  void connect(acquire_handler handler);
+
+  void schedule_health_check();
+  void check_health();
+
+  boost::asio::io_context& io_context_;
+  boost::asio::ssl::context& context_;
+  bool tls_ = false;
+  std::string host_;
+  std::string authority_;
+  std::string health_path_;
+  std::chrono::steady_clock::duration interval_;
+  std::size_t max_idle_;
+  boost::asio::ip::tcp::resolver::results_type endpoints_;
+
+  std::vector<std::shared_ptr<upstream_connection>> idle_;
+  std::size_t outstanding_ = 0;
+  bool healthy_ = true;
+  boost::asio::steady_timer health_timer_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_UPSTREAM_HPP
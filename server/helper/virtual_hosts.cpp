@@ -0,0 +1,122 @@
+#include "virtual_hosts.hpp"
+#include <strings.h>
+
+namespace http {
+namespace server {
+
+virtual_hosts::virtual_hosts(std::unique_ptr<request_handler> default_handler)
+  : default_handler_(std::move(default_handler)) {}
+
+void virtual_hosts::add(const std::string& name,
+    std::unique_ptr<request_handler> handler,
+    std::unique_ptr<boost::asio::ssl::context> context)
+{
+  std::unique_ptr<host> h(new host);
+  std::size_t length;
+  h->hash = hash(name, length);
+  h->name = name.substr(0, length);
+  h->handler = std::move(handler);
+  h->context = std::move(context);
+  hosts_.push_back(std::move(h));
+  rebuild();
+}
+
+std::uint32_t virtual_hosts::hash(std::string_view name, std::size_t& length)
+{
+  // FNV-1a over the lower-cased name. The port, if any, follows the last
+  // ':' outside an IPv6 literal such as "[::1]:8443".
+  std::size_t end = name.size();
+  if (!name.empty() && name[0] == '[')
+  {
+    std::size_t bracket = name.find(']');
+    end = bracket == std::string_view::npos ? name.size() : bracket + 1;
+  }
+  else
+  {
+    std::size_t colon = name.find(':');
+    if (colon != std::string_view::npos)
+      end = colon;
+  }
+  // "example.com." names the same host as "example.com".
+  if (end > 0 && name[end - 1] == '.')
+    --end;
+
+  std::uint32_t h = 2166136261u;
+  for (std::size_t i = 0; i < end; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(name[i]);
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h = (h ^ c) * 16777619u;
+  }
+  length = end;
+  return h;
+}
+
+void virtual_hosts::rebuild()
+{
+  std::size_t size = 4;
+  while (size < 2 * hosts_.size())
+    size *= 2;
+  slots_.assign(size, 0);
+  mask_ = size - 1;
+  for (std::size_t i = 0; i < hosts_.size(); ++i)
+  {
+    std::size_t slot = hosts_[i]->hash & mask_;
+    while (slots_[slot] != 0)
+      slot = (slot + 1) & mask_;
+    slots_[slot] = static_cast<std::uint32_t>(i + 1);
+  }
+}
+
+const virtual_hosts::host* virtual_hosts::find(std::string_view name) const
+{
+  if (hosts_.empty())
+    return nullptr;
+  std::size_t length;
+  std::uint32_t h = hash(name, length);
+  for (std::size_t slot = h & mask_; slots_[slot] != 0;
+      slot = (slot + 1) & mask_)
+  {
+    const host& candidate = *hosts_[slots_[slot] - 1];
+    if (candidate.hash == h && candidate.name.size() == length
+        && strncasecmp(candidate.name.data(), name.data(), length) == 0)
+      return &candidate;
+  }
+  return nullptr;
+}
+
+request_handler& virtual_hosts::route(std::string_view host_header) const
+{
+  const host* h = find(host_header);
+  return h ? *h->handler : *default_handler_;
+}
+
+void virtual_hosts::for_each_handler(
+    const std::function<void(request_handler&)>& f) const
+{
+  f(*default_handler_);
+  for (const auto& h : hosts_)
+    f(*h->handler);
+}
+
+void virtual_hosts::attach(boost::asio::ssl::context& context)
+{
+  SSL_CTX_set_tlsext_servername_callback(context.native_handle(),
+      &virtual_hosts::servername_callback);
+  SSL_CTX_set_tlsext_servername_arg(context.native_handle(), this);
+}
+
+int virtual_hosts::servername_callback(SSL* ssl, int*, void* arg)
+{
+  const char* name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  if (!name)
+    return SSL_TLSEXT_ERR_NOACK;
+  const host* h = static_cast<virtual_hosts*>(arg)->find(name);
+  if (h && h->context)
+    SSL_set_SSL_CTX(ssl, h->context->native_handle());
+  return SSL_TLSEXT_ERR_OK;
+}
+
+} // namespace server
+} // namespace http
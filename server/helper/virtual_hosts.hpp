@@ -0,0 +1,90 @@
+#ifndef HTTP_VIRTUAL_HOSTS_HPP
+#define HTTP_VIRTUAL_HOSTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio/ssl.hpp>
+
+#include "request_handler.hpp"
+
+namespace http {
+namespace server {
+
+/// The sites served by one server, by host name. Requests are routed on the
+/// Host header and TLS handshakes on the SNI name; names that match no site
+/// go to the default one.
+///
+/// Sites are looked up in an open-addressing hash table rebuilt whenever a
+/// site is added, so all sites must be added before the server starts
+/// taking requests. Lookups lower-case and hash the name in one pass
+/// without allocating.
+class virtual_hosts
+{
+public:
+  virtual_hosts(const virtual_hosts&) = delete;
+  virtual_hosts& operator=(const virtual_hosts&) = delete;
+
+  /// A site: its handler and, if it has its own certificate, its context.
+  struct host
+  {
+    std::string name;
+    std::uint32_t hash;
+    std::unique_ptr<request_handler> handler;
+    std::unique_ptr<boost::asio::ssl::context> context;
+  };
+
+  /// Construct with the handler for requests that match no site.
+  explicit virtual_hosts(std::unique_ptr<request_handler> default_handler);
+
+  /// Add a site. The name is matched without case and without a port. A
+  /// null context means the site shares the server's certificate.
+  void add(const std::string& name, std::unique_ptr<request_handler> handler,
+      std::unique_ptr<boost::asio::ssl::context> context = nullptr);
+
+  /// The handler for a Host header value (which may carry a port), or the
+  /// default handler.
+  request_handler& route(std::string_view host_header) const;
+
+  /// The site with the given name, ignoring case and any port, or null.
+  const host* find(std::string_view name) const;
+
+  /// The handler for requests that match no site.
+  request_handler& default_handler() const { return *default_handler_; }
+
+  /// Call f with the handler of every site, the default one first.
+  void for_each_handler(const std::function<void(request_handler&)>& f) const;
+
+  /// Number of sites, not counting the default one.
+  std::size_t size() const { return hosts_.size(); }
+
+  /// Make the given (default) context switch to a site's own certificate
+  /// when the client asks for that site by SNI.
+  void attach(boost::asio::ssl::context& context);
+
+private:
+  /// Hash the host part of name (up to any port), ignoring case. Sets
+  /// length to the length of that part.
+  static std::uint32_t hash(std::string_view name, std::size_t& length);
+
+  static int servername_callback(SSL* ssl, int* alert, void* arg);
+
+  void rebuild();
+
+  std::unique_ptr<request_handler> default_handler_;
+  std::vector<std::unique_ptr<host>> hosts_;
+
+  /// Index into hosts_ plus one, zero for an empty slot. The table is kept
+  /// at most half full.
+  std::vector<std::uint32_t> slots_;
+  std::size_t mask_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_VIRTUAL_HOSTS_HPP
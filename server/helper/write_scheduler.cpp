@@ -0,0 +1,91 @@
+#include "write_scheduler.hpp"
+#include <algorithm>
+
+namespace http {
+namespace server {
+
+write_scheduler::write_scheduler(boost::asio::io_context& io_context,
+    std::size_t quantum, std::size_t max_in_flight,
+    std::chrono::steady_clock::duration stall_time)
+  : quantum_(quantum ? quantum : 1),
+    max_in_flight_(max_in_flight ? max_in_flight : 1),
+    stall_time_(stall_time),
+    stall_timer_(io_context) {}
+
+void write_scheduler::schedule(writer* w)
+{
+  active_.push_back(entry{ w, 0 });
+  pump();
+}
+
+void write_scheduler::remove(writer* w)
+{
+  active_.erase(std::remove_if(active_.begin(), active_.end(),
+        [w](const entry& e) { return e.w == w; }),
+      active_.end());
+}
+
+void write_scheduler::pump()
+{
+  // Writers may complete synchronously and call back into pump().
+  if (pumping_)
+    return;
+  pumping_ = true;
+  while (in_flight_.size() < max_in_flight_ && !active_.empty())
+  {
+    entry e = active_.front();
+    active_.pop_front();
+    e.deficit += quantum_;
+    std::uint64_t id = next_id_++;
+    in_flight_.push_back(flight{ id, std::chrono::steady_clock::now() });
+    e.w->write_some(e.deficit,
+        [this, e, id](std::size_t written, bool more) mutable
+        {
+          finished(id);
+          if (more)
+          {
+            // Unused credit carries over to the writer's next turn.
+            e.deficit -= std::min(written, e.deficit);
+            active_.push_back(e);
+          }
+          pump();
+        });
+  }
+  pumping_ = false;
+  if (!active_.empty())
+    watch_stalls();
+}
+
+void write_scheduler::finished(std::uint64_t id)
+{
+  // Not found if it was written off as stalled.
+  auto i = std::find_if(in_flight_.begin(), in_flight_.end(),
+      [id](const flight& f) { return f.id == id; });
+  if (i != in_flight_.end())
+    in_flight_.erase(i);
+}
+
+void write_scheduler::watch_stalls()
+{
+  if (watching_ || in_flight_.empty()
+      || stall_time_ == std::chrono::steady_clock::duration::zero())
+    return;
+  watching_ = true;
+  stall_timer_.expires_at(in_flight_.front().started + stall_time_);
+  stall_timer_.async_wait([this](const boost::system::error_code& ec)
+      {
+        if (ec)
+          return;
+        watching_ = false;
+        auto limit = std::chrono::steady_clock::now() - stall_time_;
+        while (!in_flight_.empty() && in_flight_.front().started <= limit)
+        {
+          in_flight_.pop_front();
+          ++stalled_;
+        }
+        pump();
+      });
+}
+
+} // namespace server
+} // namespace http
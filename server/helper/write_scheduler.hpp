@@ -0,0 +1,108 @@
+#ifndef HTTP_WRITE_SCHEDULER_HPP
+#define HTTP_WRITE_SCHEDULER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace http {
+namespace server {
+
+/// Shares the socket writes of the server between sessions by deficit
+/// round-robin. Every turn a session is credited with one quantum and may
+/// write up to its accumulated deficit, so a small reply goes out in its
+/// first turn while a large one is cut into quantum-sized pieces that take
+/// turns with everybody else's.
+///
+/// A write that is still in flight after the stall time is waiting for a
+/// slow client to take the data rather than for the server, and stops
+/// counting against the limit; otherwise a few such clients would hold up
+/// everybody else's writes until they timed out.
+class write_scheduler
+{
+public:
+  write_scheduler(const write_scheduler&) = delete;
+  write_scheduler& operator=(const write_scheduler&) = delete;
+
+  /// Called when a write granted by the scheduler has finished: the number
+  /// of bytes written and whether the writer still has output pending.
+  typedef std::function<void(std::size_t written, bool more)> done_handler;
+
+  /// Something with output to send, i.e. a session.
+  class writer
+  {
+  public:
+    /// Write at most max_bytes of pending output, then call done exactly
+    /// once. A writer that cannot write now (e.g. rate limited) calls done
+    /// with more set to false and schedules itself again later.
+    virtual void write_some(std::size_t max_bytes, done_handler done) = 0;
+
+  protected:
+    ~writer() = default;
+  };
+
+  /// Construct with the credit given per turn and the number of writes
+  /// allowed in flight at once.
+  write_scheduler(boost::asio::io_context& io_context, std::size_t quantum,
+      std::size_t max_in_flight,
+      std::chrono::steady_clock::duration stall_time =
+        std::chrono::milliseconds(10));
+
+  /// Queue a writer that has output pending. It must not already be queued.
+  void schedule(writer* w);
+
+  /// Forget a writer that is going away. Its in-flight write, if any, must
+  /// have completed.
+  void remove(writer* w);
+
+  /// Number of writers waiting for a turn.
+  std::size_t waiting() const { return active_.size(); }
+
+  /// Number of writes that stalled and stopped counting, in total.
+  std::uint64_t stalled() const { return stalled_; }
+
+private:
+  struct entry
+  {
+    writer* w;
+    std::size_t deficit;
+  };
+
+  /// A write that counts against the limit.
+  struct flight
+  {
+    std::uint64_t id;
+    std::chrono::steady_clock::time_point started;
+  };
+
+  /// Start writes while there is capacity.
+  void pump();
+
+  /// Stop counting a write once it has completed.
+  void finished(std::uint64_t id);
+
+  /// While writers wait for capacity, write off the writes in flight as
+  /// they reach the stall time.
+  void watch_stalls();
+
+  std::size_t quantum_;
+  std::size_t max_in_flight_;
+  std::chrono::steady_clock::duration stall_time_;
+  /// Counted writes, oldest first.
+  std::deque<flight> in_flight_;
+  std::uint64_t next_id_ = 0;
+  std::uint64_t stalled_ = 0;
+  std::deque<entry> active_;
+  bool pumping_ = false;
+  boost::asio::steady_timer stall_timer_;
+  bool watching_ = false;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_WRITE_SCHEDULER_HPP
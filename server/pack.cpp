@@ -0,0 +1,121 @@
+// Packs a doc root into an archive for the server's --archive option:
+//
+//   https-pack <doc-root> <archive> [--no-gzip]
+//
+// Every regular file below doc-root is stored under its path from there
+// ("/data/text/data.txt"), with its content type and ETag worked out now
+// rather than per request. When built with zlib, files that are not
+// already compressed also get a gzip variant if it saves at least a tenth.
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#if defined(HTTP_PACK_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "archive.hpp"
+#include "file_cache.hpp"
+#include "mime_types.hpp"
+
+using namespace http::server;
+namespace fs = std::filesystem;
+
+namespace {
+
+/// Formats that gain nothing from gzip.
+bool precompressed(const std::string& content_type)
+{
+  return content_type.compare(0, 6, "image/") == 0
+      || content_type == "application/octet-stream";
+}
+
+/// The gzip encoding of body, or nothing if zlib is not available or the
+/// saving is too small to be worth a second copy.
+std::string compress(const std::string& body)
+{
+#if defined(HTTP_PACK_HAVE_ZLIB)
+  z_stream z = {};
+  // 15 window bits plus 16 asks for a gzip wrapper.
+  if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+        Z_DEFAULT_STRATEGY) != Z_OK)
+    return std::string();
+  std::string out(deflateBound(&z, body.size()), '\0');
+  z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+  z.avail_in = static_cast<uInt>(body.size());
+  z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  z.avail_out = static_cast<uInt>(out.size());
+  int result = deflate(&z, Z_FINISH);
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  if (result != Z_STREAM_END || out.size() > body.size() / 10 * 9)
+    return std::string();
+  return out;
+#else
+  (void)body;
+  return std::string();
+#endif
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3 || argc > 4
+      || (argc == 4 && std::string(argv[3]) != "--no-gzip"))
+  {
+    std::cerr << "Usage: https-pack <doc-root> <archive> [--no-gzip]\n";
+    return 1;
+  }
+  bool gzip = argc == 3;
+
+  try
+  {
+    fs::path root = argv[1];
+    std::vector<archive::source> files;
+    std::size_t bytes = 0, compressed = 0;
+    for (const fs::directory_entry& entry :
+        fs::recursive_directory_iterator(root))
+    {
+      if (!entry.is_regular_file())
+        continue;
+      archive::source file;
+      file.path =
+          "/" + entry.path().lexically_relative(root).generic_string();
+      std::ifstream in(entry.path(), std::ios::binary);
+      file.body.assign(std::istreambuf_iterator<char>(in),
+          std::istreambuf_iterator<char>());
+      if (!in && !in.eof())
+        throw std::runtime_error("cannot read " + entry.path().string());
+      std::string extension = entry.path().extension().string();
+      if (!extension.empty())
+        extension.erase(0, 1);
+      file.content_type = mime_types::extension_to_type(extension);
+      // The same tag the file cache would give it.
+      file.etag = file_cache::make_etag(file.body);
+      struct stat st;
+      if (::stat(entry.path().c_str(), &st) == 0)
+        file.mtime = st.st_mtime;
+      if (gzip && !precompressed(file.content_type))
+        file.gzip_body = compress(file.body);
+      bytes += file.body.size();
+      compressed += file.gzip_body.empty() ? 0 : 1;
+      files.push_back(std::move(file));
+    }
+    std::size_t count = files.size();
+    archive::write(argv[2], std::move(files));
+    std::cout << "Packed " << count << " files (" << bytes << " bytes, "
+              << compressed << " with gzip) into " << argv[2] << "\n";
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -1,222 +1,154 @@
-#include <cstdlib>
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <boost/bind.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
 #include <boost/asio.hpp>
-#include <boost/asio/ssl.hpp>
 
-#include "reply.hpp"
-#include "request.hpp"
-#include "request_handler.hpp"
-#include "request_parser.hpp"
+#include "certificate_check.hpp"
 
-typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
+#include "server.hpp"
+#include "server_config.hpp"
+#include "shared_stats.hpp"
+#include "supervisor.hpp"
 
 using namespace http::server;
 
-class session
-{
-public:
-  session(boost::asio::io_context& io_context,
-      boost::asio::ssl::context& context,
-      request_handler& handler)
-    : m_io_context(io_context),
-      socket_(io_context, context),
-      request_handler_(handler) {}
-
-  ssl_socket::lowest_layer_type& socket()
-  {
-    return socket_.lowest_layer();
-  }
-
-  void start()
-  {
-    socket_.async_handshake(boost::asio::ssl::stream_base::server,
-        boost::bind(&session::handle_handshake, this,
-          boost::asio::placeholders::error));
-  }
+namespace {
 
-  void handle_handshake(const boost::system::error_code& error)
+/// Warn about certificate chains that are bigger than they need to be.
+void check_certificates(const server_config& config)
+{
+  auto check = [](const std::string& chain, const std::string& stapled)
   {
-    if (!error)
+    struct stat st;
+    std::size_t stapled_bytes = !stapled.empty()
+        && ::stat(stapled.c_str(), &st) == 0 ? st.st_size : 0;
+    try
     {
-      do_read();
+      for (const std::string& warning :
+          check_chain(chain, stapled_bytes).warnings)
+        std::cerr << "Warning: " << chain << " " << warning << "\n";
     }
-    else
+    catch (std::exception& e)
     {
-      delete this;
+      std::cerr << "Warning: " << e.what() << "\n";
     }
-  }
-
-  void handle_read(const boost::system::error_code& error,
-      size_t bytes_transferred)
+  };
+  check(config.certificate_chain, config.ocsp_response);
+  for (const server_config::host& h : config.hosts)
+    if (!h.certificate_chain.empty())
+      check(h.certificate_chain, std::string());
+}
+
+/// Serve as configured until SIGINT or SIGTERM. In a worker process (stats
+/// given) the logs get the worker's number appended to their names, since
+/// several processes cannot share one file.
+int serve(const server_config& config, shared_stats* stats,
+    std::size_t worker)
+{
+  std::string suffix = stats ? "." + std::to_string(worker) : std::string();
+
+  // The log and tracer are shared by the servers of all threads.
+  std::unique_ptr<access_log> log;
+  if (!config.access_log.empty())
+    log = std::make_unique<access_log>(config.access_log + suffix,
+        config.sample_rate);
+  std::unique_ptr<request_tracer> tracer;
+  if (config.slow_threshold.count() > 0 || !config.trace_file.empty())
+    tracer = std::make_unique<request_tracer>(config.slow_threshold,
+        config.trace_file.empty() ? config.trace_file
+                                  : config.trace_file + suffix);
+
+  // One io_context and one server per thread; the kernel spreads the
+  // connections between their listening sockets.
+  std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+  for (unsigned i = 0; i < config.threads; ++i)
+    contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+  std::vector<std::unique_ptr<server>> servers(config.threads);
+
+  // Stop cleanly so that the logs are flushed.
+  boost::asio::signal_set signals(*contexts.front(), SIGINT, SIGTERM);
+  signals.async_wait([&contexts](const boost::system::error_code&, int)
+      {
+        for (auto& context : contexts)
+          context->stop();
+      });
+
+  // Each thread is pinned before it makes its server, so that the
+  // server's memory comes from the node of the CPU that uses it.
+  std::atomic<bool> failed{false};
+  auto run = [&](std::size_t i)
   {
-    if (!error)
+    try
     {
-      boost::asio::async_write(socket_,
-          boost::asio::buffer(data_, bytes_transferred),
-          boost::bind(&session::handle_write, this,
-            boost::asio::placeholders::error));
+      if (config.cpu_affinity)
+        pin_to_cpu(worker * config.threads + i);
+      // Only the first thread of the first worker asks the OCSP
+      // responder; the others follow the response file it saves to, so
+      // that their fetches and saves do not race.
+      server_config own = config;
+      if (worker > 0 || i > 0)
+        own.ocsp_fetch = false;
+      servers[i] = std::make_unique<server>(*contexts[i], own,
+          log.get(), tracer.get());
+      if (stats)
+        servers[i]->share_stats(*stats, worker);
+      contexts[i]->run();
     }
-    else
+    catch (std::exception& e)
     {
-      delete this;
+      std::cerr << "Exception: " << e.what() << "\n";
+      failed = true;
+      for (auto& context : contexts)
+        context->stop();
     }
-  }
-
-
-  void do_read()
-  {
-    socket_.async_read_some(boost::asio::buffer(data_),
-        [this](boost::system::error_code ec, std::size_t bytes_transferred)
-        {
-          if (!ec)
-          {
-            request_parser::result_type result;
-            std::tie(result, std::ignore) = request_parser_.parse(
-                request_, data_, data_ + bytes_transferred);
-
-            if (result == request_parser::good)
-            {
-              request_handler_.handle_request(request_, reply_);
-              do_write();
-            }
-            else if (result == request_parser::bad)
-            {
-              reply_ = reply::stock_reply(reply::bad_request);
-              do_write();
-            }
-            else if (result == request_parser::shutdown)
-            {
-              // Initiate graceful connection closure.
-              // server::do_await_stop() is waiting for it:
-              std::raise(SIGINT);//or std::raise(SIGINT);
-            }
-            else
-            {
-              do_read();
-            }
-          }
-        });
-  }
-
-
-  void do_write()
-  {
-    boost::asio::async_write(socket_, reply_.to_buffers(),
-        [this](boost::system::error_code ec, std::size_t bytes_transferred)
-        {
-          if (!ec)
-          {
-            do_read();
-            /*
-            // Initiate graceful connection closure.
-            boost::system::error_code ignored_ec;
-            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
-              ignored_ec);
-            */
-          }
-          else
-            std::cout<<"ERROR! "<<ec.message()<<std::endl;
-        });
-  }
+  };
 
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < contexts.size(); ++i)
+    threads.emplace_back(run, i);
+  run(0);
+  for (std::thread& t : threads)
+    t.join();
+  return failed ? 1 : 0;
+}
 
-  void handle_write(const boost::system::error_code& error)
-  {
-    if (!error)
-    {
-      socket_.async_read_some(boost::asio::buffer(data_, max_length),
-          boost::bind(&session::handle_read, this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
-    }
-    else delete this;
-  }
+} // namespace
 
-private:
-  boost::asio::io_context& m_io_context;
-  ssl_socket socket_;
-  enum { max_length = 8192 };
-  char data_[max_length];
-  /// The handler used to process the incoming request.
-  request_handler& request_handler_;
-  /// Buffer for incoming data.
-  std::array<char, 8192> buffer_;
-  /// The incoming request.
-  request request_;
-  /// The parser for the incoming request.
-  request_parser request_parser_;
-  /// The reply to be sent back to the client.
-  reply reply_;
-};
-
-class server
+int main(int argc, char* argv[])
 {
-public:
-  server(boost::asio::io_context& io_context, unsigned short port,
-         const std::string& doc_root)
-    : io_context(io_context),
-      acceptor_(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
-      context_(boost::asio::ssl::context::sslv23),
-      request_handler_(doc_root)
+  server_config config;
+  try
   {
-    context_.set_options(
-        boost::asio::ssl::context::default_workarounds
-        | boost::asio::ssl::context::no_sslv2
-        | boost::asio::ssl::context::single_dh_use);
-    context_.set_password_callback(boost::bind(&server::get_password, this));
-    context_.use_certificate_chain_file("server.crt");
-    context_.use_private_key_file("server.key", boost::asio::ssl::context::pem);
-    context_.use_tmp_dh_file("dh2048.pem");
-
-    start_accept();
+    if (!parse_config(argc, argv, config, std::cout))
+      return 0;
   }
-
-  std::string get_password() const {return "test";}
-
-  void start_accept()
+  catch (std::invalid_argument& e)
   {
-    session* new_session = new session(io_context, context_, request_handler_);
-    acceptor_.async_accept(new_session->socket(),
-        boost::bind(&server::handle_accept, this, new_session,
-          boost::asio::placeholders::error));
+    std::cerr << e.what() << "\nTry: server --help\n";
+    return 1;
   }
 
-  void handle_accept(session* new_session,
-      const boost::system::error_code& error)
-  {
-    if (!error)
-    {
-      new_session->start();
-    }
-    else
-    {
-      delete new_session;
-    }
-    start_accept();
-  }
+  check_certificates(config);
 
-private:
-  boost::asio::io_context& io_context;
-  boost::asio::ip::tcp::acceptor acceptor_;
-  boost::asio::ssl::context context_;
-  /// The handler for all incoming requests.
-  request_handler request_handler_;
-};
-
-int main(int argc, char* argv[])
-{
   try
   {
-    if (argc != 2)
-    {
-      std::cerr << "Usage: server <port>\n";
-      return 1;
-    }
-    boost::asio::io_context io_context;
-    using namespace std; // For atoi.
-    server s(io_context, atoi(argv[1]), ".");
-    io_context.run();
+    if (config.workers == 0)
+      return serve(config, nullptr, 0);
+
+    // The counters are mapped before the workers are forked, so that they
+    // all share them.
+    shared_stats stats(config.workers);
+    supervisor workers(config.workers, [&config, &stats](std::size_t i)
+        {
+          return serve(config, &stats, i);
+        }, stats);
+    return workers.run();
   }
   catch (std::exception& e)
   {
@@ -224,4 +156,4 @@ int main(int argc, char* argv[])
   }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,803 @@
+// Soaks a running server with thousands of connections, many of them
+// misbehaving, and fails if the server leaks:
+//
+//   https-soak <host> <port> <server-pid> [--seconds 60] [--rounds 6]
+//       [--clients 50] [--hold 3] [--corpus dir] [--seed n]
+//       [--rss-growth 20] [--fd-slack 8]
+//
+// Every client runs one scenario picked at random and is replaced by a new
+// one when it is done:
+//
+//   clean      a few keep-alive GETs, read in full
+//   handshake  the connection is dropped before or during the TLS handshake
+//   reset      part of a request is sent, then the connection is reset
+//   slow       hundreds of pipelined GETs whose replies are never read,
+//              held for up to --hold seconds, then reset
+//   malformed  a request from the corpus, mutated half the time, and the
+//              reply read until the server closes or a second has passed
+//   garbage    random bytes where the TLS handshake should be
+//
+// Load runs in rounds. After each one the harness lets its clients finish,
+// waits for the server to settle, and samples the server's resident memory
+// and open descriptors from /proc and its live sessions from /_stats. So
+// the server must run as one process (no --workers), with --stats on, and
+// preferably with short timeouts:
+//
+//   https-server 8443 --stats on --timeouts.handshake 2
+//       --timeouts.request 2 --timeouts.idle 2 --timeouts.write 2
+//
+// The run fails if sessions or descriptors at rest end up above what they
+// were before the first round, or if memory at rest grows by more than
+// --rss-growth percent after the first round, which warms up caches and
+// the allocator. A sample a second is printed while the rounds run.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/program_options.hpp>
+
+namespace asio = boost::asio;
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+using asio::ip::tcp;
+typedef asio::ssl::stream<tcp::socket> ssl_stream;
+typedef std::chrono::steady_clock steady;
+
+namespace {
+
+enum scenario
+{
+  clean,
+  handshake,
+  reset,
+  slow,
+  malformed,
+  garbage,
+  scenario_count
+};
+
+const char* const scenario_names[scenario_count] =
+{
+  "clean", "handshake", "reset", "slow", "malformed", "garbage"
+};
+
+/// How often each scenario is picked, out of the total.
+const double scenario_weights[scenario_count] = { 30, 15, 15, 10, 25, 5 };
+
+struct options
+{
+  std::string host;
+  std::string port;
+  int pid = 0;
+  double seconds = 60;
+  int rounds = 6;
+  int clients = 50;
+  double hold = 3;
+  std::string corpus = HTTP_SOAK_CORPUS;
+  unsigned seed = std::random_device()();
+  double rss_growth = 20;
+  long fd_slack = 8;
+};
+
+/// What the clients have done so far. Read by the sampling thread.
+struct tally
+{
+  std::array<std::atomic<std::uint64_t>, scenario_count> runs{};
+  /// Replies to clean requests: 2xx, and anything else (503 while the
+  /// server sheds load, 429 when rate limited).
+  std::atomic<std::uint64_t> ok{ 0 };
+  std::atomic<std::uint64_t> refused{ 0 };
+  /// Connections that failed where they should not have, and clients that
+  /// got no answer from the server at all within the watchdog time.
+  std::atomic<std::uint64_t> errors{ 0 };
+  std::atomic<std::uint64_t> stuck{ 0 };
+
+  std::uint64_t connections() const
+  {
+    std::uint64_t total = 0;
+    for (const auto& count : runs)
+      total += count.load();
+    return total;
+  }
+};
+
+/// Resident memory, open descriptors and live sessions of the server, or
+/// -1 for what could not be found out.
+struct sample
+{
+  long rss_kb = -1;
+  long fds = -1;
+  long sessions = -1;
+};
+
+std::ostream& operator<<(std::ostream& out, const sample& s)
+{
+  return out << "rss " << s.rss_kb << " kB, fds " << s.fds << ", sessions "
+             << s.sessions;
+}
+
+const std::string clean_request =
+    "GET /data/text/data.txt HTTP/1.1\r\nHost: localhost\r\n\r\n";
+const std::string slow_request =
+    "GET /data/images/2.png HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+std::vector<std::string> load_corpus(const std::string& dir)
+{
+  std::vector<fs::path> paths;
+  for (const fs::directory_entry& entry : fs::directory_iterator(dir))
+    if (entry.is_regular_file())
+      paths.push_back(entry.path());
+  // Sorted, so that a seed picks the same requests every time.
+  std::sort(paths.begin(), paths.end());
+  std::vector<std::string> corpus;
+  for (const fs::path& path : paths)
+  {
+    std::ifstream in(path, std::ios::binary);
+    corpus.emplace_back(std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+  }
+  if (corpus.empty())
+    throw std::runtime_error("no requests in " + dir);
+  return corpus;
+}
+
+/// Whether the request could be taken for one of the server's shutdown
+/// commands, which the soak must never send.
+bool stops_server(const std::string& request)
+{
+  std::string lower(request);
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+      [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return lower.find("server ") != std::string::npos;
+}
+
+/// A few random edits: bytes changed, inserted or removed, a slice repeated
+/// until it may exceed the server's limits, or the request cut short.
+std::string mutate(std::string s, std::mt19937& rng)
+{
+  auto below = [&rng](std::size_t n)
+  {
+    return n ? static_cast<std::size_t>(rng() % n) : 0;
+  };
+  for (int edits = 1 + below(4); edits > 0; --edits)
+  {
+    std::size_t pos = below(s.size() + 1);
+    switch (below(5))
+    {
+    case 0:
+      if (pos < s.size())
+        s[pos] = static_cast<char>(rng());
+      break;
+    case 1:
+      s.insert(pos, 1, static_cast<char>(rng()));
+      break;
+    case 2:
+      s.erase(pos, 1 + below(16));
+      break;
+    case 3:
+    {
+      std::string slice = s.substr(pos, 1 + below(16));
+      std::string repeated;
+      for (std::size_t n = 1 + below(4096); n > 0; --n)
+        repeated += slice;
+      s.insert(pos, repeated);
+      break;
+    }
+    default:
+      s.resize(pos);
+      break;
+    }
+  }
+  return s;
+}
+
+class driver;
+
+/// One connection running one scenario. It keeps itself alive through the
+/// handlers it has pending and reports to the driver when it is done.
+class client : public std::enable_shared_from_this<client>
+{
+public:
+  client(driver& owner, scenario kind);
+
+  void start();
+
+private:
+  void handshaken();
+  void read_reply();
+  void read_body(std::size_t length, int status);
+  void send_then_drain(const std::string& data, bool encrypted);
+  void drain(bool encrypted);
+
+  /// Close the connection, with a reset if abort is set, and count it.
+  /// Only the first call does anything.
+  void finish(bool abort, bool failed = false);
+
+  driver& owner_;
+  scenario kind_;
+  ssl_stream stream_;
+  asio::steady_timer timer_;
+  asio::steady_timer watchdog_;
+  asio::streambuf in_;
+  std::string out_;
+  std::array<char, 4096> scratch_;
+  int remaining_ = 0;
+  bool done_ = false;
+};
+
+/// Keeps --clients clients running until the end of each round.
+class driver
+{
+public:
+  driver(asio::io_context& io_context, asio::ssl::context& context,
+      const tcp::endpoint& endpoint, const options& opts,
+      std::vector<std::string> corpus, tally& counts)
+    : io_context_(io_context),
+      context_(context),
+      endpoint_(endpoint),
+      options_(opts),
+      corpus_(std::move(corpus)),
+      counts_(counts),
+      rng_(opts.seed),
+      pick_(std::begin(scenario_weights), std::end(scenario_weights))
+  {
+  }
+
+  /// Run clients for length, then wait for the last ones to finish.
+  void round(steady::duration length)
+  {
+    deadline_ = steady::now() + length;
+    for (int i = 0; i < options_.clients; ++i)
+      launch();
+    io_context_.restart();
+    io_context_.run();
+  }
+
+  /// Called by a client when it is done.
+  void finished()
+  {
+    if (steady::now() < deadline_)
+      launch();
+  }
+
+  asio::io_context& io_context() { return io_context_; }
+  asio::ssl::context& context() { return context_; }
+  const tcp::endpoint& endpoint() const { return endpoint_; }
+  const options& opts() const { return options_; }
+  tally& counts() { return counts_; }
+  std::mt19937& rng() { return rng_; }
+  std::mt19937::result_type random() { return rng_(); }
+
+  /// A request from the corpus, mutated half the time.
+  std::string corpus_request()
+  {
+    const std::string& original = corpus_[rng_() % corpus_.size()];
+    if (rng_() % 2)
+      return original;
+    std::string mutated = mutate(original, rng_);
+    return stops_server(mutated) ? original : mutated;
+  }
+
+private:
+  void launch()
+  {
+    scenario kind = static_cast<scenario>(pick_(rng_));
+    std::make_shared<client>(*this, kind)->start();
+  }
+
+  asio::io_context& io_context_;
+  asio::ssl::context& context_;
+  tcp::endpoint endpoint_;
+  const options& options_;
+  std::vector<std::string> corpus_;
+  tally& counts_;
+  std::mt19937 rng_;
+  std::discrete_distribution<int> pick_;
+  steady::time_point deadline_;
+};
+
+client::client(driver& owner, scenario kind)
+  : owner_(owner),
+    kind_(kind),
+    stream_(owner.io_context(), owner.context()),
+    timer_(owner.io_context()),
+    watchdog_(owner.io_context())
+{
+}
+
+void client::start()
+{
+  auto self = shared_from_this();
+  // Nothing should take this long against short server timeouts; a client
+  // still waiting by then has been forgotten by the server.
+  watchdog_.expires_after(std::chrono::seconds(15));
+  watchdog_.async_wait([self](const boost::system::error_code& ec)
+      {
+        if (ec || self->done_)
+          return;
+        ++self->owner_.counts().stuck;
+        self->finish(true);
+      });
+
+  stream_.lowest_layer().async_connect(owner_.endpoint(),
+      [self](const boost::system::error_code& ec)
+      {
+        if (ec)
+        {
+          self->finish(false, true);
+          return;
+        }
+        std::mt19937& rng = self->owner_.rng();
+        switch (self->kind_)
+        {
+        case garbage:
+        {
+          std::string bytes(1 + rng() % 4096, '\0');
+          for (char& c : bytes)
+            c = static_cast<char>(rng());
+          self->send_then_drain(bytes, false);
+          return;
+        }
+        case handshake:
+        {
+          // Gone at once a quarter of the time, otherwise somewhere in
+          // the handshake, or just after it on a fast machine.
+          if (rng() % 4 == 0)
+          {
+            self->finish(rng() % 2 == 0);
+            return;
+          }
+          self->timer_.expires_after(
+              std::chrono::microseconds(rng() % 3000));
+          self->timer_.async_wait(
+              [self](const boost::system::error_code& ec)
+              {
+                if (!ec)
+                  self->finish(self->owner_.random() % 2 == 0);
+              });
+          self->stream_.async_handshake(asio::ssl::stream_base::client,
+              [self](const boost::system::error_code&)
+              {
+                self->finish(true);
+              });
+          return;
+        }
+        default:
+          self->stream_.async_handshake(asio::ssl::stream_base::client,
+              [self](const boost::system::error_code& ec)
+              {
+                if (ec)
+                  self->finish(false, true);
+                else
+                  self->handshaken();
+              });
+        }
+      });
+}
+
+void client::handshaken()
+{
+  auto self = shared_from_this();
+  std::mt19937& rng = owner_.rng();
+  switch (kind_)
+  {
+  case clean:
+    remaining_ = 1 + rng() % 5;
+    read_reply();
+    return;
+  case reset:
+  {
+    out_ = owner_.corpus_request();
+    if (out_.size() < 2 || rng() % 2)
+      out_ = clean_request;
+    out_.resize(1 + rng() % (out_.size() - 1));
+    asio::async_write(stream_, asio::buffer(out_),
+        [self](const boost::system::error_code& ec, std::size_t)
+        {
+          if (ec)
+          {
+            self->finish(true);
+            return;
+          }
+          self->timer_.expires_after(
+              std::chrono::milliseconds(self->owner_.random() % 50));
+          self->timer_.async_wait([self](const boost::system::error_code&)
+              {
+                self->finish(true);
+              });
+        });
+    return;
+  }
+  case slow:
+  {
+    for (int n = 100 + rng() % 1900; n > 0; --n)
+      out_ += slow_request;
+    // The server stops reading once its replies back up, so this write may
+    // never finish; the hold timer ends the client either way.
+    asio::async_write(stream_, asio::buffer(out_),
+        [self](const boost::system::error_code&, std::size_t) {});
+    auto hold = std::chrono::duration<double>(
+        owner_.opts().hold * (rng() % 1000 + 1) / 1000);
+    timer_.expires_after(
+        std::chrono::duration_cast<steady::duration>(hold));
+    timer_.async_wait([self](const boost::system::error_code&)
+        {
+          self->finish(true);
+        });
+    return;
+  }
+  default:
+    send_then_drain(owner_.corpus_request(), true);
+  }
+}
+
+void client::read_reply()
+{
+  if (remaining_-- == 0)
+  {
+    finish(false);
+    return;
+  }
+  auto self = shared_from_this();
+  out_ = clean_request;
+  asio::async_write(stream_, asio::buffer(out_),
+      [self](const boost::system::error_code& ec, std::size_t)
+      {
+        if (ec)
+        {
+          self->finish(false, true);
+          return;
+        }
+        asio::async_read_until(self->stream_, self->in_, "\r\n\r\n",
+            [self](const boost::system::error_code& ec, std::size_t size)
+            {
+              if (ec)
+              {
+                self->finish(false, true);
+                return;
+              }
+              std::string head(asio::buffers_begin(self->in_.data()),
+                  asio::buffers_begin(self->in_.data()) + size);
+              self->in_.consume(size);
+              int status = 0;
+              if (head.size() > 12)
+                status = std::atoi(head.c_str() + 9);
+              std::size_t length = 0;
+              std::size_t at = head.find("\r\nContent-Length: ");
+              if (at != std::string::npos)
+                length = std::strtoul(head.c_str() + at + 18, nullptr, 10);
+              self->read_body(length, status);
+            });
+      });
+}
+
+void client::read_body(std::size_t length, int status)
+{
+  auto self = shared_from_this();
+  std::size_t buffered = std::min(length, in_.size());
+  in_.consume(buffered);
+  asio::async_read(stream_, in_, asio::transfer_exactly(length - buffered),
+      [self, length, buffered, status](const boost::system::error_code& ec,
+        std::size_t)
+      {
+        if (ec)
+        {
+          self->finish(false, true);
+          return;
+        }
+        self->in_.consume(length - buffered);
+        if (status >= 200 && status < 300)
+          ++self->owner_.counts().ok;
+        else
+          ++self->owner_.counts().refused;
+        // A refusal comes with the connection closed.
+        if (status == 503)
+          self->finish(false);
+        else
+          self->read_reply();
+      });
+}
+
+void client::send_then_drain(const std::string& data, bool encrypted)
+{
+  auto self = shared_from_this();
+  out_ = data;
+  auto sent = [self, encrypted](const boost::system::error_code& ec,
+      std::size_t)
+  {
+    if (ec)
+      self->finish(false);
+    else
+      self->drain(encrypted);
+  };
+  if (encrypted)
+    asio::async_write(stream_, asio::buffer(out_), sent);
+  else
+    asio::async_write(stream_.next_layer(), asio::buffer(out_), sent);
+  timer_.expires_after(std::chrono::seconds(1));
+  timer_.async_wait([self](const boost::system::error_code& ec)
+      {
+        if (!ec)
+          self->finish(self->owner_.random() % 2 == 0);
+      });
+}
+
+void client::drain(bool encrypted)
+{
+  auto self = shared_from_this();
+  auto read = [self, encrypted](const boost::system::error_code& ec,
+      std::size_t)
+  {
+    if (ec)
+      self->finish(false);
+    else
+      self->drain(encrypted);
+  };
+  if (encrypted)
+    stream_.async_read_some(asio::buffer(scratch_), read);
+  else
+    stream_.next_layer().async_read_some(asio::buffer(scratch_), read);
+}
+
+void client::finish(bool abort, bool failed)
+{
+  if (done_)
+    return;
+  done_ = true;
+  boost::system::error_code ignored;
+  if (abort)
+    stream_.lowest_layer().set_option(asio::socket_base::linger(true, 0),
+        ignored);
+  stream_.lowest_layer().close(ignored);
+  timer_.cancel();
+  watchdog_.cancel();
+  ++owner_.counts().runs[kind_];
+  if (failed)
+    ++owner_.counts().errors;
+  // Not from inside a handler of this client's own stream.
+  asio::post(owner_.io_context(), [self = shared_from_this()]()
+      {
+        self->owner_.finished();
+      });
+}
+
+long proc_rss_kb(int pid)
+{
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      return std::atol(line.c_str() + 6);
+  return -1;
+}
+
+long proc_fds(int pid)
+{
+  std::error_code ec;
+  long count = 0;
+  for (fs::directory_iterator it("/proc/" + std::to_string(pid) + "/fd", ec),
+      end; !ec && it != end; it.increment(ec))
+    ++count;
+  return ec ? -1 : count;
+}
+
+/// The sessions count from /_stats, fetched on a connection of its own,
+/// which the count includes. -1 if the server does not answer in time.
+long stats_sessions(const tcp::endpoint& endpoint, asio::ssl::context& context)
+{
+  asio::io_context io_context;
+  ssl_stream stream(io_context, context);
+  std::string request =
+      "GET /_stats HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  std::string reply;
+  std::array<char, 4096> buffer;
+  std::function<void(const boost::system::error_code&, std::size_t)> read =
+      [&](const boost::system::error_code& ec, std::size_t size)
+      {
+        reply.append(buffer.data(), size);
+        if (!ec)
+          stream.async_read_some(asio::buffer(buffer), read);
+      };
+  stream.lowest_layer().async_connect(endpoint,
+      [&](const boost::system::error_code& ec)
+      {
+        if (ec)
+          return;
+        stream.async_handshake(asio::ssl::stream_base::client,
+            [&](const boost::system::error_code& ec)
+            {
+              if (ec)
+                return;
+              asio::async_write(stream, asio::buffer(request),
+                  [&](const boost::system::error_code& ec, std::size_t)
+                  {
+                    if (!ec)
+                      stream.async_read_some(asio::buffer(buffer), read);
+                  });
+            });
+      });
+  io_context.run_for(std::chrono::seconds(5));
+  std::size_t at = reply.find("\"sessions\":");
+  if (at == std::string::npos)
+    return -1;
+  return std::atol(reply.c_str() + at + 11);
+}
+
+sample take_sample(const options& opts, const tcp::endpoint& endpoint,
+    asio::ssl::context& context)
+{
+  sample s;
+  s.sessions = stats_sessions(endpoint, context);
+  s.rss_kb = proc_rss_kb(opts.pid);
+  s.fds = proc_fds(opts.pid);
+  return s;
+}
+
+/// Sample until the server is back to the baseline or settle has passed,
+/// and return the last sample.
+sample at_rest(const options& opts, const tcp::endpoint& endpoint,
+    asio::ssl::context& context, const sample& baseline,
+    steady::duration settle)
+{
+  steady::time_point give_up = steady::now() + settle;
+  for (;;)
+  {
+    sample s = take_sample(opts, endpoint, context);
+    if ((s.sessions >= 0 && s.sessions <= baseline.sessions
+          && s.fds <= baseline.fds + opts.fd_slack)
+        || steady::now() >= give_up)
+      return s;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  options opts;
+  po::options_description described("Options");
+  described.add_options()
+    ("help", "this message")
+    ("host", po::value(&opts.host)->required(), "server address")
+    ("port", po::value(&opts.port)->required(), "server port")
+    ("pid", po::value(&opts.pid)->required(), "server process id")
+    ("seconds", po::value(&opts.seconds), "length of the whole run")
+    ("rounds", po::value(&opts.rounds), "rounds, each followed by a check")
+    ("clients", po::value(&opts.clients), "concurrent connections")
+    ("hold", po::value(&opts.hold), "longest a slow reader stays, seconds")
+    ("corpus", po::value(&opts.corpus), "directory of malformed requests")
+    ("seed", po::value(&opts.seed), "random seed, to repeat a run")
+    ("rss-growth", po::value(&opts.rss_growth),
+     "memory growth allowed after the first round, percent")
+    ("fd-slack", po::value(&opts.fd_slack),
+     "descriptors allowed above the starting count");
+  po::positional_options_description positional;
+  positional.add("host", 1).add("port", 1).add("pid", 1);
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(described)
+        .positional(positional).run(), vm);
+    if (vm.count("help"))
+    {
+      std::cout << "Usage: https-soak <host> <port> <server-pid> [options]\n"
+                << described;
+      return 0;
+    }
+    po::notify(vm);
+    if (opts.rounds < 2 || opts.clients < 1 || opts.seconds <= 0)
+      throw std::runtime_error("need at least 2 rounds, 1 client and "
+          "some seconds");
+
+    std::vector<std::string> corpus = load_corpus(opts.corpus);
+    asio::io_context io_context;
+    asio::ssl::context context(asio::ssl::context::sslv23);
+    context.set_verify_mode(asio::ssl::verify_none);
+    tcp::resolver resolver(io_context);
+    tcp::endpoint endpoint =
+        *resolver.resolve(opts.host, opts.port).begin();
+
+    sample baseline = take_sample(opts, endpoint, context);
+    if (baseline.sessions < 0 || baseline.rss_kb < 0 || baseline.fds < 0)
+      throw std::runtime_error("cannot sample the server; is it process "
+          + std::to_string(opts.pid) + " and running with --stats on?");
+    std::cout << "seed " << opts.seed << ", " << corpus.size()
+              << " requests in the corpus\nbefore: " << baseline << "\n";
+
+    tally counts;
+    driver load(io_context, context, endpoint, opts, corpus, counts);
+
+    // While the rounds run, a sample a second from another thread.
+    std::atomic<bool> running{ true };
+    steady::time_point began = steady::now();
+    std::thread sampler([&]()
+        {
+          while (running)
+          {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (!running)
+              break;
+            sample s = take_sample(opts, endpoint, context);
+            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                steady::now() - began).count();
+            std::ostringstream line;
+            line << "  " << elapsed << "s: " << counts.connections()
+                 << " connections, " << s << "\n";
+            std::cout << line.str() << std::flush;
+          }
+        });
+
+    std::vector<std::string> failures;
+    sample first;
+    auto length = std::chrono::duration_cast<steady::duration>(
+        std::chrono::duration<double>(opts.seconds / opts.rounds));
+    for (int round = 1; round <= opts.rounds; ++round)
+    {
+      load.round(length);
+      sample rest = at_rest(opts, endpoint, context, baseline,
+          std::chrono::seconds(10));
+      std::ostringstream line;
+      line << "round " << round << ": " << counts.connections()
+           << " connections so far, at rest: " << rest << "\n";
+      std::cout << line.str() << std::flush;
+      std::string when = " after round " + std::to_string(round);
+      if (rest.sessions < 0)
+        failures.push_back("no /_stats" + when);
+      else if (rest.sessions > baseline.sessions)
+        failures.push_back(std::to_string(rest.sessions - baseline.sessions)
+            + " sessions still alive" + when);
+      if (rest.fds > baseline.fds + opts.fd_slack)
+        failures.push_back(std::to_string(rest.fds - baseline.fds)
+            + " more descriptors open" + when);
+      if (round == 1)
+        first = rest;
+    }
+    running = false;
+    sampler.join();
+
+    sample last = take_sample(opts, endpoint, context);
+    if (last.rss_kb > first.rss_kb * (1 + opts.rss_growth / 100))
+      failures.push_back("memory grew from " + std::to_string(first.rss_kb)
+          + " kB to " + std::to_string(last.rss_kb) + " kB");
+
+    for (int kind = 0; kind < scenario_count; ++kind)
+      std::cout << scenario_names[kind] << " " << counts.runs[kind] << ", ";
+    std::cout << "\nclean replies " << counts.ok << " ok, " << counts.refused
+              << " refused; " << counts.errors << " errors, " << counts.stuck
+              << " stuck\n";
+    if (counts.stuck > 0)
+      failures.push_back(std::to_string(counts.stuck)
+          + " clients never heard back from the server");
+
+    for (const std::string& failure : failures)
+      std::cout << "FAIL: " << failure << "\n";
+    if (!failures.empty())
+      return 1;
+    std::cout << "ok\n";
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 2;
+  }
+  return 0;
+}